@@ -11,29 +11,6 @@
 #include <fcntl.h>
 #include "../src/lab.h"
 
-static void explain_waitpid(int status)
-{
-    if (!WIFEXITED(status))
-    {
-        fprintf(stderr, "Child exited with status %d\n", WEXITSTATUS(status));
-    }
-
-    if (WIFSIGNALED(status))
-    {
-        fprintf(stderr, "Child exited via signal %d\n", WTERMSIG(status));
-    }
-
-    if (WIFSTOPPED(status))
-    {
-        fprintf(stderr, "Child stopped by %d\n", WSTOPSIG(status));
-    }
-
-    if (WIFCONTINUED(status))
-    {
-        fprintf(stderr, "Child was resumed by delivery of SIGCONT\n");
-    }
-}
-
 // Function to print version PART2
 void print_version() {
     printf("Shell version: %d.%d\n", lab_VERSION_MAJOR, lab_VERSION_MINOR);
@@ -45,13 +22,14 @@ int main(int argc, char *argv[])
     struct shell sh;
     sh_init(&sh);
     char *line = (char *)NULL;
-    while ((line = readline(sh.prompt)))
+    // The line buffer and the arena belong to the shell and are reused for
+    // every command, nothing in the loop goes back to the heap.
+    while ((line = sh_read_line(&sh)))
     {
         // do nothing on blank lines don't save history or attempt to exec
         line = trim_white(line);
         if (!*line)
         {
-            free(line);
             continue;
         }
 
@@ -59,56 +37,15 @@ int main(int argc, char *argv[])
          if (strcmp(line, "-v") == 0)
          {
              print_version();  // Print the version
-             free(line);
              continue;  // Return to the prompt
          }
 
-        add_history(line);
-        // check to see if we are launching a built in command
-        char **cmd = cmd_parse(line);
-        if (!do_builtin(&sh, cmd))
+        if (sh.shell_is_interactive)
         {
-            pid_t pid = fork();
-            if (pid == 0)
-            {
-                /*This is the child process*/
-                pid_t child = getpid();
-                setpgid(child, child);
-                tcsetpgrp(sh.shell_terminal, child);
-                signal(SIGINT, SIG_DFL);
-                signal(SIGQUIT, SIG_DFL);
-                signal(SIGTSTP, SIG_DFL);
-                signal(SIGTTIN, SIG_DFL);
-                signal(SIGTTOU, SIG_DFL);
-                execvp(cmd[0], cmd);
-                exit(EXIT_FAILURE);
-            }
-            else if (pid < 0)
-            {
-                // If fork failed we are in trouble!
-                perror("fork return < 0 Process creation failed!");
-                abort();
-            }
-
-            /*
-            This is in the parent put the child process into its own
-            process group and give it control of the terminal
-            to avoid a race condition
-            */
-            // printf("shell:%d , child%d\n",sh.shell_pgid, pid);
-            setpgid(pid, pid);
-            tcsetpgrp(sh.shell_terminal, pid);
-            int status;
-            int rval = waitpid(pid, &status, 0);
-            if (rval == -1)
-            {
-                fprintf(stderr, "Wait pid failed with -1\n");
-		        explain_waitpid(status);
-            }
-            cmd_free(cmd);
-            // get control of the shell
-            tcsetpgrp(sh.shell_terminal, sh.shell_pgid);
+            add_history(line);
         }
+        sh_execute(&sh, line);
+        arena_reset(&sh.arena);
     }
     sh_destroy(&sh);
 }
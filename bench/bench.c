@@ -0,0 +1,213 @@
+#include "bench.h"
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+
+//-----------------------------------------------------------------------------
+// bench_parse_args
+//-----------------------------------------------------------------------------
+static void bench_usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [--reps N] [--warmup N] [--min-time-ms MS] "
+            "[--filter SUBSTR] [--json FILE|-] [--compare BASELINE.json]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+void bench_parse_args(int argc, char **argv, struct bench_opts *o) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (i + 1 >= argc)
+            bench_usage(argv[0]);
+        const char *val = argv[++i];
+        if (strcmp(arg, "--reps") == 0) {
+            o->reps = strtoul(val, NULL, 10);
+        } else if (strcmp(arg, "--warmup") == 0) {
+            o->warmup = strtoul(val, NULL, 10);
+        } else if (strcmp(arg, "--min-time-ms") == 0) {
+            o->min_sample_ns = strtod(val, NULL) * 1e6;
+        } else if (strcmp(arg, "--filter") == 0) {
+            o->filter = val;
+        } else if (strcmp(arg, "--json") == 0) {
+            o->json = val;
+        } else if (strcmp(arg, "--compare") == 0) {
+            o->compare = val;
+        } else {
+            bench_usage(argv[0]);
+        }
+    }
+    if (o->reps == 0)
+        o->reps = 1;
+}
+
+//-----------------------------------------------------------------------------
+// bench_now_ns
+//-----------------------------------------------------------------------------
+uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+//-----------------------------------------------------------------------------
+// bench_summarize
+//-----------------------------------------------------------------------------
+static int bench_cmp(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double bench_median(const double *sorted, size_t n) {
+    if (n == 0)
+        return 0;
+    return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+void bench_summarize(double *samples, size_t n, struct bench_result *out) {
+    qsort(samples, n, sizeof(double), bench_cmp);
+    out->reps = n;
+    out->median_ns = bench_median(samples, n);
+    out->min_ns = n ? samples[0] : 0;
+    out->max_ns = n ? samples[n - 1] : 0;
+
+    double *dev = malloc((n ? n : 1) * sizeof(double));
+    if (!dev) {
+        out->mad_ns = NAN;
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        dev[i] = fabs(samples[i] - out->median_ns);
+    }
+    qsort(dev, n, sizeof(double), bench_cmp);
+    out->mad_ns = bench_median(dev, n);
+    free(dev);
+}
+
+//-----------------------------------------------------------------------------
+// bench_run
+//-----------------------------------------------------------------------------
+int bench_run(const struct bench_opts *o, const char *name, bench_fn fn, void *ctx,
+              struct bench_result *out) {
+    if (o->filter && !strstr(name, o->filter))
+        return 1;
+    memset(out, 0, sizeof(*out));
+    out->name = name;
+
+    // Calibrate so timer resolution and loop overhead are noise.
+    size_t iters = 1;
+    for (;;) {
+        uint64_t t0 = bench_now_ns();
+        fn(ctx, iters);
+        uint64_t dt = bench_now_ns() - t0;
+        if ((double)dt >= o->min_sample_ns || iters >= ((size_t)1 << 30))
+            break;
+        iters *= 2;
+    }
+    out->iters = iters;
+
+    for (size_t i = 0; i < o->warmup; i++) {
+        fn(ctx, iters);
+    }
+
+    double *samples = malloc(o->reps * sizeof(double));
+    if (!samples) {
+        perror("bench_run");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < o->reps; i++) {
+        uint64_t t0 = bench_now_ns();
+        fn(ctx, iters);
+        samples[i] = (double)(bench_now_ns() - t0) / (double)iters;
+    }
+    bench_summarize(samples, o->reps, out);
+    free(samples);
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+// bench_print
+//-----------------------------------------------------------------------------
+void bench_print(FILE *fp, const struct bench_result *r) {
+    double pct = r->median_ns > 0 ? 100.0 * r->mad_ns / r->median_ns : 0;
+    fprintf(fp, "%-24s %12.1f ns/op  +- %5.1f%%  (min %.1f, max %.1f, %zu x %zu)\n",
+            r->name, r->median_ns, pct, r->min_ns, r->max_ns, r->reps, r->iters);
+}
+
+//-----------------------------------------------------------------------------
+// bench_write_json
+//-----------------------------------------------------------------------------
+int bench_write_json(const char *file, const char *suite,
+                     const struct bench_result *rs, size_t n) {
+    FILE *fp = strcmp(file, "-") == 0 ? stdout : fopen(file, "w");
+    if (!fp) {
+        perror(file);
+        return -1;
+    }
+    struct utsname u;
+    if (uname(&u) != 0)
+        memset(&u, 0, sizeof(u));
+    fprintf(fp, "{\n  \"suite\": \"%s\",\n  \"timestamp\": %lld,\n", suite, (long long)time(NULL));
+    fprintf(fp, "  \"host\": {\"sysname\": \"%s\", \"release\": \"%s\", \"machine\": \"%s\", "
+                "\"cpus\": %ld},\n", u.sysname, u.release, u.machine, sysconf(_SC_NPROCESSORS_ONLN));
+    fprintf(fp, "  \"compiler\": \"%s\",\n  \"benchmarks\": [\n", __VERSION__);
+    for (size_t i = 0; i < n; i++) {
+        const struct bench_result *r = &rs[i];
+        fprintf(fp, "    {\"name\": \"%s\", \"iters\": %zu, \"reps\": %zu, "
+                    "\"median_ns\": %.3f, \"mad_ns\": %.3f, \"min_ns\": %.3f, \"max_ns\": %.3f}%s\n",
+                r->name, r->iters, r->reps, r->median_ns, r->mad_ns, r->min_ns, r->max_ns,
+                i + 1 < n ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    if (fp != stdout)
+        return fclose(fp) == 0 ? 0 : -1;
+    fflush(fp);
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+// bench_compare
+//-----------------------------------------------------------------------------
+// Only reads back what bench_write_json writes, one benchmark per line.
+int bench_compare(FILE *fp, const char *file, const struct bench_result *rs, size_t n) {
+    FILE *in = fopen(file, "r");
+    if (!in) {
+        perror(file);
+        return -1;
+    }
+    double *base = malloc((n ? n : 1) * sizeof(double));
+    if (!base) {
+        fclose(in);
+        return -1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        base[i] = NAN;
+    }
+
+    char *line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, in) > 0) {
+        char name[128];
+        const char *med = strstr(line, "\"median_ns\": ");
+        if (sscanf(line, " {\"name\": \"%127[^\"]\"", name) != 1 || !med)
+            continue;
+        for (size_t i = 0; i < n; i++) {
+            if (strcmp(rs[i].name, name) == 0)
+                base[i] = strtod(med + strlen("\"median_ns\": "), NULL);
+        }
+    }
+    free(line);
+    fclose(in);
+
+    fprintf(fp, "%-24s %14s %14s %9s\n", "benchmark", "baseline ns", "current ns", "change");
+    for (size_t i = 0; i < n; i++) {
+        if (isnan(base[i]) || base[i] <= 0) {
+            fprintf(fp, "%-24s %14s %14.1f %9s\n", rs[i].name, "-", rs[i].median_ns, "-");
+        } else {
+            fprintf(fp, "%-24s %14.1f %14.1f %+8.1f%%\n", rs[i].name, base[i], rs[i].median_ns,
+                    100.0 * (rs[i].median_ns - base[i]) / base[i]);
+        }
+    }
+    free(base);
+    return 0;
+}
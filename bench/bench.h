@@ -0,0 +1,128 @@
+#ifndef BENCH_H
+#define BENCH_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * Knobs shared by every benchmark in a run, filled in from the command
+   * line by bench_parse_args.
+   */
+  struct bench_opts
+  {
+    size_t warmup;
+    size_t reps;
+    double min_sample_ns;
+    const char *filter;
+    const char *json;
+    const char *compare;
+  };
+
+  /**
+   * Summary of one benchmark. Times are per operation, the median and the
+   * median absolute deviation are used because a single preempted sample
+   * would drag a mean and standard deviation around.
+   */
+  struct bench_result
+  {
+    const char *name;
+    size_t iters;
+    size_t reps;
+    double median_ns;
+    double mad_ns;
+    double min_ns;
+    double max_ns;
+  };
+
+  /**
+   * A benchmark body. It must perform the operation iters times.
+   */
+  typedef void (*bench_fn)(void *ctx, size_t iters);
+
+  /**
+   * @brief Parse --reps, --warmup, --min-time-ms, --filter, --json and
+   * --compare.
+   * Unknown options print usage and exit.
+   *
+   * @param argc Number of args
+   * @param argv The arg array
+   * @param o Defaults on entry, the parsed options on return
+   */
+  void bench_parse_args(int argc, char **argv, struct bench_opts *o);
+
+  /**
+   * @brief Monotonic time in nanoseconds.
+   *
+   * @return The current time
+   */
+  uint64_t bench_now_ns(void);
+
+  /**
+   * @brief Run one benchmark. The number of iterations per sample is
+   * doubled until a sample takes at least min_sample_ns, then warmup
+   * samples are thrown away and reps samples are kept.
+   *
+   * @param o The options
+   * @param name Name of the benchmark
+   * @param fn The body
+   * @param ctx Passed through to fn
+   * @param out The summary
+   * @return 0 if the benchmark ran, 1 if it was skipped by the filter
+   */
+  int bench_run(const struct bench_opts *o, const char *name, bench_fn fn, void *ctx,
+                struct bench_result *out);
+
+  /**
+   * @brief Summarize samples (in nanoseconds per operation) into out. The
+   * array is sorted in place.
+   *
+   * @param samples The samples
+   * @param n Number of samples
+   * @param out Receives median, MAD, min and max
+   */
+  void bench_summarize(double *samples, size_t n, struct bench_result *out);
+
+  /**
+   * @brief Print a one line human readable summary.
+   *
+   * @param fp Where to print
+   * @param r The result
+   */
+  void bench_print(FILE *fp, const struct bench_result *r);
+
+  /**
+   * @brief Write all results as JSON so runs can be compared by a script.
+   * A file name of "-" writes to stdout.
+   *
+   * @param file Where to write
+   * @param suite Name of the suite
+   * @param rs The results
+   * @param n Number of results
+   * @return 0 on success, -1 if the file could not be written
+   */
+  int bench_write_json(const char *file, const char *suite,
+                       const struct bench_result *rs, size_t n);
+
+  /**
+   * @brief Print each result next to the result of the same name in a JSON
+   * file written earlier by bench_write_json, with the relative change of
+   * the median. Negative changes are faster.
+   *
+   * @param fp Where to print
+   * @param file The baseline JSON
+   * @param rs The current results
+   * @param n Number of results
+   * @return 0 on success, -1 if the baseline could not be read
+   */
+  int bench_compare(FILE *fp, const char *file, const struct bench_result *rs, size_t n);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,16 @@
+# A CI style script, mostly tool invocations with long flag lists.
+cd /tmp
+mkdir -p out/obj out/bin
+cc -Wall -Wextra -O2 -c src/a.c -o out/obj/a.o
+cc -Wall -Wextra -O2 -c src/b.c -o out/obj/b.o
+cc -Wall -Wextra -O2 -c src/c.c -o out/obj/c.o
+cc -Wall -Wextra -O2 -c src/d.c -o out/obj/d.o
+cc -o out/bin/app out/obj/a.o out/obj/b.o out/obj/c.o out/obj/d.o -lm -pthread
+strip out/bin/app
+sha256sum out/bin/app
+cp out/bin/app /tmp/app.bak
+test -x out/bin/app
+install -m 755 out/bin/app out/bin/app.installed
+ls -l out/bin
+rm -rf out
+cd
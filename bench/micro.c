@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "bench.h"
+#include "../src/lab.h"
+#include "../src/arena.h"
+#include "../src/journal.h"
+#include "../src/forkmem.h"
+#include <sys/wait.h>
+
+// Results are written here so the compiler cannot drop the work.
+static volatile uintptr_t sink;
+
+static void bm_cmd_parse(void *ctx, size_t iters) {
+    UNUSED(ctx);
+    for (size_t i = 0; i < iters; i++) {
+        char **argv = cmd_parse("ls -l --color=auto /var/log/syslog");
+        sink += (uintptr_t)argv[0];
+        cmd_free(argv);
+    }
+}
+
+static void bm_cmd_parse_arena(void *ctx, size_t iters) {
+    struct arena *a = ctx;
+    for (size_t i = 0; i < iters; i++) {
+        char **argv = cmd_parse_arena(a, "ls -l --color=auto /var/log/syslog");
+        sink += (uintptr_t)argv[0];
+        arena_reset(a);
+    }
+}
+
+static void bm_trim_white(void *ctx, size_t iters) {
+    UNUSED(ctx);
+    static const char src[] = "    ls -a -l /tmp     \t ";
+    char buf[sizeof(src)];
+    for (size_t i = 0; i < iters; i++) {
+        memcpy(buf, src, sizeof(src));
+        sink += (uintptr_t)trim_white(buf);
+    }
+}
+
+static void bm_get_prompt(void *ctx, size_t iters) {
+    const char *env = ctx;
+    for (size_t i = 0; i < iters; i++) {
+        char *p = get_prompt(env);
+        sink += (uintptr_t)p[0];
+        free(p);
+    }
+}
+
+static void bm_change_dir(void *ctx, size_t iters) {
+    UNUSED(ctx);
+    char *to_root[] = {"cd", "/", NULL};
+    char *to_tmp[] = {"cd", "/tmp", NULL};
+    for (size_t i = 0; i < iters; i++) {
+        sink += (uintptr_t)change_dir(i % 2 ? to_tmp : to_root);
+    }
+}
+
+static void bm_do_builtin(void *ctx, size_t iters) {
+    struct shell *sh = ctx;
+    char *cd[] = {"cd", "/", NULL};
+    char *notbuiltin[] = {"ls", "-l", NULL};
+    for (size_t i = 0; i < iters; i++) {
+        sink += (uintptr_t)do_builtin(sh, cd);
+        sink += (uintptr_t)do_builtin(sh, notbuiltin);
+    }
+}
+
+static void bm_execute_builtin(void *ctx, size_t iters) {
+    struct shell *sh = ctx;
+    for (size_t i = 0; i < iters; i++) {
+        sink += (uintptr_t)sh_execute(sh, "cd /");
+        arena_reset(&sh->arena);
+    }
+}
+
+static void bm_spawn_true(void *ctx, size_t iters) {
+    struct shell *sh = ctx;
+    char *argv[] = {"/bin/true", NULL};
+    for (size_t i = 0; i < iters; i++) {
+        sink += (uintptr_t)sh_launch(sh, argv);
+    }
+}
+
+static void bm_spawn_true_path(void *ctx, size_t iters) {
+    struct shell *sh = ctx;
+    for (size_t i = 0; i < iters; i++) {
+        sink += (uintptr_t)sh_execute(sh, "true");
+        arena_reset(&sh->arena);
+    }
+}
+
+// Buffered appends to a real file, the occasional flush is amortized over
+// the records that filled the buffer. The journal is only opened here so it
+// does not add to the other benchmarks.
+static void bm_journal_record(void *ctx, size_t iters) {
+    static struct job_stats st;
+    if (!journal_enabled() && journal_open(ctx) != 0)
+        return;
+    for (size_t i = 0; i < iters; i++) {
+        journal_record("make -j8 all", 1700000000000000000ull + i, 1234567, 0, &st, 1);
+    }
+}
+
+// 64MiB through a two stage pipeline with the pipe buffer at size bytes,
+// 0 being the kernel's 64KiB. dd writes whole megabytes so a small buffer
+// makes the stages take turns many times per write.
+struct pipe_bench
+{
+    struct shell *sh;
+    int size;
+};
+
+static void bm_pipeline_throughput(void *ctx, size_t iters) {
+    struct pipe_bench *b = ctx;
+    b->sh->pipesize = b->size;
+    for (size_t i = 0; i < iters; i++) {
+        sink += (uintptr_t)sh_execute(
+            b->sh, "dd if=/dev/zero bs=1M count=64 status=none | dd of=/dev/null bs=1M status=none");
+        arena_reset(&b->sh->arena);
+    }
+    b->sh->pipesize = 0;
+}
+
+// fork latency against how much the shell holds in memory. The cache is
+// written once so its pages are real, either on the heap where fork copies
+// every page table entry or in forkmem where it copies none. Only one cache
+// is alive at a time, the previous case's is freed when the next starts.
+struct fork_bench
+{
+    size_t size;
+    bool dontfork;
+};
+
+static struct fork_bench *fork_cur;
+static void *fork_mem;
+
+static void fork_cache_release(void) {
+    if (fork_cur && fork_cur->dontfork)
+        forkmem_free(fork_mem, fork_cur->size);
+    else
+        free(fork_mem);
+    fork_cur = NULL;
+    fork_mem = NULL;
+}
+
+static void bm_fork_cache(void *ctx, size_t iters) {
+    struct fork_bench *b = ctx;
+    if (fork_cur != b) {
+        fork_cache_release();
+        fork_mem = b->dontfork ? forkmem_alloc(b->size) : malloc(b->size);
+        if (fork_mem)
+            memset(fork_mem, 1, b->size);
+        fork_cur = b;
+    }
+    for (size_t i = 0; i < iters; i++) {
+        pid_t pid = fork();
+        if (pid == 0)
+            _exit(0);
+        int status;
+        waitpid(pid, &status, 0);
+        sink += (uintptr_t)status;
+    }
+}
+
+int main(int argc, char **argv) {
+    struct bench_opts o = {
+        .warmup = 3,
+        .reps = 21,
+        .min_sample_ns = 5e6,
+        .filter = NULL,
+        .json = NULL,
+        .compare = NULL,
+    };
+    bench_parse_args(argc, argv, &o);
+
+    // A shell that is never attached to the terminal, so launching does
+    // not try to hand the terminal to the child.
+    struct shell sh;
+    memset(&sh, 0, sizeof(sh));
+    arena_init(&sh.arena, 0);
+    struct arena a;
+    arena_init(&a, 0);
+    setenv("BENCH_PROMPT", "bench> ", 1);
+    char *cwd = getcwd(NULL, 0);
+    char journal[] = "/tmp/bench-journal-XXXXXX";
+    int jfd = mkstemp(journal);
+    if (jfd < 0)
+        perror("mkstemp");
+    else
+        close(jfd);
+
+    struct pipe_bench pipes[] = {{&sh, 0}, {&sh, 256 * 1024}, {&sh, 1024 * 1024}};
+    struct fork_bench forks[] = {{0, false},
+                                 {16 << 20, false},
+                                 {16 << 20, true},
+                                 {128 << 20, false},
+                                 {128 << 20, true}};
+
+    struct {
+        const char *name;
+        bench_fn fn;
+        void *ctx;
+    } cases[] = {
+        {"cmd_parse", bm_cmd_parse, NULL},
+        {"cmd_parse_arena", bm_cmd_parse_arena, &a},
+        {"trim_white", bm_trim_white, NULL},
+        {"get_prompt", bm_get_prompt, "BENCH_PROMPT"},
+        {"get_prompt_default", bm_get_prompt, "BENCH_PROMPT_UNSET"},
+        {"change_dir", bm_change_dir, NULL},
+        {"do_builtin", bm_do_builtin, &sh},
+        {"execute_builtin", bm_execute_builtin, &sh},
+        {"spawn_true", bm_spawn_true, &sh},
+        {"spawn_true_path", bm_spawn_true_path, &sh},
+        {"journal_record", bm_journal_record, journal},
+        {"pipeline_64m_pipe64k", bm_pipeline_throughput, &pipes[0]},
+        {"pipeline_64m_pipe256k", bm_pipeline_throughput, &pipes[1]},
+        {"pipeline_64m_pipe1m", bm_pipeline_throughput, &pipes[2]},
+        {"fork_cache_none", bm_fork_cache, &forks[0]},
+        {"fork_cache_16m_heap", bm_fork_cache, &forks[1]},
+        {"fork_cache_16m_dontfork", bm_fork_cache, &forks[2]},
+        {"fork_cache_128m_heap", bm_fork_cache, &forks[3]},
+        {"fork_cache_128m_dontfork", bm_fork_cache, &forks[4]},
+    };
+    const size_t ncases = sizeof(cases) / sizeof(cases[0]);
+    struct bench_result results[sizeof(cases) / sizeof(cases[0])];
+    size_t nresults = 0;
+
+    for (size_t i = 0; i < ncases; i++) {
+        if (bench_run(&o, cases[i].name, cases[i].fn, cases[i].ctx, &results[nresults]) == 0)
+            bench_print(stdout, &results[nresults++]);
+    }
+    fork_cache_release();
+
+    // The cd benchmarks move us around, a relative --json is relative to
+    // where we started.
+    if (cwd && chdir(cwd) != 0)
+        perror("chdir");
+    free(cwd);
+
+    int rval = 0;
+    if (o.json)
+        rval = bench_write_json(o.json, "micro", results, nresults) == 0 ? 0 : 1;
+    if (o.compare && bench_compare(stdout, o.compare, results, nresults) != 0)
+        rval = 1;
+    arena_destroy(&a);
+    sh_destroy(&sh);
+    unlink(journal);
+    return rval;
+}
@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "bench.h"
+#include "../src/lab.h"
+#include "../src/arena.h"
+#include "../src/parse.h"
+
+// Replays recorded history or scripts through the shell's non-interactive
+// path. Every command name in the corpus is a symlink to a stub binary in a
+// private PATH so the only work left is the shell's own plus process
+// creation, which is measured separately and reported as the spawn floor.
+
+struct replay_opts
+{
+    const char *shell;
+    const char *stub;
+    const char *json;
+    size_t reps;
+    size_t repeat;
+};
+
+struct replay_run
+{
+    double wall_ns;
+    double user_ns;
+    double sys_ns;
+    long maxrss_kb;
+};
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s --shell PATH --stub PATH [--reps N] [--repeat N] "
+            "[--json FILE|-] corpus...\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+static double tv_ns(struct timeval tv) {
+    return (double)tv.tv_sec * 1e9 + (double)tv.tv_usec * 1e3;
+}
+
+//-----------------------------------------------------------------------------
+// corpus preparation
+//-----------------------------------------------------------------------------
+static bool is_command_line(const char *line) {
+    while (*line == ' ' || *line == '\t')
+        line++;
+    // Blank lines and comments, which includes bash's #<epoch> history
+    // timestamps, are dropped since the shell has no comment syntax.
+    return *line && *line != '#';
+}
+
+// Make a symlink to the stub for the first word of line unless it is a path.
+static void add_stub(const char *dir, const char *stub, const char *line) {
+    while (*line == ' ' || *line == '\t')
+        line++;
+    size_t len = strcspn(line, " \t");
+    if (len == 0 || memchr(line, '/', len))
+        return;
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%.*s", dir, (int)len, line);
+    if (symlink(stub, path) != 0 && errno != EEXIST) {
+        perror(path);
+    }
+}
+
+// Concatenate the corpus files repeat times into one input file and stub
+// out every command they name. Returns the number of lines fed to the shell.
+static size_t prepare(const struct replay_opts *o, char **files, int nfiles,
+                      const char *dir, const char *input, size_t *nexternal) {
+    FILE *out = fopen(input, "w");
+    if (!out) {
+        perror(input);
+        exit(EXIT_FAILURE);
+    }
+    size_t lines = 0;
+    *nexternal = 0;
+    char *line = NULL;
+    size_t cap = 0;
+    for (size_t r = 0; r < o->repeat; r++) {
+        for (int i = 0; i < nfiles; i++) {
+            FILE *in = fopen(files[i], "r");
+            if (!in) {
+                perror(files[i]);
+                exit(EXIT_FAILURE);
+            }
+            ssize_t n;
+            while ((n = getline(&line, &cap, in)) > 0) {
+                if (!is_command_line(line))
+                    continue;
+                // exit would end the replay early.
+                if (strncmp(line, "exit", 4) == 0 && (line[4] == '\n' || line[4] == ' '))
+                    continue;
+                if (r == 0)
+                    add_stub(dir, o->stub, line);
+                fputs(line, out);
+                if (line[n - 1] != '\n')
+                    fputc('\n', out);
+                lines++;
+            }
+            fclose(in);
+        }
+    }
+    free(line);
+    fclose(out);
+
+    // Count what the shell will actually exec, a builtin name has a stub
+    // but the shell never runs it. The shell's own parser and builtin table
+    // decide, so a builtin that only takes some arguments is counted right.
+    struct arena a;
+    arena_init(&a, 0);
+    FILE *in = fopen(input, "r");
+    while (in && getline(&line, &cap, in) > 0) {
+        struct pipeline *list = pipeline_parse(&a, line);
+        if (!list)
+            (*nexternal)++;
+        for (struct pipeline *p = list; p; p = p->next) {
+            for (int k = 0; k < p->ncmds; k++) {
+                char **argv = p->cmds[k].argv;
+                if (!p->cmds[k].group && argv && argv[0] && !builtin_find(argv))
+                    (*nexternal)++;
+            }
+        }
+        arena_reset(&a);
+    }
+    if (in)
+        fclose(in);
+    arena_destroy(&a);
+    free(line);
+    return lines;
+}
+
+//-----------------------------------------------------------------------------
+// run_shell
+//-----------------------------------------------------------------------------
+static void run_shell(const struct replay_opts *o, const char *dir, const char *input,
+                      struct replay_run *run) {
+    uint64_t t0 = bench_now_ns();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int in = open(input, O_RDONLY);
+        int null = open("/dev/null", O_WRONLY);
+        if (in < 0 || null < 0)
+            _exit(126);
+        dup2(in, STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        setenv("PATH", dir, 1);
+        setenv("HOME", dir, 1);
+        unsetenv("XDG_CACHE_HOME");
+        execl(o->shell, o->shell, (char *)NULL);
+        _exit(127);
+    } else if (pid < 0) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    int status;
+    struct rusage ru;
+    if (wait4(pid, &status, 0, &ru) != pid) {
+        perror("wait4");
+        exit(EXIT_FAILURE);
+    }
+    run->wall_ns = (double)(bench_now_ns() - t0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) >= 126) {
+        fprintf(stderr, "replay: %s did not run (status %d)\n", o->shell, status);
+        exit(EXIT_FAILURE);
+    }
+    run->user_ns = tv_ns(ru.ru_utime);
+    run->sys_ns = tv_ns(ru.ru_stime);
+    run->maxrss_kb = ru.ru_maxrss;
+}
+
+// The cost of the same number of fork+exec+wait of the stub with no shell
+// in between. Whatever the replay takes on top of this is shell overhead.
+static double spawn_floor_ns(const struct replay_opts *o, size_t n) {
+    uint64_t t0 = bench_now_ns();
+    for (size_t i = 0; i < n; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            execl(o->stub, o->stub, (char *)NULL);
+            _exit(127);
+        }
+        int status;
+        waitpid(pid, &status, 0);
+    }
+    return (double)(bench_now_ns() - t0);
+}
+
+int main(int argc, char **argv) {
+    struct replay_opts o = {NULL, NULL, NULL, 5, 20};
+    int i = 1;
+    for (; i < argc && strncmp(argv[i], "--", 2) == 0; i += 2) {
+        if (i + 1 >= argc)
+            usage(argv[0]);
+        if (strcmp(argv[i], "--shell") == 0)
+            o.shell = argv[i + 1];
+        else if (strcmp(argv[i], "--stub") == 0)
+            o.stub = argv[i + 1];
+        else if (strcmp(argv[i], "--json") == 0)
+            o.json = argv[i + 1];
+        else if (strcmp(argv[i], "--reps") == 0)
+            o.reps = strtoul(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "--repeat") == 0)
+            o.repeat = strtoul(argv[i + 1], NULL, 10);
+        else
+            usage(argv[0]);
+    }
+    if (!o.shell || !o.stub || i >= argc || o.reps == 0 || o.repeat == 0)
+        usage(argv[0]);
+
+    char *shell = realpath(o.shell, NULL);
+    char *stub = realpath(o.stub, NULL);
+    if (!shell || !stub) {
+        perror("realpath");
+        return EXIT_FAILURE;
+    }
+    o.shell = shell;
+    o.stub = stub;
+
+    char dir[] = "/tmp/replay-XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    char input[sizeof(dir) + 16];
+    snprintf(input, sizeof(input), "%s/.input", dir);
+    size_t nexternal;
+    size_t lines = prepare(&o, argv + i, argc - i, dir, input, &nexternal);
+
+    // One unmeasured run warms the page cache and the shell's PATH cache.
+    struct replay_run warm;
+    run_shell(&o, dir, input, &warm);
+
+    double *wall = malloc(o.reps * sizeof(double));
+    double *cpu = malloc(o.reps * sizeof(double));
+    double *overhead = malloc(o.reps * sizeof(double));
+    if (!wall || !cpu || !overhead) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+    long maxrss = 0;
+    for (size_t r = 0; r < o.reps; r++) {
+        struct replay_run run;
+        run_shell(&o, dir, input, &run);
+        double floor = spawn_floor_ns(&o, nexternal);
+        wall[r] = run.wall_ns;
+        cpu[r] = run.user_ns + run.sys_ns;
+        overhead[r] = run.wall_ns > floor ? run.wall_ns - floor : 0;
+        if (run.maxrss_kb > maxrss)
+            maxrss = run.maxrss_kb;
+    }
+
+    struct bench_result rw = {.name = "wall"}, rc = {.name = "cpu"}, ro = {.name = "overhead"};
+    bench_summarize(wall, o.reps, &rw);
+    bench_summarize(cpu, o.reps, &rc);
+    bench_summarize(overhead, o.reps, &ro);
+    double lps = rw.median_ns > 0 ? (double)lines * 1e9 / rw.median_ns : 0;
+
+    printf("lines %zu (%zu external), reps %zu\n", lines, nexternal, o.reps);
+    printf("wall      %10.3f ms  +- %.3f\n", rw.median_ns / 1e6, rw.mad_ns / 1e6);
+    printf("cpu       %10.3f ms  +- %.3f\n", rc.median_ns / 1e6, rc.mad_ns / 1e6);
+    printf("overhead  %10.3f ms  +- %.3f  (%.1f us/line)\n", ro.median_ns / 1e6,
+           ro.mad_ns / 1e6, lines ? ro.median_ns / 1e3 / (double)lines : 0);
+    printf("throughput %9.0f lines/s\n", lps);
+    printf("peak rss  %10ld KiB\n", maxrss);
+
+    int rval = 0;
+    if (o.json) {
+        FILE *fp = strcmp(o.json, "-") == 0 ? stdout : fopen(o.json, "w");
+        if (fp) {
+            fprintf(fp, "{\n  \"suite\": \"replay\",\n  \"lines\": %zu,\n  \"external\": %zu,\n"
+                        "  \"reps\": %zu,\n  \"wall_ns\": {\"median\": %.0f, \"mad\": %.0f},\n"
+                        "  \"cpu_ns\": {\"median\": %.0f, \"mad\": %.0f},\n"
+                        "  \"overhead_ns\": {\"median\": %.0f, \"mad\": %.0f},\n"
+                        "  \"lines_per_sec\": %.1f,\n  \"peak_rss_kb\": %ld\n}\n",
+                    lines, nexternal, o.reps, rw.median_ns, rw.mad_ns, rc.median_ns, rc.mad_ns,
+                    ro.median_ns, ro.mad_ns, lps, maxrss);
+            if (fp != stdout)
+                fclose(fp);
+        } else {
+            perror(o.json);
+            rval = 1;
+        }
+    }
+
+    char cmd[sizeof(dir) + 16];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", dir);
+    if (system(cmd) != 0)
+        fprintf(stderr, "replay: could not remove %s\n", dir);
+    free(wall);
+    free(cpu);
+    free(overhead);
+    free(shell);
+    free(stub);
+    return rval;
+}
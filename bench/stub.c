@@ -0,0 +1,6 @@
+// Stands in for every external command during a replay so the measurement
+// is the shell and process creation, not the work the commands would do.
+int main(void)
+{
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include "arena.h"
+#include <stdint.h>
+#include <string.h>
+
+#define ARENA_ALIGN _Alignof(max_align_t)
+
+struct arena_chunk
+{
+    struct arena_chunk *next;
+    size_t size;
+    size_t used;
+    _Alignas(max_align_t) unsigned char data[];
+};
+
+//-----------------------------------------------------------------------------
+// arena_init
+//-----------------------------------------------------------------------------
+void arena_init(struct arena *a, size_t chunk_size) {
+    a->first = NULL;
+    a->cur = NULL;
+    a->chunk_size = chunk_size ? chunk_size : ARENA_CHUNK_SIZE;
+    a->heap_allocs = 0;
+}
+
+//-----------------------------------------------------------------------------
+// arena_alloc
+//-----------------------------------------------------------------------------
+void *arena_alloc(struct arena *a, size_t n) {
+    n = (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if (n == 0)
+        n = ARENA_ALIGN;
+
+    struct arena_chunk *c = a->cur;
+    if (c && c->size - c->used >= n) {
+        void *p = c->data + c->used;
+        c->used += n;
+        return p;
+    }
+
+    // Chunks left over from an earlier command are reused before asking the
+    // heap for more. A chunk that is too small for n is skipped, not freed.
+    struct arena_chunk **link = c ? &c->next : &a->first;
+    while (*link && (*link)->size < n)
+        link = &(*link)->next;
+    if (!*link) {
+        size_t size = n > a->chunk_size ? n : a->chunk_size;
+        struct arena_chunk *nc = malloc(sizeof(*nc) + size);
+        if (!nc)
+            return NULL;
+        nc->next = NULL;
+        nc->size = size;
+        nc->used = 0;
+        *link = nc;
+        a->heap_allocs++;
+    }
+    c = *link;
+    // Move the chunk right after the current one so chunks that were skipped
+    // stay reachable for later, smaller requests.
+    if (a->cur && a->cur->next != c) {
+        *link = c->next;
+        c->next = a->cur->next;
+        a->cur->next = c;
+    }
+    a->cur = c;
+    c->used = n;
+    return c->data;
+}
+
+//-----------------------------------------------------------------------------
+// arena_strndup
+//-----------------------------------------------------------------------------
+char *arena_strndup(struct arena *a, const char *s, size_t n) {
+    char *p = arena_alloc(a, n + 1);
+    if (!p)
+        return NULL;
+    memcpy(p, s, n);
+    p[n] = '\0';
+    return p;
+}
+
+//-----------------------------------------------------------------------------
+// arena_reset
+//-----------------------------------------------------------------------------
+void arena_reset(struct arena *a) {
+    for (struct arena_chunk *c = a->first; c; c = c->next) {
+        c->used = 0;
+    }
+    a->cur = a->first;
+}
+
+//-----------------------------------------------------------------------------
+// arena_destroy
+//-----------------------------------------------------------------------------
+void arena_destroy(struct arena *a) {
+    struct arena_chunk *c = a->first;
+    while (c) {
+        struct arena_chunk *next = c->next;
+        free(c);
+        c = next;
+    }
+    a->first = NULL;
+    a->cur = NULL;
+}
@@ -0,0 +1,79 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <stdlib.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * Default size of one arena chunk, enough for a typical command line.
+   */
+#define ARENA_CHUNK_SIZE 4096
+
+  struct arena_chunk;
+
+  /**
+   * Bump allocator for data that lives for exactly one command. Chunks are
+   * never returned to the heap on reset, they are rewound and reused so a
+   * warmed up arena serves every later command without calling malloc.
+   */
+  struct arena
+  {
+    struct arena_chunk *first;
+    struct arena_chunk *cur;
+    size_t chunk_size;
+    size_t heap_allocs;
+  };
+
+  /**
+   * @brief Prepare an empty arena. No memory is allocated until the first
+   * call to arena_alloc.
+   *
+   * @param a The arena
+   * @param chunk_size Minimum size of each chunk, 0 uses ARENA_CHUNK_SIZE
+   */
+  void arena_init(struct arena *a, size_t chunk_size);
+
+  /**
+   * @brief Allocate n bytes aligned for any type. The memory is valid until
+   * the next arena_reset or arena_destroy.
+   *
+   * @param a The arena
+   * @param n Number of bytes
+   * @return The memory or NULL if a new chunk could not be allocated
+   */
+  void *arena_alloc(struct arena *a, size_t n);
+
+  /**
+   * @brief Copy the first n bytes of s into the arena and NUL terminate it.
+   *
+   * @param a The arena
+   * @param s The string to copy
+   * @param n Number of bytes to copy
+   * @return The copy or NULL on allocation failure
+   */
+  char *arena_strndup(struct arena *a, const char *s, size_t n);
+
+  /**
+   * @brief Release everything allocated from the arena in one step. The
+   * chunks are kept for reuse.
+   *
+   * @param a The arena
+   */
+  void arena_reset(struct arena *a);
+
+  /**
+   * @brief Return all chunks to the heap.
+   *
+   * @param a The arena
+   */
+  void arena_destroy(struct arena *a);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,415 @@
+#define _GNU_SOURCE
+#include "cmdsub.h"
+#include "lab.h"
+#include "job.h"
+#include "parse.h"
+#include "intern.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+//-----------------------------------------------------------------------------
+// capture
+//-----------------------------------------------------------------------------
+// Room for at least extra more bytes and the terminating zero, doubling so
+// a large output costs a handful of reallocs.
+static int capture_reserve(struct capture *c, size_t extra) {
+    if (c->len + extra + 1 <= c->cap)
+        return 0;
+    size_t cap = c->cap ? c->cap : CMDSUB_INITIAL;
+    while (cap < c->len + extra + 1)
+        cap *= 2;
+    char *tmp = realloc(c->buf, cap);
+    if (!tmp)
+        return -1;
+    c->buf = tmp;
+    c->cap = cap;
+    return 0;
+}
+
+static void capture_free(struct capture *c) {
+    if (c->mapped)
+        munmap(c->buf, c->cap);
+    else
+        free(c->buf);
+}
+
+// Past CMDSUB_SPILL the rest of the output is spliced into a memfd, which
+// takes no more reallocs and no more passes through user space, then the
+// whole of it is mapped with a zero byte after the end.
+static int capture_spill(struct capture *c, int fd) {
+    int mfd = memfd_create("cmdsub", MFD_CLOEXEC);
+    if (mfd < 0)
+        return -1;
+    size_t total = 0;
+    while (total < c->len) {
+        ssize_t n = write(mfd, c->buf + total, c->len - total);
+        if (n < 0 && errno != EINTR)
+            goto fail;
+        if (n > 0)
+            total += (size_t)n;
+    }
+    for (;;) {
+        ssize_t n = splice(fd, NULL, mfd, NULL, CMDSUB_SPILL, SPLICE_F_MOVE);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            goto fail;
+        if (n == 0)
+            break;
+        total += (size_t)n;
+    }
+    if (ftruncate(mfd, (off_t)total + 1) != 0)
+        goto fail;
+    char *map = mmap(NULL, total + 1, PROT_READ | PROT_WRITE, MAP_PRIVATE, mfd, 0);
+    if (map == MAP_FAILED)
+        goto fail;
+    close(mfd);
+    free(c->buf);
+    c->buf = map;
+    c->len = total;
+    c->cap = total + 1;
+    c->mapped = true;
+    return 0;
+fail:
+    close(mfd);
+    return -1;
+}
+
+static int capture_read(struct capture *c, int fd) {
+    for (;;) {
+        if (c->len >= CMDSUB_SPILL)
+            return capture_spill(c, fd);
+        if (capture_reserve(c, CMDSUB_INITIAL) != 0)
+            return -1;
+        ssize_t n = read(fd, c->buf + c->len, c->cap - c->len - 1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            break;
+        c->len += (size_t)n;
+    }
+    c->buf[c->len] = '\0';
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+// cmdsub_capture
+//-----------------------------------------------------------------------------
+// A pure builtin prints through a stdio stream that appends to the capture
+// it is pointed at. It is made once and kept for the life of the shell.
+static FILE *cookie_fp;
+static struct capture *cookie_target;
+
+static ssize_t cookie_write(void *cookie, const char *p, size_t n) {
+    (void)cookie;
+    if (capture_reserve(cookie_target, n) != 0)
+        return -1;
+    memcpy(cookie_target->buf + cookie_target->len, p, n);
+    cookie_target->len += n;
+    cookie_target->buf[cookie_target->len] = '\0';
+    return (ssize_t)n;
+}
+
+static int capture_builtin(struct shell *sh, builtin_fn fn, char **argv, struct capture *c) {
+    if (!cookie_fp) {
+        cookie_io_functions_t io = {.write = cookie_write};
+        cookie_fp = fopencookie(NULL, "w", io);
+        if (!cookie_fp)
+            return -1;
+    }
+    if (capture_reserve(c, 0) != 0)
+        return -1;
+    c->buf[c->len] = '\0';
+    cookie_target = c;
+    FILE *saved = stdout;
+    stdout = cookie_fp;
+    int status = fn(sh, argv);
+    fflush(stdout);
+    stdout = saved;
+    cookie_target = NULL;
+    return status;
+}
+
+static int capture_fork(struct shell *sh, struct pipeline *list, struct capture *c) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0)
+        return -1;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        // The copy stays in the shell's process group, an interrupt at the
+        // terminal has to stop it and whatever it runs.
+        if (sh->shell_is_interactive) {
+            signal(SIGINT, SIG_DFL);
+            signal(SIGQUIT, SIG_DFL);
+            signal(SIGTSTP, SIG_DFL);
+            signal(SIGTTIN, SIG_DFL);
+            signal(SIGTTOU, SIG_DFL);
+            sh->shell_is_interactive = 0;
+        }
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[1]);
+        int status = job_run_list(sh, list, NULL);
+        fflush(stdout);
+        _exit(status);
+    }
+    close(fds[1]);
+    if (pid < 0) {
+        close(fds[0]);
+        return -1;
+    }
+    int rval = capture_read(c, fds[0]);
+    int saved = errno;
+    close(fds[0]);
+    int status;
+    struct rusage ru;
+    pid_t r;
+    while ((r = wait4(pid, &status, 0, &ru)) < 0 && errno == EINTR)
+        ;
+    if (r != pid)
+        return -1;
+    // Its time counts toward the shell's totals, it is not a job of its own.
+    job_stats_add(&sh->totals, &ru);
+    if (rval != 0) {
+        errno = saved;
+        return -1;
+    }
+    return WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+}
+
+int cmdsub_capture(struct shell *sh, const char *body, struct capture *cap) {
+    struct pipeline *list = pipeline_parse(&sh->arena, body);
+    if (!list)
+        return 2;
+    if (list->ncmds == 0)
+        return capture_reserve(cap, 0) == 0 ? 0 : -1;
+    if (!list->next && list->ncmds == 1 && !list->timed && list->folded < 0) {
+        struct command *c = &list->cmds[0];
+        if (c->expand && cmdsub_expand(sh, c) != 0)
+            return -1;
+        builtin_fn fn = c->nredirs || c->nsubs ? NULL : builtin_find_pure(c->argv);
+        if (fn)
+            return capture_builtin(sh, fn, c->argv, cap);
+    }
+    return capture_fork(sh, list, cap);
+}
+
+//-----------------------------------------------------------------------------
+// cmdsub_expand
+//-----------------------------------------------------------------------------
+struct fields
+{
+    char **v;
+    int n;
+    int cap;
+};
+
+static int fields_push(struct fields *f, char *s) {
+    if (f->n == f->cap) {
+        int cap = f->cap ? f->cap * 2 : 16;
+        char **tmp = realloc(f->v, cap * sizeof(*tmp));
+        if (!tmp)
+            return -1;
+        f->v = tmp;
+        f->cap = cap;
+    }
+    f->v[f->n++] = s;
+    return 0;
+}
+
+static bool is_ifs(char c) {
+    return c == ' ' || c == '\t' || c == '\n';
+}
+
+// The closing parenthesis of the substitution whose body starts at p. The
+// parser made sure there is one.
+static const char *close_paren(const char *p) {
+    int depth = 1;
+    for (; *p; p++) {
+        if (*p == '(')
+            depth++;
+        else if (*p == ')' && --depth == 0)
+            return p;
+    }
+    return p;
+}
+
+static struct capture *capture_new(struct shell *sh) {
+    struct capture *c = calloc(1, sizeof(*c));
+    if (!c)
+        return NULL;
+    c->next = sh->captures;
+    sh->captures = c;
+    return c;
+}
+
+// Text of the field being built when the word mixes substitutions with
+// other text, which takes a copy. A word that is only a substitution is
+// cut up in place instead.
+struct field_buf
+{
+    char *p;
+    size_t len;
+    size_t cap;
+    bool started;
+};
+
+static int field_add(struct field_buf *b, const char *s, size_t n) {
+    if (b->len + n + 1 > b->cap) {
+        size_t cap = b->cap ? b->cap : 64;
+        while (cap < b->len + n + 1)
+            cap *= 2;
+        char *tmp = realloc(b->p, cap);
+        if (!tmp)
+            return -1;
+        b->p = tmp;
+        b->cap = cap;
+    }
+    memcpy(b->p + b->len, s, n);
+    b->len += n;
+    b->started = true;
+    return 0;
+}
+
+static int field_end(struct shell *sh, struct field_buf *b, struct fields *f) {
+    char *s = arena_strndup(&sh->arena, b->p ? b->p : "", b->len);
+    b->len = 0;
+    b->started = false;
+    return s ? fields_push(f, s) : -1;
+}
+
+static int expand_word(struct shell *sh, const char *word, bool split, struct fields *f) {
+    struct field_buf b = {0};
+    int rval = -1;
+    const char *s = word;
+    while (*s) {
+        if (s[0] != '$' || s[1] != '(') {
+            const char *next = strstr(s + 1, "$(");
+            size_t n = next ? (size_t)(next - s) : strlen(s);
+            if (field_add(&b, s, n) != 0)
+                goto out;
+            s += n;
+            continue;
+        }
+        const char *end = close_paren(s + 2);
+        char *body = arena_strndup(&sh->arena, s + 2, (size_t)(end - s - 2));
+        struct capture *c = body ? capture_new(sh) : NULL;
+        if (!c || cmdsub_capture(sh, body, c) < 0)
+            goto out;
+        // Dropping the trailing newlines is only a shorter length.
+        while (c->len && c->buf[c->len - 1] == '\n')
+            c->len--;
+        if (c->buf)
+            c->buf[c->len] = '\0';
+        bool whole = s == word && *end && !end[1];
+        s = *end ? end + 1 : end;
+        if (!split) {
+            if (c->len && field_add(&b, c->buf, c->len) != 0)
+                goto out;
+            continue;
+        }
+        char *p = c->buf;
+        char *stop = c->buf + c->len;
+        if (whole) {
+            while (p < stop) {
+                while (p < stop && is_ifs(*p))
+                    p++;
+                if (p == stop)
+                    break;
+                char *start = p;
+                while (p < stop && !is_ifs(*p))
+                    p++;
+                *p++ = '\0';
+                if (fields_push(f, start) != 0)
+                    goto out;
+            }
+            continue;
+        }
+        while (p < stop) {
+            if (is_ifs(*p)) {
+                if (b.started && field_end(sh, &b, f) != 0)
+                    goto out;
+                p++;
+                continue;
+            }
+            char *start = p;
+            while (p < stop && !is_ifs(*p))
+                p++;
+            if (field_add(&b, start, (size_t)(p - start)) != 0)
+                goto out;
+        }
+    }
+    if ((b.started || !split) && field_end(sh, &b, f) != 0)
+        goto out;
+    rval = 0;
+out:
+    free(b.p);
+    return rval;
+}
+
+int cmdsub_expand(struct shell *sh, struct command *c) {
+    c->expand = false;
+    struct fields f = {0};
+    int *index = arena_alloc(&sh->arena, (c->argc + 1) * sizeof(*index));
+    if (!index)
+        return -1;
+    for (int i = 0; i < c->argc; i++) {
+        index[i] = f.n;
+        bool sub = c->group != NULL;
+        for (int k = 0; k < c->nsubs; k++)
+            sub = sub || c->subs[k].argi == i;
+        // A process substitution keeps its text for the spawn to replace,
+        // a subshell expands its own words when they run.
+        int r = !sub && strstr(c->argv[i], "$(") ? expand_word(sh, c->argv[i], true, &f)
+                                                 : fields_push(&f, c->argv[i]);
+        if (r != 0)
+            goto fail;
+    }
+    for (int i = 0; i < c->nredirs; i++) {
+        if (!strstr(c->redirs[i].word, "$("))
+            continue;
+        struct fields one = {0};
+        int r = expand_word(sh, c->redirs[i].word, false, &one);
+        if (r == 0)
+            c->redirs[i].word = one.v[0];
+        free(one.v);
+        if (r != 0)
+            goto fail;
+    }
+    char **argv = arena_alloc(&sh->arena, (f.n + 2) * sizeof(*argv));
+    if (!argv)
+        goto fail;
+    if (f.n)
+        memcpy(argv, f.v, f.n * sizeof(*argv));
+    // The builtin table and the PATH memo go by interned name.
+    argv[0] = (char *)intern(f.n ? f.v[0] : "true");
+    argv[f.n ? f.n : 1] = NULL;
+    for (int k = 0; k < c->nsubs; k++)
+        c->subs[k].argi = index[c->subs[k].argi];
+    c->argv = argv;
+    c->argc = f.n ? f.n : 1;
+    free(f.v);
+    return argv[0] ? 0 : -1;
+fail:
+    free(f.v);
+    return -1;
+}
+
+void cmdsub_release(struct shell *sh) {
+    while (sh->captures) {
+        struct capture *c = sh->captures;
+        sh->captures = c->next;
+        capture_free(c);
+        free(c);
+    }
+}
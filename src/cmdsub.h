@@ -0,0 +1,78 @@
+#ifndef CMDSUB_H
+#define CMDSUB_H
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  struct shell;
+  struct command;
+
+  /**
+   * First size of a capture buffer, which then doubles as it fills.
+   */
+#define CMDSUB_INITIAL 4096
+
+  /**
+   * Output past this many bytes is moved into a memfd with splice instead
+   * of growing the buffer further, and mapped once the command is done.
+   */
+#define CMDSUB_SPILL (1u << 20)
+
+  /**
+   * The output of one command substitution. buf always has a zero byte
+   * after len so the fields of a word that is only a substitution can be
+   * cut out of it in place. Captures live until cmdsub_release.
+   */
+  struct capture
+  {
+    char *buf;
+    size_t len;
+    size_t cap;
+    bool mapped;
+    struct capture *next;
+  };
+
+  /**
+   * @brief Run body and capture what it writes to stdout. A single pure
+   * builtin runs in the shell with stdout swapped for the capture, anything
+   * else runs in a forked copy of the shell writing into a pipe.
+   *
+   * @param sh The shell
+   * @param body The text between $( and )
+   * @param cap The capture to fill, zeroed by the caller
+   * @return The exit status of body, or -1 with errno set if it could not
+   * be run or read
+   */
+  int cmdsub_capture(struct shell *sh, const char *body, struct capture *cap);
+
+  /**
+   * @brief Replace every $(...) in the words and redirections of c by the
+   * output of its command, without the trailing newlines. In a word the
+   * output is split into fields at blanks and newlines, a word that was
+   * only a substitution giving nothing disappears. A command left without
+   * words becomes true.
+   *
+   * @param sh The shell, the new words come from its arena
+   * @param c The command, expand is cleared
+   * @return 0 on success, -1 if a substitution could not be run
+   */
+  int cmdsub_expand(struct shell *sh, struct command *c);
+
+  /**
+   * @brief Free every capture made since the last call. Called once the
+   * line whose words point into them has run.
+   *
+   * @param sh The shell
+   */
+  void cmdsub_release(struct shell *sh);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,141 @@
+#include "complete.h"
+#include "pathcache.h"
+#include "dircache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <readline/readline.h>
+
+// Readline's completion callbacks carry no user data so the shell has to be
+// reachable from here.
+static struct shell *complete_sh;
+
+static char **matches;
+static size_t nmatches;
+static size_t matches_cap;
+static size_t matches_next;
+
+// arg is an optional directory part that is glued in front of name.
+static void collect_match(const char *name, void *arg) {
+    const char *dir = arg ? arg : "";
+    if (nmatches == matches_cap) {
+        size_t ncap = matches_cap ? matches_cap * 2 : 32;
+        char **tmp = realloc(matches, ncap * sizeof(char *));
+        if (!tmp)
+            return;
+        matches = tmp;
+        matches_cap = ncap;
+    }
+    size_t dlen = strlen(dir);
+    size_t nlen = strlen(name);
+    char *copy = malloc(dlen + nlen + 1);
+    if (!copy)
+        return;
+    memcpy(copy, dir, dlen);
+    memcpy(copy + dlen, name, nlen + 1);
+    matches[nmatches++] = copy;
+}
+
+static void reset_matches(void) {
+    // Anything that was handed to readline is owned by readline now.
+    for (size_t i = matches_next; i < nmatches; i++) {
+        free(matches[i]);
+    }
+    nmatches = 0;
+    matches_next = 0;
+}
+
+//-----------------------------------------------------------------------------
+// command_generator
+//-----------------------------------------------------------------------------
+static char *command_generator(const char *text, int state) {
+    if (state == 0) {
+        reset_matches();
+        struct pathcache *pc = complete_sh->pathcache;
+        const char *path = getenv("PATH");
+        if (!path)
+            path = "";
+        if (pc && strcmp(pc->path_env, path) != 0) {
+            // PATH was changed, rebuilding is mostly served from the cache file.
+            char *file = pc->cache_file ? strdup(pc->cache_file) : NULL;
+            pathcache_destroy(pc);
+            pc = complete_sh->pathcache = pathcache_create(path, file);
+            free(file);
+        } else {
+            pathcache_refresh(pc);
+        }
+        pathcache_complete(pc, text, collect_match, NULL);
+    }
+    if (matches_next < nmatches)
+        return matches[matches_next++];
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// file_generator
+//-----------------------------------------------------------------------------
+static char *file_generator(const char *text, int state) {
+    if (state == 0) {
+        reset_matches();
+        const char *slash = strrchr(text, '/');
+        if (!slash) {
+            dircache_complete(complete_sh->dircache, ".", text, collect_match, NULL);
+        } else {
+            size_t dlen = (size_t)(slash - text) + 1;
+            char *dir = strndup(text, dlen);
+            if (dir) {
+                // Keep the trailing slash on the match but not on the
+                // directory we open unless it is the root.
+                if (dlen > 1)
+                    dir[dlen - 1] = '\0';
+                char *part = strndup(text, dlen);
+                if (part)
+                    dircache_complete(complete_sh->dircache, dir, slash + 1, collect_match, part);
+                free(part);
+                free(dir);
+            }
+        }
+    }
+    if (matches_next < nmatches)
+        return matches[matches_next++];
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// sh_completion
+//-----------------------------------------------------------------------------
+char **sh_completion(const char *text, int start, int end) {
+    UNUSED(end);
+    if (!complete_sh)
+        return NULL;
+    int i = 0;
+    while (i < start && isspace((unsigned char)rl_line_buffer[i]))
+        i++;
+    // Both caches hand back sorted names already.
+    rl_sort_completion_matches = 0;
+    if (i == start && !strchr(text, '/') && complete_sh->pathcache) {
+        rl_attempted_completion_over = 1;
+        return rl_completion_matches(text, command_generator);
+    }
+    // Tilde and variable expansion are left to readline.
+    if (complete_sh->dircache && text[0] != '~' && !strchr(text, '$')) {
+        rl_attempted_completion_over = 1;
+        rl_filename_completion_desired = 1;
+        return rl_completion_matches(text, file_generator);
+    }
+    rl_sort_completion_matches = 1;
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// sh_complete_init
+//-----------------------------------------------------------------------------
+void sh_complete_init(struct shell *sh) {
+    complete_sh = sh;
+    char *file = pathcache_default_file();
+    sh->pathcache = pathcache_create(getenv("PATH"), file);
+    free(file);
+    sh->dircache = dircache_create(0);
+    rl_attempted_completion_function = sh_completion;
+}
@@ -0,0 +1,34 @@
+#ifndef COMPLETE_H
+#define COMPLETE_H
+#include "lab.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * @brief Hook the shell's completion into readline. The first word on the
+   * line is completed from the PATH executable trie, every other word is
+   * completed from the per directory filename cache.
+   *
+   * @param sh The shell that owns the caches used for completion
+   */
+  void sh_complete_init(struct shell *sh);
+
+  /**
+   * @brief Return the readline completion matches for text, this is what
+   * readline calls through rl_attempted_completion_function.
+   *
+   * @param text The word being completed
+   * @param start Offset of text in rl_line_buffer
+   * @param end Offset of the cursor in rl_line_buffer
+   * @return The matches or NULL to use the default completion
+   */
+  char **sh_completion(const char *text, int start, int end);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
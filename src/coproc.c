@@ -0,0 +1,206 @@
+#define _GNU_SOURCE
+#include "coproc.h"
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+static struct coproc coprocs[COPROC_MAX];
+
+//-----------------------------------------------------------------------------
+// coproc_start
+//-----------------------------------------------------------------------------
+static void set_var(const char *name, const char *suffix, long value) {
+    char key[256], num[32];
+    snprintf(key, sizeof(key), "%s_%s", name, suffix);
+    snprintf(num, sizeof(num), "%ld", value);
+    setenv(key, num, 1);
+}
+
+static void unset_var(const char *name, const char *suffix) {
+    char key[256];
+    snprintf(key, sizeof(key), "%s_%s", name, suffix);
+    unsetenv(key);
+}
+
+struct coproc *coproc_start(const char *name, char **argv, bool interactive) {
+    if (coproc_find(name)) {
+        errno = EEXIST;
+        return NULL;
+    }
+    struct coproc *c = NULL;
+    for (int i = 0; i < COPROC_MAX && !c; i++) {
+        if (!coprocs[i].name)
+            c = &coprocs[i];
+    }
+    if (!c) {
+        errno = EAGAIN;
+        return NULL;
+    }
+    int in[2], out[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, in) != 0)
+        return NULL;
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, out) != 0) {
+        close(in[0]);
+        close(in[1]);
+        return NULL;
+    }
+    // Each socket carries one direction only.
+    shutdown(in[0], SHUT_RD);
+    shutdown(out[0], SHUT_WR);
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (interactive) {
+            setpgid(0, 0);
+            signal(SIGINT, SIG_DFL);
+            signal(SIGQUIT, SIG_DFL);
+            signal(SIGTSTP, SIG_DFL);
+            signal(SIGTTIN, SIG_DFL);
+            signal(SIGTTOU, SIG_DFL);
+        }
+        dup2(in[1], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        execvp(argv[0], argv);
+        fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+        _exit(127);
+    }
+    close(in[1]);
+    close(out[1]);
+    if (pid < 0) {
+        close(in[0]);
+        close(out[0]);
+        return NULL;
+    }
+    if (interactive)
+        setpgid(pid, pid);
+    c->name = strdup(name);
+    c->pid = pid;
+    c->in = in[0];
+    c->out = out[0];
+    set_var(name, "PID", pid);
+    set_var(name, "IN", c->in);
+    set_var(name, "OUT", c->out);
+    return c;
+}
+
+//-----------------------------------------------------------------------------
+// coproc_find
+//-----------------------------------------------------------------------------
+struct coproc *coproc_find(const char *name) {
+    for (int i = 0; i < COPROC_MAX && name; i++) {
+        if (coprocs[i].name && strcmp(coprocs[i].name, name) == 0)
+            return &coprocs[i];
+    }
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// coproc_read
+//-----------------------------------------------------------------------------
+// Peek at what is there, then take up to and including the first newline.
+// Two calls per line and no buffer of our own to keep in sync.
+int coproc_read(struct coproc *c, FILE *fp) {
+    char buf[COPROC_PEEK];
+    bool any = false;
+    for (;;) {
+        ssize_t n = recv(c->out, buf, sizeof(buf), MSG_PEEK);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        if (n == 0) {
+            // A last line without a newline still gets one.
+            if (any)
+                fputc('\n', fp);
+            return any ? 0 : 1;
+        }
+        char *nl = memchr(buf, '\n', (size_t)n);
+        size_t take = nl ? (size_t)(nl - buf) + 1 : (size_t)n;
+        while ((n = recv(c->out, buf, take, MSG_WAITALL)) < 0 && errno == EINTR)
+            ;
+        if (n < 0)
+            return -1;
+        fwrite(buf, 1, (size_t)n, fp);
+        any = true;
+        if (nl)
+            return 0;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// coproc_write
+//-----------------------------------------------------------------------------
+int coproc_write(struct coproc *c, char **words) {
+    size_t len = 1;
+    for (int i = 0; words[i]; i++)
+        len += strlen(words[i]) + 1;
+    char *line = malloc(len);
+    if (!line)
+        return -1;
+    char *end = line;
+    for (int i = 0; words[i]; i++) {
+        if (i > 0)
+            *end++ = ' ';
+        size_t n = strlen(words[i]);
+        memcpy(end, words[i], n);
+        end += n;
+    }
+    *end++ = '\n';
+    size_t done = 0;
+    int rval = 0;
+    while (done < (size_t)(end - line)) {
+        ssize_t n = send(c->in, line + done, (size_t)(end - line) - done, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            rval = -1;
+            break;
+        }
+        done += (size_t)n;
+    }
+    int saved = errno;
+    free(line);
+    errno = saved;
+    return rval;
+}
+
+//-----------------------------------------------------------------------------
+// coproc_close
+//-----------------------------------------------------------------------------
+static void coproc_forget(struct coproc *c) {
+    unset_var(c->name, "PID");
+    unset_var(c->name, "IN");
+    unset_var(c->name, "OUT");
+    free(c->name);
+    memset(c, 0, sizeof(*c));
+}
+
+int coproc_close(struct coproc *c) {
+    close(c->in);
+    close(c->out);
+    int status = 0;
+    pid_t r;
+    while ((r = waitpid(c->pid, &status, 0)) < 0 && errno == EINTR)
+        ;
+    coproc_forget(c);
+    if (r < 0)
+        return 1;
+    return WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+}
+
+void coproc_close_all(void) {
+    // A coprocess that does not stop at end of input is not waited for,
+    // it is left to finish on its own like any background job.
+    for (int i = 0; i < COPROC_MAX; i++) {
+        struct coproc *c = &coprocs[i];
+        if (!c->name)
+            continue;
+        close(c->in);
+        close(c->out);
+        waitpid(c->pid, NULL, WNOHANG);
+        coproc_forget(c);
+    }
+}
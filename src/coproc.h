@@ -0,0 +1,99 @@
+#ifndef COPROC_H
+#define COPROC_H
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * Most coprocesses running at once.
+   */
+#define COPROC_MAX 16
+
+  /**
+   * Longest line read in one peek, a longer one takes several.
+   */
+#define COPROC_PEEK 4096
+
+  /**
+   * A long-lived child started by coproc NAME cmd. in is the shell's end of
+   * its stdin and out the shell's end of its stdout, both are Unix stream
+   * sockets so a line can be peeked before it is taken and a write to a
+   * child that has gone fails instead of raising SIGPIPE. The shell's ends
+   * are close-on-exec, no other command ever sees them.
+   */
+  struct coproc
+  {
+    char *name;
+    pid_t pid;
+    int in;
+    int out;
+  };
+
+  /**
+   * @brief Start argv as the coprocess name and set NAME_PID, NAME_IN and
+   * NAME_OUT in the environment to its pid and the fds to write to and read
+   * from.
+   *
+   * @param name The name, not already running
+   * @param argv The command
+   * @param interactive Put the child in a process group of its own so the
+   * terminal's signals only go to the foreground job
+   * @return The coprocess or NULL with errno set, EEXIST if name is taken
+   */
+  struct coproc *coproc_start(const char *name, char **argv, bool interactive);
+
+  /**
+   * @brief Look up a running coprocess.
+   *
+   * @param name The name
+   * @return The coprocess or NULL
+   */
+  struct coproc *coproc_find(const char *name);
+
+  /**
+   * @brief Take one line of the coprocess' output and write it to fp. The
+   * line is peeked first and only its own bytes are taken, so nothing is
+   * buffered in the shell and a forked reader leaves the rest in place.
+   *
+   * @param c The coprocess
+   * @param fp The stream to print the line on, newline included
+   * @return 0 if a line was read, 1 at end of output, -1 with errno set on
+   * failure
+   */
+  int coproc_read(struct coproc *c, FILE *fp);
+
+  /**
+   * @brief Write words joined by spaces and a newline to the coprocess'
+   * stdin in one call.
+   *
+   * @param c The coprocess
+   * @param words NULL terminated
+   * @return 0 on success, -1 with errno set, EPIPE if it stopped reading
+   */
+  int coproc_write(struct coproc *c, char **words);
+
+  /**
+   * @brief Close the coprocess' stdin and stdout, wait for it and remove
+   * its variables from the environment.
+   *
+   * @param c The coprocess
+   * @return Its exit status, 128 + the signal number if it was killed
+   */
+  int coproc_close(struct coproc *c);
+
+  /**
+   * @brief Close every coprocess, when the shell exits.
+   */
+  void coproc_close_all(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,226 @@
+#include "dircache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+//-----------------------------------------------------------------------------
+// LRU helpers
+//-----------------------------------------------------------------------------
+static void dc_unlink(struct dircache *dc, struct dc_entry *e) {
+    if (e->prev)
+        e->prev->next = e->next;
+    else
+        dc->head = e->next;
+    if (e->next)
+        e->next->prev = e->prev;
+    else
+        dc->tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void dc_push_front(struct dircache *dc, struct dc_entry *e) {
+    e->prev = NULL;
+    e->next = dc->head;
+    if (dc->head)
+        dc->head->prev = e;
+    dc->head = e;
+    if (!dc->tail)
+        dc->tail = e;
+}
+
+static void dc_entry_free(struct dc_entry *e) {
+    free(e->strings);
+    free(e->names);
+    free(e->last_prefix);
+    free(e);
+}
+
+static void dc_remove(struct dircache *dc, struct dc_entry *e) {
+    dc_unlink(dc, e);
+    dc->bytes -= e->bytes;
+    dc->nentries--;
+    dc_entry_free(e);
+}
+
+// Never evicts the head, that is the listing the caller is about to use.
+static void dc_evict(struct dircache *dc) {
+    while (dc->bytes > dc->max_bytes && dc->tail && dc->tail != dc->head) {
+        dc_remove(dc, dc->tail);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// dc_load
+//-----------------------------------------------------------------------------
+static int dc_name_cmp(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static struct dc_entry *dc_load(const char *dir, const struct stat *st) {
+    DIR *dp = opendir(dir);
+    if (!dp)
+        return NULL;
+    struct dc_entry *e = calloc(1, sizeof(*e));
+    if (!e) {
+        closedir(dp);
+        return NULL;
+    }
+    e->dev = st->st_dev;
+    e->ino = st->st_ino;
+    e->mtime = st->st_mtim;
+
+    // Names are packed back to back first and the index is built once the
+    // block stops moving.
+    size_t used = 0, cap = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dp))) {
+        const char *name = ent->d_name;
+        if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2])))
+            continue;
+        size_t len = strlen(name) + 1;
+        if (used + len > cap) {
+            size_t ncap = cap ? cap * 2 : 4096;
+            while (ncap < used + len)
+                ncap *= 2;
+            char *tmp = realloc(e->strings, ncap);
+            if (!tmp)
+                goto fail;
+            e->strings = tmp;
+            cap = ncap;
+        }
+        memcpy(e->strings + used, name, len);
+        used += len;
+        e->nnames++;
+    }
+    closedir(dp);
+    dp = NULL;
+
+    e->names = malloc((e->nnames ? e->nnames : 1) * sizeof(char *));
+    if (!e->names)
+        goto fail;
+    char *p = e->strings;
+    for (size_t i = 0; i < e->nnames; i++) {
+        e->names[i] = p;
+        p += strlen(p) + 1;
+    }
+    qsort(e->names, e->nnames, sizeof(char *), dc_name_cmp);
+    e->bytes = sizeof(*e) + cap + e->nnames * sizeof(char *);
+    return e;
+
+fail:
+    if (dp)
+        closedir(dp);
+    dc_entry_free(e);
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// dc_lower_bound
+//-----------------------------------------------------------------------------
+// First index in [lo, hi) whose name is not less than prefix when only the
+// first len bytes are compared.
+static size_t dc_lower_bound(struct dc_entry *e, size_t lo, size_t hi,
+                             const char *prefix, size_t len) {
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strncmp(e->names[mid], prefix, len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static size_t dc_upper_bound(struct dc_entry *e, size_t lo, size_t hi,
+                             const char *prefix, size_t len) {
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strncmp(e->names[mid], prefix, len) <= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+//-----------------------------------------------------------------------------
+// dircache_create
+//-----------------------------------------------------------------------------
+struct dircache *dircache_create(size_t max_bytes) {
+    struct dircache *dc = calloc(1, sizeof(*dc));
+    if (dc)
+        dc->max_bytes = max_bytes ? max_bytes : DIRCACHE_DEFAULT_BYTES;
+    return dc;
+}
+
+//-----------------------------------------------------------------------------
+// dircache_destroy
+//-----------------------------------------------------------------------------
+void dircache_destroy(struct dircache *dc) {
+    if (!dc)
+        return;
+    while (dc->head) {
+        dc_remove(dc, dc->head);
+    }
+    free(dc);
+}
+
+//-----------------------------------------------------------------------------
+// dircache_complete
+//-----------------------------------------------------------------------------
+ssize_t dircache_complete(struct dircache *dc, const char *dir, const char *prefix,
+                          void (*fn)(const char *name, void *arg), void *arg) {
+    struct stat st;
+    if (!dc || !dir || !prefix || stat(dir, &st) != 0 || !S_ISDIR(st.st_mode))
+        return -1;
+
+    // Entries are keyed by inode so "." and the absolute path of the cwd
+    // share a listing, and a cd does not invalidate anything.
+    struct dc_entry *e = dc->head;
+    while (e && (e->dev != st.st_dev || e->ino != st.st_ino))
+        e = e->next;
+    if (e && (e->mtime.tv_sec != st.st_mtim.tv_sec || e->mtime.tv_nsec != st.st_mtim.tv_nsec)) {
+        dc_remove(dc, e);
+        e = NULL;
+    }
+    if (e) {
+        dc_unlink(dc, e);
+    } else {
+        e = dc_load(dir, &st);
+        if (!e)
+            return -1;
+        dc->bytes += e->bytes;
+        dc->nentries++;
+    }
+    dc_push_front(dc, e);
+    dc_evict(dc);
+
+    size_t len = strlen(prefix);
+    size_t lo = 0, hi = e->nnames;
+    if (e->last_prefix && strncmp(prefix, e->last_prefix, strlen(e->last_prefix)) == 0) {
+        lo = e->lo;
+        hi = e->hi;
+    }
+    lo = dc_lower_bound(e, lo, hi, prefix, len);
+    hi = dc_upper_bound(e, lo, hi, prefix, len);
+
+    char *last = strdup(prefix);
+    if (last) {
+        free(e->last_prefix);
+        e->last_prefix = last;
+        e->lo = lo;
+        e->hi = hi;
+    }
+
+    ssize_t count = 0;
+    bool hidden = prefix[0] == '.';
+    for (size_t i = lo; i < hi; i++) {
+        if (!hidden && e->names[i][0] == '.')
+            continue;
+        fn(e->names[i], arg);
+        count++;
+    }
+    return count;
+}
@@ -0,0 +1,89 @@
+#ifndef DIRCACHE_H
+#define DIRCACHE_H
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * Default memory budget for all cached directories together.
+   */
+#define DIRCACHE_DEFAULT_BYTES (32u * 1024u * 1024u)
+
+  /**
+   * The sorted listing of one directory. The names all live in one block
+   * so a listing costs one allocation for the strings and one for the index.
+   */
+  struct dc_entry
+  {
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    char *strings;
+    char **names;
+    size_t nnames;
+    size_t bytes;
+    // The range matched by the previous lookup. A longer prefix that
+    // extends it (the user typed more) only has to search inside it.
+    char *last_prefix;
+    size_t lo;
+    size_t hi;
+    struct dc_entry *prev;
+    struct dc_entry *next;
+  };
+
+  /**
+   * Filename completion cache. Entries are kept on an LRU list with the
+   * most recently used directory at the head and are evicted from the tail
+   * once max_bytes is exceeded.
+   */
+  struct dircache
+  {
+    struct dc_entry *head;
+    struct dc_entry *tail;
+    size_t nentries;
+    size_t bytes;
+    size_t max_bytes;
+  };
+
+  /**
+   * @brief Create an empty cache.
+   *
+   * @param max_bytes The memory budget, 0 uses DIRCACHE_DEFAULT_BYTES
+   * @return The cache or NULL if memory could not be allocated
+   */
+  struct dircache *dircache_create(size_t max_bytes);
+
+  /**
+   * @brief Free every cached listing and the cache itself.
+   *
+   * @param dc The cache to destroy
+   */
+  void dircache_destroy(struct dircache *dc);
+
+  /**
+   * @brief Call fn for every name in dir that starts with prefix, in sorted
+   * order. The listing is read and sorted the first time a directory is
+   * seen and reused until the directory's mtime changes. Dot files are only
+   * reported when prefix starts with a dot.
+   *
+   * @param dc The cache
+   * @param dir The directory to list
+   * @param prefix The start of the name being completed
+   * @param fn Called with each matching name
+   * @param arg Passed through to fn
+   * @return The number of names reported or -1 if dir could not be read
+   */
+  ssize_t dircache_complete(struct dircache *dc, const char *dir, const char *prefix,
+                            void (*fn)(const char *name, void *arg), void *arg);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,61 @@
+#include "evloop.h"
+#include <errno.h>
+#include <poll.h>
+
+//-----------------------------------------------------------------------------
+// evloop
+//-----------------------------------------------------------------------------
+void evloop_init(struct evloop *l) {
+    l->n = 0;
+}
+
+int evloop_add(struct evloop *l, struct ev_source *s) {
+    if (l->n == EVLOOP_MAX)
+        return -1;
+    l->src[l->n++] = s;
+    return 0;
+}
+
+void evloop_del(struct evloop *l, struct ev_source *s) {
+    for (int i = 0; i < l->n; i++) {
+        if (l->src[i] == s) {
+            l->src[i] = l->src[--l->n];
+            return;
+        }
+    }
+}
+
+static bool evloop_has(const struct evloop *l, const struct ev_source *s) {
+    for (int i = 0; i < l->n; i++) {
+        if (l->src[i] == s)
+            return true;
+    }
+    return false;
+}
+
+int evloop_run_once(struct evloop *l, int timeout_ms) {
+    struct pollfd pfd[EVLOOP_MAX];
+    struct ev_source *src[EVLOOP_MAX];
+    int n = l->n;
+    for (int i = 0; i < n; i++) {
+        src[i] = l->src[i];
+        pfd[i].fd = src[i]->fd;
+        pfd[i].events = src[i]->events;
+        pfd[i].revents = 0;
+    }
+    int r = poll(pfd, (nfds_t)n, timeout_ms);
+    if (r < 0)
+        return errno == EINTR ? 0 : -1;
+    int calls = 0;
+    for (int i = 0; i < n && r > 0; i++) {
+        if (!pfd[i].revents)
+            continue;
+        r--;
+        // An earlier callback may have removed this source.
+        if (!evloop_has(l, src[i]))
+            continue;
+        src[i]->fn(src[i], pfd[i].revents);
+        calls++;
+    }
+    return calls;
+}
@@ -0,0 +1,84 @@
+#ifndef EVLOOP_H
+#define EVLOOP_H
+#include <stdlib.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * Most sources one loop watches at once.
+   */
+#define EVLOOP_MAX 64
+
+  struct ev_source;
+
+  /**
+   * Called with the poll revents of the source's fd.
+   */
+  typedef void (*ev_fn)(struct ev_source *src, short revents);
+
+  /**
+   * One fd to watch. The source is owned by whoever added it and must stay
+   * valid until it is removed.
+   */
+  struct ev_source
+  {
+    int fd;
+    short events;
+    ev_fn fn;
+    void *arg;
+  };
+
+  /**
+   * A poll(2) loop the shell runs while it waits for a foreground job, so
+   * child exits (through pidfds), timers and relayed pipes are all served
+   * from one place without threads.
+   */
+  struct evloop
+  {
+    struct ev_source *src[EVLOOP_MAX];
+    int n;
+  };
+
+  /**
+   * @brief Start with no sources.
+   *
+   * @param l The loop
+   */
+  void evloop_init(struct evloop *l);
+
+  /**
+   * @brief Start watching a source.
+   *
+   * @param l The loop
+   * @param s The source
+   * @return 0 on success, -1 if the loop is full
+   */
+  int evloop_add(struct evloop *l, struct ev_source *s);
+
+  /**
+   * @brief Stop watching a source, safe to call from any callback.
+   *
+   * @param l The loop
+   * @param s The source
+   */
+  void evloop_del(struct evloop *l, struct ev_source *s);
+
+  /**
+   * @brief Poll once and call back every source that is ready.
+   *
+   * @param l The loop
+   * @param timeout_ms How long to wait, -1 for ever
+   * @return The number of callbacks made, or -1 with errno set if poll
+   * failed for a reason other than EINTR
+   */
+  int evloop_run_once(struct evloop *l, int timeout_ms);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,53 @@
+#include "forkmem.h"
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//-----------------------------------------------------------------------------
+// forkmem_alloc
+//-----------------------------------------------------------------------------
+void *forkmem_alloc(size_t size) {
+    if (size == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+    // Without it the memory still works, it is only copied like the heap.
+    madvise(p, size, MADV_DONTFORK);
+    return p;
+}
+
+//-----------------------------------------------------------------------------
+// forkmem_free
+//-----------------------------------------------------------------------------
+void forkmem_free(void *p, size_t size) {
+    if (p)
+        munmap(p, size);
+}
+
+//-----------------------------------------------------------------------------
+// forkmem_share
+//-----------------------------------------------------------------------------
+int forkmem_share(void *p, size_t size) {
+    return madvise(p, size, MADV_DOFORK);
+}
+
+//-----------------------------------------------------------------------------
+// forkmem_map_file
+//-----------------------------------------------------------------------------
+const void *forkmem_map_file(int fd, size_t *size) {
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        return NULL;
+    if (st.st_size <= 0) {
+        errno = ENODATA;
+        return NULL;
+    }
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+    *size = (size_t)st.st_size;
+    return p;
+}
@@ -0,0 +1,59 @@
+#ifndef FORKMEM_H
+#define FORKMEM_H
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * @brief Allocate memory that a forked child does not get. It is a
+   * mapping of its own marked MADV_DONTFORK, so fork copies none of its
+   * page tables and the child sees nothing at that address. Only for data
+   * that no forked copy of the shell ever reads.
+   *
+   * @param size The size in bytes, rounded up to whole pages
+   * @return The memory, zeroed, or NULL with errno set
+   */
+  void *forkmem_alloc(size_t size);
+
+  /**
+   * @brief Free memory from forkmem_alloc or forkmem_map_file. Memory from
+   * forkmem_alloc may only be freed by the process that allocated it, in a
+   * forked child something else may have been mapped at that address.
+   *
+   * @param p The memory, may be NULL
+   * @param size The size it was allocated or mapped with
+   */
+  void forkmem_free(void *p, size_t size);
+
+  /**
+   * @brief Let forked children have a copy of memory from forkmem_alloc
+   * after all. It is then ordinary memory that a child may also free.
+   *
+   * @param p The memory
+   * @param size The size it was allocated with
+   * @return 0 on success, -1 with errno set
+   */
+  int forkmem_share(void *p, size_t size);
+
+  /**
+   * @brief Map a whole file read-only and shared. fork copies no page
+   * tables for a shared file mapping, the child faults in what it reads
+   * from the page cache. The file must only ever be replaced by rename,
+   * never truncated in place.
+   *
+   * @param fd The file, may be closed afterwards
+   * @param size Set to the size of the file
+   * @return The mapping or NULL with errno set, also for an empty file
+   */
+  const void *forkmem_map_file(int fd, size_t *size);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,170 @@
+#include "intern.h"
+#include <stddef.h>
+#include <string.h>
+
+#define INTERN_BLOCK_SIZE (64 * 1024)
+
+// The hash and length sit in front of the characters so they can be found
+// from the string pointer alone.
+struct istr
+{
+    uint32_t hash;
+    uint32_t len;
+    char s[];
+};
+
+struct iblock
+{
+    struct iblock *next;
+    size_t used;
+    char data[INTERN_BLOCK_SIZE];
+};
+
+// Open addressing table of pointers to the strings, strings themselves are
+// packed into large blocks so interning a word is not a malloc.
+static struct istr **table;
+static size_t table_cap;
+static size_t table_used;
+static struct iblock *blocks;
+static size_t epoch;
+
+#define ISTR(p) ((struct istr *)((char *)(p) - offsetof(struct istr, s)))
+
+//-----------------------------------------------------------------------------
+// intern_hash_bytes
+//-----------------------------------------------------------------------------
+// 32 bit FNV-1a, short words are the common case and it has no setup cost.
+uint32_t intern_hash_bytes(const char *s, size_t n) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static struct istr **intern_slot(const char *s, size_t n, uint32_t hash) {
+    size_t mask = table_cap - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        struct istr *e = table[i];
+        if (!e || (e->hash == hash && e->len == n && memcmp(e->s, s, n) == 0))
+            return &table[i];
+    }
+}
+
+static int intern_grow(void) {
+    size_t ncap = table_cap ? table_cap * 2 : 1024;
+    struct istr **ntable = calloc(ncap, sizeof(*ntable));
+    if (!ntable)
+        return -1;
+    for (size_t i = 0; i < table_cap; i++) {
+        struct istr *e = table[i];
+        if (!e)
+            continue;
+        size_t j = e->hash & (ncap - 1);
+        while (ntable[j])
+            j = (j + 1) & (ncap - 1);
+        ntable[j] = e;
+    }
+    free(table);
+    table = ntable;
+    table_cap = ncap;
+    return 0;
+}
+
+static struct istr *intern_store(const char *s, size_t n, uint32_t hash) {
+    size_t need = (offsetof(struct istr, s) + n + 1 + _Alignof(struct istr) - 1) &
+                  ~(_Alignof(struct istr) - 1);
+    if (need > INTERN_BLOCK_SIZE)
+        return NULL;
+    if (!blocks || INTERN_BLOCK_SIZE - blocks->used < need) {
+        struct iblock *b = malloc(sizeof(*b));
+        if (!b)
+            return NULL;
+        b->next = blocks;
+        b->used = 0;
+        blocks = b;
+    }
+    struct istr *e = (struct istr *)(blocks->data + blocks->used);
+    blocks->used += need;
+    e->hash = hash;
+    e->len = (uint32_t)n;
+    memcpy(e->s, s, n);
+    e->s[n] = '\0';
+    return e;
+}
+
+//-----------------------------------------------------------------------------
+// intern_n
+//-----------------------------------------------------------------------------
+const char *intern_n(const char *s, size_t n) {
+    if (!s)
+        return NULL;
+    // Keep the load factor under 3/4 so probes stay short.
+    if ((table_used + 1) * 4 > table_cap * 3 && intern_grow() != 0)
+        return NULL;
+    uint32_t hash = intern_hash_bytes(s, n);
+    struct istr **slot = intern_slot(s, n, hash);
+    if (!*slot) {
+        *slot = intern_store(s, n, hash);
+        if (!*slot)
+            return NULL;
+        table_used++;
+    }
+    return (*slot)->s;
+}
+
+//-----------------------------------------------------------------------------
+// intern
+//-----------------------------------------------------------------------------
+const char *intern(const char *s) {
+    return s ? intern_n(s, strlen(s)) : NULL;
+}
+
+//-----------------------------------------------------------------------------
+// intern_find
+//-----------------------------------------------------------------------------
+const char *intern_find(const char *s) {
+    if (!s || !table_cap)
+        return NULL;
+    size_t n = strlen(s);
+    struct istr *e = *intern_slot(s, n, intern_hash_bytes(s, n));
+    return e ? e->s : NULL;
+}
+
+//-----------------------------------------------------------------------------
+// intern_hash
+//-----------------------------------------------------------------------------
+uint32_t intern_hash(const char *s) {
+    return ISTR(s)->hash;
+}
+
+//-----------------------------------------------------------------------------
+// intern_count
+//-----------------------------------------------------------------------------
+size_t intern_count(void) {
+    return table_used;
+}
+
+//-----------------------------------------------------------------------------
+// intern_clear
+//-----------------------------------------------------------------------------
+void intern_clear(void) {
+    while (blocks) {
+        struct iblock *next = blocks->next;
+        free(blocks);
+        blocks = next;
+    }
+    free(table);
+    table = NULL;
+    table_cap = 0;
+    table_used = 0;
+    epoch++;
+}
+
+//-----------------------------------------------------------------------------
+// intern_epoch
+//-----------------------------------------------------------------------------
+size_t intern_epoch(void) {
+    return epoch;
+}
@@ -0,0 +1,83 @@
+#ifndef INTERN_H
+#define INTERN_H
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * @brief Return the one shared copy of the first n bytes of s, adding it
+   * to the table if this is the first time it is seen. Two interned strings
+   * are equal if and only if their pointers are equal. Interned strings
+   * live until intern_clear and must not be modified or freed.
+   *
+   * @param s The string
+   * @param n Its length
+   * @return The interned copy or NULL on allocation failure
+   */
+  const char *intern_n(const char *s, size_t n);
+
+  /**
+   * @brief intern_n for a NUL terminated string.
+   *
+   * @param s The string
+   * @return The interned copy or NULL on allocation failure
+   */
+  const char *intern(const char *s);
+
+  /**
+   * @brief Look a string up without adding it.
+   *
+   * @param s The string
+   * @return The interned copy or NULL if s was never interned
+   */
+  const char *intern_find(const char *s);
+
+  /**
+   * @brief Return the hash computed when s was interned, so hash tables
+   * keyed by interned strings never hash the characters again.
+   *
+   * @param s A string returned by intern, intern_n or intern_find
+   * @return The hash of s
+   */
+  uint32_t intern_hash(const char *s);
+
+  /**
+   * @brief Hash n bytes of s with the same function the table uses.
+   *
+   * @param s The bytes to hash
+   * @param n The number of bytes
+   * @return The hash
+   */
+  uint32_t intern_hash_bytes(const char *s, size_t n);
+
+  /**
+   * @brief Number of distinct strings in the table.
+   *
+   * @return The count
+   */
+  size_t intern_count(void);
+
+  /**
+   * @brief Free every interned string. Pointers handed out earlier become
+   * invalid.
+   */
+  void intern_clear(void);
+
+  /**
+   * @brief Counter that changes every time intern_clear runs, tables that
+   * hold on to interned pointers compare it to know when to re-intern.
+   *
+   * @return The current epoch
+   */
+  size_t intern_epoch(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
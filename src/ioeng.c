@@ -0,0 +1,364 @@
+#define _GNU_SOURCE
+#include "ioeng.h"
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+static struct ioeng *default_engine;
+static pid_t default_owner;
+
+//-----------------------------------------------------------------------------
+// io_uring
+//-----------------------------------------------------------------------------
+// There is no liburing here, the three syscalls and the ring layout from
+// the kernel header are all the engine needs.
+static int uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned submit, unsigned wait, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+
+static int uring_register(int fd, unsigned opcode, const void *arg, unsigned n) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, n);
+}
+
+static void uring_unmap(struct ioeng *e) {
+    if (e->sqes)
+        munmap(e->sqes, e->sqes_size);
+    if (e->cq_ring && e->cq_ring != e->sq_ring)
+        munmap(e->cq_ring, e->cq_ring_size);
+    if (e->sq_ring)
+        munmap(e->sq_ring, e->sq_ring_size);
+    e->sqes = NULL;
+    e->sq_ring = e->cq_ring = NULL;
+}
+
+static int uring_init(struct ioeng *e) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = uring_setup(IOENG_ENTRIES, &p);
+    if (fd < 0)
+        return -1;
+    e->ring_fd = fd;
+    e->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    e->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (e->cq_ring_size > e->sq_ring_size)
+            e->sq_ring_size = e->cq_ring_size;
+        e->cq_ring_size = e->sq_ring_size;
+    }
+    e->sq_ring = mmap(NULL, e->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_SQ_RING);
+    if (e->sq_ring == MAP_FAILED) {
+        e->sq_ring = NULL;
+        goto fail;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        e->cq_ring = e->sq_ring;
+    } else {
+        e->cq_ring = mmap(NULL, e->cq_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (e->cq_ring == MAP_FAILED) {
+            e->cq_ring = NULL;
+            goto fail;
+        }
+    }
+    e->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    e->sqes = mmap(NULL, e->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                   IORING_OFF_SQES);
+    if (e->sqes == MAP_FAILED) {
+        e->sqes = NULL;
+        goto fail;
+    }
+    char *sq = e->sq_ring;
+    char *cq = e->cq_ring;
+    e->sq_head = (unsigned *)(sq + p.sq_off.head);
+    e->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    e->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    e->sq_array = (unsigned *)(sq + p.sq_off.array);
+    e->cq_head = (unsigned *)(cq + p.cq_off.head);
+    e->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    e->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    e->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    if (uring_register(fd, IORING_REGISTER_EVENTFD, &e->efd, 1) != 0)
+        goto fail;
+    return 0;
+fail:
+    uring_unmap(e);
+    close(fd);
+    e->ring_fd = -1;
+    return -1;
+}
+
+// The ring holds IOENG_ENTRIES sqes and at most that many operations are
+// ever outstanding, so there is always room for a queued one.
+static void uring_push(struct ioeng *e, int slot) {
+    const struct ioeng_op *op = &e->slots[slot];
+    unsigned tail = *e->sq_tail;
+    unsigned idx = tail & *e->sq_mask;
+    struct io_uring_sqe *sqe = &e->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = op->fd;
+    sqe->user_data = (uint64_t)slot;
+    e->sq_array[idx] = idx;
+    if (op->opcode == IOENG_CANCEL) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        __atomic_store_n(e->sq_tail, tail + 1, __ATOMIC_RELEASE);
+        return;
+    }
+    sqe->opcode = op->opcode == IOENG_READ ? IORING_OP_READ : IORING_OP_WRITE;
+    sqe->addr = (uint64_t)(uintptr_t)op->buf;
+    sqe->len = (uint32_t)op->len;
+    sqe->off = op->off < 0 ? (uint64_t)-1 : (uint64_t)op->off;
+    __atomic_store_n(e->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static int uring_collect(struct ioeng *e) {
+    unsigned head = *e->cq_head;
+    unsigned tail = __atomic_load_n(e->cq_tail, __ATOMIC_ACQUIRE);
+    int n = 0;
+    for (; head != tail; head++) {
+        const struct io_uring_cqe *cqe = &e->cqes[head & *e->cq_mask];
+        int slot = (int)cqe->user_data;
+        e->results[slot] = cqe->res;
+        e->done[e->ndone++] = slot;
+        n++;
+    }
+    __atomic_store_n(e->cq_head, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+//-----------------------------------------------------------------------------
+// readv fallback
+//-----------------------------------------------------------------------------
+static bool adjacent(const struct ioeng_op *a, const struct ioeng_op *b) {
+    if (a->fd != b->fd || a->opcode != b->opcode || a->opcode == IOENG_CANCEL)
+        return false;
+    // A short read in the middle of a batch would look like end of file to
+    // the operations after it, so only positioned reads are merged.
+    if (a->opcode == IOENG_READ)
+        return a->off >= 0 && b->off == a->off + (int64_t)a->len;
+    return (a->off < 0 && b->off < 0) || (a->off >= 0 && b->off == a->off + (int64_t)a->len);
+}
+
+static void readv_run(struct ioeng *e) {
+    for (int i = 0; i < e->nqueued;) {
+        if (e->slots[e->queue[i]].opcode == IOENG_CANCEL) {
+            // Nothing is ever left running to cancel.
+            e->results[e->queue[i]] = 0;
+            e->done[e->ndone++] = e->queue[i++];
+            continue;
+        }
+        int j = i + 1;
+        while (j < e->nqueued && j - i < IOV_MAX &&
+               adjacent(&e->slots[e->queue[j - 1]], &e->slots[e->queue[j]]))
+            j++;
+        struct iovec iov[IOENG_ENTRIES];
+        for (int k = i; k < j; k++) {
+            iov[k - i].iov_base = e->slots[e->queue[k]].buf;
+            iov[k - i].iov_len = e->slots[e->queue[k]].len;
+        }
+        const struct ioeng_op *first = &e->slots[e->queue[i]];
+        ssize_t n;
+        do {
+            if (first->opcode == IOENG_READ)
+                n = first->off < 0 ? readv(first->fd, iov, j - i)
+                                   : preadv(first->fd, iov, j - i, first->off);
+            else
+                n = first->off < 0 ? writev(first->fd, iov, j - i)
+                                   : pwritev(first->fd, iov, j - i, first->off);
+        } while (n < 0 && errno == EINTR);
+        e->syscalls++;
+        // Spread what one call moved over the operations it covered.
+        ssize_t err = n < 0 ? -errno : 0;
+        for (int k = i; k < j; k++) {
+            int slot = e->queue[k];
+            if (n < 0) {
+                e->results[slot] = err;
+            } else {
+                size_t len = e->slots[slot].len;
+                e->results[slot] = (size_t)n < len ? n : (ssize_t)len;
+                n -= e->results[slot];
+            }
+            e->done[e->ndone++] = slot;
+        }
+        i = j;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// ioeng
+//-----------------------------------------------------------------------------
+// Only a watched engine needs its eventfd emptied, elsewhere the count is
+// left to grow rather than pay a read for every reap.
+static void on_eventfd(struct ev_source *src, short revents) {
+    (void)revents;
+    uint64_t count;
+    if (read(src->fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        return;
+    ioeng_reap(src->arg, false);
+}
+
+int ioeng_init(struct ioeng *e, bool uring) {
+    memset(e, 0, sizeof(*e));
+    e->ring_fd = -1;
+    e->efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (e->efd < 0)
+        return -1;
+    e->backend = uring && uring_init(e) == 0 ? IOENG_URING : IOENG_READV;
+    for (int i = 0; i < IOENG_ENTRIES; i++)
+        e->free_slots[i] = IOENG_ENTRIES - 1 - i;
+    e->nfree = IOENG_ENTRIES;
+    e->src = (struct ev_source){e->efd, POLLIN, on_eventfd, e};
+    return 0;
+}
+
+void ioeng_destroy(struct ioeng *e) {
+    if (e->efd < 0)
+        return;
+    ioeng_drain(e);
+    if (e->backend == IOENG_URING) {
+        uring_unmap(e);
+        close(e->ring_fd);
+    }
+    close(e->efd);
+    e->efd = -1;
+    e->ring_fd = -1;
+}
+
+int ioeng_queue(struct ioeng *e, const struct ioeng_op *op) {
+    if (e->nfree == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    int slot = e->free_slots[--e->nfree];
+    e->slots[slot] = *op;
+    e->queue[e->nqueued++] = slot;
+    return 0;
+}
+
+int ioeng_submit(struct ioeng *e) {
+    int n = e->nqueued;
+    if (n == 0)
+        return 0;
+    if (e->backend == IOENG_READV) {
+        readv_run(e);
+        // The operations already ran, a full eventfd only means the loop
+        // has yet to notice earlier completions.
+        uint64_t one = 1;
+        ssize_t w = write(e->efd, &one, sizeof(one));
+        (void)w;
+    } else {
+        unsigned tail = *e->sq_tail;
+        for (int i = 0; i < n; i++)
+            uring_push(e, e->queue[i]);
+        int r;
+        while ((r = uring_enter(e->ring_fd, (unsigned)n, 0, 0)) < 0 && errno == EINTR)
+            ;
+        e->syscalls++;
+        if (r < 0) {
+            // The kernel took none of them. They stay queued, so take them
+            // back off the ring or the next submit would push them twice.
+            __atomic_store_n(e->sq_tail, tail, __ATOMIC_RELEASE);
+            return -1;
+        }
+    }
+    e->nqueued = 0;
+    e->inflight += n;
+    e->ops += (uint64_t)n;
+    return n;
+}
+
+int ioeng_reap(struct ioeng *e, bool wait) {
+    if (e->backend == IOENG_URING) {
+        uring_collect(e);
+        while (wait && e->ndone == 0 && e->inflight > 0) {
+            int r = uring_enter(e->ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+            e->syscalls++;
+            if (r < 0 && errno != EINTR)
+                return -1;
+            uring_collect(e);
+        }
+    }
+    // done may be refilled by callbacks that submit more, those are left
+    // for the next call.
+    int n = e->ndone;
+    int batch[IOENG_ENTRIES];
+    memcpy(batch, e->done, n * sizeof(int));
+    e->ndone = 0;
+    for (int i = 0; i < n; i++) {
+        int slot = batch[i];
+        struct ioeng_op op = e->slots[slot];
+        e->free_slots[e->nfree++] = slot;
+        e->inflight--;
+        if (op.done)
+            op.done(op.arg, e->results[slot]);
+    }
+    return n;
+}
+
+void ioeng_drain(struct ioeng *e) {
+    while (e->nqueued > 0 || e->inflight > 0) {
+        if (ioeng_submit(e) < 0 && e->nqueued > 0) {
+            // Nothing can be submitted, fail what is left.
+            for (int i = 0; i < e->nqueued; i++) {
+                e->results[e->queue[i]] = -errno;
+                e->done[e->ndone++] = e->queue[i];
+            }
+            e->inflight += e->nqueued;
+            e->nqueued = 0;
+        }
+        if (ioeng_reap(e, true) < 0)
+            return;
+    }
+}
+
+int ioeng_watch(struct ioeng *e, struct evloop *l) {
+    return evloop_add(l, &e->src);
+}
+
+void ioeng_cancel(struct ioeng *e, int fd) {
+    struct ioeng_op op = {.opcode = IOENG_CANCEL, .fd = fd};
+    if (ioeng_queue(e, &op) == 0)
+        ioeng_drain(e);
+}
+
+//-----------------------------------------------------------------------------
+// ioeng_default
+//-----------------------------------------------------------------------------
+struct ioeng *ioeng_default(void) {
+    if (default_engine)
+        return default_owner == getpid() ? default_engine : NULL;
+    struct ioeng *e = malloc(sizeof(*e));
+    if (!e)
+        return NULL;
+    if (ioeng_init(e, true) != 0) {
+        free(e);
+        return NULL;
+    }
+    default_engine = e;
+    default_owner = getpid();
+    return e;
+}
+
+struct ioeng *ioeng_default_peek(void) {
+    return default_engine && default_owner == getpid() ? default_engine : NULL;
+}
+
+void ioeng_default_close(void) {
+    if (!default_engine || default_owner != getpid())
+        return;
+    ioeng_destroy(default_engine);
+    free(default_engine);
+    default_engine = NULL;
+}
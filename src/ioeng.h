@@ -0,0 +1,198 @@
+#ifndef IOENG_H
+#define IOENG_H
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include "evloop.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * Most operations in flight at once, queued and submitted but not yet
+   * reaped.
+   */
+#define IOENG_ENTRIES 64
+
+  /**
+   * io_uring when the kernel allows it, otherwise operations are run at
+   * submit time with one readv or writev per run of adjacent operations on
+   * the same fd.
+   */
+  enum ioeng_backend
+  {
+    IOENG_URING,
+    IOENG_READV,
+  };
+
+  /**
+   * IOENG_CANCEL stops every read and write in flight on its fd, they
+   * complete with -ECANCELED.
+   */
+  enum ioeng_opcode
+  {
+    IOENG_READ,
+    IOENG_WRITE,
+    IOENG_CANCEL,
+  };
+
+  /**
+   * Called once an operation completes with the number of bytes moved or
+   * -errno.
+   */
+  typedef void (*ioeng_fn)(void *arg, ssize_t res);
+
+  /**
+   * One read or write. off is the file offset or -1 to use and advance the
+   * fd's own position, which is the only choice for a pipe.
+   */
+  struct ioeng_op
+  {
+    enum ioeng_opcode opcode;
+    int fd;
+    void *buf;
+    size_t len;
+    int64_t off;
+    ioeng_fn done;
+    void *arg;
+  };
+
+  /**
+   * The engine. Completions are signalled on an eventfd so they can be
+   * reaped from the event loop through src.
+   */
+  struct ioeng
+  {
+    enum ioeng_backend backend;
+    int ring_fd;
+    int efd;
+    struct ev_source src;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    struct ioeng_op slots[IOENG_ENTRIES];
+    ssize_t results[IOENG_ENTRIES];
+    int free_slots[IOENG_ENTRIES];
+    int nfree;
+    int queue[IOENG_ENTRIES];
+    int nqueued;
+    int done[IOENG_ENTRIES];
+    int ndone;
+    int inflight;
+    uint64_t syscalls;
+    uint64_t ops;
+  };
+
+  /**
+   * @brief Set up an engine. With uring false, or if io_uring_setup fails,
+   * the readv backend is used.
+   *
+   * @param e The engine
+   * @param uring Try io_uring first
+   * @return 0 on success, -1 with errno set if not even the eventfd could
+   * be created
+   */
+  int ioeng_init(struct ioeng *e, bool uring);
+
+  /**
+   * @brief Wait for everything in flight, then release the ring.
+   *
+   * @param e The engine
+   */
+  void ioeng_destroy(struct ioeng *e);
+
+  /**
+   * @brief Queue an operation. Nothing reaches the kernel until
+   * ioeng_submit, the buffer must stay valid until done is called.
+   *
+   * @param e The engine
+   * @param op The operation, copied
+   * @return 0 on success, -1 with errno set to EAGAIN if IOENG_ENTRIES
+   * operations are already queued or in flight
+   */
+  int ioeng_queue(struct ioeng *e, const struct ioeng_op *op);
+
+  /**
+   * @brief Hand every queued operation to the kernel, with io_uring that
+   * is one io_uring_enter for the whole batch.
+   *
+   * @param e The engine
+   * @return The number of operations submitted or -1 with errno set
+   */
+  int ioeng_submit(struct ioeng *e);
+
+  /**
+   * @brief Call done for every completed operation.
+   *
+   * @param e The engine
+   * @param wait Block until at least one operation completes if nothing
+   * has yet and something is in flight
+   * @return The number of completions reaped
+   */
+  int ioeng_reap(struct ioeng *e, bool wait);
+
+  /**
+   * @brief Submit what is queued and reap until nothing is in flight.
+   *
+   * @param e The engine
+   */
+  void ioeng_drain(struct ioeng *e);
+
+  /**
+   * @brief Watch the engine's eventfd in an event loop, completions are
+   * reaped by the loop from then on.
+   *
+   * @param e The engine
+   * @param l The loop
+   * @return 0 on success, -1 if the loop is full
+   */
+  int ioeng_watch(struct ioeng *e, struct evloop *l);
+
+  /**
+   * @brief Cancel everything in flight on fd and reap it, for a read that
+   * may never complete such as one on a pipe nobody writes to.
+   *
+   * @param e The engine
+   * @param fd The fd
+   */
+  void ioeng_cancel(struct ioeng *e, int fd);
+
+  /**
+   * @brief The shell's engine, created on first use. A forked child gets
+   * NULL so it never touches a ring it shares with its parent.
+   *
+   * @return The engine or NULL
+   */
+  struct ioeng *ioeng_default(void);
+
+  /**
+   * @brief The shell's engine if it was already created by this process.
+   *
+   * @return The engine or NULL
+   */
+  struct ioeng *ioeng_default_peek(void);
+
+  /**
+   * @brief Destroy the shell's engine if this process created it.
+   */
+  void ioeng_default_close(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
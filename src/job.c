@@ -0,0 +1,935 @@
+#define _GNU_SOURCE
+#include "job.h"
+#include "lab.h"
+#include "parse.h"
+#include "cmdsub.h"
+#include "pathcache.h"
+#include "trace.h"
+#include "evloop.h"
+#include "ioeng.h"
+#include "jobmeter.h"
+#include "pipemeter.h"
+#include "zcopy.h"
+#include "journal.h"
+#include "spawnsrv.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+//-----------------------------------------------------------------------------
+// job_stats
+//-----------------------------------------------------------------------------
+void job_stats_add(struct job_stats *st, const struct rusage *ru) {
+    timeradd(&st->utime, &ru->ru_utime, &st->utime);
+    timeradd(&st->stime, &ru->ru_stime, &st->stime);
+    if (ru->ru_maxrss > st->maxrss_kb)
+        st->maxrss_kb = ru->ru_maxrss;
+    st->minflt += ru->ru_minflt;
+    st->majflt += ru->ru_majflt;
+    st->nvcsw += ru->ru_nvcsw;
+    st->nivcsw += ru->ru_nivcsw;
+}
+
+void job_stats_merge(struct job_stats *dst, const struct job_stats *src) {
+    dst->real_ns += src->real_ns;
+    timeradd(&dst->utime, &src->utime, &dst->utime);
+    timeradd(&dst->stime, &src->stime, &dst->stime);
+    if (src->maxrss_kb > dst->maxrss_kb)
+        dst->maxrss_kb = src->maxrss_kb;
+    dst->minflt += src->minflt;
+    dst->majflt += src->majflt;
+    dst->nvcsw += src->nvcsw;
+    dst->nivcsw += src->nivcsw;
+    dst->jobs += src->jobs;
+}
+
+static void print_time(FILE *fp, const char *label, long sec, long usec) {
+    fprintf(fp, "%s\t%ldm%ld.%03lds\n", label, sec / 60, sec % 60, usec / 1000);
+}
+
+void job_stats_print(FILE *fp, const struct job_stats *st) {
+    print_time(fp, "real", (long)(st->real_ns / 1000000000ull),
+               (long)(st->real_ns % 1000000000ull / 1000));
+    print_time(fp, "user", (long)st->utime.tv_sec, (long)st->utime.tv_usec);
+    print_time(fp, "sys", (long)st->stime.tv_sec, (long)st->stime.tv_usec);
+    fprintf(fp, "maxrss\t%ldk\n", st->maxrss_kb);
+    fprintf(fp, "faults\t%ld minor, %ld major\n", st->minflt, st->majflt);
+    fprintf(fp, "csw\t%ld voluntary, %ld involuntary\n", st->nvcsw, st->nivcsw);
+}
+
+//-----------------------------------------------------------------------------
+// explain_waitpid
+//-----------------------------------------------------------------------------
+static void explain_waitpid(int status)
+{
+    if (!WIFEXITED(status))
+    {
+        fprintf(stderr, "Child exited with status %d\n", WEXITSTATUS(status));
+    }
+
+    if (WIFSIGNALED(status))
+    {
+        fprintf(stderr, "Child exited via signal %d\n", WTERMSIG(status));
+    }
+
+    if (WIFSTOPPED(status))
+    {
+        fprintf(stderr, "Child stopped by %d\n", WSTOPSIG(status));
+    }
+
+    if (WIFCONTINUED(status))
+    {
+        fprintf(stderr, "Child was resumed by delivery of SIGCONT\n");
+    }
+}
+
+//-----------------------------------------------------------------------------
+// job_resolve
+//-----------------------------------------------------------------------------
+// Map an interned command name to a full path through the PATH cache. The
+// cache is built on first use so shells that only run builtins never pay
+// for it.
+static const char *job_resolve(struct shell *sh, const char *name) {
+    if (!name || strchr(name, '/'))
+        return NULL;
+    const char *path = getenv("PATH");
+    if (!path)
+        path = "";
+    if (!sh->pathcache || strcmp(sh->pathcache->path_env, path) != 0) {
+        pathcache_destroy(sh->pathcache);
+        char *file = pathcache_default_file();
+        sh->pathcache = pathcache_create(path, file);
+        free(file);
+    } else {
+        pathcache_refresh(sh->pathcache);
+    }
+    return pathcache_resolve(sh->pathcache, name);
+}
+
+//-----------------------------------------------------------------------------
+// job_redirect
+//-----------------------------------------------------------------------------
+// A here-string is put in a memfd rather than a pipe so it can be any size
+// without something having to write it while the command reads.
+static int here_string(const char *word) {
+    int fd = memfd_create("here-string", MFD_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    struct iovec iov[2] = {{(void *)word, strlen(word)}, {"\n", 1}};
+    if (writev(fd, iov, 2) != (ssize_t)(iov[0].iov_len + 1) || lseek(fd, 0, SEEK_SET) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Open the file of one redirection, target is set to the fd it replaces.
+static int redirect_open(const struct redir *r, int *target) {
+    *target = STDOUT_FILENO;
+    switch (r->type) {
+    case REDIR_IN:
+        *target = STDIN_FILENO;
+        return open(r->word, O_RDONLY | O_CLOEXEC);
+    case REDIR_OUT:
+        return open(r->word, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    case REDIR_APPEND:
+        return open(r->word, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+    case REDIR_HERE:
+        *target = STDIN_FILENO;
+        return here_string(r->word);
+    }
+    return -1;
+}
+
+// Apply the command's redirections to stdin and stdout in order. Returns
+// -1 after saying why if one of them could not be opened.
+static int job_redirect(const struct command *c) {
+    for (int i = 0; i < c->nredirs; i++) {
+        int target;
+        int fd = redirect_open(&c->redirs[i], &target);
+        if (fd < 0) {
+            fprintf(stderr, "%s: %s\n", c->redirs[i].word, strerror(errno));
+            return -1;
+        }
+        dup2(fd, target);
+        close(fd);
+    }
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+// job_child
+//-----------------------------------------------------------------------------
+// Runs in the forked child of one stage and never returns. in and out are
+// the pipe ends to put on stdin and stdout, or -1 to inherit the shell's.
+// Join the job's process group, the first process of the job starts it and
+// takes the terminal, and get back the signals the shell ignores.
+static void job_child_pgrp(struct shell *sh, pid_t pgid) {
+    if (!sh->shell_is_interactive)
+        return;
+    pid_t child = getpid();
+    setpgid(child, pgid ? pgid : child);
+    if (!pgid)
+        tcsetpgrp(sh->shell_terminal, child);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGTTIN, SIG_DFL);
+    signal(SIGTTOU, SIG_DFL);
+}
+
+static void job_child(struct shell *sh, const struct command *c, const char *file, pid_t pgid,
+                      int in, int out, uint64_t t_fork) {
+    char **argv = c->argv;
+    uint64_t t_child = t_fork ? trace_now() : 0;
+    job_child_pgrp(sh, pgid);
+    if (in >= 0) {
+        dup2(in, STDIN_FILENO);
+        close(in);
+    }
+    if (out >= 0) {
+        dup2(out, STDOUT_FILENO);
+        close(out);
+    }
+    if (job_redirect(c) != 0)
+        _exit(1);
+    if (c->group) {
+        // A subshell is this copy of the shell running the list, which
+        // does not hand the terminal around.
+        sh->shell_is_interactive = 0;
+        uint64_t t_list = trace_enabled() ? trace_now() : 0;
+        int status = job_run_list(sh, c->group, NULL);
+        if (t_list)
+            trace_span(TRACE_SUBSHELL, t_list, trace_now(), sh->job, argv[0]);
+        fflush(stdout);
+        _exit(status);
+    }
+    builtin_fn fn = builtin_find(argv);
+    if (fn) {
+        // A builtin in a pipeline gets a process of its own like any other
+        // stage, it cannot change the shell it was forked from.
+        int status = fn(sh, argv);
+        fflush(stdout);
+        _exit(status);
+    }
+    if (t_child)
+        trace_span(TRACE_EXEC, t_child, trace_now(), sh->job, argv[0]);
+    // A stale cache entry or a script without a #! line is handed to
+    // execvp which knows how to deal with both.
+    if (file)
+        execv(file, argv);
+    execvp(argv[0], argv);
+    fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+    _exit(127);
+}
+
+//-----------------------------------------------------------------------------
+// job_wait
+//-----------------------------------------------------------------------------
+// One stage being waited for in the event loop, its pidfd turns readable
+// when it exits.
+struct job_waiter
+{
+    struct ev_source src;
+    struct evloop *loop;
+    pid_t pid;
+    bool is_last;
+    bool reaped;
+    struct job_stats *st;
+    int *last;
+    int *remaining;
+    int *rval;
+};
+
+static void on_stage_exit(struct ev_source *src, short revents) {
+    UNUSED(revents);
+    struct job_waiter *w = src->arg;
+    struct rusage ru;
+    int status;
+    pid_t r = wait4(w->pid, &status, WNOHANG, &ru);
+    if (r == 0)
+        return;
+    if (r < 0) {
+        *w->rval = -1;
+    } else {
+        job_stats_add(w->st, &ru);
+        if (w->is_last)
+            *w->last = status;
+    }
+    evloop_del(w->loop, src);
+    close(src->fd);
+    w->reaped = true;
+    (*w->remaining)--;
+}
+
+static void reap_blocking(struct pipeline *p, int i, struct job_stats *st, int *last, int *rval) {
+    struct rusage ru;
+    int status = 0;
+    int r;
+    // A stage run by a helper thread has no process.
+    if (p->cmds[i].pid == 0)
+        return;
+    while ((r = wait4(p->cmds[i].pid, &status, 0, &ru)) == -1 && errno == EINTR)
+        ;
+    if (r == -1) {
+        *rval = -1;
+        return;
+    }
+    job_stats_add(st, &ru);
+    if (i == p->ncmds - 1)
+        *last = status;
+}
+
+// Waits in a poll loop so the job meter's timer and the pipe relays are
+// served while the job runs. Returns 1 if there is nothing for the loop to
+// do without pidfds and the caller should block in wait4 instead.
+static int job_wait_loop(struct shell *sh, struct pipeline *p, int nspawned, pid_t pgid,
+                         struct pipe_relay *relays, struct job_stats *st, int *last) {
+    struct job_waiter *w = arena_alloc(&sh->arena, nspawned * sizeof(*w));
+    struct evloop loop;
+    evloop_init(&loop);
+    int remaining = 0;
+    int active = 0;
+    int rval = 0;
+    bool pidfds = w != NULL;
+    for (int i = 0; pidfds && i < nspawned; i++) {
+        if (p->cmds[i].pid == 0) {
+            w[i] = (struct job_waiter){.src = {.fd = -1}, .reaped = true};
+            continue;
+        }
+        int fd = (int)syscall(SYS_pidfd_open, p->cmds[i].pid, 0);
+        if (fd < 0) {
+            for (int j = 0; j < i; j++)
+                if (w[j].src.fd >= 0)
+                    close(w[j].src.fd);
+            pidfds = false;
+            break;
+        }
+        w[i] = (struct job_waiter){{fd, POLLIN, on_stage_exit, &w[i]}, &loop, p->cmds[i].pid,
+                                   i == p->ncmds - 1, false, st, last, &remaining, &rval};
+    }
+    if (!pidfds && !relays)
+        return 1;
+    for (int i = 0; pidfds && i < nspawned; i++) {
+        if (w[i].reaped)
+            continue;
+        evloop_add(&loop, &w[i].src);
+        remaining++;
+    }
+
+    // A relay writing into a stage that has exited gets EPIPE, the shell
+    // must not die of the SIGPIPE that comes with it.
+    sigset_t pipe_set, saved;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    if (relays) {
+        sigprocmask(SIG_BLOCK, &pipe_set, &saved);
+        for (int i = 0; i + 1 < nspawned; i++)
+            pipe_relay_start(&relays[i], &loop, &active);
+    }
+    bool metered = sh->jobmeter &&
+                   jobmeter_start(sh->jobmeter, &loop, p, sh->shell_is_interactive ? pgid : 0) == 0;
+    // A journal write or a read ahead of the script that lands while the
+    // job runs is reaped here instead of at the next flush.
+    struct ioeng *io = ioeng_default_peek();
+    bool io_watched = io && io->inflight > 0 && ioeng_watch(io, &loop) == 0;
+    while (remaining > 0 || active > 0) {
+        if (evloop_run_once(&loop, -1) < 0) {
+            perror("poll");
+            break;
+        }
+    }
+    if (metered)
+        jobmeter_stop(sh->jobmeter, &loop);
+    if (io_watched)
+        evloop_del(&loop, &io->src);
+    if (relays) {
+        for (int i = 0; i + 1 < p->ncmds; i++)
+            pipe_relay_close(&relays[i]);
+        struct timespec zero = {0, 0};
+        while (sigtimedwait(&pipe_set, NULL, &zero) == SIGPIPE)
+            ;
+        sigprocmask(SIG_SETMASK, &saved, NULL);
+    }
+    // Whatever the loop did not reap, without pidfds or after a poll
+    // failure, is reaped blocking.
+    for (int i = 0; i < nspawned; i++) {
+        if (pidfds && w[i].reaped)
+            continue;
+        if (pidfds)
+            close(w[i].src.fd);
+        reap_blocking(p, i, st, last, &rval);
+    }
+    return rval;
+}
+
+// Reap every stage, adding its rusage to st and leaving the status of the
+// last one in last. Returns -1 if any of them could not be waited for.
+static int job_wait(struct shell *sh, struct pipeline *p, int nspawned, pid_t pgid,
+                    struct pipe_relay *relays, struct job_stats *st, int *last) {
+    struct ioeng *io = ioeng_default_peek();
+    if (sh->jobmeter || relays || (io && io->inflight > 0)) {
+        int r = job_wait_loop(sh, p, nspawned, pgid, relays, st, last);
+        if (r != 1)
+            return r;
+    }
+    int rval = 0;
+    for (int i = 0; i < nspawned; i++)
+        reap_blocking(p, i, st, last, &rval);
+    return rval;
+}
+
+//-----------------------------------------------------------------------------
+// job_thread
+//-----------------------------------------------------------------------------
+// A cat or tee stage run by a helper thread in the shell instead of a
+// process. It owns its two pipe ends and closes them when it is done, which
+// is the end of file for the next stage.
+struct job_thread
+{
+    pthread_t tid;
+    char **argv;
+    int in;
+    int out;
+    int stage;
+    int status;
+    bool started;
+    struct rusage ru;
+};
+
+static void *job_thread_main(void *arg) {
+    struct job_thread *t = arg;
+    t->status = zcopy_run(t->argv, t->in >= 0 ? t->in : STDIN_FILENO,
+                          t->out >= 0 ? t->out : STDOUT_FILENO);
+    getrusage(RUSAGE_THREAD, &t->ru);
+    if (t->in >= 0)
+        close(t->in);
+    if (t->out >= 0)
+        close(t->out);
+    return NULL;
+}
+
+// Every signal stays with the main thread, the helper only copies.
+static void job_thread_start(struct job_thread *t) {
+    sigset_t all, saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+    int err = pthread_create(&t->tid, NULL, job_thread_main, t);
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    if (err != 0) {
+        fprintf(stderr, "%s: %s\n", t->argv[0], strerror(err));
+        if (t->in >= 0)
+            close(t->in);
+        if (t->out >= 0)
+            close(t->out);
+        t->status = 1;
+        return;
+    }
+    t->started = true;
+}
+
+static void job_thread_join(struct job_thread *t, struct job_stats *st) {
+    if (!t->started)
+        return;
+    pthread_join(t->tid, NULL);
+    job_stats_add(st, &t->ru);
+}
+
+//-----------------------------------------------------------------------------
+// job_sub
+//-----------------------------------------------------------------------------
+// A running process substitution. keep is the shell's end of its pipe, the
+// one the stage opens as /dev/fd/N.
+struct job_sub
+{
+    pid_t pid;
+    int keep;
+    int stage;
+};
+
+// The body of a process substitution runs in a forked copy of the shell
+// with one end of the pipe as its stdin or stdout.
+static void job_sub_child(struct shell *sh, struct pipeline *body, int fd, int target,
+                          pid_t pgid) {
+    job_child_pgrp(sh, pgid);
+    // Only the shell itself hands the terminal around.
+    sh->shell_is_interactive = 0;
+    dup2(fd, target);
+    close(fd);
+    int status = job_run_list(sh, body, NULL);
+    fflush(stdout);
+    _exit(status);
+}
+
+// Start every process substitution of the pipeline before any stage, so
+// none of them holds a pipe between stages open. Returns how many started.
+static int job_subs_start(struct shell *sh, struct pipeline *p, struct job_sub *subs,
+                          pid_t *pgid) {
+    int n = 0;
+    for (int i = 0; i < p->ncmds; i++) {
+        struct command *c = &p->cmds[i];
+        for (int k = 0; k < c->nsubs; k++) {
+            const struct procsub *ps = &c->subs[k];
+            char *path = arena_alloc(&sh->arena, 32);
+            int fds[2];
+            if (!path || pipe2(fds, O_CLOEXEC) != 0) {
+                perror("pipe");
+                return n;
+            }
+            int keep = ps->out ? fds[1] : fds[0];
+            int give = ps->out ? fds[0] : fds[1];
+            pid_t pid = fork();
+            if (pid == 0) {
+                for (int j = 0; j < n; j++)
+                    close(subs[j].keep);
+                close(keep);
+                job_sub_child(sh, ps->body, give, ps->out ? STDIN_FILENO : STDOUT_FILENO, *pgid);
+            } else if (pid < 0) {
+                perror("fork");
+                close(keep);
+                close(give);
+                return n;
+            }
+            if (!*pgid)
+                *pgid = pid;
+            if (sh->shell_is_interactive) {
+                setpgid(pid, *pgid);
+                if (pid == *pgid)
+                    tcsetpgrp(sh->shell_terminal, *pgid);
+            }
+            close(give);
+            snprintf(path, 32, "/dev/fd/%d", keep);
+            c->argv[ps->argi] = path;
+            subs[n++] = (struct job_sub){pid, keep, i};
+        }
+    }
+    return n;
+}
+
+// Reap the substitutions once the stages are done. Their pipes are closed
+// by then, so a reader sees end of file and a writer gets EPIPE.
+static void job_subs_wait(struct job_sub *subs, int n, struct job_stats *st) {
+    for (int i = 0; i < n; i++) {
+        int status;
+        struct rusage ru;
+        pid_t r;
+        while ((r = wait4(subs[i].pid, &status, 0, &ru)) < 0 && errno == EINTR)
+            ;
+        if (r == subs[i].pid)
+            job_stats_add(st, &ru);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// job_remote
+//-----------------------------------------------------------------------------
+// Have the spawn server start an external stage. The shell opens the
+// redirections itself and hands over the fds the stage ends up with, the
+// cwd and the environment. Returns -1 for the caller to fork instead,
+// which also reports any redirection that failed.
+static pid_t job_remote(struct shell *sh, const struct command *c, const char *file, pid_t pgid,
+                        int in, int out, const struct job_sub *subs, int nsubs, int stage) {
+    int fds[SPAWNSRV_MAX_FDS] = {in >= 0 ? in : STDIN_FILENO, out >= 0 ? out : STDOUT_FILENO,
+                                 STDERR_FILENO};
+    int targets[SPAWNSRV_MAX_FDS] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    int opened[SPAWNSRV_MAX_FDS];
+    int nfds = 3;
+    int nopened = 0;
+    pid_t pid = -1;
+    for (int i = 0; i < c->nredirs; i++) {
+        int target;
+        int fd = redirect_open(&c->redirs[i], &target);
+        if (fd < 0)
+            goto out;
+        opened[nopened++] = fd;
+        fds[target] = fd;
+    }
+    // The stage's own substitutions keep the numbers its /dev/fd paths name.
+    for (int j = 0; j < nsubs; j++) {
+        if (subs[j].stage != stage)
+            continue;
+        if (nfds == SPAWNSRV_MAX_FDS - 1)
+            goto out;
+        fds[nfds] = subs[j].keep;
+        targets[nfds++] = subs[j].keep;
+    }
+    int cwd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (cwd < 0)
+        goto out;
+    pid = spawnsrv_spawn(file, c->argv, environ, fds, targets, nfds, cwd, pgid,
+                         sh->shell_is_interactive);
+    close(cwd);
+out:
+    for (int i = 0; i < nopened; i++)
+        close(opened[i]);
+    return pid;
+}
+
+//-----------------------------------------------------------------------------
+// job_pipe
+//-----------------------------------------------------------------------------
+int job_pipe_max(void) {
+    static int max;
+    if (max)
+        return max;
+    max = 1 << 20;
+    FILE *fp = fopen("/proc/sys/fs/pipe-max-size", "re");
+    if (fp) {
+        int v;
+        if (fscanf(fp, "%d", &v) == 1 && v > 0)
+            max = v;
+        fclose(fp);
+    }
+    return max;
+}
+
+// Close on exec keeps every other stage's pipe ends out of the children,
+// dup2 clears the flag on the copies that matter. A buffer the kernel
+// refuses to grow, past the per-user page limit, is left at the default.
+static int job_pipe(int fds[2], int size) {
+    if (pipe2(fds, O_CLOEXEC) != 0)
+        return -1;
+    if (size > 0)
+        fcntl(fds[1], F_SETPIPE_SZ, size);
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+// job_spawn
+//-----------------------------------------------------------------------------
+int job_spawn(struct shell *sh, struct pipeline *p) {
+    // Builtin output still sitting in our buffer must come out before
+    // anything the children write.
+    fflush(stdout);
+    struct job_stats st = {0};
+    st.jobs = 1;
+    uint64_t start = now_ns();
+    uint64_t t_fork = trace_enabled() ? trace_now() : 0;
+
+    // With the pipe meter on every link is two pipes with the shell
+    // splicing from one to the other.
+    struct pipe_relay *relays = NULL;
+    if (sh->pipemeter && p->ncmds > 1 && 2 * p->ncmds < EVLOOP_MAX)
+        relays = arena_alloc(&sh->arena, (p->ncmds - 1) * sizeof(*relays));
+
+    // cat and tee stages are copied by helper threads, started once every
+    // process is forked.
+    struct job_thread *threads = NULL;
+    int nthreads = 0;
+    if (p->ncmds > 1)
+        threads = arena_alloc(&sh->arena, p->ncmds * sizeof(*threads));
+
+    // Bigger buffers mean fewer switches between stages moving lots of
+    // data, the pipeline's own pipesize=N wins over set -o pipesize.
+    int pipesize = p->pipesize ? p->pipesize : sh->pipesize;
+    if (pipesize > job_pipe_max())
+        pipesize = job_pipe_max();
+
+    // Process substitutions start first, each with a pipe whose far end is
+    // its stdin or stdout. The near ends are closed by the shell once every
+    // stage has its copy.
+    pid_t pgid = 0;
+    int nsubs = 0;
+    for (int i = 0; i < p->ncmds; i++)
+        nsubs += p->cmds[i].nsubs;
+    struct job_sub *subs = nsubs ? arena_alloc(&sh->arena, nsubs * sizeof(*subs)) : NULL;
+    if (nsubs) {
+        int started = subs ? job_subs_start(sh, p, subs, &pgid) : 0;
+        if (started < nsubs) {
+            for (int j = 0; j < started; j++)
+                close(subs[j].keep);
+            job_subs_wait(subs, started, &st);
+            if (sh->shell_is_interactive && pgid)
+                tcsetpgrp(sh->shell_terminal, sh->shell_pgid);
+            return 1;
+        }
+    }
+
+    int in = -1;
+    int nspawned = 0;
+    int nrelays = 0;
+    for (int i = 0; i < p->ncmds; i++) {
+        int fds[2] = {-1, -1};
+        if (i + 1 < p->ncmds && job_pipe(fds, pipesize) != 0) {
+            perror("pipe");
+            break;
+        }
+        if (relays && fds[0] >= 0) {
+            int down[2];
+            if (job_pipe(down, pipesize) != 0) {
+                perror("pipe");
+                close(fds[0]);
+                close(fds[1]);
+                break;
+            }
+            pipe_relay_init(&relays[nrelays++], fds[0], down[1]);
+            fds[0] = down[0];
+        }
+        char **argv = p->cmds[i].argv;
+        if (threads && !p->cmds[i].nredirs && !p->cmds[i].nsubs &&
+            zcopy_handles(argv, in >= 0 ? ZCOPY_STAGE_PIPE : STDIN_FILENO)) {
+            threads[nthreads++] = (struct job_thread){.argv = argv, .in = in, .out = fds[1],
+                                                      .stage = i};
+            p->cmds[nspawned++].pid = 0;
+            in = fds[0];
+            continue;
+        }
+        const char *file = p->cmds[i].group ? NULL : job_resolve(sh, argv[0]);
+        uint64_t t_stage = t_fork ? trace_now() : 0;
+        // An external command can come from the small spawn server instead
+        // of a fork of this shell, a builtin or subshell needs the shell.
+        pid_t pid = -1;
+        if (spawnsrv_running() && !p->cmds[i].group && !builtin_find(argv))
+            pid = job_remote(sh, &p->cmds[i], file, pgid, in, fds[1], subs, nsubs, i);
+        if (pid < 0)
+            pid = fork();
+        if (pid == 0) {
+            if (fds[0] >= 0)
+                close(fds[0]);
+            // Only matters for a builtin stage, which never execs.
+            for (int j = 0; j < nrelays; j++) {
+                close(relays[j].in.fd);
+                close(relays[j].out.fd);
+            }
+            for (int j = 0; j < nthreads; j++) {
+                if (threads[j].in >= 0)
+                    close(threads[j].in);
+                if (threads[j].out >= 0)
+                    close(threads[j].out);
+            }
+            // The stage's own substitutions must survive exec.
+            for (int j = 0; j < nsubs; j++) {
+                if (subs[j].stage == i)
+                    fcntl(subs[j].keep, F_SETFD, 0);
+                else
+                    close(subs[j].keep);
+            }
+            job_child(sh, &p->cmds[i], file, pgid, in, fds[1], t_stage);
+        } else if (pid < 0) {
+            // If fork failed we are in trouble!
+            perror("fork return < 0 Process creation failed!");
+            abort();
+        }
+        /*
+        This is in the parent put the child process into its
+        process group and give it control of the terminal
+        to avoid a race condition
+        */
+        if (!pgid)
+            pgid = pid;
+        if (sh->shell_is_interactive) {
+            setpgid(pid, pgid);
+            if (pid == pgid)
+                tcsetpgrp(sh->shell_terminal, pgid);
+        }
+        if (t_stage)
+            trace_span(TRACE_SPAWN, t_stage, trace_now(), sh->job, argv[0]);
+        p->cmds[nspawned++].pid = pid;
+        if (in >= 0)
+            close(in);
+        if (fds[1] >= 0)
+            close(fds[1]);
+        in = fds[0];
+    }
+    if (in >= 0)
+        close(in);
+    for (int j = 0; j < nsubs; j++)
+        close(subs[j].keep);
+    for (int j = 0; j < nthreads; j++)
+        job_thread_start(&threads[j]);
+
+    uint64_t t_wait = t_fork ? trace_now() : 0;
+    int last = 0;
+    if (relays && nrelays < p->ncmds - 1) {
+        // A stage could not be started, the links that were made are
+        // closed so the stages on either side see end of file.
+        for (int j = 0; j < nrelays; j++)
+            pipe_relay_close(&relays[j]);
+        relays = NULL;
+    }
+    int rval = job_wait(sh, p, nspawned, pgid, relays, &st, &last);
+    for (int j = 0; j < nthreads; j++) {
+        job_thread_join(&threads[j], &st);
+        if (threads[j].stage == p->ncmds - 1)
+            last = W_EXITCODE(threads[j].status, 0);
+    }
+    job_subs_wait(subs, nsubs, &st);
+    if (relays)
+        pipe_relay_report(stderr, p, relays);
+    if (t_wait)
+        trace_span(TRACE_WAIT, t_wait, trace_now(), sh->job, p->cmds[0].argv[0]);
+    if (sh->shell_is_interactive && pgid) {
+        // get control of the shell
+        tcsetpgrp(sh->shell_terminal, sh->shell_pgid);
+    }
+    st.real_ns = now_ns() - start;
+    sh->last_job = st;
+    job_stats_merge(&sh->totals, &st);
+    if (t_fork && p->ncmds > 1)
+        trace_span(TRACE_PIPELINE, t_fork, trace_now(), sh->job, p->cmds[0].argv[0]);
+
+    if (rval == -1 || nspawned < p->ncmds) {
+        fprintf(stderr, "Wait pid failed with -1\n");
+        explain_waitpid(last);
+        return -1;
+    }
+    if (WIFSIGNALED(last))
+        return 128 + WTERMSIG(last);
+    return WEXITSTATUS(last);
+}
+
+//-----------------------------------------------------------------------------
+// job_run
+//-----------------------------------------------------------------------------
+// Run a builtin in the shell. Its redirections are applied to the shell's
+// own stdin and stdout, which are put back afterwards.
+static int job_builtin(struct shell *sh, const struct command *c, builtin_fn fn) {
+    if (!c->nredirs)
+        return fn(sh, c->argv);
+    fflush(stdout);
+    int saved_in = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+    int saved_out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+    int status = 1;
+    if (job_redirect(c) == 0)
+        status = fn(sh, c->argv);
+    fflush(stdout);
+    if (saved_in >= 0) {
+        dup2(saved_in, STDIN_FILENO);
+        close(saved_in);
+    }
+    if (saved_out >= 0) {
+        dup2(saved_out, STDOUT_FILENO);
+        close(saved_out);
+    }
+    return status;
+}
+
+// A subshell can run in the shell when every command of its list is a
+// builtin that only changes what job_subshell puts back. Anything that
+// forks anyway, or could be interrupted on its own, gets a real subshell.
+static bool job_local(struct pipeline *list) {
+    for (struct pipeline *p = list; p; p = p->next) {
+        const struct command *c = &p->cmds[0];
+        if (p->ncmds != 1 || c->nsubs || c->expand)
+            return false;
+        if (c->group ? !job_local(c->group) : !builtin_find_local(c->argv))
+            return false;
+    }
+    return true;
+}
+
+// Run a subshell without forking: save the cwd and the std fds, apply the
+// subshell's redirections, run the list and put everything back.
+static int job_subshell(struct shell *sh, const struct command *c) {
+    fflush(stdout);
+    int cwd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (cwd < 0) {
+        perror("subshell");
+        return 1;
+    }
+    int saved_in = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+    int saved_out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+    int status = 1;
+    if (job_redirect(c) == 0)
+        status = job_run_list(sh, c->group, NULL);
+    fflush(stdout);
+    if (saved_in >= 0) {
+        dup2(saved_in, STDIN_FILENO);
+        close(saved_in);
+    }
+    if (saved_out >= 0) {
+        dup2(saved_out, STDOUT_FILENO);
+        close(saved_out);
+    }
+    if (fchdir(cwd) != 0)
+        perror("subshell");
+    close(cwd);
+    journal_chdir();
+    sh->subshells_local++;
+    return status;
+}
+
+int job_run(struct shell *sh, struct pipeline *p) {
+    // Substitutions run only once the pipeline is reached, after the ones
+    // before it in the list decided it runs at all.
+    for (int i = 0; i < p->ncmds; i++) {
+        if (p->cmds[i].expand && cmdsub_expand(sh, &p->cmds[i]) != 0) {
+            perror("command substitution");
+            return 1;
+        }
+    }
+    // A builtin with process substitutions is forked like any command, the
+    // /dev/fd paths only make sense in the process that has the pipes.
+    const struct command *c = &p->cmds[0];
+    builtin_fn fn = p->ncmds == 1 && !c->nsubs && !c->group ? builtin_find(c->argv) : NULL;
+    bool local = p->ncmds == 1 && !c->nsubs && c->group && job_local(c->group);
+    int status;
+    if (fn || local) {
+        // The builtin runs in the shell so its cost is whatever the shell
+        // itself used while it ran.
+        struct rusage before, after;
+        uint64_t start = 0;
+        if (p->timed) {
+            getrusage(RUSAGE_SELF, &before);
+            start = now_ns();
+        }
+        uint64_t t1 = trace_enabled() ? trace_now() : 0;
+        status = fn ? job_builtin(sh, c, fn) : job_subshell(sh, c);
+        if (t1)
+            trace_span(fn ? TRACE_BUILTIN : TRACE_SUBSHELL, t1, trace_now(), sh->job,
+                       p->cmds[0].argv[0]);
+        if (!p->timed)
+            return status;
+        getrusage(RUSAGE_SELF, &after);
+        struct job_stats st = {0};
+        st.real_ns = now_ns() - start;
+        timersub(&after.ru_utime, &before.ru_utime, &st.utime);
+        timersub(&after.ru_stime, &before.ru_stime, &st.stime);
+        st.maxrss_kb = after.ru_maxrss;
+        st.minflt = after.ru_minflt - before.ru_minflt;
+        st.majflt = after.ru_majflt - before.ru_majflt;
+        st.nvcsw = after.ru_nvcsw - before.ru_nvcsw;
+        st.nivcsw = after.ru_nivcsw - before.ru_nivcsw;
+        job_stats_print(stderr, &st);
+        return status;
+    }
+    status = job_spawn(sh, p);
+    if (p->timed)
+        job_stats_print(stderr, &sh->last_job);
+    return status;
+}
+
+int job_run_list(struct shell *sh, struct pipeline *list, int *ncmds) {
+    int status = 0;
+    for (struct pipeline *p = list; p; p = p->next) {
+        if ((p->op == LIST_AND && status != 0) || (p->op == LIST_OR && status == 0))
+            continue;
+        if (p->folded >= 0) {
+            status = p->folded;
+            sh->opt.forks++;
+            continue;
+        }
+        status = job_run(sh, p);
+        if (ncmds)
+            *ncmds += p->ncmds;
+    }
+    return status;
+}
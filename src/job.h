@@ -0,0 +1,107 @@
+#ifndef JOB_H
+#define JOB_H
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  struct shell;
+  struct pipeline;
+
+  /**
+   * Resources used by one job, or a running total of them. CPU time and
+   * the fault and context switch counts are summed over every process in
+   * the job, maxrss is the largest of them since the stages of a pipeline
+   * run side by side rather than one after another.
+   */
+  struct job_stats
+  {
+    uint64_t real_ns;
+    struct timeval utime;
+    struct timeval stime;
+    long maxrss_kb;
+    long minflt;
+    long majflt;
+    long nvcsw;
+    long nivcsw;
+    uint64_t jobs;
+  };
+
+  /**
+   * @brief Run a parsed pipeline and wait for it. A single builtin runs in
+   * the shell itself, anything else is forked with one process per stage,
+   * all in one process group. Every stage is reaped with wait4 and its
+   * rusage is recorded in sh->last_job and added to sh->totals. If the
+   * pipeline was prefixed with time the stats are printed on stderr.
+   *
+   * @param sh The shell
+   * @param p The pipeline to run, must have at least one command
+   * @return The exit status of the last stage, 128 + the signal number if
+   * it was killed, or -1 if it could not be waited for
+   */
+  int job_run(struct shell *sh, struct pipeline *p);
+
+  /**
+   * @brief Run a list of pipelines joined by && and ||, skipping the ones
+   * the previous status rules out and using the status of folded ones.
+   *
+   * @param sh The shell
+   * @param list The first pipeline of the list
+   * @param ncmds If not NULL, the number of commands run is added to it
+   * @return The status of the last pipeline that ran, 0 if none did
+   */
+  int job_run_list(struct shell *sh, struct pipeline *list, int *ncmds);
+
+  /**
+   * @brief Fork every stage of the pipeline, builtins included, and wait
+   * for all of them. This is job_run without the in process shortcut.
+   *
+   * @param sh The shell
+   * @param p The pipeline to run
+   * @return Same as job_run
+   */
+  int job_spawn(struct shell *sh, struct pipeline *p);
+
+  /**
+   * @brief The largest pipe buffer an unprivileged process may ask for,
+   * read from /proc/sys/fs/pipe-max-size the first time it is needed.
+   *
+   * @return The limit in bytes, 1MiB if it cannot be read
+   */
+  int job_pipe_max(void);
+
+  /**
+   * @brief Add the rusage of one process to st.
+   *
+   * @param st The stats to add to
+   * @param ru The rusage from wait4 or getrusage
+   */
+  void job_stats_add(struct job_stats *st, const struct rusage *ru);
+
+  /**
+   * @brief Add every field of src to dst, maxrss keeps the larger value.
+   *
+   * @param dst The running total
+   * @param src The stats of one job
+   */
+  void job_stats_merge(struct job_stats *dst, const struct job_stats *src);
+
+  /**
+   * @brief Print st the way the time keyword does, real, user and sys in
+   * the familiar 0m0.000s format followed by memory and scheduling lines.
+   *
+   * @param fp Where to print
+   * @param st The stats to print
+   */
+  void job_stats_print(FILE *fp, const struct job_stats *st);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,289 @@
+#include "jobmeter.h"
+#include "parse.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/timerfd.h>
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+//-----------------------------------------------------------------------------
+// /proc readers
+//-----------------------------------------------------------------------------
+struct proc_stat
+{
+    pid_t pgrp;
+    uint64_t ticks;
+    long rss_pages;
+};
+
+// Fields are counted from the end of the command name, which may itself
+// contain spaces and parentheses.
+static int read_stat(pid_t pid, struct proc_stat *ps) {
+    char path[64], buf[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+    size_t n = fread(buf, 1, sizeof(buf) - 1, fp);
+    fclose(fp);
+    buf[n] = '\0';
+    char *p = strrchr(buf, ')');
+    if (!p)
+        return -1;
+    char state;
+    int ppid, pgrp;
+    unsigned long long utime, stime;
+    long long cutime, cstime;
+    long rss;
+    // state ppid pgrp session tty tpgid flags minflt cminflt majflt cmajflt
+    // utime stime cutime cstime priority nice threads itrealvalue starttime
+    // vsize rss
+    if (sscanf(p + 2, "%c %d %d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %lld %lld "
+                      "%*d %*d %*d %*d %*u %*u %ld",
+               &state, &ppid, &pgrp, &utime, &stime, &cutime, &cstime, &rss) != 8)
+        return -1;
+    ps->pgrp = pgrp;
+    ps->ticks = utime + stime + (uint64_t)cutime + (uint64_t)cstime;
+    ps->rss_pages = rss;
+    return 0;
+}
+
+static void read_io(pid_t pid, uint64_t *rchar, uint64_t *wchar) {
+    char path[64], line[128];
+    snprintf(path, sizeof(path), "/proc/%d/io", (int)pid);
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return;
+    unsigned long long v;
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "rchar: %llu", &v) == 1)
+            *rchar += v;
+        else if (sscanf(line, "wchar: %llu", &v) == 1)
+            *wchar += v;
+    }
+    fclose(fp);
+}
+
+//-----------------------------------------------------------------------------
+// jobmeter_sample
+//-----------------------------------------------------------------------------
+struct collect
+{
+    struct jobmeter *m;
+    struct jm_proc *cur;
+    size_t ncur;
+    size_t cap;
+    struct jobmeter_sample *out;
+    long page_kb;
+};
+
+static uint64_t prev_ticks(const struct jobmeter *m, pid_t pid, bool *found) {
+    for (size_t i = 0; i < m->nprocs; i++) {
+        if (m->procs[i].pid == pid) {
+            *found = true;
+            return m->procs[i].ticks;
+        }
+    }
+    *found = false;
+    return 0;
+}
+
+static void add_proc(struct collect *c, pid_t pid, const struct proc_stat *ps) {
+    for (size_t i = 0; i < c->ncur; i++) {
+        if (c->cur[i].pid == pid)
+            return;
+    }
+    if (c->ncur == c->cap) {
+        size_t cap = c->cap ? c->cap * 2 : 16;
+        struct jm_proc *tmp = realloc(c->cur, cap * sizeof(*tmp));
+        if (!tmp)
+            return;
+        c->cur = tmp;
+        c->cap = cap;
+    }
+    c->cur[c->ncur].pid = pid;
+    c->cur[c->ncur].ticks = ps->ticks;
+    c->ncur++;
+    c->out->nprocs++;
+    c->out->rss_kb += ps->rss_pages * c->page_kb;
+    read_io(pid, &c->out->rchar, &c->out->wchar);
+}
+
+// Without job control the stages share the shell's process group, so the
+// job is the stages plus everything below them.
+static void add_tree(struct collect *c, pid_t pid, int depth) {
+    struct proc_stat ps;
+    if (depth > 16 || read_stat(pid, &ps) != 0)
+        return;
+    add_proc(c, pid, &ps);
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/task/%d/children", (int)pid, (int)pid);
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return;
+    int child;
+    while (fscanf(fp, "%d", &child) == 1)
+        add_tree(c, child, depth + 1);
+    fclose(fp);
+}
+
+static void add_pgrp(struct collect *c, pid_t pgid) {
+    DIR *d = opendir("/proc");
+    if (!d)
+        return;
+    struct dirent *e;
+    while ((e = readdir(d))) {
+        if (!isdigit((unsigned char)e->d_name[0]))
+            continue;
+        pid_t pid = (pid_t)atoi(e->d_name);
+        struct proc_stat ps;
+        if (read_stat(pid, &ps) == 0 && ps.pgrp == pgid)
+            add_proc(c, pid, &ps);
+    }
+    closedir(d);
+}
+
+int jobmeter_sample(struct jobmeter *m, struct jobmeter_sample *out) {
+    memset(out, 0, sizeof(*out));
+    struct collect c = {m, NULL, 0, 0, out, sysconf(_SC_PAGESIZE) / 1024};
+    if (m->pgid) {
+        add_pgrp(&c, m->pgid);
+    } else if (m->p) {
+        for (int i = 0; i < m->p->ncmds; i++) {
+            if (m->p->cmds[i].pid > 0)
+                add_tree(&c, m->p->cmds[i].pid, 0);
+        }
+    }
+    uint64_t now = now_ns();
+    uint64_t used = 0;
+    for (size_t i = 0; i < c.ncur; i++) {
+        bool found;
+        uint64_t prev = prev_ticks(m, c.cur[i].pid, &found);
+        // A process that started since the last sample counts from zero,
+        // one that was reaped in between just drops out.
+        if (c.cur[i].ticks > prev)
+            used += c.cur[i].ticks - prev;
+    }
+    double elapsed = (double)(now - m->last_ns) / 1e9;
+    double hz = (double)sysconf(_SC_CLK_TCK);
+    out->cpu_pct = m->last_ns && elapsed > 0 ? 100.0 * (double)used / hz / elapsed : 0.0;
+    free(m->procs);
+    m->procs = c.cur;
+    m->nprocs = c.ncur;
+    m->procs_cap = c.cap;
+    m->last_ns = now;
+    // A tick that lands between the last stage exiting and it being reaped
+    // finds nothing, last keeps what the job looked like while it ran.
+    if (out->nprocs)
+        m->last = *out;
+    return out->nprocs ? 0 : -1;
+}
+
+//-----------------------------------------------------------------------------
+// status line
+//-----------------------------------------------------------------------------
+static const char *human(char *buf, size_t len, double bytes) {
+    static const char units[] = "BKMGT";
+    int u = 0;
+    while (bytes >= 1024 && u < 4) {
+        bytes /= 1024;
+        u++;
+    }
+    snprintf(buf, len, u ? "%.1f%c" : "%.0f%c", bytes, units[u]);
+    return buf;
+}
+
+static void draw(struct jobmeter *m, const struct jobmeter_sample *s) {
+    char rss[16], rd[16], wr[16];
+    // A terminal gets one line that is rewritten in place, anything else
+    // gets one line per sample.
+    fprintf(stderr, "%s[jobmeter] procs %d  cpu %5.1f%%  rss %s  read %s  write %s%s",
+            m->tty ? "\r\033[K" : "", s->nprocs, s->cpu_pct,
+            human(rss, sizeof(rss), (double)s->rss_kb * 1024), human(rd, sizeof(rd), (double)s->rchar),
+            human(wr, sizeof(wr), (double)s->wchar), m->tty ? "" : "\n");
+    fflush(stderr);
+    m->drawn = true;
+}
+
+static void on_timer(struct ev_source *src, short revents) {
+    (void)revents;
+    struct jobmeter *m = src->arg;
+    uint64_t expirations;
+    if (read(m->tfd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return;
+    struct jobmeter_sample s;
+    if (jobmeter_sample(m, &s) == 0)
+        draw(m, &s);
+}
+
+//-----------------------------------------------------------------------------
+// jobmeter_create
+//-----------------------------------------------------------------------------
+struct jobmeter *jobmeter_create(unsigned interval_ms) {
+    struct jobmeter *m = calloc(1, sizeof(*m));
+    if (!m)
+        return NULL;
+    m->interval_ms = interval_ms ? interval_ms : JOBMETER_DEFAULT_MS;
+    m->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (m->tfd < 0) {
+        free(m);
+        return NULL;
+    }
+    m->src.fd = m->tfd;
+    m->src.events = POLLIN;
+    m->src.fn = on_timer;
+    m->src.arg = m;
+    m->tty = isatty(STDERR_FILENO);
+    return m;
+}
+
+void jobmeter_destroy(struct jobmeter *m) {
+    if (!m)
+        return;
+    close(m->tfd);
+    free(m->procs);
+    free(m);
+}
+
+//-----------------------------------------------------------------------------
+// jobmeter_start
+//-----------------------------------------------------------------------------
+int jobmeter_start(struct jobmeter *m, struct evloop *l, struct pipeline *p, pid_t pgid) {
+    m->p = p;
+    m->pgid = pgid;
+    m->nprocs = 0;
+    m->last_ns = 0;
+    m->drawn = false;
+    // The first sample only sets the baseline for CPU.
+    struct jobmeter_sample s;
+    jobmeter_sample(m, &s);
+    struct itimerspec its;
+    its.it_interval.tv_sec = m->interval_ms / 1000;
+    its.it_interval.tv_nsec = (long)(m->interval_ms % 1000) * 1000000;
+    its.it_value = its.it_interval;
+    if (timerfd_settime(m->tfd, 0, &its, NULL) != 0)
+        return -1;
+    return evloop_add(l, &m->src);
+}
+
+void jobmeter_stop(struct jobmeter *m, struct evloop *l) {
+    struct itimerspec off;
+    memset(&off, 0, sizeof(off));
+    timerfd_settime(m->tfd, 0, &off, NULL);
+    evloop_del(l, &m->src);
+    if (m->drawn && m->tty) {
+        fputs("\r\033[K", stderr);
+        fflush(stderr);
+    }
+    m->p = NULL;
+}
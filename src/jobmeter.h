@@ -0,0 +1,113 @@
+#ifndef JOBMETER_H
+#define JOBMETER_H
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include "evloop.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  struct pipeline;
+
+  /**
+   * Sampling interval used by set -o jobmeter without a value.
+   */
+#define JOBMETER_DEFAULT_MS 1000
+
+  /**
+   * CPU ticks of one process at the previous sample, so the next one can
+   * tell how much it used in between.
+   */
+  struct jm_proc
+  {
+    pid_t pid;
+    uint64_t ticks;
+  };
+
+  /**
+   * What one sample of the foreground job found, summed over its processes.
+   */
+  struct jobmeter_sample
+  {
+    int nprocs;
+    double cpu_pct;
+    long rss_kb;
+    uint64_t rchar;
+    uint64_t wchar;
+  };
+
+  /**
+   * Samples the foreground job from /proc on a timerfd. The timer is only
+   * armed while a job runs, between jobs the meter costs nothing.
+   */
+  struct jobmeter
+  {
+    unsigned interval_ms;
+    int tfd;
+    struct ev_source src;
+    struct pipeline *p;
+    pid_t pgid;
+    uint64_t last_ns;
+    struct jm_proc *procs;
+    size_t nprocs;
+    size_t procs_cap;
+    struct jobmeter_sample last;
+    bool tty;
+    bool drawn;
+  };
+
+  /**
+   * @brief Create a meter.
+   *
+   * @param interval_ms How often to sample, 0 for JOBMETER_DEFAULT_MS
+   * @return The meter or NULL with errno set if the timerfd could not be
+   * created
+   */
+  struct jobmeter *jobmeter_create(unsigned interval_ms);
+
+  /**
+   * @brief Close the timer and free the meter.
+   *
+   * @param m The meter, may be NULL
+   */
+  void jobmeter_destroy(struct jobmeter *m);
+
+  /**
+   * @brief Arm the timer and add it to the loop the job is waited in.
+   *
+   * @param m The meter
+   * @param l The loop
+   * @param p The job
+   * @param pgid Its process group when the shell does job control, 0 to
+   * follow the stages and their descendants instead
+   * @return 0 on success, -1 if the timer could not be armed
+   */
+  int jobmeter_start(struct jobmeter *m, struct evloop *l, struct pipeline *p, pid_t pgid);
+
+  /**
+   * @brief Disarm the timer, take it out of the loop and erase the status
+   * line.
+   *
+   * @param m The meter
+   * @param l The loop
+   */
+  void jobmeter_stop(struct jobmeter *m, struct evloop *l);
+
+  /**
+   * @brief Take one sample now. CPU is relative to the previous sample.
+   *
+   * @param m The meter
+   * @param out The sample
+   * @return 0 on success, -1 if no process of the job could be read
+   */
+  int jobmeter_sample(struct jobmeter *m, struct jobmeter_sample *out);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
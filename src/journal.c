@@ -0,0 +1,300 @@
+#include "journal.h"
+#include "forkmem.h"
+#include "job.h"
+#include "ioeng.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static int journal_fd = -1;
+static char *journal_path;
+static pid_t journal_owner;
+static char *buf;
+static size_t buf_used;
+static uint64_t cwd_id;
+
+// The buffer handed to the I/O engine while records keep filling buf. Only
+// one write is ever in flight so records reach the file in order.
+static char *spare;
+static size_t spare_len;
+static bool flushing;
+static int flush_err;
+
+// Ids whose text has already been written by this process. Zero marks an
+// empty slot so a real id of zero is stored as one.
+static uint64_t *seen;
+static size_t seen_cap;
+static size_t seen_used;
+
+//-----------------------------------------------------------------------------
+// journal_hash
+//-----------------------------------------------------------------------------
+uint64_t journal_hash(const char *s, size_t n) {
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < n; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ull;
+    }
+    return h ? h : 1;
+}
+
+static int write_all(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+// journal_open
+//-----------------------------------------------------------------------------
+int journal_open(const char *file) {
+    if (journal_fd >= 0)
+        journal_close();
+    int fd = open(file, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (st.st_size == 0 && write_all(fd, JOURNAL_MAGIC, 8) != 0)) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    // Only this process ever records, a fork leaves the buffers behind.
+    buf = forkmem_alloc(JOURNAL_BUF_SIZE);
+    spare = forkmem_alloc(JOURNAL_BUF_SIZE);
+    journal_path = strdup(file);
+    if (!buf || !spare || !journal_path) {
+        forkmem_free(buf, JOURNAL_BUF_SIZE);
+        forkmem_free(spare, JOURNAL_BUF_SIZE);
+        free(journal_path);
+        buf = spare = journal_path = NULL;
+        close(fd);
+        errno = ENOMEM;
+        return -1;
+    }
+    buf_used = 0;
+    flushing = false;
+    flush_err = 0;
+    cwd_id = 0;
+    journal_owner = getpid();
+    journal_fd = fd;
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+// journal_flush
+//-----------------------------------------------------------------------------
+static void on_flushed(void *arg, ssize_t res) {
+    (void)arg;
+    flushing = false;
+    if (res < 0) {
+        flush_err = (int)-res;
+        return;
+    }
+    // Only a full disk cuts an append short, what is left goes out now.
+    if ((size_t)res < spare_len && write_all(journal_fd, spare + res, spare_len - (size_t)res) != 0)
+        flush_err = errno;
+}
+
+static void flush_wait(struct ioeng *e) {
+    while (flushing && ioeng_reap(e, true) >= 0)
+        ;
+}
+
+// Hand the buffer to the engine and carry on recording into the spare one.
+static int flush_async(void) {
+    if (journal_fd < 0 || buf_used == 0)
+        return 0;
+    // With O_APPEND one write per flush keeps whole records together even
+    // when another shell appends to the same file.
+    struct ioeng *e = ioeng_default();
+    if (e)
+        flush_wait(e);
+    if (!e || flushing) {
+        int rval = write_all(journal_fd, buf, buf_used);
+        buf_used = 0;
+        return rval;
+    }
+    char *tmp = spare;
+    spare = buf;
+    spare_len = buf_used;
+    buf = tmp;
+    buf_used = 0;
+    struct ioeng_op op = {
+        .opcode = IOENG_WRITE,
+        .fd = journal_fd,
+        .buf = spare,
+        .len = spare_len,
+        .off = -1,
+        .done = on_flushed,
+    };
+    flushing = true;
+    if (ioeng_queue(e, &op) != 0 || ioeng_submit(e) < 0) {
+        flushing = false;
+        return write_all(journal_fd, spare, spare_len);
+    }
+    return 0;
+}
+
+int journal_flush(void) {
+    int rval = flush_async();
+    struct ioeng *e = ioeng_default();
+    if (e)
+        flush_wait(e);
+    if (flush_err) {
+        errno = flush_err;
+        flush_err = 0;
+        rval = -1;
+    }
+    return rval;
+}
+
+//-----------------------------------------------------------------------------
+// journal_close
+//-----------------------------------------------------------------------------
+int journal_close(void) {
+    if (journal_fd < 0)
+        return 0;
+    int rval = 0;
+    if (getpid() == journal_owner)
+        rval = journal_flush();
+    close(journal_fd);
+    journal_fd = -1;
+    if (getpid() == journal_owner) {
+        forkmem_free(buf, JOURNAL_BUF_SIZE);
+        forkmem_free(spare, JOURNAL_BUF_SIZE);
+    }
+    buf = spare = NULL;
+    buf_used = 0;
+    flushing = false;
+    free(journal_path);
+    journal_path = NULL;
+    free(seen);
+    seen = NULL;
+    seen_cap = seen_used = 0;
+    return rval;
+}
+
+//-----------------------------------------------------------------------------
+// journal_file
+//-----------------------------------------------------------------------------
+const char *journal_file(void) {
+    return journal_fd >= 0 ? journal_path : NULL;
+}
+
+bool journal_enabled(void) {
+    return journal_fd >= 0 && getpid() == journal_owner;
+}
+
+void journal_chdir(void) {
+    cwd_id = 0;
+}
+
+//-----------------------------------------------------------------------------
+// journal_record
+//-----------------------------------------------------------------------------
+static void *reserve(size_t n) {
+    if (buf_used + n > JOURNAL_BUF_SIZE)
+        flush_async();
+    void *p = buf + buf_used;
+    buf_used += n;
+    return p;
+}
+
+// Returns true the first time id is seen.
+static bool seen_add(uint64_t id) {
+    if (seen_used * 2 >= seen_cap) {
+        size_t cap = seen_cap ? seen_cap * 2 : 256;
+        uint64_t *tmp = calloc(cap, sizeof(*tmp));
+        if (!tmp)
+            return true;
+        for (size_t i = 0; i < seen_cap; i++) {
+            if (!seen[i])
+                continue;
+            size_t j = seen[i] & (cap - 1);
+            while (tmp[j])
+                j = (j + 1) & (cap - 1);
+            tmp[j] = seen[i];
+        }
+        free(seen);
+        seen = tmp;
+        seen_cap = cap;
+    }
+    size_t j = id & (seen_cap - 1);
+    while (seen[j]) {
+        if (seen[j] == id)
+            return false;
+        j = (j + 1) & (seen_cap - 1);
+    }
+    seen[j] = id;
+    seen_used++;
+    return true;
+}
+
+static void put_str(uint64_t id, const char *s, size_t len) {
+    if (!seen_add(id))
+        return;
+    // Anything longer than the buffer is cut short rather than split.
+    size_t max = JOURNAL_BUF_SIZE - sizeof(struct journal_str) - 8;
+    if (len > max)
+        len = max;
+    size_t padded = (len + 7) & ~(size_t)7;
+    struct journal_str *r = reserve(sizeof(*r) + padded);
+    r->type = JOURNAL_STR;
+    r->len = (uint32_t)len;
+    r->id = id;
+    char *text = (char *)(r + 1);
+    memcpy(text, s, len);
+    memset(text + len, 0, padded - len);
+}
+
+void journal_record(const char *line, uint64_t time_ns, uint64_t duration_ns, int status,
+                    const struct job_stats *st, int ncmds) {
+    if (!journal_enabled())
+        return;
+    if (!cwd_id) {
+        // The directory only changes through cd so it is looked up once
+        // and reused until journal_chdir.
+        char cwd[4096];
+        if (getcwd(cwd, sizeof(cwd))) {
+            cwd_id = journal_hash(cwd, strlen(cwd));
+            put_str(cwd_id, cwd, strlen(cwd));
+        } else {
+            cwd_id = 1;
+        }
+    }
+    size_t len = strlen(line);
+    uint64_t argv_hash = journal_hash(line, len);
+    put_str(argv_hash, line, len);
+
+    struct journal_cmd *r = reserve(sizeof(*r));
+    memset(r, 0, sizeof(*r));
+    r->type = JOURNAL_CMD;
+    r->status = status;
+    r->time_ns = time_ns;
+    r->duration_ns = duration_ns;
+    r->argv_hash = argv_hash;
+    r->cwd_id = cwd_id;
+    r->ncmds = (uint32_t)ncmds;
+    if (st) {
+        r->utime_us = (uint64_t)st->utime.tv_sec * 1000000u + (uint64_t)st->utime.tv_usec;
+        r->stime_us = (uint64_t)st->stime.tv_sec * 1000000u + (uint64_t)st->stime.tv_usec;
+        r->maxrss_kb = (uint32_t)st->maxrss_kb;
+        r->minflt = (uint32_t)st->minflt;
+        r->majflt = (uint32_t)st->majflt;
+        r->nvcsw = (uint32_t)st->nvcsw;
+        r->nivcsw = (uint32_t)st->nivcsw;
+    }
+}
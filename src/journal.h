@@ -0,0 +1,133 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  struct job_stats;
+
+  /**
+   * Every journal starts with these 8 bytes, a reader refuses anything else.
+   */
+#define JOURNAL_MAGIC "tshjrnl1"
+
+  /**
+   * Records are buffered in memory and written with one write once this
+   * many bytes are pending, when the journal is closed, or on journal_flush.
+   * A full buffer is written through the I/O engine while recording goes
+   * on into a second one.
+   */
+#define JOURNAL_BUF_SIZE (64u * 1024u)
+
+  enum journal_type
+  {
+    JOURNAL_CMD = 1,
+    JOURNAL_STR = 2,
+  };
+
+  /**
+   * One executed command line. Times are nanoseconds except the CPU times
+   * which are microseconds like rusage. argv_hash and cwd_id are 64 bit
+   * FNV-1a hashes of the line and of the working directory, the text for
+   * each is in a JOURNAL_STR record written before the first command that
+   * uses it.
+   */
+  struct journal_cmd
+  {
+    uint32_t type;
+    int32_t status;
+    uint64_t time_ns;
+    uint64_t duration_ns;
+    uint64_t argv_hash;
+    uint64_t cwd_id;
+    uint64_t utime_us;
+    uint64_t stime_us;
+    uint32_t maxrss_kb;
+    uint32_t minflt;
+    uint32_t majflt;
+    uint32_t nvcsw;
+    uint32_t nivcsw;
+    uint32_t ncmds;
+  };
+
+  /**
+   * Maps a hash to its text, followed by len bytes padded with zeros to a
+   * multiple of 8 so every record stays aligned.
+   */
+  struct journal_str
+  {
+    uint32_t type;
+    uint32_t len;
+    uint64_t id;
+  };
+
+  /**
+   * @brief Start appending to file, creating it if needed. Several shells
+   * can share one journal, records only ever reach the file whole.
+   *
+   * @param file The journal file
+   * @return 0 on success, -1 with errno set on failure
+   */
+  int journal_open(const char *file);
+
+  /**
+   * @brief Flush and close the journal. A forked child that calls this
+   * drops the buffer it inherited instead of writing it a second time.
+   *
+   * @return 0 on success, -1 if buffered records could not be written
+   */
+  int journal_close(void);
+
+  /**
+   * @brief Write out any buffered records and wait until they are in the
+   * file.
+   *
+   * @return 0 on success, -1 on a write error
+   */
+  int journal_flush(void);
+
+  /**
+   * @brief Return the journal file or NULL if journaling is off.
+   */
+  const char *journal_file(void);
+
+  /**
+   * @brief Forget the cached working directory id, called after cd so the
+   * next record looks it up again.
+   */
+  void journal_chdir(void);
+
+  /**
+   * @brief Append a record for one command line.
+   *
+   * @param line The command line as typed
+   * @param time_ns When it started, CLOCK_REALTIME in nanoseconds
+   * @param duration_ns How long it ran
+   * @param status Its exit status
+   * @param st The rusage of the job, NULL for a builtin that ran in the shell
+   * @param ncmds The number of pipeline stages
+   */
+  void journal_record(const char *line, uint64_t time_ns, uint64_t duration_ns, int status,
+                      const struct job_stats *st, int ncmds);
+
+  /**
+   * @brief 64 bit FNV-1a, exposed so tools can match ids to text.
+   */
+  uint64_t journal_hash(const char *s, size_t n);
+
+  /**
+   * @brief Check that this process records into the journal. A forked
+   * child keeps the fd but not the buffers, so it never does.
+   */
+  bool journal_enabled(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
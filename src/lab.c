@@ -1,4 +1,23 @@
 #include "lab.h"
+#include "complete.h"
+#include "pathcache.h"
+#include "dircache.h"
+#include "intern.h"
+#include "trace.h"
+#include "parse.h"
+#include "job.h"
+#include "journal.h"
+#include "metrics.h"
+#include "sysprof.h"
+#include "jobmeter.h"
+#include "zcopy.h"
+#include "optimize.h"
+#include "ioeng.h"
+#include "lineread.h"
+#include "cmdsub.h"
+#include "coproc.h"
+#include "spawnsrv.h"
+#include "shserver.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,6 +25,9 @@
 #include <signal.h>
 #include <errno.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/resource.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 
@@ -24,6 +46,9 @@ char *get_prompt(const char *env) {
 // change_dir
 //-----------------------------------------------------------------------------
 int change_dir(char **dir) {
+    // dir is the argument list for cd so the target is the second entry.
+    if (dir != NULL && *dir != NULL)
+        dir++;
     if (dir == NULL || *dir == NULL) {
         // No directory argument provided; use HOME.
         const char *home = getenv("HOME");
@@ -93,6 +118,54 @@ char **cmd_parse(const char *line) {
     return args;
 }
 
+//-----------------------------------------------------------------------------
+// cmd_parse_arena
+//-----------------------------------------------------------------------------
+// Words are sliced straight out of the line. The command name is interned
+// so repeated commands share one copy, the arguments are copied into the
+// arena and go with it. Interning them too would keep every file name a
+// long script or server ever saw.
+char **cmd_parse_arena(struct arena *a, const char *line) {
+    if (!line) return NULL;
+
+    int count = 0;
+    for (const char *p = line; *p;) {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (!*p)
+            break;
+        count++;
+        while (*p && *p != ' ' && *p != '\t')
+            p++;
+    }
+
+    char **args = arena_alloc(a, (count + 1) * sizeof(char *));
+    if (!args) return NULL;
+
+    int i = 0;
+    for (const char *p = line; *p;) {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (!*p)
+            break;
+        const char *start = p;
+        while (*p && *p != ' ' && *p != '\t')
+            p++;
+        size_t len = (size_t)(p - start);
+        // Builtin and PATH lookups depend on the command name being
+        // interned.
+        if (i == 0)
+            args[i] = (char *)intern_n(start, len);
+        else
+            args[i] = arena_strndup(a, start, len);
+        if (!args[i])
+            return NULL;
+        i++;
+    }
+    args[i] = NULL;
+    return args;
+}
+
 //-----------------------------------------------------------------------------
 // cmd_free
 //-----------------------------------------------------------------------------
@@ -128,61 +201,684 @@ char *trim_white(char *line) {
 }
 
 //-----------------------------------------------------------------------------
-// do_builtin
+// builtins
 //-----------------------------------------------------------------------------
-bool do_builtin(struct shell *sh, char **argv) {
-    if (!argv || !argv[0])
-        return false;
+// Exit built-in: terminates the shell. PART 5
+static int builtin_exit(struct shell *sh, char **argv) {
+    int exit_status = (argv[1] != NULL) ? atoi(argv[1]) : 0;
+    // A pipeline stage or subshell is a fork that shares the io_uring ring,
+    // the journal and the caches with the shell, only the shell tears them
+    // down.
+    if (getpid() != sh->pid) {
+        fflush(stdout);
+        fflush(stderr);
+        _exit(exit_status);
+    }
+    // argv belongs to the caller (usually the shell's arena) so it is
+    // released by sh_destroy rather than freed here.
+    sh_destroy(sh);  // Cleanup before exiting.
+    exit(exit_status);
+}
 
-    // Exit built-in: terminates the shell. PART 5
-    if (strcmp(argv[0], "exit") == 0) {
-        int exit_status = 0;  // Default to normal exit.
+// Change directory built-in.
+static int builtin_cd(struct shell *sh, char **argv) {
+    UNUSED(sh);
+    journal_chdir();
+    if (change_dir(argv) != 0) {
+        fprintf(stderr, "cd: failed to change directory\n");
+        return 1;
+    }
+    return 0;
+}
+
+// Echo built-in: -n leaves out the newline, any other option is left to
+// the real echo. Backslashes are printed as they are, like the real one
+// does without -e.
+static int builtin_echo(struct shell *sh, char **argv) {
+    UNUSED(sh);
+    bool newline = true;
+    int i = 1;
+    for (; argv[i] && strcmp(argv[i], "-n") == 0; i++)
+        newline = false;
+    for (int first = i; argv[i]; i++) {
+        if (i > first)
+            putchar(' ');
+        fputs(argv[i], stdout);
+    }
+    if (newline)
+        putchar('\n');
+    return 0;
+}
 
-        if (argv[1] != NULL) {
-            // Convert argument to an integer exit status.
-            exit_status = atoi(argv[1]);  
+static bool echo_handles(char **argv) {
+    for (int i = 1; argv[i] && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-n") != 0)
+            return false;
+    }
+    return true;
+}
+
+// Pwd built-in, options are left to the real pwd.
+static int builtin_pwd(struct shell *sh, char **argv) {
+    UNUSED(sh);
+    UNUSED(argv);
+    char cwd[4096];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        perror("pwd");
+        return 1;
+    }
+    puts(cwd);
+    return 0;
+}
+
+static bool pwd_handles(char **argv) {
+    return !argv[1];
+}
+
+static int builtin_history(struct shell *sh, char **argv) {
+    UNUSED(sh);
+    UNUSED(argv);
+    HIST_ENTRY **hist_list = history_list();
+    if (hist_list) {
+        for (int i = 0; hist_list[i]; i++) {
+            printf("%d  %s\n", i + history_base, hist_list[i]->line);
         }
+    }
+    return 0;
+}
+
+// Options that can be changed with set -o name[=value] and set +o name.
+struct sh_option
+{
+    const char *name;
+    int (*set)(struct shell *sh, bool on, const char *value);
+    const char *(*show)(struct shell *sh);
+};
+
+static int opt_trace_set(struct shell *sh, bool on, const char *value) {
+    UNUSED(sh);
+    if (!on)
+        return trace_close() == 0 ? 0 : 1;
+    if (!value || !*value) {
+        fprintf(stderr, "set: trace needs a file, set -o trace=/path.json\n");
+        return 1;
+    }
+    if (trace_open(value) != 0) {
+        fprintf(stderr, "set: trace: %s\n", strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+static const char *opt_trace_show(struct shell *sh) {
+    UNUSED(sh);
+    return trace_file() ? trace_file() : "off";
+}
+
+static int opt_journal_set(struct shell *sh, bool on, const char *value) {
+    UNUSED(sh);
+    if (!on)
+        return journal_close() == 0 ? 0 : 1;
+    if (!value || !*value) {
+        fprintf(stderr, "set: journal needs a file, set -o journal=/path\n");
+        return 1;
+    }
+    if (journal_open(value) != 0) {
+        fprintf(stderr, "set: journal: %s\n", strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+static const char *opt_journal_show(struct shell *sh) {
+    UNUSED(sh);
+    return journal_file() ? journal_file() : "off";
+}
+
+static int opt_metrics_set(struct shell *sh, bool on, const char *value) {
+    UNUSED(sh);
+    if (!on)
+        return metrics_close() == 0 ? 0 : 1;
+    if (!value || !*value) {
+        fprintf(stderr, "set: metrics needs a file or unix:socket, set -o metrics=/path.prom\n");
+        return 1;
+    }
+    if (metrics_open(value) != 0) {
+        fprintf(stderr, "set: metrics: %s\n", strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+static const char *opt_metrics_show(struct shell *sh) {
+    UNUSED(sh);
+    return metrics_target() ? metrics_target() : "off";
+}
+
+static int opt_jobmeter_set(struct shell *sh, bool on, const char *value) {
+    if (!on) {
+        jobmeter_destroy(sh->jobmeter);
+        sh->jobmeter = NULL;
+        return 0;
+    }
+    unsigned ms = 0;
+    if (value && *value) {
+        char *end;
+        unsigned long v = strtoul(value, &end, 10);
+        if (*end || v == 0 || v > 3600000) {
+            fprintf(stderr, "set: jobmeter: %s: interval must be 1 to 3600000 ms\n", value);
+            return 1;
+        }
+        ms = (unsigned)v;
+    }
+    jobmeter_destroy(sh->jobmeter);
+    sh->jobmeter = jobmeter_create(ms);
+    if (!sh->jobmeter) {
+        fprintf(stderr, "set: jobmeter: %s\n", strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+static const char *opt_jobmeter_show(struct shell *sh) {
+    static char buf[32];
+    if (!sh->jobmeter)
+        return "off";
+    snprintf(buf, sizeof(buf), "%ums", sh->jobmeter->interval_ms);
+    return buf;
+}
+
+static int opt_pipemeter_set(struct shell *sh, bool on, const char *value) {
+    UNUSED(value);
+    sh->pipemeter = on;
+    return 0;
+}
+
+static const char *opt_pipemeter_show(struct shell *sh) {
+    return sh->pipemeter ? "on" : "off";
+}
+
+static int opt_pipesize_set(struct shell *sh, bool on, const char *value) {
+    if (!on) {
+        sh->pipesize = 0;
+        return 0;
+    }
+    long size = value ? parse_size(value, strlen(value)) : -1;
+    if (size < 0) {
+        fprintf(stderr, "set: pipesize needs a size, set -o pipesize=1m\n");
+        return 1;
+    }
+    // Only a privileged shell may go past the limit, everyone else gets
+    // EPERM from every pipe.
+    if (size > job_pipe_max()) {
+        fprintf(stderr, "set: pipesize: %ld is over pipe-max-size, using %d\n", size,
+                job_pipe_max());
+        size = job_pipe_max();
+    }
+    sh->pipesize = (int)size;
+    return 0;
+}
+
+static const char *opt_pipesize_show(struct shell *sh) {
+    static char buf[32];
+    if (!sh->pipesize)
+        return "default";
+    snprintf(buf, sizeof(buf), "%d", sh->pipesize);
+    return buf;
+}
+
+static int opt_optimize_set(struct shell *sh, bool on, const char *value) {
+    UNUSED(value);
+    sh->optimize = on;
+    return 0;
+}
+
+static const char *opt_optimize_show(struct shell *sh) {
+    return sh->optimize ? "on" : "off";
+}
+
+static int opt_spawnserver_set(struct shell *sh, bool on, const char *value) {
+    UNUSED(sh);
+    UNUSED(value);
+    if (!on) {
+        spawnsrv_stop();
+        return 0;
+    }
+    if (spawnsrv_start() != 0) {
+        fprintf(stderr, "set: spawnserver: %s\n", strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+static const char *opt_spawnserver_show(struct shell *sh) {
+    static char buf[48];
+    UNUSED(sh);
+    if (!spawnsrv_running())
+        return "off";
+    snprintf(buf, sizeof(buf), "on, %llu spawned", (unsigned long long)spawnsrv_count());
+    return buf;
+}
 
-        if (strcmp(argv[0], "exit") == 0) {
-            int exit_status = (argv[1] != NULL) ? atoi(argv[1]) : 0;
-        
-            cmd_free(argv);  // Free arguments before exiting
-            sh_destroy(sh);  // Cleanup shell
-            exit(exit_status);
+static const struct sh_option options[] = {
+    {"trace", opt_trace_set, opt_trace_show},
+    {"journal", opt_journal_set, opt_journal_show},
+    {"metrics", opt_metrics_set, opt_metrics_show},
+    {"jobmeter", opt_jobmeter_set, opt_jobmeter_show},
+    {"pipemeter", opt_pipemeter_set, opt_pipemeter_show},
+    {"pipesize", opt_pipesize_set, opt_pipesize_show},
+    {"optimize", opt_optimize_set, opt_optimize_show},
+    {"spawnserver", opt_spawnserver_set, opt_spawnserver_show},
+};
+
+static int builtin_set(struct shell *sh, char **argv) {
+    const size_t n = sizeof(options) / sizeof(options[0]);
+    if (!argv[1] || !argv[2]) {
+        for (size_t i = 0; i < n; i++) {
+            printf("%-15s %s\n", options[i].name, options[i].show(sh));
         }
-        else if (strcmp(argv[0], "history") == 0) {
-            HIST_ENTRY **hist_list = history_list();
-            if (hist_list) {
-                for (int i = 0; hist_list[i]; i++) {
-                    printf("%d  %s\n", i + history_base, hist_list[i]->line);
+        return 0;
+    }
+    bool on = strcmp(argv[1], "-o") == 0;
+    if (!on && strcmp(argv[1], "+o") != 0) {
+        fprintf(stderr, "set: usage: set [-o|+o] option[=value]\n");
+        return 2;
+    }
+    const char *eq = strchr(argv[2], '=');
+    size_t len = eq ? (size_t)(eq - argv[2]) : strlen(argv[2]);
+    for (size_t i = 0; i < n; i++) {
+        if (strlen(options[i].name) == len && strncmp(options[i].name, argv[2], len) == 0)
+            return options[i].set(sh, on, eq ? eq + 1 : NULL);
+    }
+    fprintf(stderr, "set: %.*s: invalid option name\n", (int)len, argv[2]);
+    return 1;
+}
+
+// Times built-in: the shell's own CPU time on the first line and the total
+// for every job it has waited for on the second, -v adds memory and
+// scheduling counts for the jobs.
+static int builtin_times(struct shell *sh, char **argv) {
+    bool verbose = argv[1] && strcmp(argv[1], "-v") == 0;
+    if (argv[1] && !verbose) {
+        fprintf(stderr, "times: usage: times [-v]\n");
+        return 2;
+    }
+    struct rusage self;
+    getrusage(RUSAGE_SELF, &self);
+    const struct job_stats *t = &sh->totals;
+    printf("%ldm%ld.%03lds %ldm%ld.%03lds\n", (long)self.ru_utime.tv_sec / 60,
+           (long)self.ru_utime.tv_sec % 60, (long)self.ru_utime.tv_usec / 1000,
+           (long)self.ru_stime.tv_sec / 60, (long)self.ru_stime.tv_sec % 60,
+           (long)self.ru_stime.tv_usec / 1000);
+    printf("%ldm%ld.%03lds %ldm%ld.%03lds\n", (long)t->utime.tv_sec / 60,
+           (long)t->utime.tv_sec % 60, (long)t->utime.tv_usec / 1000,
+           (long)t->stime.tv_sec / 60, (long)t->stime.tv_sec % 60,
+           (long)t->stime.tv_usec / 1000);
+    if (verbose) {
+        printf("jobs\t%llu\n", (unsigned long long)t->jobs);
+        printf("maxrss\t%ldk\n", t->maxrss_kb);
+        printf("faults\t%ld minor, %ld major\n", t->minflt, t->majflt);
+        printf("csw\t%ld voluntary, %ld involuntary\n", t->nvcsw, t->nivcsw);
+        printf("optimized\t%llu stages removed, %llu forks saved\n",
+               (unsigned long long)sh->opt.stages, (unsigned long long)sh->opt.forks);
+        printf("subshells\t%llu run in the shell\n", (unsigned long long)sh->subshells_local);
+    }
+    return 0;
+}
+
+// Sysprof built-in: run a command under ptrace and print where its
+// syscalls went. -s traps through a seccomp filter instead and -e limits it
+// to the listed syscalls, which leaves everything else at full speed.
+static int builtin_sysprof(struct shell *sh, char **argv) {
+    struct sysprof *prof = calloc(1, sizeof(*prof));
+    if (!prof) {
+        perror("sysprof");
+        return 1;
+    }
+    prof->mode = SYSPROF_PTRACE;
+    int i = 1;
+    int rval = 2;
+    for (; argv[i] && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-s") == 0) {
+            prof->mode = SYSPROF_SECCOMP;
+        } else if (strcmp(argv[i], "-e") == 0 && argv[i + 1]) {
+            prof->mode = SYSPROF_SECCOMP;
+            char list[1024];
+            snprintf(list, sizeof(list), "%s", argv[++i]);
+            char *save;
+            for (char *name = strtok_r(list, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+                int nr = sysprof_nr(name);
+                if (nr < 0 || prof->nfilter == SYSPROF_MAX_FILTER) {
+                    fprintf(stderr, "sysprof: %s: %s\n", name,
+                            nr < 0 ? "unknown syscall" : "too many syscalls");
+                    goto out;
                 }
+                prof->filter[prof->nfilter++] = nr;
             }
-            return 1;  // Indicate built-in command was handled
+        } else {
+            break;
         }
-        
+    }
+    if (!argv[i]) {
+        fprintf(stderr, "sysprof: usage: sysprof [-s] [-e syscall,...] command [args]\n");
+        goto out;
+    }
+    rval = sysprof_run(sh, argv + i, prof);
+    sysprof_print(stderr, prof);
+out:
+    free(prof);
+    return rval;
+}
+
+// Cat and tee built-ins: the bytes are moved by the kernel without passing
+// through the shell. Only argument lists zcopy_handles accepts get here,
+// the rest run the real command. A < redirection is only applied after the
+// check, if it brought in something other than a regular file the real
+// command is started now.
+static int builtin_zcopy(struct shell *sh, char **argv) {
+    fflush(stdout);
+    if (!zcopy_handles(argv, STDIN_FILENO))
+        return sh_launch(sh, argv);
+    return zcopy_run(argv, STDIN_FILENO, STDOUT_FILENO);
+}
+
+static bool zcopy_handles_stdin(char **argv) {
+    return zcopy_handles(argv, STDIN_FILENO);
+}
 
-        sh_destroy(sh);  // Cleanup before exiting.
-        exit(exit_status);
+// Coproc built-in: coproc NAME cmd starts cmd as a coprocess, coproc NAME
+// closes its stdin and waits for it.
+static int builtin_coproc(struct shell *sh, char **argv) {
+    if (!argv[1]) {
+        fprintf(stderr, "usage: coproc NAME [command ...]\n");
+        return 2;
     }
+    if (!argv[2]) {
+        struct coproc *c = coproc_find(argv[1]);
+        if (!c) {
+            fprintf(stderr, "coproc: %s: no such coprocess\n", argv[1]);
+            return 1;
+        }
+        return coproc_close(c);
+    }
+    if (!coproc_start(argv[1], argv + 2, sh->shell_is_interactive)) {
+        fprintf(stderr, "coproc: %s: %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+// Read and write built-ins talk to a coprocess: read NAME prints its next
+// line, write NAME words sends it one. With any other first argument the
+// command in PATH runs instead.
+static int builtin_read(struct shell *sh, char **argv) {
+    UNUSED(sh);
+    int rval = coproc_read(coproc_find(argv[1]), stdout);
+    if (rval < 0)
+        fprintf(stderr, "read: %s: %s\n", argv[1], strerror(errno));
+    return rval < 0 ? 1 : rval;
+}
+
+static int builtin_write(struct shell *sh, char **argv) {
+    UNUSED(sh);
+    if (coproc_write(coproc_find(argv[1]), argv + 2) == 0)
+        return 0;
+    fprintf(stderr, "write: %s: %s\n", argv[1], strerror(errno));
+    return 1;
+}
 
-    // Change directory built-in.
-    if (strcmp(argv[0], "cd") == 0) {
-        if (change_dir(&argv[1]) != 0) {
-            fprintf(stderr, "cd: failed to change directory\n");
+static bool coproc_handles(char **argv) {
+    return argv[1] && coproc_find(argv[1]);
+}
+
+// handles is NULL for a builtin that takes any arguments, otherwise it says
+// whether these ones are for the builtin or for the command of the same
+// name in PATH. scope says how much of the shell the builtin can change.
+enum builtin_scope
+{
+    // Only prints through stdout.
+    SCOPE_PURE,
+    // Only changes the cwd and the std fds, which a subshell puts back.
+    SCOPE_LOCAL,
+    // Anything else, such as exiting or opening files for the shell.
+    SCOPE_SHELL,
+};
+
+struct builtin
+{
+    const char *name;
+    int (*fn)(struct shell *sh, char **argv);
+    bool (*handles)(char **argv);
+    const char *key;
+    enum builtin_scope scope;
+};
+
+static struct builtin builtins[] = {
+    {"exit", builtin_exit, NULL, NULL, SCOPE_SHELL},
+    {"cd", builtin_cd, NULL, NULL, SCOPE_LOCAL},
+    {"history", builtin_history, NULL, NULL, SCOPE_PURE},
+    {"set", builtin_set, NULL, NULL, SCOPE_SHELL},
+    {"times", builtin_times, NULL, NULL, SCOPE_PURE},
+    {"sysprof", builtin_sysprof, NULL, NULL, SCOPE_SHELL},
+    {"cat", builtin_zcopy, zcopy_handles_stdin, NULL, SCOPE_LOCAL},
+    {"tee", builtin_zcopy, zcopy_handles_stdin, NULL, SCOPE_LOCAL},
+    {"echo", builtin_echo, echo_handles, NULL, SCOPE_PURE},
+    {"pwd", builtin_pwd, pwd_handles, NULL, SCOPE_PURE},
+    {"coproc", builtin_coproc, NULL, NULL, SCOPE_SHELL},
+    {"read", builtin_read, coproc_handles, NULL, SCOPE_PURE},
+    {"write", builtin_write, coproc_handles, NULL, SCOPE_PURE},
+};
+
+// Names are matched by interned pointer, the table is re-interned if the
+// intern table was cleared since the last lookup.
+static const struct builtin *builtin_lookup(const char *name) {
+    static size_t epoch = (size_t)-1;
+    const size_t n = sizeof(builtins) / sizeof(builtins[0]);
+    if (epoch != intern_epoch()) {
+        for (size_t i = 0; i < n; i++) {
+            builtins[i].key = intern(builtins[i].name);
         }
-        return true;
+        epoch = intern_epoch();
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (builtins[i].key == name)
+            return &builtins[i];
     }
+    return NULL;
+}
+
+builtin_fn builtin_find(char **argv) {
+    const struct builtin *b = argv && argv[0] ? builtin_lookup(argv[0]) : NULL;
+    if (!b || (b->handles && !b->handles(argv)))
+        return NULL;
+    return b->fn;
+}
 
-    return false;
+builtin_fn builtin_find_any(char **argv) {
+    const struct builtin *b = argv && argv[0] ? builtin_lookup(argv[0]) : NULL;
+    return b ? b->fn : NULL;
 }
 
+builtin_fn builtin_find_pure(char **argv) {
+    const struct builtin *b = argv && argv[0] ? builtin_lookup(argv[0]) : NULL;
+    if (!b || b->scope != SCOPE_PURE || (b->handles && !b->handles(argv)))
+        return NULL;
+    return b->fn;
+}
+
+builtin_fn builtin_find_local(char **argv) {
+    const struct builtin *b = argv && argv[0] ? builtin_lookup(argv[0]) : NULL;
+    if (!b || b->scope == SCOPE_SHELL || (b->handles && !b->handles(argv)))
+        return NULL;
+    return b->fn;
+}
+
+//-----------------------------------------------------------------------------
+// do_builtin
+//-----------------------------------------------------------------------------
+bool do_builtin(struct shell *sh, char **argv) {
+    if (!argv || !argv[0])
+        return false;
+
+    // argv may come from anywhere so the name is looked up once, builtins
+    // are always interned so a name that is not cannot be one.
+    const char *name = intern_find(argv[0]);
+    const struct builtin *b = name ? builtin_lookup(name) : NULL;
+    if (!b || (b->handles && !b->handles(argv)))
+        return false;
+    b->fn(sh, argv);
+    return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// sh_launch
+//-----------------------------------------------------------------------------
+int sh_launch(struct shell *sh, char **argv) {
+    // A one stage pipeline, job_spawn forks it even if it names a builtin.
+    // The name is swapped for its interned copy while the job runs since
+    // that is what the PATH memo is keyed on, argv itself stays the caller's.
+    int argc = 0;
+    while (argv[argc])
+        argc++;
+    struct command cmd = {.argv = argv, .argc = argc};
+    struct pipeline p = {.cmds = &cmd, .ncmds = 1, .folded = -1};
+    char *name = argv[0];
+    if (!strchr(name, '/'))
+        argv[0] = (char *)intern(name);
+    int status = job_spawn(sh, &p);
+    argv[0] = name;
+    return status;
+}
+
+//-----------------------------------------------------------------------------
+// sh_execute
+//-----------------------------------------------------------------------------
+int sh_execute(struct shell *sh, const char *line) {
+    sh->job++;
+    uint64_t t0 = trace_enabled() ? trace_now() : 0;
+    struct pipeline *list = pipeline_parse(&sh->arena, line);
+    if (list && sh->optimize)
+        pipeline_optimize(&sh->arena, list, &sh->opt);
+    if (t0)
+        trace_span(TRACE_PARSE, t0, trace_now(), sh->job, NULL);
+    if (!list)
+        return 2;
+    if (list->ncmds == 0) {
+        if (list->timed) {
+            struct job_stats none = {0};
+            job_stats_print(stderr, &none);
+        }
+        return 0;
+    }
+    struct timespec wall, mono;
+    uint64_t jobs = sh->totals.jobs;
+    // The line that turns the journal or the metrics on is not counted.
+    bool journaled = journal_enabled();
+    bool metered = metrics_enabled();
+    if (journaled || metered) {
+        clock_gettime(CLOCK_REALTIME, &wall);
+        clock_gettime(CLOCK_MONOTONIC, &mono);
+    }
+    int ncmds = 0;
+    int status = job_run_list(sh, list, &ncmds);
+    if (t0)
+        trace_span(TRACE_COMMAND, t0, trace_now(), sh->job, list->cmds[0].argv[0]);
+    // Substituted words may point into the captures, the line is done.
+    cmdsub_release(sh);
+    journaled = journaled && journal_enabled();
+    metered = metered && metrics_enabled();
+    if (journaled || metered) {
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        uint64_t dur = (uint64_t)(end.tv_sec - mono.tv_sec) * 1000000000u +
+                       (uint64_t)end.tv_nsec - (uint64_t)mono.tv_nsec;
+        // Only a job that was forked and waited for has rusage of its own.
+        const struct job_stats *st = sh->totals.jobs != jobs ? &sh->last_job : NULL;
+        if (journaled)
+            journal_record(line, (uint64_t)wall.tv_sec * 1000000000u + (uint64_t)wall.tv_nsec,
+                           dur, status, st, ncmds);
+        if (metered)
+            metrics_command(dur, status, ncmds, st);
+    }
+    return status;
+}
+
+//-----------------------------------------------------------------------------
+// sh_read_line
+//-----------------------------------------------------------------------------
+char *sh_read_line(struct shell *sh) {
+    if (!sh->shell_is_interactive) {
+        if (!sh->input) {
+            // A script is read ahead a block at a time instead of the
+            // small reads stdio makes on a pipe.
+            struct ioeng *e = ioeng_default();
+            sh->input = e ? malloc(sizeof(*sh->input)) : NULL;
+            if (sh->input && lineread_init(sh->input, e, STDIN_FILENO) != 0) {
+                free(sh->input);
+                sh->input = NULL;
+            }
+        }
+        if (sh->input)
+            return lineread_next(sh->input, NULL);
+        ssize_t n = getline(&sh->line, &sh->line_cap, stdin);
+        if (n < 0)
+            return NULL;
+        if (n > 0 && sh->line[n - 1] == '\n')
+            sh->line[n - 1] = '\0';
+        return sh->line;
+    }
+
+    // readline always hands back a fresh allocation, copying it into the
+    // shared buffer keeps the rest of the loop independent of that.
+    char *rl = readline(sh->prompt);
+    if (!rl)
+        return NULL;
+    size_t len = strlen(rl) + 1;
+    if (len > sh->line_cap) {
+        size_t cap = sh->line_cap ? sh->line_cap : 128;
+        while (cap < len)
+            cap *= 2;
+        char *tmp = realloc(sh->line, cap);
+        if (!tmp) {
+            free(rl);
+            return NULL;
+        }
+        sh->line = tmp;
+        sh->line_cap = cap;
+    }
+    memcpy(sh->line, rl, len);
+    free(rl);
+    return sh->line;
+}
 
 //-----------------------------------------------------------------------------
 // sh_init
 //-----------------------------------------------------------------------------
 void sh_init(struct shell *sh) {
+    // The spawn server is forked first, before the shell has grown.
+    const char *spawn = getenv("TonyShellSpawnServer");
+    if (spawn && *spawn && strcmp(spawn, "0") != 0 && spawnsrv_start() != 0)
+        fprintf(stderr, "sh_init: spawn server: %s\n", strerror(errno));
+    sh->pid = getpid();
     sh->shell_terminal = STDIN_FILENO;
     sh->shell_is_interactive = isatty(sh->shell_terminal);
+    sh->pathcache = NULL;
+    sh->dircache = NULL;
+    sh->jobmeter = NULL;
+    sh->pipemeter = false;
+    sh->pipesize = 0;
+    sh->optimize = true;
+    memset(&sh->opt, 0, sizeof(sh->opt));
+    sh->subshells_local = 0;
+    sh->line = NULL;
+    sh->line_cap = 0;
+    sh->input = NULL;
+    sh->captures = NULL;
+    sh->job = 0;
+    memset(&sh->last_job, 0, sizeof(sh->last_job));
+    memset(&sh->totals, 0, sizeof(sh->totals));
+    arena_init(&sh->arena, 0);
 
     if (sh->shell_is_interactive) {
         // Block until we are in the foreground
@@ -207,10 +903,22 @@ void sh_init(struct shell *sh) {
         // Grab control of the terminal and save its attributes
         tcsetpgrp(sh->shell_terminal, sh->shell_pgid);
         tcgetattr(sh->shell_terminal, &sh->shell_tmodes);
+
+        // Only an interactive shell completes so only it pays for the trie.
+        sh_complete_init(sh);
     }
 
     // Get the prompt from the environment variable
     sh->prompt = get_prompt("TonyShellPrompt");
+
+    // Hosts that want every shell journaled or exporting metrics set these
+    // instead of running set -o in each one.
+    const char *journal = getenv("TonyShellJournal");
+    if (journal && *journal && journal_open(journal) != 0)
+        fprintf(stderr, "sh_init: journal %s: %s\n", journal, strerror(errno));
+    const char *metrics = getenv("TonyShellMetrics");
+    if (metrics && *metrics && metrics_open(metrics) != 0)
+        fprintf(stderr, "sh_init: metrics %s: %s\n", metrics, strerror(errno));
 }
 
 
@@ -220,17 +928,93 @@ void sh_init(struct shell *sh) {
 void sh_destroy(struct shell *sh) {
     if (sh->prompt) {
         free(sh->prompt);
+        sh->prompt = NULL;
+    }
+    if (sh->input) {
+        lineread_destroy(sh->input);
+        free(sh->input);
+        sh->input = NULL;
     }
+    // A trace is written out when the shell exits.
+    trace_close();
+    journal_close();
+    metrics_close();
+    // Last, the journal may still have a write in flight until its close.
+    ioeng_default_close();
+    pathcache_destroy(sh->pathcache);
+    sh->pathcache = NULL;
+    dircache_destroy(sh->dircache);
+    sh->dircache = NULL;
+    jobmeter_destroy(sh->jobmeter);
+    sh->jobmeter = NULL;
+    cmdsub_release(sh);
+    coproc_close_all();
+    spawnsrv_stop();
+    arena_destroy(&sh->arena);
+    free(sh->line);
+    sh->line = NULL;
+    sh->line_cap = 0;
     // Any other cleanup can go here.
 }
 
 //-----------------------------------------------------------------------------
 // parse_args
 //-----------------------------------------------------------------------------
-// A stub for command line argument processing. Expand as needed.
+// The server never reads its own stdin, and must not take over a terminal
+// it was started from.
+static int run_server(const char *path) {
+    int null = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (null >= 0) {
+        dup2(null, STDIN_FILENO);
+        close(null);
+    }
+    struct shell sh;
+    sh_init(&sh);
+    int rval = shserver_run(&sh, path);
+    if (rval != 0)
+        fprintf(stderr, "--server: %s: %s\n", path, strerror(errno));
+    sh_destroy(&sh);
+    return rval == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int run_client(const char *path, char **words) {
+    size_t len = 1;
+    for (int i = 0; words[i]; i++)
+        len += strlen(words[i]) + 1;
+    char *cmd = calloc(1, len);
+    if (!cmd)
+        return 126;
+    for (int i = 0; words[i]; i++) {
+        if (i > 0)
+            strcat(cmd, " ");
+        strcat(cmd, words[i]);
+    }
+    int status = -1;
+    int sock = shserver_connect(path);
+    if (sock >= 0) {
+        const int fds[] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+        status = shserver_send(sock, cmd, fds, 3);
+    }
+    if (status < 0)
+        fprintf(stderr, "--client: %s: %s\n", path, strerror(errno));
+    if (sock >= 0)
+        close(sock);
+    free(cmd);
+    return status < 0 ? 126 : status;
+}
+
 void parse_args(int argc, char **argv) {
-    UNUSED(argc);
-    UNUSED(argv);
+    if (argc < 2)
+        return;
+    bool server = strcmp(argv[1], "--server") == 0;
+    bool client = strcmp(argv[1], "--client") == 0;
+    if (!server && !client)
+        return;
+    if (argc < (server ? 3 : 4)) {
+        fprintf(stderr, "usage: %s [--server PATH | --client PATH command...]\n", argv[0]);
+        exit(2);
+    }
+    exit(server ? run_server(argv[2]) : run_client(argv[2], argv + 3));
 }
 
 
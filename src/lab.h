@@ -6,6 +6,9 @@
 #include <termios.h>
 #include <unistd.h>
 #include <signal.h>
+#include "arena.h"
+#include "job.h"
+#include "optimize.h"
 
 #define lab_VERSION_MAJOR 1
 #define lab_VERSION_MINOR 0
@@ -16,15 +19,44 @@ extern "C"
 {
 #endif
 
+  struct pathcache;
+  struct dircache;
+  struct jobmeter;
+  struct lineread;
+  struct capture;
+
   struct shell
   {
     int shell_is_interactive;
+    pid_t pid;
     pid_t shell_pgid;
     struct termios shell_tmodes;
     int shell_terminal;
     char *prompt;
+    struct pathcache *pathcache;
+    struct dircache *dircache;
+    struct arena arena;
+    char *line;
+    size_t line_cap;
+    struct lineread *input;
+    int job;
+    struct job_stats last_job;
+    struct job_stats totals;
+    struct jobmeter *jobmeter;
+    bool pipemeter;
+    int pipesize;
+    bool optimize;
+    struct opt_stats opt;
+    uint64_t subshells_local;
+    struct capture *captures;
   };
 
+  /**
+   * Every builtin takes the shell and its argument list and returns an exit
+   * status.
+   */
+  typedef int (*builtin_fn)(struct shell *sh, char **argv);
+
 
 
   /**
@@ -43,7 +75,7 @@ extern "C"
    * call chdir. With no arguments the users home directory is used as the
    * directory to change to.
    *
-   * @param dir The directory to change to
+   * @param dir The cd argument list, dir[1] is the directory to change to
    * @return  On success, zero is returned.  On error, -1 is returned, and
    * errno is set to indicate the error.
    */
@@ -61,6 +93,19 @@ extern "C"
    */
   char **cmd_parse(char const *line);
 
+  /**
+   * @brief Same as cmd_parse but the argument array is carved out of an
+   * arena instead of the heap. The command name is an interned string that
+   * must not be modified, the other words are copied into the arena.
+   * Nothing needs to be freed, the result is released by the next
+   * arena_reset.
+   *
+   * @param a The arena to allocate from
+   * @param line The line to process
+   * @return The line read in a format suitable for exec
+   */
+  char **cmd_parse_arena(struct arena *a, char const *line);
+
   /**
    * @brief Free the line that was constructed with parse_cmd
    *
@@ -93,6 +138,83 @@ extern "C"
    */
   bool do_builtin(struct shell *sh, char **argv);
 
+  /**
+   * @brief Look up the builtin that runs argv. Some builtins only take
+   * over the arguments they understand and leave the rest to the command
+   * of the same name in PATH.
+   *
+   * @param argv A command whose name is interned
+   * @return The builtin or NULL if argv is not for one
+   */
+  builtin_fn builtin_find(char **argv);
+
+  /**
+   * @brief Same as builtin_find but whatever the arguments, also for the
+   * builtins that only take over some of them. For deciding where a
+   * command runs before its arguments and fds are final.
+   *
+   * @param argv A command whose name is interned
+   * @return The builtin or NULL
+   */
+  builtin_fn builtin_find_any(char **argv);
+
+  /**
+   * @brief Same as builtin_find but only for builtins that print through
+   * stdout and change nothing in the shell, so their output can be
+   * captured by swapping stdout while they run in the shell itself.
+   *
+   * @param argv A command whose name is interned
+   * @return The builtin or NULL
+   */
+  builtin_fn builtin_find_pure(char **argv);
+
+  /**
+   * @brief Same as builtin_find but only for builtins that change nothing
+   * in the shell beyond its working directory and its stdin and stdout, so
+   * a subshell made only of them can run in the shell and put those back.
+   *
+   * @param argv A command whose name is interned
+   * @return The builtin or NULL
+   */
+  builtin_fn builtin_find_local(char **argv);
+
+  /**
+   * @brief Fork and exec argv then wait for it to finish. When the shell is
+   * interactive the child is put in its own process group and given the
+   * terminal for as long as it runs. The child is reaped with wait4 and its
+   * rusage is recorded like any other job.
+   *
+   * @param sh The shell
+   * @param argv The command to run
+   * @return The exit status of the child, 128 + the signal number if it
+   * was killed, or -1 if it could not be waited for
+   */
+  int sh_launch(struct shell *sh, char **argv);
+
+  /**
+   * @brief Run one command line. The line is parsed into the shell's arena
+   * as a pipeline, optionally prefixed with the time keyword, and either
+   * handled as a built in or launched. The caller resets the
+   * arena once it is done with the command.
+   *
+   * @param sh The shell
+   * @param line A trimmed, non empty line
+   * @return The exit status of the command
+   */
+  int sh_execute(struct shell *sh, const char *line);
+
+  /**
+   * @brief Read the next command line. Interactive shells use readline with
+   * the prompt, otherwise stdin is read in large blocks through the I/O
+   * engine, falling back to getline if that cannot be set up. Either way
+   * the result is stored in a buffer owned by the shell that is reused for
+   * every line, the caller must not free it.
+   *
+   * @param sh The shell
+   * @return The line without its newline, or NULL at end of input
+   */
+  char *sh_read_line(struct shell *sh);
+
   /**
    * @brief Initialize the shell for use. Allocate all data structures
    * Grab control of the terminal and put the shell in its own
@@ -114,7 +236,10 @@ extern "C"
   void sh_destroy(struct shell *sh);
 
   /**
-   * @brief Parse command line args from the user when the shell was launched
+   * @brief Parse command line args from the user when the shell was launched.
+   * --server PATH serves command lines on the socket PATH and
+   * --client PATH WORD... runs one line in a session of that server with
+   * our stdin, stdout and stderr. Both exit rather than return.
    *
    * @param argc Number of args
    * @param argv The arg array
@@ -0,0 +1,155 @@
+#include "lineread.h"
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+static void on_read(void *arg, ssize_t res) {
+    struct lineread_slot *s = arg;
+    struct lineread *r = s->r;
+    r->pending[s->idx] = false;
+    r->ready[s->idx] = true;
+    if (res < 0) {
+        r->err = (int)-res;
+        r->len[s->idx] = 0;
+    } else {
+        r->len[s->idx] = (size_t)res;
+    }
+}
+
+static int start_read(struct lineread *r, int idx) {
+    struct ioeng_op op = {
+        .opcode = IOENG_READ,
+        .fd = r->fd,
+        .buf = r->buf[idx],
+        .len = LINEREAD_BLOCK,
+        .off = -1,
+        .done = on_read,
+        .arg = &r->slot[idx],
+    };
+    if (ioeng_queue(r->eng, &op) != 0)
+        return -1;
+    r->pending[idx] = true;
+    r->ready[idx] = false;
+    return ioeng_submit(r->eng) < 0 ? -1 : 0;
+}
+
+//-----------------------------------------------------------------------------
+// lineread_init
+//-----------------------------------------------------------------------------
+int lineread_init(struct lineread *r, struct ioeng *eng, int fd) {
+    memset(r, 0, sizeof(*r));
+    r->eng = eng;
+    r->fd = fd;
+    r->buf[0] = malloc(LINEREAD_BLOCK);
+    r->buf[1] = malloc(LINEREAD_BLOCK);
+    if (!r->buf[0] || !r->buf[1]) {
+        free(r->buf[0]);
+        free(r->buf[1]);
+        r->buf[0] = r->buf[1] = NULL;
+        errno = ENOMEM;
+        return -1;
+    }
+    for (int i = 0; i < 2; i++)
+        r->slot[i] = (struct lineread_slot){r, i};
+    // A read left in flight on a pipe or terminal would race the commands
+    // the shell starts for their stdin. A file has all its bytes already.
+    struct stat st;
+    r->ahead = eng->backend == IOENG_URING && fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+// lineread_destroy
+//-----------------------------------------------------------------------------
+void lineread_destroy(struct lineread *r) {
+    // A read ahead may still be in flight, the buffers can only go once the
+    // kernel lets go of them. A forked child shares the ring but the read
+    // and its completion belong to the parent.
+    if ((r->pending[0] || r->pending[1]) && ioeng_default_peek() == r->eng)
+        ioeng_cancel(r->eng, r->fd);
+    free(r->buf[0]);
+    free(r->buf[1]);
+    free(r->line);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+//-----------------------------------------------------------------------------
+// lineread_next
+//-----------------------------------------------------------------------------
+// Move on to the other buffer once the current one is used up, then start
+// refilling the one just left.
+static int advance(struct lineread *r) {
+    int next = 1 - r->cur;
+    if (!r->pending[next] && !r->ready[next] && start_read(r, next) != 0)
+        return -1;
+    while (r->pending[next])
+        if (ioeng_reap(r->eng, true) < 0)
+            return -1;
+    r->ready[next] = false;
+    r->cur = next;
+    r->pos = 0;
+    if (r->err) {
+        errno = r->err;
+        return -1;
+    }
+    if (r->len[next] == 0) {
+        r->eof = true;
+        return 0;
+    }
+    if (r->ahead)
+        start_read(r, 1 - next);
+    return 0;
+}
+
+static int append(struct lineread *r, const char *p, size_t n) {
+    if (r->line_len + n + 1 > r->line_cap) {
+        size_t cap = r->line_cap ? r->line_cap : 128;
+        while (cap < r->line_len + n + 1)
+            cap *= 2;
+        char *tmp = realloc(r->line, cap);
+        if (!tmp)
+            return -1;
+        r->line = tmp;
+        r->line_cap = cap;
+    }
+    memcpy(r->line + r->line_len, p, n);
+    r->line_len += n;
+    r->line[r->line_len] = '\0';
+    return 0;
+}
+
+char *lineread_next(struct lineread *r, size_t *len) {
+    r->line_len = 0;
+    for (;;) {
+        if (r->pos < r->len[r->cur]) {
+            char *start = r->buf[r->cur] + r->pos;
+            size_t avail = r->len[r->cur] - r->pos;
+            char *nl = memchr(start, '\n', avail);
+            size_t n = nl ? (size_t)(nl - start) : avail;
+            r->pos += nl ? n + 1 : n;
+            // A line wholly inside one buffer is handed out in place.
+            if (nl && r->line_len == 0) {
+                *nl = '\0';
+                if (len)
+                    *len = n;
+                return start;
+            }
+            if (append(r, start, n) != 0)
+                return NULL;
+            if (!nl)
+                continue;
+        } else if (!r->eof && advance(r) == 0) {
+            continue;
+        } else if (!r->eof) {
+            r->eof = true;
+        }
+        // Either a newline ended a line split across buffers or the input
+        // ended, possibly without a final newline.
+        if (r->line_len == 0 && r->eof)
+            return NULL;
+        if (len)
+            *len = r->line_len;
+        return r->line;
+    }
+}
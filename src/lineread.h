@@ -0,0 +1,81 @@
+#ifndef LINEREAD_H
+#define LINEREAD_H
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include "ioeng.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * Size of each of the two read buffers.
+   */
+#define LINEREAD_BLOCK (64 * 1024)
+
+  /**
+   * Splits an fd into lines. With io_uring and a regular file the next
+   * block is already being read while the lines of the current one run.
+   * Otherwise a block is read only once the current one is used up, so the
+   * shell never blocks on input it does not need yet and never takes input
+   * from a pipe or terminal that a command it runs was meant to read.
+   */
+  struct lineread
+  {
+    struct ioeng *eng;
+    int fd;
+    char *buf[2];
+    size_t len[2];
+    bool pending[2];
+    bool ready[2];
+    int cur;
+    size_t pos;
+    bool eof;
+    bool ahead;
+    int err;
+    char *line;
+    size_t line_len;
+    size_t line_cap;
+    // Completion arguments, one per buffer.
+    struct lineread_slot
+    {
+      struct lineread *r;
+      int idx;
+    } slot[2];
+  };
+
+  /**
+   * @brief Start reading fd.
+   *
+   * @param r The reader
+   * @param eng The engine used for every read
+   * @param fd The fd to read, left open
+   * @return 0 on success, -1 with errno set on failure
+   */
+  int lineread_init(struct lineread *r, struct ioeng *eng, int fd);
+
+  /**
+   * @brief Cancel any read still in flight and free the buffers. A forked
+   * copy of the shell only frees its buffers, the read is its parent's.
+   *
+   * @param r The reader
+   */
+  void lineread_destroy(struct lineread *r);
+
+  /**
+   * @brief Get the next line without its newline. The line is valid until
+   * the next call and may point into the read buffers.
+   *
+   * @param r The reader
+   * @param len If not NULL, set to the length of the line
+   * @return The line or NULL at end of input or on error
+   */
+  char *lineread_next(struct lineread *r, size_t *len);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
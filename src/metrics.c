@@ -0,0 +1,325 @@
+#define _GNU_SOURCE
+#include "metrics.h"
+#include "job.h"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+int metrics_on;
+static struct metrics m;
+static char *metrics_path;
+static bool metrics_socket;
+static int listen_fd = -1;
+static int wake_fds[2] = {-1, -1};
+static pthread_t metrics_thread;
+static pid_t metrics_owner;
+static time_t start_time;
+
+static const uint64_t bucket_ns[METRICS_BUCKETS] = {
+    100000ull, 1000000ull, 10000000ull, 100000000ull,
+    500000000ull, 1000000000ull, 10000000000ull, 60000000000ull,
+};
+
+// There is only ever one writer, the shell, so a relaxed load and store is
+// enough and avoids a locked add on every command.
+static inline void bump(uint64_t *p, uint64_t v) {
+    __atomic_store_n(p, __atomic_load_n(p, __ATOMIC_RELAXED) + v, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t get(const uint64_t *p) {
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+//-----------------------------------------------------------------------------
+// metrics_command
+//-----------------------------------------------------------------------------
+void metrics_command(uint64_t duration_ns, int status, int ncmds, const struct job_stats *st) {
+    bump(&m.commands, 1);
+    bump(&m.duration_ns, duration_ns);
+    int b = 0;
+    while (b < METRICS_BUCKETS && duration_ns > bucket_ns[b])
+        b++;
+    bump(&m.buckets[b], 1);
+    if (status != 0)
+        bump(&m.failed, 1);
+    if (!st) {
+        bump(&m.builtins, 1);
+        return;
+    }
+    bump(&m.jobs, 1);
+    bump(&m.stages, (uint64_t)ncmds);
+    // 126 and 127 are what a stage that could not exec exits with.
+    if (status < 0 || status == 126 || status == 127)
+        bump(&m.spawn_failures, 1);
+    bump(&m.child_utime_us, (uint64_t)st->utime.tv_sec * 1000000u + (uint64_t)st->utime.tv_usec);
+    bump(&m.child_stime_us, (uint64_t)st->stime.tv_sec * 1000000u + (uint64_t)st->stime.tv_usec);
+    if ((uint64_t)st->maxrss_kb > get(&m.child_maxrss_kb))
+        __atomic_store_n(&m.child_maxrss_kb, (uint64_t)st->maxrss_kb, __ATOMIC_RELAXED);
+}
+
+//-----------------------------------------------------------------------------
+// metrics_write
+//-----------------------------------------------------------------------------
+static void counter(FILE *fp, const char *name, const char *help, uint64_t v) {
+    fprintf(fp, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", name, help, name, name,
+            (unsigned long long)v);
+}
+
+static long self_rss_bytes(void) {
+    // The second field of statm is the resident set in pages.
+    FILE *fp = fopen("/proc/self/statm", "r");
+    long size, resident = 0;
+    if (fp) {
+        if (fscanf(fp, "%ld %ld", &size, &resident) != 2)
+            resident = 0;
+        fclose(fp);
+    }
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+int metrics_write(FILE *fp) {
+    counter(fp, "tonyshell_commands_total", "Command lines executed.", get(&m.commands));
+    counter(fp, "tonyshell_builtins_total", "Command lines run as a builtin in the shell.",
+            get(&m.builtins));
+    counter(fp, "tonyshell_jobs_total", "Jobs forked and waited for.", get(&m.jobs));
+    counter(fp, "tonyshell_processes_total", "Processes forked for jobs.", get(&m.stages));
+    counter(fp, "tonyshell_spawn_failures_total", "Jobs that could not be started.",
+            get(&m.spawn_failures));
+    counter(fp, "tonyshell_failed_total", "Command lines with a non zero exit status.",
+            get(&m.failed));
+
+    fputs("# HELP tonyshell_command_duration_seconds Wall time of each command line.\n"
+          "# TYPE tonyshell_command_duration_seconds histogram\n", fp);
+    uint64_t cumulative = 0;
+    for (int b = 0; b <= METRICS_BUCKETS; b++) {
+        cumulative += get(&m.buckets[b]);
+        if (b < METRICS_BUCKETS)
+            fprintf(fp, "tonyshell_command_duration_seconds_bucket{le=\"%g\"} %llu\n",
+                    (double)bucket_ns[b] / 1e9, (unsigned long long)cumulative);
+        else
+            fprintf(fp, "tonyshell_command_duration_seconds_bucket{le=\"+Inf\"} %llu\n",
+                    (unsigned long long)cumulative);
+    }
+    fprintf(fp, "tonyshell_command_duration_seconds_sum %.9f\n",
+            (double)get(&m.duration_ns) / 1e9);
+    fprintf(fp, "tonyshell_command_duration_seconds_count %llu\n", (unsigned long long)cumulative);
+
+    fprintf(fp, "# HELP tonyshell_children_cpu_seconds_total CPU time used by jobs.\n"
+                "# TYPE tonyshell_children_cpu_seconds_total counter\n"
+                "tonyshell_children_cpu_seconds_total{mode=\"user\"} %.6f\n"
+                "tonyshell_children_cpu_seconds_total{mode=\"system\"} %.6f\n",
+            (double)get(&m.child_utime_us) / 1e6, (double)get(&m.child_stime_us) / 1e6);
+    fprintf(fp, "# HELP tonyshell_children_max_rss_bytes Largest resident set of any job.\n"
+                "# TYPE tonyshell_children_max_rss_bytes gauge\n"
+                "tonyshell_children_max_rss_bytes %llu\n",
+            (unsigned long long)get(&m.child_maxrss_kb) * 1024u);
+    fprintf(fp, "# HELP tonyshell_resident_memory_bytes Resident set of the shell.\n"
+                "# TYPE tonyshell_resident_memory_bytes gauge\n"
+                "tonyshell_resident_memory_bytes %ld\n", self_rss_bytes());
+    fprintf(fp, "# HELP tonyshell_start_time_seconds When the exporter started.\n"
+                "# TYPE tonyshell_start_time_seconds gauge\n"
+                "tonyshell_start_time_seconds %lld\n", (long long)start_time);
+    return ferror(fp) ? -1 : 0;
+}
+
+//-----------------------------------------------------------------------------
+// exporter
+//-----------------------------------------------------------------------------
+static int write_textfile(const char *file) {
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp.%d", file, (int)getpid());
+    FILE *fp = fopen(tmp, "w");
+    if (!fp)
+        return -1;
+    int rval = metrics_write(fp);
+    if (fclose(fp) != 0)
+        rval = -1;
+    // The collector only ever sees a complete file.
+    if (rval == 0 && rename(tmp, file) != 0)
+        rval = -1;
+    if (rval != 0)
+        unlink(tmp);
+    return rval;
+}
+
+static void write_all(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return;
+        p += w;
+        n -= (size_t)w;
+    }
+}
+
+static void serve(int fd) {
+    // A client gets a moment to send a request, curl --unix-socket does and
+    // gets an HTTP response, nc does not and gets the plain text.
+    char req[1024];
+    ssize_t n = 0;
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, 100) == 1)
+        n = read(fd, req, sizeof(req));
+    char *text = NULL;
+    size_t len = 0;
+    FILE *fp = open_memstream(&text, &len);
+    if (!fp)
+        return;
+    metrics_write(fp);
+    fclose(fp);
+    if (n >= 4 && memcmp(req, "GET ", 4) == 0) {
+        char hdr[128];
+        int h = snprintf(hdr, sizeof(hdr),
+                         "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                         "Content-Length: %zu\r\n\r\n", len);
+        write_all(fd, hdr, (size_t)h);
+    }
+    write_all(fd, text, len);
+    free(text);
+}
+
+static const char *metrics_file(void) {
+    return metrics_socket ? metrics_path + 5 : metrics_path;
+}
+
+static void *exporter(void *arg) {
+    (void)arg;
+    for (;;) {
+        struct pollfd pfd[2] = {{wake_fds[0], POLLIN, 0}, {listen_fd, POLLIN, 0}};
+        int r = poll(pfd, metrics_socket ? 2 : 1,
+                     metrics_socket ? -1 : METRICS_INTERVAL_SECS * 1000);
+        if (r < 0 && errno != EINTR)
+            break;
+        if (pfd[0].revents)
+            break;
+        if (!metrics_socket) {
+            if (r == 0)
+                write_textfile(metrics_file());
+        } else if (pfd[1].revents & POLLIN) {
+            int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+            if (fd >= 0) {
+                serve(fd);
+                close(fd);
+            }
+        }
+    }
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// metrics_open
+//-----------------------------------------------------------------------------
+static int listen_unix(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    // A socket left behind by a shell that did not exit cleanly is
+    // replaced, anything else at path is left alone.
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            errno = EEXIST;
+            return -1;
+        }
+        unlink(path);
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+int metrics_open(const char *target) {
+    if (metrics_on)
+        metrics_close();
+    bool sock = strncmp(target, "unix:", 5) == 0;
+    char *path = strdup(target);
+    if (!path)
+        return -1;
+    const char *file = sock ? path + 5 : path;
+    if (start_time == 0)
+        start_time = time(NULL);
+    int lfd = -1;
+    if (sock ? (lfd = listen_unix(file)) < 0 : write_textfile(file) != 0)
+        goto fail;
+    if (pipe2(wake_fds, O_CLOEXEC) != 0)
+        goto fail;
+    metrics_path = path;
+    metrics_socket = sock;
+    listen_fd = lfd;
+    int err = pthread_create(&metrics_thread, NULL, exporter, NULL);
+    if (err != 0) {
+        close(wake_fds[0]);
+        close(wake_fds[1]);
+        wake_fds[0] = wake_fds[1] = -1;
+        listen_fd = -1;
+        metrics_path = NULL;
+        errno = err;
+        goto fail;
+    }
+    metrics_owner = getpid();
+    metrics_on = 1;
+    return 0;
+
+fail:;
+    int saved = errno;
+    if (lfd >= 0) {
+        close(lfd);
+        unlink(file);
+    }
+    free(path);
+    errno = saved;
+    return -1;
+}
+
+//-----------------------------------------------------------------------------
+// metrics_close
+//-----------------------------------------------------------------------------
+int metrics_close(void) {
+    if (!metrics_on)
+        return 0;
+    metrics_on = 0;
+    int rval = 0;
+    if (getpid() == metrics_owner) {
+        write_all(wake_fds[1], "x", 1);
+        pthread_join(metrics_thread, NULL);
+        if (metrics_socket)
+            unlink(metrics_file());
+        else
+            rval = write_textfile(metrics_file());
+    }
+    close(wake_fds[0]);
+    close(wake_fds[1]);
+    wake_fds[0] = wake_fds[1] = -1;
+    if (listen_fd >= 0)
+        close(listen_fd);
+    listen_fd = -1;
+    free(metrics_path);
+    metrics_path = NULL;
+    return rval;
+}
+
+//-----------------------------------------------------------------------------
+// metrics_target
+//-----------------------------------------------------------------------------
+const char *metrics_target(void) {
+    return metrics_on ? metrics_path : NULL;
+}
@@ -0,0 +1,107 @@
+#ifndef METRICS_H
+#define METRICS_H
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  struct job_stats;
+
+  /**
+   * How often the exporter rewrites its textfile, a socket is answered as
+   * soon as a client connects.
+   */
+#define METRICS_INTERVAL_SECS 10
+
+  /**
+   * Upper bounds of the command duration histogram in seconds, a final
+   * +Inf bucket is implied.
+   */
+#define METRICS_BUCKETS 8
+
+  /**
+   * Counters the shell bumps once per command line. They are written by
+   * the shell and read by the exporter thread with relaxed atomics, so an
+   * export may see one command half counted but never a torn value.
+   */
+  struct metrics
+  {
+    uint64_t commands;
+    uint64_t builtins;
+    uint64_t jobs;
+    uint64_t stages;
+    uint64_t spawn_failures;
+    uint64_t failed;
+    uint64_t duration_ns;
+    uint64_t buckets[METRICS_BUCKETS + 1];
+    uint64_t child_utime_us;
+    uint64_t child_stime_us;
+    uint64_t child_maxrss_kb;
+  };
+
+  /**
+   * Non zero while an exporter is running, checked inline so the shell
+   * does not even read the clock for metrics when they are off.
+   */
+  extern int metrics_on;
+
+  /**
+   * @brief Start exporting. A target of the form unix:PATH listens on a
+   * Unix socket and answers every connection with the current metrics,
+   * with an HTTP header if the client sent a GET. Anything else is a
+   * Prometheus textfile rewritten every METRICS_INTERVAL_SECS through a
+   * temporary file and rename. Either way the work happens on a thread of
+   * its own.
+   *
+   * @param target The textfile or unix:PATH
+   * @return 0 on success, -1 with errno set on failure
+   */
+  int metrics_open(const char *target);
+
+  /**
+   * @brief Stop the exporter, a textfile is written one last time. A forked
+   * child that calls this only forgets the exporter, the thread is not
+   * there to stop.
+   *
+   * @return 0 on success, -1 if the final write failed
+   */
+  int metrics_close(void);
+
+  /**
+   * @brief Return the export target or NULL if metrics are off.
+   */
+  const char *metrics_target(void);
+
+  /**
+   * @brief Count one command line.
+   *
+   * @param duration_ns How long it took
+   * @param status Its exit status
+   * @param ncmds The number of pipeline stages
+   * @param st The rusage of the job, NULL for a builtin that ran in the shell
+   */
+  void metrics_command(uint64_t duration_ns, int status, int ncmds, const struct job_stats *st);
+
+  /**
+   * @brief Write the current metrics in the Prometheus text format.
+   *
+   * @param fp Where to write
+   * @return 0 on success, -1 on a write error
+   */
+  int metrics_write(FILE *fp);
+
+  static inline bool metrics_enabled(void)
+  {
+    return metrics_on != 0;
+  }
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,114 @@
+#include "optimize.h"
+#include "lab.h"
+#include "parse.h"
+#include "zcopy.h"
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static bool is(const struct command *c, const char *name) {
+    return strcmp(c->argv[0], name) == 0;
+}
+
+// Put r in front of the command's own redirections so they still win.
+static bool prepend_redir(struct arena *a, struct command *c, enum redir_type type,
+                          const char *word) {
+    struct redir *redirs = arena_alloc(a, (c->nredirs + 1) * sizeof(*redirs));
+    if (!redirs)
+        return false;
+    redirs[0].type = type;
+    redirs[0].word = word;
+    if (c->nredirs)
+        memcpy(redirs + 1, c->redirs, c->nredirs * sizeof(*redirs));
+    c->redirs = redirs;
+    c->nredirs++;
+    return true;
+}
+
+// A stage in a pipeline always runs in a fork, a builtin left on its own runs
+// in the shell. Dropping the first of two stages must not turn a cd or an
+// exit in a child into one that changes the shell. A name still to come from
+// $(...) could be any builtin, and whether one that looks at its arguments
+// or fds takes over is only known once the stage is set up.
+static bool can_drop_first(const struct pipeline *p) {
+    if (p->ncmds > 2)
+        return true;
+    const struct command *next = &p->cmds[1];
+    return p->ncmds == 2 && !next->expand && !builtin_find_any(next->argv);
+}
+
+static void drop_first(struct pipeline *p) {
+    p->cmds++;
+    p->ncmds--;
+}
+
+//-----------------------------------------------------------------------------
+// useless cat
+//-----------------------------------------------------------------------------
+static bool useless_cat(struct arena *a, struct pipeline *p, struct opt_stats *st) {
+    struct command *c = &p->cmds[0];
+    if (!can_drop_first(p) || c->argc != 2 || c->nredirs || c->nsubs || c->expand ||
+        !is(c, "cat") || c->argv[1][0] == '-')
+        return false;
+    struct stat sb;
+    if (stat(c->argv[1], &sb) != 0 || !S_ISREG(sb.st_mode) || access(c->argv[1], R_OK) != 0)
+        return false;
+    bool forked = !zcopy_handles(c->argv, STDIN_FILENO);
+    if (!prepend_redir(a, &p->cmds[1], REDIR_IN, c->argv[1]))
+        return false;
+    drop_first(p);
+    st->stages++;
+    st->forks += forked;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// echo into a pipe
+//-----------------------------------------------------------------------------
+static bool echo_pipe(struct arena *a, struct pipeline *p, struct opt_stats *st) {
+    struct command *c = &p->cmds[0];
+    if (!can_drop_first(p) || c->nredirs || c->nsubs || c->expand || !is(c, "echo") ||
+        (c->argc > 1 && c->argv[1][0] == '-'))
+        return false;
+    size_t len = 0;
+    for (int i = 1; i < c->argc; i++) {
+        if (strchr(c->argv[i], '\\'))
+            return false;
+        len += strlen(c->argv[i]) + 1;
+    }
+    char *text = arena_alloc(a, len + 1);
+    if (!text)
+        return false;
+    char *end = text;
+    for (int i = 1; i < c->argc; i++) {
+        if (i > 1)
+            *end++ = ' ';
+        size_t n = strlen(c->argv[i]);
+        memcpy(end, c->argv[i], n);
+        end += n;
+    }
+    *end = '\0';
+    if (!prepend_redir(a, &p->cmds[1], REDIR_HERE, text))
+        return false;
+    drop_first(p);
+    st->stages++;
+    st->forks++;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// pipeline_optimize
+//-----------------------------------------------------------------------------
+void pipeline_optimize(struct arena *a, struct pipeline *list, struct opt_stats *st) {
+    for (struct pipeline *p = list; p; p = p->next) {
+        if (p->ncmds == 0)
+            continue;
+        while (useless_cat(a, p, st) || echo_pipe(a, p, st))
+            ;
+        struct command *c = &p->cmds[0];
+        // A timed pipeline is kept so time has something to measure.
+        if (p->ncmds == 1 && c->argc == 1 && !c->nredirs && !p->timed &&
+            (is(c, "true") || is(c, "false")))
+            p->folded = is(c, "false");
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "arena.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  struct pipeline;
+
+  /**
+   * What the optimizer took out of the lines it was given. A stage removed
+   * as a pipe feeding the next one is a fork saved unless the stage would
+   * have run on a helper thread anyway, a folded pipeline counts as a fork
+   * saved each time the line reaches it.
+   */
+  struct opt_stats
+  {
+    uint64_t stages;
+    uint64_t forks;
+  };
+
+  /**
+   * @brief Rewrite a parsed list in place where the result is certain to
+   * behave the same:
+   *
+   * - cat FILE | cmd becomes cmd < FILE when FILE is a readable regular
+   *   file, so there is no error from cat for the redirection to change.
+   * - echo WORDS | cmd becomes cmd <<< WORDS when echo has no options and
+   *   no backslashes, which it would print the same as the here-string.
+   * - A pipeline that is just true or false gets folded to 0 or 1 and is
+   *   never run, && and || around it are decided from that.
+   *
+   * @param a The arena the list was parsed into
+   * @param list The first pipeline of the list
+   * @param st Counts of what was removed, added to
+   */
+  void pipeline_optimize(struct arena *a, struct pipeline *list, struct opt_stats *st);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
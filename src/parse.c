@@ -0,0 +1,387 @@
+#define _GNU_SOURCE
+#include "parse.h"
+#include "intern.h"
+#include <stdio.h>
+#include <limits.h>
+#include <string.h>
+
+enum token_type
+{
+    TOK_WORD,
+    TOK_PIPE,
+    TOK_AND,
+    TOK_OR,
+    TOK_LESS,
+    TOK_GREAT,
+    TOK_DGREAT,
+    TOK_TLESS,
+    TOK_AMP,
+    TOK_PSUB_IN,
+    TOK_PSUB_OUT,
+    TOK_GROUP,
+};
+
+struct token
+{
+    enum token_type type;
+    const char *start;
+    size_t len;
+    bool open;
+};
+
+// Longest first so "<<<" is not read as "<" three times.
+static const struct
+{
+    const char *text;
+    size_t len;
+    enum token_type type;
+} operators[] = {
+    {"<<<", 3, TOK_TLESS}, {"&&", 2, TOK_AND}, {"||", 2, TOK_OR}, {">>", 2, TOK_DGREAT},
+    {"|", 1, TOK_PIPE},    {"<", 1, TOK_LESS}, {">", 1, TOK_GREAT}, {"&", 1, TOK_AMP},
+};
+
+static bool is_blank(char c) {
+    return c == ' ' || c == '\t';
+}
+
+static bool is_operator(char c) {
+    return c == '|' || c == '&' || c == '<' || c == '>';
+}
+
+static bool is_psub(enum token_type type) {
+    return type == TOK_PSUB_IN || type == TOK_PSUB_OUT;
+}
+
+static bool is_redir(enum token_type type) {
+    return type == TOK_LESS || type == TOK_GREAT || type == TOK_DGREAT || type == TOK_TLESS;
+}
+
+// Skip to just past the parenthesis matching the one before p, blanks and
+// operators included. One left open takes the rest of the line.
+static const char *skip_parens(const char *p, bool *open) {
+    int depth = 1;
+    for (; *p && depth > 0; p++) {
+        if (*p == '(')
+            depth++;
+        else if (*p == ')')
+            depth--;
+    }
+    if (depth > 0)
+        *open = true;
+    return p;
+}
+
+//-----------------------------------------------------------------------------
+// lex_next
+//-----------------------------------------------------------------------------
+// Returns false at the end of the line. Operators split words even without
+// surrounding blanks so "a|b" is three tokens.
+static bool lex_next(const char **pp, struct token *t) {
+    const char *p = *pp;
+    while (is_blank(*p))
+        p++;
+    if (!*p)
+        return false;
+    t->start = p;
+    t->open = false;
+    if ((*p == '<' || *p == '>') && p[1] == '(') {
+        t->type = *p == '<' ? TOK_PSUB_IN : TOK_PSUB_OUT;
+        p = skip_parens(p + 2, &t->open);
+    } else if (*p == '(') {
+        t->type = TOK_GROUP;
+        p = skip_parens(p + 1, &t->open);
+    } else if (is_operator(*p)) {
+        for (size_t i = 0; i < sizeof(operators) / sizeof(operators[0]); i++) {
+            if (strncmp(p, operators[i].text, operators[i].len) == 0) {
+                t->type = operators[i].type;
+                p += operators[i].len;
+                break;
+            }
+        }
+    } else {
+        t->type = TOK_WORD;
+        while (*p && !is_blank(*p) && !is_operator(*p)) {
+            // A command substitution is part of the word it is in.
+            if (p[0] == '$' && p[1] == '(')
+                p = skip_parens(p + 2, &t->open);
+            else
+                p++;
+        }
+    }
+    t->len = (size_t)(p - t->start);
+    *pp = p;
+    return true;
+}
+
+static void syntax_error(const struct token *t) {
+    if (t)
+        fprintf(stderr, "syntax error near unexpected token `%.*s'\n", (int)t->len, t->start);
+    else
+        fprintf(stderr, "syntax error: unexpected end of line\n");
+}
+
+struct parser
+{
+    struct arena *a;
+    const struct token *toks;
+    int n;
+    int i;
+};
+
+static const struct token *peek(const struct parser *ps) {
+    return ps->i < ps->n ? &ps->toks[ps->i] : NULL;
+}
+
+// The body of <(list), >(list) or (list), which must not be empty.
+static struct pipeline *parse_body(struct parser *ps, const struct token *t, size_t skip) {
+    char *body = arena_strndup(ps->a, t->start + skip, t->len - skip - 1);
+    struct pipeline *list = body ? pipeline_parse(ps->a, body) : NULL;
+    if (list && list->ncmds == 0) {
+        syntax_error(t);
+        return NULL;
+    }
+    return list;
+}
+
+//-----------------------------------------------------------------------------
+// parse_command
+//-----------------------------------------------------------------------------
+// Words and redirections in any order, at least one word. A subshell is a
+// word of its own that only redirections may follow.
+static bool parse_command(struct parser *ps, struct command *c) {
+    int argc = 0;
+    int nredirs = 0;
+    int nsubs = 0;
+    bool group = false;
+    int end = ps->i;
+    for (; end < ps->n; end++) {
+        if (ps->toks[end].open) {
+            syntax_error(NULL);
+            return false;
+        }
+        if (group && (ps->toks[end].type == TOK_WORD || is_psub(ps->toks[end].type) ||
+                      ps->toks[end].type == TOK_GROUP)) {
+            syntax_error(&ps->toks[end]);
+            return false;
+        }
+        if (ps->toks[end].type == TOK_GROUP) {
+            if (argc) {
+                syntax_error(&ps->toks[end]);
+                return false;
+            }
+            argc++;
+            group = true;
+        } else if (ps->toks[end].type == TOK_WORD) {
+            argc++;
+        } else if (is_psub(ps->toks[end].type)) {
+            argc++;
+            nsubs++;
+        } else if (is_redir(ps->toks[end].type)) {
+            if (end + 1 == ps->n || ps->toks[end + 1].type != TOK_WORD ||
+                ps->toks[end + 1].open) {
+                syntax_error(end + 1 < ps->n && !ps->toks[end + 1].open ? &ps->toks[end + 1]
+                                                                        : NULL);
+                return false;
+            }
+            nredirs++;
+            end++;
+        } else {
+            break;
+        }
+    }
+    if (argc == 0) {
+        syntax_error(end < ps->n ? &ps->toks[end] : NULL);
+        return false;
+    }
+    char **argv = arena_alloc(ps->a, (argc + 1) * sizeof(char *));
+    struct redir *redirs = nredirs ? arena_alloc(ps->a, nredirs * sizeof(*redirs)) : NULL;
+    struct procsub *subs = nsubs ? arena_alloc(ps->a, nsubs * sizeof(*subs)) : NULL;
+    if (!argv || (nredirs && !redirs) || (nsubs && !subs))
+        return false;
+    int w = 0;
+    int r = 0;
+    int n = 0;
+    bool expand = false;
+    c->group = NULL;
+    for (; ps->i < end; ps->i++) {
+        const struct token *t = &ps->toks[ps->i];
+        if (t->type == TOK_GROUP) {
+            // The text stays as the name, for traces and the journal.
+            c->group = parse_body(ps, t, 1);
+            argv[w] = c->group ? arena_strndup(ps->a, t->start, t->len) : NULL;
+            if (!argv[w++])
+                return false;
+            continue;
+        }
+        if (is_psub(t->type)) {
+            // The word keeps the text until the spawn puts the /dev/fd
+            // path of the pipe in its place.
+            subs[n].argi = w;
+            subs[n].out = t->type == TOK_PSUB_OUT;
+            subs[n].body = parse_body(ps, t, 2);
+            if (!subs[n].body)
+                return false;
+            n++;
+            argv[w] = arena_strndup(ps->a, t->start, t->len);
+            if (!argv[w++])
+                return false;
+            continue;
+        }
+        if (is_redir(t->type)) {
+            const struct token *word = &ps->toks[++ps->i];
+            redirs[r].type = t->type == TOK_LESS     ? REDIR_IN
+                             : t->type == TOK_GREAT  ? REDIR_OUT
+                             : t->type == TOK_DGREAT ? REDIR_APPEND
+                                                     : REDIR_HERE;
+            redirs[r].word = arena_strndup(ps->a, word->start, word->len);
+            if (!redirs[r++].word)
+                return false;
+            expand = expand || memmem(word->start, word->len, "$(", 2);
+            continue;
+        }
+        expand = expand || memmem(t->start, t->len, "$(", 2);
+        // Same rule as cmd_parse_arena, see there.
+        if (w == 0)
+            argv[w] = (char *)intern_n(t->start, t->len);
+        else
+            argv[w] = arena_strndup(ps->a, t->start, t->len);
+        if (!argv[w++])
+            return false;
+    }
+    argv[argc] = NULL;
+    c->argv = argv;
+    c->argc = argc;
+    c->pid = 0;
+    c->redirs = redirs;
+    c->nredirs = nredirs;
+    c->subs = subs;
+    c->nsubs = nsubs;
+    c->expand = expand;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// parse_pipeline
+//-----------------------------------------------------------------------------
+static bool parse_pipeline(struct parser *ps, struct pipeline *p) {
+    const struct token *t = peek(ps);
+    if (t && t->type == TOK_WORD && t->len == 4 && strncmp(t->start, "time", 4) == 0) {
+        p->timed = true;
+        ps->i++;
+    }
+    t = peek(ps);
+    if (t && t->type == TOK_WORD && t->len > 9 && strncmp(t->start, "pipesize=", 9) == 0) {
+        long size = parse_size(t->start + 9, t->len - 9);
+        if (size < 0) {
+            syntax_error(t);
+            return false;
+        }
+        p->pipesize = (int)size;
+        ps->i++;
+    }
+    int ncmds = 1;
+    for (int i = ps->i; i < ps->n && ps->toks[i].type != TOK_AND && ps->toks[i].type != TOK_OR;
+         i++) {
+        if (ps->toks[i].type == TOK_PIPE)
+            ncmds++;
+    }
+    p->cmds = arena_alloc(ps->a, ncmds * sizeof(struct command));
+    if (!p->cmds)
+        return false;
+    for (int c = 0; c < ncmds; c++) {
+        if (c > 0)
+            ps->i++;  // skip the pipe
+        if (!parse_command(ps, &p->cmds[c]))
+            return false;
+    }
+    p->ncmds = ncmds;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// parse_size
+//-----------------------------------------------------------------------------
+long parse_size(const char *s, size_t len) {
+    long size = 0;
+    size_t i = 0;
+    for (; i < len && s[i] >= '0' && s[i] <= '9'; i++) {
+        size = size * 10 + (s[i] - '0');
+        if (size > INT_MAX)
+            return -1;
+    }
+    if (i == 0)
+        return -1;
+    if (i + 1 == len && (s[i] == 'k' || s[i] == 'K'))
+        size <<= 10;
+    else if (i + 1 == len && (s[i] == 'm' || s[i] == 'M'))
+        size <<= 20;
+    else if (i != len)
+        return -1;
+    return size > 0 && size <= INT_MAX ? size : -1;
+}
+
+//-----------------------------------------------------------------------------
+// pipeline_parse
+//-----------------------------------------------------------------------------
+static struct pipeline *pipeline_new(struct arena *a, enum list_op op) {
+    struct pipeline *p = arena_alloc(a, sizeof(*p));
+    if (!p)
+        return NULL;
+    p->cmds = NULL;
+    p->ncmds = 0;
+    p->timed = false;
+    p->op = op;
+    p->folded = -1;
+    p->pipesize = 0;
+    p->next = NULL;
+    return p;
+}
+
+struct pipeline *pipeline_parse(struct arena *a, const char *line) {
+    if (!line)
+        return NULL;
+    struct pipeline *first = pipeline_new(a, LIST_FIRST);
+    if (!first)
+        return NULL;
+
+    // Lex once to size everything, then again to fill it in, which keeps
+    // the whole parse to a handful of bump allocations.
+    struct token t;
+    int ntokens = 0;
+    for (const char *s = line; lex_next(&s, &t);)
+        ntokens++;
+    if (ntokens == 0)
+        return first;
+    struct token *toks = arena_alloc(a, ntokens * sizeof(*toks));
+    if (!toks)
+        return NULL;
+    int n = 0;
+    for (const char *s = line; lex_next(&s, &toks[n]);)
+        n++;
+
+    // A bare "time" times nothing, which is fine.
+    if (n == 1 && toks[0].type == TOK_WORD && toks[0].len == 4 &&
+        strncmp(toks[0].start, "time", 4) == 0) {
+        first->timed = true;
+        return first;
+    }
+
+    struct parser ps = {a, toks, n, 0};
+    struct pipeline *p = first;
+    for (;;) {
+        if (!parse_pipeline(&ps, p))
+            return NULL;
+        const struct token *op = peek(&ps);
+        if (!op)
+            return first;
+        if (op->type != TOK_AND && op->type != TOK_OR) {
+            syntax_error(op);
+            return NULL;
+        }
+        ps.i++;
+        p->next = pipeline_new(a, op->type == TOK_AND ? LIST_AND : LIST_OR);
+        if (!p->next)
+            return NULL;
+        p = p->next;
+    }
+}
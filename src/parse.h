@@ -0,0 +1,123 @@
+#ifndef PARSE_H
+#define PARSE_H
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include "arena.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * How a redirection opens its word. REDIR_HERE is a here-string, the
+   * word itself followed by a newline is the command's stdin.
+   */
+  enum redir_type
+  {
+    REDIR_IN,
+    REDIR_OUT,
+    REDIR_APPEND,
+    REDIR_HERE,
+  };
+
+  /**
+   * One redirection of a command, applied in order after the pipes so a
+   * later one wins.
+   */
+  struct redir
+  {
+    enum redir_type type;
+    const char *word;
+  };
+
+  struct pipeline;
+
+  /**
+   * A process substitution, <(body) when out is false and >(body) when it
+   * is true. argv[argi] of its command is replaced by the /dev/fd path of
+   * a pipe to or from body when the command is spawned.
+   */
+  struct procsub
+  {
+    int argi;
+    bool out;
+    struct pipeline *body;
+  };
+
+  /**
+   * One simple command, argv is NULL terminated and follows the same
+   * interning rules as cmd_parse_arena. pid is filled in once the command
+   * has been forked. expand is set while a word or redirection still holds
+   * a $(...) command substitution. group is the list of a ( list )
+   * subshell, whose text is then the command's only word.
+   */
+  struct command
+  {
+    char **argv;
+    int argc;
+    pid_t pid;
+    struct redir *redirs;
+    int nredirs;
+    struct procsub *subs;
+    int nsubs;
+    bool expand;
+    struct pipeline *group;
+  };
+
+  /**
+   * How a pipeline is joined to the one before it in a list.
+   */
+  enum list_op
+  {
+    LIST_FIRST,
+    LIST_AND,
+    LIST_OR,
+  };
+
+  /**
+   * Commands joined by |, timed is set when the pipeline started with the
+   * time keyword. A line is a list of pipelines joined by && and ||, next
+   * is the following one and op says when it runs. folded is -1, or the
+   * exit status the optimizer found the pipeline always has, in which case
+   * it is not run. pipesize is the pipe buffer size a leading
+   * pipesize=N asked for, or 0 to use the shell's.
+   */
+  struct pipeline
+  {
+    struct command *cmds;
+    int ncmds;
+    bool timed;
+    enum list_op op;
+    int folded;
+    int pipesize;
+    struct pipeline *next;
+  };
+
+  /**
+   * @brief Parse a line into a list of pipelines. Everything is allocated
+   * from the arena. A syntax error is reported on stderr.
+   *
+   * @param a The arena to allocate from
+   * @param line The line to parse
+   * @return The first pipeline (with ncmds of 0 for a blank line) or NULL
+   * on a syntax error or allocation failure
+   */
+  struct pipeline *pipeline_parse(struct arena *a, const char *line);
+
+  /**
+   * @brief Parse a size in bytes with an optional k or m suffix, as in
+   * pipesize=1m.
+   *
+   * @param s The size
+   * @param len Number of characters of s to parse
+   * @return The size, or -1 if it is not a positive number below 2GiB
+   */
+  long parse_size(const char *s, size_t len);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
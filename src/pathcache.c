@@ -0,0 +1,620 @@
+#include "pathcache.h"
+#include "intern.h"
+#include "forkmem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#define PC_POOL_NODES 1024
+#define PC_CACHE_MAGIC "tonyshell-pathcache 2"
+#define PC_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                       IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF)
+
+// Tries are stored as first child / next sibling so a node costs a few words
+// instead of a 256 entry table. Siblings are kept sorted by character which
+// makes the completion walk come out in sorted order for free.
+struct pc_node
+{
+    struct pc_node *child;
+    struct pc_node *next;
+    int dir;
+    unsigned char c;
+    bool terminal;
+};
+
+//-----------------------------------------------------------------------------
+// trie helpers
+//-----------------------------------------------------------------------------
+static struct pc_node *pc_node_alloc(struct pathcache *pc) {
+    if (pc->npools == 0 || pc->pool_used == PC_POOL_NODES) {
+        struct pc_node **pools = realloc(pc->pools, (pc->npools + 1) * sizeof(*pools));
+        if (!pools)
+            return NULL;
+        pc->pools = pools;
+        pc->pools[pc->npools] = forkmem_alloc(PC_POOL_NODES * sizeof(struct pc_node));
+        if (!pc->pools[pc->npools])
+            return NULL;
+        if (pc->shared)
+            forkmem_share(pc->pools[pc->npools], PC_POOL_NODES * sizeof(struct pc_node));
+        pc->npools++;
+        pc->pool_used = 0;
+    }
+    struct pc_node *n = &pc->pools[pc->npools - 1][pc->pool_used++];
+    memset(n, 0, sizeof(*n));
+    return n;
+}
+
+// Whether this process has the trie, a forked child only has it when it is
+// shared.
+static bool pc_has_trie(const struct pathcache *pc) {
+    return pc->shared || pc->owner == getpid();
+}
+
+// In a forked child the pools may never have been there to free.
+static void pc_trie_free(struct pathcache *pc) {
+    for (size_t i = 0; i < pc->npools && pc_has_trie(pc); i++) {
+        forkmem_free(pc->pools[i], PC_POOL_NODES * sizeof(struct pc_node));
+    }
+    free(pc->pools);
+    pc->pools = NULL;
+    pc->npools = 0;
+    pc->pool_used = 0;
+    pc->root = NULL;
+}
+
+static int pc_insert(struct pathcache *pc, const char *name, int dir) {
+    struct pc_node *parent = pc->root;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        struct pc_node **link = &parent->child;
+        while (*link && (*link)->c < *p)
+            link = &(*link)->next;
+        if (!*link || (*link)->c != *p) {
+            struct pc_node *n = pc_node_alloc(pc);
+            if (!n)
+                return -1;
+            n->c = *p;
+            n->next = *link;
+            *link = n;
+        }
+        parent = *link;
+    }
+    // PATH order wins, the first directory to provide a name keeps it.
+    if (!parent->terminal) {
+        parent->terminal = true;
+        parent->dir = dir;
+    }
+    return 0;
+}
+
+static struct pc_node *pc_find(struct pathcache *pc, const char *prefix) {
+    struct pc_node *n = pc->root;
+    for (const unsigned char *p = (const unsigned char *)prefix; *p && n; p++) {
+        n = n->child;
+        while (n && n->c < *p)
+            n = n->next;
+        if (n && n->c != *p)
+            n = NULL;
+    }
+    return n;
+}
+
+static void pc_memo_clear(struct pathcache *pc) {
+    for (size_t i = 0; i < pc->memo_cap; i++) {
+        free(pc->memo[i].file);
+    }
+    free(pc->memo);
+    pc->memo = NULL;
+    pc->memo_cap = 0;
+    pc->memo_used = 0;
+}
+
+static int pc_rebuild(struct pathcache *pc) {
+    pc_memo_clear(pc);
+    pc_trie_free(pc);
+    pc->root = pc_node_alloc(pc);
+    if (!pc->root)
+        return -1;
+    for (size_t i = 0; i < pc->ndirs; i++) {
+        for (size_t j = 0; j < pc->dirs[i].nnames; j++) {
+            if (pc_insert(pc, pc->dirs[i].names[j], (int)i) != 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+// directory scanning
+//-----------------------------------------------------------------------------
+static void pc_dir_clear(struct pc_dir *d) {
+    for (size_t i = 0; i < d->nnames && !d->mapped; i++) {
+        free(d->names[i]);
+    }
+    free(d->names);
+    d->names = NULL;
+    d->nnames = 0;
+    d->mapped = false;
+}
+
+// A mapped name is used where it is, a scanned one is copied.
+static int pc_dir_push(struct pc_dir *d, size_t *cap, const char *name) {
+    if (d->nnames == *cap) {
+        size_t ncap = *cap ? *cap * 2 : 64;
+        char **names = realloc(d->names, ncap * sizeof(char *));
+        if (!names)
+            return -1;
+        d->names = names;
+        *cap = ncap;
+    }
+    d->names[d->nnames] = d->mapped ? (char *)name : strdup(name);
+    if (!d->names[d->nnames])
+        return -1;
+    d->nnames++;
+    return 0;
+}
+
+static void pc_dir_stat(struct pc_dir *d) {
+    struct stat st;
+    if (stat(d->path, &st) == 0) {
+        d->mtime = st.st_mtim;
+    } else {
+        d->mtime.tv_sec = 0;
+        d->mtime.tv_nsec = 0;
+    }
+}
+
+// Scanning is the expensive part on network filesystems because every
+// entry has to be stat'ed to find out if it is an executable file.
+static void pc_dir_scan(struct pc_dir *d) {
+    pc_dir_clear(d);
+    pc_dir_stat(d);
+    d->dirty = false;
+
+    DIR *dp = opendir(d->path);
+    if (!dp)
+        return;
+
+    size_t cap = 0;
+    int fd = dirfd(dp);
+    struct dirent *ent;
+    while ((ent = readdir(dp))) {
+        const char *name = ent->d_name;
+        if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2])))
+            continue;
+        if (ent->d_type == DT_DIR || strchr(name, '\n'))
+            continue;
+        struct stat st;
+        if (fstatat(fd, name, &st, 0) != 0)
+            continue;
+        if (!S_ISREG(st.st_mode) || !(st.st_mode & 0111))
+            continue;
+        if (pc_dir_push(d, &cap, name) != 0)
+            break;
+    }
+    closedir(dp);
+}
+
+//-----------------------------------------------------------------------------
+// persistence
+//-----------------------------------------------------------------------------
+static struct pc_dir *pc_dir_by_path(struct pathcache *pc, const char *path) {
+    for (size_t i = 0; i < pc->ndirs; i++) {
+        if (strcmp(pc->dirs[i].path, path) == 0)
+            return &pc->dirs[i];
+    }
+    return NULL;
+}
+
+// Returns a bitmap (one bool per directory) of the entries that were
+// satisfied from the cache file. The file is mapped shared and read-only,
+// names are NUL terminated in it so the name lists point straight into it
+// and cost a fork nothing.
+static void pc_load(struct pathcache *pc, bool *loaded) {
+    if (!pc->cache_file)
+        return;
+    int fd = open(pc->cache_file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    size_t size = 0;
+    const char *map = forkmem_map_file(fd, &size);
+    close(fd);
+    if (!map)
+        return;
+    const char *p = map;
+    const char *end = map + size;
+    size_t magic = strlen(PC_CACHE_MAGIC);
+    if (size <= magic || memcmp(p, PC_CACHE_MAGIC, magic) != 0 || p[magic] != '\n') {
+        forkmem_free((void *)map, size);
+        return;
+    }
+    pc->map = map;
+    pc->map_size = size;
+    p += magic + 1;
+
+    while (p < end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        char line[PATH_MAX + 64];
+        if (!nl || (size_t)(nl - p) >= sizeof(line))
+            break;
+        memcpy(line, p, (size_t)(nl - p));
+        line[nl - p] = '\0';
+        p = nl + 1;
+        long long sec;
+        long nsec;
+        size_t count;
+        int off = 0;
+        if (sscanf(line, "D %lld %ld %zu %n", &sec, &nsec, &count, &off) != 3 || off == 0)
+            break;
+
+        struct pc_dir *d = pc_dir_by_path(pc, line + off);
+        bool use = d && !loaded[d - pc->dirs] && d->mtime.tv_sec == sec &&
+                   d->mtime.tv_nsec == nsec && sec != 0;
+        size_t dcap = 0;
+        if (use) {
+            pc_dir_clear(d);
+            d->mapped = true;
+        }
+        for (size_t i = 0; i < count; i++) {
+            const char *nul = p < end ? memchr(p, '\0', (size_t)(end - p)) : NULL;
+            if (!nul) {
+                // Cut short, what was taken from it is dropped again.
+                if (use)
+                    pc_dir_clear(d);
+                return;
+            }
+            if (use && pc_dir_push(d, &dcap, p) != 0)
+                return;
+            p = nul + 1;
+        }
+        if (use)
+            loaded[d - pc->dirs] = true;
+    }
+}
+
+static void pc_mkdirs(const char *file) {
+    char *tmp = strdup(file);
+    if (!tmp)
+        return;
+    for (char *p = tmp + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            mkdir(tmp, 0700);
+            *p = '/';
+        }
+    }
+    free(tmp);
+}
+
+static void pc_save(struct pathcache *pc) {
+    if (!pc->cache_file)
+        return;
+    size_t n = strlen(pc->cache_file) + 16;
+    char *tmp = malloc(n);
+    if (!tmp)
+        return;
+    snprintf(tmp, n, "%s.%d", pc->cache_file, (int)getpid());
+    pc_mkdirs(tmp);
+
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) {
+        free(tmp);
+        return;
+    }
+    fprintf(fp, "%s\n", PC_CACHE_MAGIC);
+    for (size_t i = 0; i < pc->ndirs; i++) {
+        struct pc_dir *d = &pc->dirs[i];
+        if (d->mtime.tv_sec == 0 || strchr(d->path, '\n'))
+            continue;
+        fprintf(fp, "D %lld %ld %zu %s\n", (long long)d->mtime.tv_sec,
+                (long)d->mtime.tv_nsec, d->nnames, d->path);
+        for (size_t j = 0; j < d->nnames; j++) {
+            fwrite(d->names[j], 1, strlen(d->names[j]) + 1, fp);
+        }
+    }
+    // Write to a private file and rename so concurrent shells never see a
+    // half written cache.
+    if (fclose(fp) == 0) {
+        rename(tmp, pc->cache_file);
+    } else {
+        unlink(tmp);
+    }
+    free(tmp);
+}
+
+//-----------------------------------------------------------------------------
+// pathcache_create
+//-----------------------------------------------------------------------------
+struct pathcache *pathcache_create(const char *path, const char *cache_file) {
+    struct pathcache *pc = calloc(1, sizeof(*pc));
+    if (!pc)
+        return NULL;
+    pc->inotify_fd = -1;
+    pc->owner = getpid();
+    pc->path_env = strdup(path ? path : "");
+    pc->cache_file = cache_file ? strdup(cache_file) : NULL;
+    if (!pc->path_env || (cache_file && !pc->cache_file))
+        goto fail;
+
+    // Relative and empty PATH entries depend on the cwd so they are not
+    // something we can cache, they are left to execvp.
+    size_t cap = 0;
+    char *copy = strdup(pc->path_env);
+    if (!copy)
+        goto fail;
+    char *save = NULL;
+    for (char *tok = strtok_r(copy, ":", &save); tok; tok = strtok_r(NULL, ":", &save)) {
+        if (tok[0] != '/' || pc_dir_by_path(pc, tok))
+            continue;
+        if (pc->ndirs == cap) {
+            cap = cap ? cap * 2 : 16;
+            struct pc_dir *dirs = realloc(pc->dirs, cap * sizeof(*dirs));
+            if (!dirs) {
+                free(copy);
+                goto fail;
+            }
+            pc->dirs = dirs;
+        }
+        struct pc_dir *d = &pc->dirs[pc->ndirs];
+        memset(d, 0, sizeof(*d));
+        d->wd = -1;
+        d->path = strdup(tok);
+        if (!d->path) {
+            free(copy);
+            goto fail;
+        }
+        pc->ndirs++;
+    }
+    free(copy);
+
+    // Watches go in before the directories are looked at so a change made
+    // while we are scanning is not lost.
+    pc->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    for (size_t i = 0; i < pc->ndirs; i++) {
+        if (pc->inotify_fd >= 0)
+            pc->dirs[i].wd = inotify_add_watch(pc->inotify_fd, pc->dirs[i].path, PC_WATCH_MASK);
+        pc_dir_stat(&pc->dirs[i]);
+    }
+
+    bool *loaded = calloc(pc->ndirs ? pc->ndirs : 1, sizeof(bool));
+    if (!loaded)
+        goto fail;
+    pc_load(pc, loaded);
+    bool scanned = false;
+    for (size_t i = 0; i < pc->ndirs; i++) {
+        if (!loaded[i]) {
+            pc_dir_scan(&pc->dirs[i]);
+            scanned = true;
+        }
+    }
+    free(loaded);
+    if (scanned)
+        pc_save(pc);
+
+    if (pc_rebuild(pc) != 0)
+        goto fail;
+    pc->validated = time(NULL);
+    return pc;
+
+fail:
+    pathcache_destroy(pc);
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// pathcache_share
+//-----------------------------------------------------------------------------
+void pathcache_share(struct pathcache *pc) {
+    if (!pc || pc->owner != getpid())
+        return;
+    pc->shared = true;
+    for (size_t i = 0; i < pc->npools; i++)
+        forkmem_share(pc->pools[i], PC_POOL_NODES * sizeof(struct pc_node));
+}
+
+//-----------------------------------------------------------------------------
+// pathcache_destroy
+//-----------------------------------------------------------------------------
+void pathcache_destroy(struct pathcache *pc) {
+    if (!pc)
+        return;
+    pc_memo_clear(pc);
+    pc_trie_free(pc);
+    for (size_t i = 0; i < pc->ndirs; i++) {
+        pc_dir_clear(&pc->dirs[i]);
+        free(pc->dirs[i].path);
+    }
+    free(pc->dirs);
+    forkmem_free((void *)pc->map, pc->map_size);
+    if (pc->inotify_fd >= 0)
+        close(pc->inotify_fd);
+    free(pc->path_env);
+    free(pc->cache_file);
+    free(pc);
+}
+
+//-----------------------------------------------------------------------------
+// pathcache_refresh
+//-----------------------------------------------------------------------------
+int pathcache_refresh(struct pathcache *pc) {
+    // A forked child has no trie to rebuild and no business saving.
+    if (!pc || pc->owner != getpid())
+        return 0;
+
+    if (pc->inotify_fd >= 0) {
+        char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        ssize_t len;
+        while ((len = read(pc->inotify_fd, buf, sizeof(buf))) > 0) {
+            for (char *p = buf; p < buf + len;) {
+                struct inotify_event *ev = (struct inotify_event *)p;
+                for (size_t i = 0; i < pc->ndirs; i++) {
+                    if (pc->dirs[i].wd == ev->wd) {
+                        pc->dirs[i].dirty = true;
+                        if (ev->mask & IN_IGNORED)
+                            pc->dirs[i].wd = -1;
+                    }
+                }
+                p += sizeof(struct inotify_event) + ev->len;
+            }
+        }
+    }
+
+    time_t now = time(NULL);
+    bool revalidate = now - pc->validated >= PATHCACHE_STALE_SECS;
+    int rescanned = 0;
+    for (size_t i = 0; i < pc->ndirs; i++) {
+        struct pc_dir *d = &pc->dirs[i];
+        // Watches are lost when a directory is removed, or were never set
+        // up because it did not exist yet, those are polled instead.
+        if (revalidate || d->wd < 0) {
+            struct timespec old = d->mtime;
+            pc_dir_stat(d);
+            if (old.tv_sec != d->mtime.tv_sec || old.tv_nsec != d->mtime.tv_nsec)
+                d->dirty = true;
+        }
+        if (!d->dirty)
+            continue;
+        if (d->wd < 0 && pc->inotify_fd >= 0)
+            d->wd = inotify_add_watch(pc->inotify_fd, d->path, PC_WATCH_MASK);
+        pc_dir_scan(d);
+        rescanned++;
+    }
+    if (revalidate)
+        pc->validated = now;
+
+    if (rescanned) {
+        pc_save(pc);
+        pc_rebuild(pc);
+    }
+    return rescanned;
+}
+
+//-----------------------------------------------------------------------------
+// pathcache_complete
+//-----------------------------------------------------------------------------
+static size_t pc_walk(struct pc_node *n, char *buf, size_t len,
+                      void (*fn)(const char *, void *), void *arg) {
+    size_t count = 0;
+    for (; n; n = n->next) {
+        buf[len] = (char)n->c;
+        if (n->terminal) {
+            buf[len + 1] = '\0';
+            fn(buf, arg);
+            count++;
+        }
+        if (n->child && len + 1 < NAME_MAX)
+            count += pc_walk(n->child, buf, len + 1, fn, arg);
+    }
+    return count;
+}
+
+size_t pathcache_complete(struct pathcache *pc, const char *prefix,
+                          void (*fn)(const char *name, void *arg), void *arg) {
+    if (!pc || !pc->root || !prefix || !pc_has_trie(pc))
+        return 0;
+    size_t len = strlen(prefix);
+    if (len >= NAME_MAX)
+        return 0;
+    struct pc_node *n = pc_find(pc, prefix);
+    if (!n)
+        return 0;
+
+    char buf[NAME_MAX + 1];
+    memcpy(buf, prefix, len + 1);
+    size_t count = 0;
+    if (len > 0 && n->terminal) {
+        fn(buf, arg);
+        count++;
+    }
+    return count + pc_walk(n->child, buf, len, fn, arg);
+}
+
+//-----------------------------------------------------------------------------
+// pathcache_lookup
+//-----------------------------------------------------------------------------
+const char *pathcache_lookup(struct pathcache *pc, const char *name) {
+    if (!pc || !pc->root || !name || !*name || !pc_has_trie(pc))
+        return NULL;
+    struct pc_node *n = pc_find(pc, name);
+    if (!n || !n->terminal)
+        return NULL;
+    return pc->dirs[n->dir].path;
+}
+
+//-----------------------------------------------------------------------------
+// pathcache_resolve
+//-----------------------------------------------------------------------------
+static struct pc_memo *pc_memo_slot(struct pc_memo *memo, size_t cap, const char *name) {
+    size_t mask = cap - 1;
+    size_t i = intern_hash(name) & mask;
+    while (memo[i].name && memo[i].name != name)
+        i = (i + 1) & mask;
+    return &memo[i];
+}
+
+const char *pathcache_resolve(struct pathcache *pc, const char *name) {
+    if (!pc || !name)
+        return NULL;
+    if (pc->memo_epoch != intern_epoch())
+        pc_memo_clear(pc);
+    if (pc->memo_cap) {
+        struct pc_memo *m = pc_memo_slot(pc->memo, pc->memo_cap, name);
+        if (m->name)
+            return m->file;
+    }
+
+    if ((pc->memo_used + 1) * 4 > pc->memo_cap * 3) {
+        size_t ncap = pc->memo_cap ? pc->memo_cap * 2 : 64;
+        struct pc_memo *memo = calloc(ncap, sizeof(*memo));
+        if (!memo)
+            return NULL;
+        for (size_t i = 0; i < pc->memo_cap; i++) {
+            if (pc->memo[i].name)
+                *pc_memo_slot(memo, ncap, pc->memo[i].name) = pc->memo[i];
+        }
+        free(pc->memo);
+        pc->memo = memo;
+        pc->memo_cap = ncap;
+        pc->memo_epoch = intern_epoch();
+    }
+
+    char *file = NULL;
+    const char *dir = pathcache_lookup(pc, name);
+    if (dir) {
+        size_t n = strlen(dir) + strlen(name) + 2;
+        file = malloc(n);
+        if (!file)
+            return NULL;
+        snprintf(file, n, "%s/%s", dir, name);
+    }
+    struct pc_memo *m = pc_memo_slot(pc->memo, pc->memo_cap, name);
+    m->name = name;
+    m->file = file;
+    pc->memo_used++;
+    return file;
+}
+
+//-----------------------------------------------------------------------------
+// pathcache_default_file
+//-----------------------------------------------------------------------------
+char *pathcache_default_file(void) {
+    const char *base = getenv("XDG_CACHE_HOME");
+    const char *suffix = "/tonyshell/pathcache";
+    if (!base || !*base) {
+        base = getenv("HOME");
+        suffix = "/.cache/tonyshell/pathcache";
+    }
+    if (!base || !*base)
+        return NULL;
+    size_t n = strlen(base) + strlen(suffix) + 1;
+    char *file = malloc(n);
+    if (file)
+        snprintf(file, n, "%s%s", base, suffix);
+    return file;
+}
@@ -0,0 +1,166 @@
+#ifndef PATHCACHE_H
+#define PATHCACHE_H
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * If inotify cannot see a change (for example a PATH entry that lives on
+   * NFS and was modified on another host) the directory mtimes are checked
+   * again after this many seconds.
+   */
+#define PATHCACHE_STALE_SECS 30
+
+  struct pc_node;
+
+  /**
+   * Resolved command, name is an interned string so the memo table
+   * compares pointers and reuses the hash computed when it was interned.
+   */
+  struct pc_memo
+  {
+    const char *name;
+    char *file;
+  };
+
+  /**
+   * One directory from PATH along with the executables it contained the
+   * last time it was scanned. mapped is set when the names point into the
+   * mapped cache file rather than being allocated one by one.
+   */
+  struct pc_dir
+  {
+    char *path;
+    struct timespec mtime;
+    int wd;
+    bool dirty;
+    bool mapped;
+    char **names;
+    size_t nnames;
+  };
+
+  /**
+   * Prefix trie of every executable reachable through PATH. The per
+   * directory name lists are the source of truth, the trie is rebuilt from
+   * them whenever one of the directories changes. The trie lives in
+   * mappings a fork does not copy unless shared is set, without it only
+   * the resolve memo answers in a child of owner. The cache file stays
+   * mapped read-only at map.
+   */
+  struct pathcache
+  {
+    char *path_env;
+    char *cache_file;
+    struct pc_dir *dirs;
+    size_t ndirs;
+    struct pc_node *root;
+    struct pc_node **pools;
+    size_t npools;
+    size_t pool_used;
+    int inotify_fd;
+    time_t validated;
+    struct pc_memo *memo;
+    size_t memo_cap;
+    size_t memo_used;
+    size_t memo_epoch;
+    pid_t owner;
+    bool shared;
+    const char *map;
+    size_t map_size;
+  };
+
+  /**
+   * @brief Build the executable trie for the given PATH string. Directories
+   * whose mtime matches the entry saved in cache_file are loaded from the
+   * cache instead of being scanned. Any directory that had to be scanned is
+   * written back to cache_file. Pass NULL for cache_file to disable
+   * persistence.
+   *
+   * @param path A colon separated directory list, usually getenv("PATH")
+   * @param cache_file Where the cache is persisted, may be NULL
+   * @return The cache or NULL if memory could not be allocated
+   */
+  struct pathcache *pathcache_create(const char *path, const char *cache_file);
+
+  /**
+   * @brief Free the trie, the name lists and close the inotify watches.
+   *
+   * @param pc The cache to destroy
+   */
+  void pathcache_destroy(struct pathcache *pc);
+
+  /**
+   * @brief Let forked copies of the shell look names up in the trie too,
+   * for a server whose children do all the work. The trie is then copied
+   * by every fork. Only the owner refreshes it, so a child sees what was
+   * there when it was forked.
+   *
+   * @param pc The cache
+   */
+  void pathcache_share(struct pathcache *pc);
+
+  /**
+   * @brief Bring the cache up to date. Pending inotify events are drained
+   * without blocking and only the directories they name are rescanned.
+   * This is cheap enough to call before every completion.
+   *
+   * @param pc The cache to refresh
+   * @return The number of directories that were rescanned
+   */
+  int pathcache_refresh(struct pathcache *pc);
+
+  /**
+   * @brief Call fn once for every executable name that starts with prefix,
+   * in sorted order.
+   *
+   * @param pc The cache
+   * @param prefix The prefix to complete
+   * @param fn Called with each full name, the string is only valid for the
+   * duration of the call
+   * @param arg Passed through to fn
+   * @return The number of names that were reported
+   */
+  size_t pathcache_complete(struct pathcache *pc, const char *prefix,
+                            void (*fn)(const char *name, void *arg), void *arg);
+
+  /**
+   * @brief Find the PATH directory that provides name, honoring PATH order.
+   *
+   * @param pc The cache
+   * @param name An executable name without any slashes
+   * @return The directory or NULL if name is not in PATH
+   */
+  const char *pathcache_lookup(struct pathcache *pc, const char *name);
+
+  /**
+   * @brief Resolve a command name to the full path execv needs. Results,
+   * including misses, are remembered until one of the PATH directories
+   * changes.
+   *
+   * @param pc The cache
+   * @param name An interned command name without any slashes
+   * @return The full path, owned by the cache, or NULL if name is not in
+   * PATH
+   */
+  const char *pathcache_resolve(struct pathcache *pc, const char *name);
+
+  /**
+   * @brief Return the default location of the persisted cache, this is
+   * $XDG_CACHE_HOME/tonyshell/pathcache falling back to $HOME/.cache. The
+   * caller must free the returned string.
+   *
+   * @return The path or NULL if neither variable is set
+   */
+  char *pathcache_default_file(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,143 @@
+#define _GNU_SOURCE
+#include "pipemeter.h"
+#include "parse.h"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+//-----------------------------------------------------------------------------
+// pipe_relay
+//-----------------------------------------------------------------------------
+static void relay_finish(struct pipe_relay *r) {
+    if (r->done)
+        return;
+    if (r->t_blocked)
+        r->blocked_ns += now_ns() - r->t_blocked;
+    r->t_blocked = 0;
+    r->t_end = now_ns();
+    evloop_del(r->loop, &r->in);
+    evloop_del(r->loop, &r->out);
+    // Closing the write end is the downstream's end of file, closing the
+    // read end is what gets the upstream its SIGPIPE.
+    close(r->in.fd);
+    close(r->out.fd);
+    r->done = true;
+    (*r->active)--;
+}
+
+// Move as much as is ready. With both ends non blocking EAGAIN means the
+// input ran dry or the output filled up, poll tells which.
+static void relay_pump(struct pipe_relay *r) {
+    for (;;) {
+        ssize_t n = splice(r->in.fd, NULL, r->out.fd, NULL, PIPEMETER_CHUNK,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            r->bytes += (uint64_t)n;
+            r->splices++;
+            continue;
+        }
+        if (n == 0) {
+            relay_finish(r);
+            return;
+        }
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN) {
+            // EPIPE, the downstream stage is gone.
+            relay_finish(r);
+            return;
+        }
+        struct pollfd pfd[2] = {{r->in.fd, POLLIN, 0}, {r->out.fd, POLLOUT, 0}};
+        poll(pfd, 2, 0);
+        if (pfd[1].revents & POLLERR) {
+            relay_finish(r);
+            return;
+        }
+        if ((pfd[0].revents & (POLLIN | POLLHUP)) && !(pfd[1].revents & POLLOUT)) {
+            // Data is waiting and the downstream is not taking it.
+            if (!r->t_blocked)
+                r->t_blocked = now_ns();
+            evloop_del(r->loop, &r->in);
+            evloop_del(r->loop, &r->out);
+            if (evloop_add(r->loop, &r->out) != 0)
+                relay_finish(r);
+            return;
+        }
+        evloop_del(r->loop, &r->out);
+        evloop_del(r->loop, &r->in);
+        if (evloop_add(r->loop, &r->in) != 0)
+            relay_finish(r);
+        return;
+    }
+}
+
+static void on_relay_in(struct ev_source *src, short revents) {
+    (void)revents;
+    relay_pump(src->arg);
+}
+
+static void on_relay_out(struct ev_source *src, short revents) {
+    (void)revents;
+    struct pipe_relay *r = src->arg;
+    if (r->t_blocked) {
+        r->blocked_ns += now_ns() - r->t_blocked;
+        r->t_blocked = 0;
+    }
+    relay_pump(r);
+}
+
+void pipe_relay_init(struct pipe_relay *r, int rfd, int wfd) {
+    memset(r, 0, sizeof(*r));
+    fcntl(rfd, F_SETFL, fcntl(rfd, F_GETFL) | O_NONBLOCK);
+    fcntl(wfd, F_SETFL, fcntl(wfd, F_GETFL) | O_NONBLOCK);
+    r->in = (struct ev_source){rfd, POLLIN, on_relay_in, r};
+    r->out = (struct ev_source){wfd, POLLOUT, on_relay_out, r};
+}
+
+void pipe_relay_start(struct pipe_relay *r, struct evloop *l, int *active) {
+    r->loop = l;
+    r->active = active;
+    r->t_start = now_ns();
+    (*active)++;
+    if (evloop_add(l, &r->in) != 0)
+        relay_finish(r);
+}
+
+void pipe_relay_close(struct pipe_relay *r) {
+    if (r->done)
+        return;
+    if (r->loop) {
+        relay_finish(r);
+        return;
+    }
+    close(r->in.fd);
+    close(r->out.fd);
+    r->done = true;
+}
+
+//-----------------------------------------------------------------------------
+// pipe_relay_report
+//-----------------------------------------------------------------------------
+void pipe_relay_report(FILE *fp, const struct pipeline *p, const struct pipe_relay *relays) {
+    fprintf(fp, "%-24s %12s %10s %10s %12s\n", "link", "bytes", "MB/s", "splices", "backpressure");
+    for (int i = 0; i + 1 < p->ncmds; i++) {
+        const struct pipe_relay *r = &relays[i];
+        char link[64];
+        snprintf(link, sizeof(link), "%d:%.10s -> %d:%.10s", i + 1, p->cmds[i].argv[0], i + 2,
+                 p->cmds[i + 1].argv[0]);
+        uint64_t life = r->t_end > r->t_start ? r->t_end - r->t_start : 0;
+        double mbs = life ? (double)r->bytes / 1e6 / ((double)life / 1e9) : 0.0;
+        double bp = life ? 100.0 * (double)r->blocked_ns / (double)life : 0.0;
+        fprintf(fp, "%-24s %12llu %10.1f %10llu %11.1f%%\n", link, (unsigned long long)r->bytes,
+                mbs, (unsigned long long)r->splices, bp);
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef PIPEMETER_H
+#define PIPEMETER_H
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "evloop.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  struct pipeline;
+
+  /**
+   * Most bytes moved by one splice call.
+   */
+#define PIPEMETER_CHUNK (64 * 1024)
+
+  /**
+   * The shell's end of one link between two stages. The upstream stage
+   * writes into a pipe the shell reads (rfd) and the shell splices that
+   * into a second pipe (wfd) the downstream stage reads, the data never
+   * passes through user space.
+   */
+  struct pipe_relay
+  {
+    struct ev_source in;
+    struct ev_source out;
+    struct evloop *loop;
+    int *active;
+    uint64_t bytes;
+    uint64_t splices;
+    uint64_t blocked_ns;
+    uint64_t t_blocked;
+    uint64_t t_start;
+    uint64_t t_end;
+    bool done;
+  };
+
+  /**
+   * @brief Take over the shell's ends of a link. Both are made non
+   * blocking, they are never shared with a child.
+   *
+   * @param r The relay
+   * @param rfd The read end of the pipe the upstream stage writes
+   * @param wfd The write end of the pipe the downstream stage reads
+   */
+  void pipe_relay_init(struct pipe_relay *r, int rfd, int wfd);
+
+  /**
+   * @brief Start relaying in the loop. active is incremented now and
+   * decremented once the upstream reaches end of file or the downstream
+   * stops reading, at which point both fds are closed.
+   *
+   * @param r The relay
+   * @param l The loop the job is waited in
+   * @param active Count of relays still running
+   */
+  void pipe_relay_start(struct pipe_relay *r, struct evloop *l, int *active);
+
+  /**
+   * @brief Close a relay that was never started or did not finish.
+   *
+   * @param r The relay
+   */
+  void pipe_relay_close(struct pipe_relay *r);
+
+  /**
+   * @brief Print bytes, throughput and backpressure for every link of a
+   * pipeline. Backpressure is the share of a link's life its upstream
+   * stage had output waiting that the downstream stage was not reading.
+   *
+   * @param fp Where to print
+   * @param p The pipeline
+   * @param relays One relay per link, p->ncmds - 1 of them
+   */
+  void pipe_relay_report(FILE *fp, const struct pipeline *p, const struct pipe_relay *relays);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
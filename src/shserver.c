@@ -0,0 +1,259 @@
+#define _GNU_SOURCE
+#include "shserver.h"
+#include "lab.h"
+#include "pathcache.h"
+#include "journal.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+// Each session reads its lines here, one at a time. A line is sent with its
+// NUL so that an empty one is not taken for the end of the session.
+static char line[SHSERVER_MAX_LINE + 2];
+static volatile sig_atomic_t stopping;
+static int session_sock = -1;
+static pid_t session_pid;
+
+//-----------------------------------------------------------------------------
+// session
+//-----------------------------------------------------------------------------
+static ssize_t recv_line(int sock, int *fds, int *nfds) {
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(int) * SHSERVER_MAX_FDS)];
+        struct cmsghdr align;
+    } ctl;
+    struct iovec iov = {line, SHSERVER_MAX_LINE + 1};
+    struct msghdr mh = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctl.buf,
+                        .msg_controllen = sizeof(ctl.buf)};
+    ssize_t n;
+    while ((n = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR)
+        ;
+    *nfds = 0;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&mh); n >= 0 && c; c = CMSG_NXTHDR(&mh, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+            continue;
+        int k = (int)((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        memcpy(fds + *nfds, CMSG_DATA(c), (size_t)k * sizeof(int));
+        *nfds += k;
+    }
+    if (n > 0 && (mh.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+        for (int i = 0; i < *nfds; i++)
+            close(fds[i]);
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if (n >= 0)
+        line[n] = '\0';
+    return n;
+}
+
+static int send_status(int sock, int32_t status) {
+    ssize_t n;
+    while ((n = send(sock, &status, sizeof(status), MSG_NOSIGNAL)) < 0 && errno == EINTR)
+        ;
+    return n < 0 ? -1 : 0;
+}
+
+// exit leaves the shell from inside sh_execute, the client still gets its
+// status. Its own children that exit through here have nothing to say.
+static void on_session_exit(int status, void *arg) {
+    (void)arg;
+    if (getpid() != session_pid)
+        return;
+    fflush(stdout);
+    fflush(stderr);
+    send_status(session_sock, status);
+}
+
+static void session(struct shell *sh, int sock) {
+    session_sock = sock;
+    session_pid = getpid();
+    // The session is a shell of its own, exit ends it and not the server.
+    sh->pid = session_pid;
+    on_exit(on_session_exit, NULL);
+    // The buffers of the server's journal stayed behind in the fork, the
+    // session records through its own. The file is shared, O_APPEND keeps
+    // the records whole.
+    if (journal_file()) {
+        char *file = strdup(journal_file());
+        if (!file || journal_open(file) != 0)
+            journal_close();
+        free(file);
+    }
+    for (;;) {
+        int fds[SHSERVER_MAX_FDS];
+        int nfds;
+        if (recv_line(sock, fds, &nfds) <= 0)
+            break;
+        // Whatever the last command left buffered goes out where it was
+        // meant to before the fds change.
+        fflush(stdout);
+        fflush(stderr);
+        for (int i = 0; i < nfds; i++) {
+            if (fds[i] != i) {
+                dup2(fds[i], i);
+                close(fds[i]);
+            }
+        }
+        char *cmd = trim_white(line);
+        int32_t status = *cmd ? sh_execute(sh, cmd) : 0;
+        arena_reset(&sh->arena);
+        fflush(stdout);
+        fflush(stderr);
+        if (send_status(sock, status) != 0)
+            break;
+    }
+    sh_destroy(sh);
+    _exit(0);
+}
+
+//-----------------------------------------------------------------------------
+// shserver_run
+//-----------------------------------------------------------------------------
+static void on_stop(int sig) {
+    (void)sig;
+    stopping = 1;
+}
+
+int shserver_run(struct shell *sh, const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path);
+    int lsock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (lsock < 0)
+        return -1;
+    if (bind(lsock, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(lsock, SOMAXCONN) != 0) {
+        int saved = errno;
+        close(lsock);
+        errno = saved;
+        return -1;
+    }
+
+    // The PATH cache is built once, here, and every session gets it.
+    if (!sh->pathcache) {
+        const char *env = getenv("PATH");
+        char *file = pathcache_default_file();
+        sh->pathcache = pathcache_create(env ? env : "", file);
+        free(file);
+    }
+    pathcache_share(sh->pathcache);
+
+    // Sessions are not waited for, their status goes to the client. No
+    // SA_RESTART so a stop request breaks out of accept.
+    struct sigaction stop = {.sa_handler = on_stop}, old_term, old_int, old_chld;
+    struct sigaction reap = {.sa_handler = SIG_IGN};
+    sigaction(SIGTERM, &stop, &old_term);
+    sigaction(SIGINT, &stop, &old_int);
+    sigaction(SIGCHLD, &reap, &old_chld);
+    stopping = 0;
+    int rval = 0;
+    while (!stopping) {
+        int sock = accept4(lsock, NULL, NULL, SOCK_CLOEXEC);
+        if (sock < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            rval = -1;
+            break;
+        }
+        pathcache_refresh(sh->pathcache);
+        fflush(stdout);
+        fflush(stderr);
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(lsock);
+            sigaction(SIGTERM, &old_term, NULL);
+            sigaction(SIGINT, &old_int, NULL);
+            // The session waits for its own jobs.
+            sigaction(SIGCHLD, &old_chld, NULL);
+            session(sh, sock);
+        }
+        if (pid < 0)
+            perror("shserver: fork");
+        close(sock);
+    }
+    int saved = errno;
+    close(lsock);
+    unlink(path);
+    sigaction(SIGTERM, &old_term, NULL);
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGCHLD, &old_chld, NULL);
+    errno = saved;
+    return rval;
+}
+
+//-----------------------------------------------------------------------------
+// shserver_connect
+//-----------------------------------------------------------------------------
+int shserver_connect(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+        return -1;
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        int saved = errno;
+        close(sock);
+        errno = saved;
+        return -1;
+    }
+    return sock;
+}
+
+//-----------------------------------------------------------------------------
+// shserver_send
+//-----------------------------------------------------------------------------
+int shserver_send(int sock, const char *cmd, const int *fds, int nfds) {
+    size_t len = strlen(cmd);
+    if (len > SHSERVER_MAX_LINE || nfds < 0 || nfds > SHSERVER_MAX_FDS) {
+        errno = EINVAL;
+        return -1;
+    }
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(int) * SHSERVER_MAX_FDS)];
+        struct cmsghdr align;
+    } ctl;
+    struct iovec iov = {(void *)cmd, len + 1};
+    struct msghdr mh = {.msg_iov = &iov, .msg_iovlen = 1};
+    if (nfds > 0) {
+        mh.msg_control = ctl.buf;
+        mh.msg_controllen = CMSG_SPACE(sizeof(int) * (size_t)nfds);
+        struct cmsghdr *c = CMSG_FIRSTHDR(&mh);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int) * (size_t)nfds);
+        memcpy(CMSG_DATA(c), fds, (size_t)nfds * sizeof(int));
+    }
+    ssize_t n;
+    while ((n = sendmsg(sock, &mh, MSG_NOSIGNAL)) < 0 && errno == EINTR)
+        ;
+    int32_t status;
+    if (n >= 0) {
+        while ((n = recv(sock, &status, sizeof(status), 0)) < 0 && errno == EINTR)
+            ;
+    }
+    if (n != (ssize_t)sizeof(status)) {
+        // A session that ended while the line was on its way resets the
+        // connection instead, either way it is gone.
+        errno = n >= 0 || errno == ECONNRESET ? EPIPE : errno;
+        return -1;
+    }
+    return status;
+}
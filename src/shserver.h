@@ -0,0 +1,67 @@
+#ifndef SHSERVER_H
+#define SHSERVER_H
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  struct shell;
+
+  /**
+   * Longest command line a client can send.
+   */
+#define SHSERVER_MAX_LINE (64 * 1024)
+
+  /**
+   * Most fds sent with one line, they become stdin, stdout and stderr.
+   */
+#define SHSERVER_MAX_FDS 3
+
+  /**
+   * @brief Serve command lines on a SOCK_SEQPACKET Unix socket at path
+   * until SIGTERM or SIGINT. Every connection is a session in a fork of
+   * the server, so sessions run side by side and what one changes (cd,
+   * set -o, coprocesses, the environment) stays in it. They all start
+   * from the server's warm state, its PATH cache is shared with them.
+   *
+   * Each message is one command line, NUL terminated, and gets back an
+   * int32_t exit status. fds sent with it as SCM_RIGHTS replace the
+   * session's fd 0, 1 and 2 in that order, for this command and the ones
+   * after it. exit replies with its status and ends the session. A socket
+   * left at path by a server that was killed is replaced.
+   *
+   * @param sh The server's shell
+   * @param path Where to create the socket
+   * @return 0 once stopped, -1 with errno set if it could not start
+   */
+  int shserver_run(struct shell *sh, const char *path);
+
+  /**
+   * @brief Start a session with the server at path.
+   *
+   * @param path The server's socket
+   * @return The connection or -1 with errno set
+   */
+  int shserver_connect(const char *path);
+
+  /**
+   * @brief Run a command line in a session and wait for it.
+   *
+   * @param sock The connection from shserver_connect
+   * @param line The command line
+   * @param fds The fds to use for 0, 1 and 2 from now on, may be NULL
+   * @param nfds Number of fds, at most SHSERVER_MAX_FDS
+   * @return The exit status or -1 with errno set, EPIPE if the session
+   * ended
+   */
+  int shserver_send(int sock, const char *line, const int *fds, int nfds);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
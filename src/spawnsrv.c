@@ -0,0 +1,283 @@
+#define _GNU_SOURCE
+#include "spawnsrv.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+// One request is a header, then file (when has_file is set), argv and envp
+// as NUL terminated strings. fds travel as SCM_RIGHTS, the cwd last.
+struct spawn_req
+{
+    pid_t pgid;
+    int32_t interactive;
+    int32_t nfds;
+    int32_t targets[SPAWNSRV_MAX_FDS];
+    int32_t argc;
+    int32_t envc;
+    int32_t has_file;
+};
+
+struct spawn_reply
+{
+    pid_t pid;
+    int32_t err;
+};
+
+static int sock = -1;
+static pid_t server_pid;
+static pid_t owner;
+static uint64_t count;
+// Requests are built and read here, one at a time in each process.
+static char msg[SPAWNSRV_MAX_MSG];
+
+//-----------------------------------------------------------------------------
+// server
+//-----------------------------------------------------------------------------
+static const int ignored[] = {SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU};
+
+// The new process, between clone and exec.
+static void spawn_child(const struct spawn_req *req, const int *fds, char **argv, char **envp,
+                        const char *file) {
+    if (req->interactive) {
+        pid_t self = getpid();
+        setpgid(self, req->pgid ? req->pgid : self);
+        if (!req->pgid)
+            tcsetpgrp(STDIN_FILENO, self);
+    }
+    for (size_t i = 0; i < sizeof(ignored) / sizeof(ignored[0]); i++)
+        signal(ignored[i], SIG_DFL);
+    if (fchdir(fds[req->nfds]) != 0)
+        _exit(126);
+    // Everything is first moved above every number in play so no dup2
+    // lands on an fd that is still to be moved.
+    int base = 0;
+    for (int i = 0; i <= req->nfds; i++) {
+        if (fds[i] >= base)
+            base = fds[i] + 1;
+        if (i < req->nfds && req->targets[i] >= base)
+            base = req->targets[i] + 1;
+    }
+    int moved[SPAWNSRV_MAX_FDS];
+    for (int i = 0; i < req->nfds; i++)
+        moved[i] = fcntl(fds[i], F_DUPFD_CLOEXEC, base);
+    for (int i = 0; i < req->nfds; i++)
+        dup2(moved[i], req->targets[i]);
+    environ = envp;
+    if (file)
+        execv(file, argv);
+    execvp(argv[0], argv);
+    fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+    _exit(127);
+}
+
+static pid_t serve_one(const struct spawn_req *req, size_t len, const int *fds) {
+    const char *p = msg + sizeof(*req);
+    const char *end = msg + len;
+    char **argv = malloc((size_t)(req->argc + req->envc + 2) * sizeof(*argv));
+    if (!argv) {
+        errno = ENOMEM;
+        return -1;
+    }
+    char **envp = argv + req->argc + 1;
+    const char *file = NULL;
+    int nstrings = req->argc + req->envc + (req->has_file ? 1 : 0);
+    for (int i = 0; i < nstrings; i++) {
+        const char *nul = p < end ? memchr(p, '\0', (size_t)(end - p)) : NULL;
+        if (!nul) {
+            free(argv);
+            errno = EINVAL;
+            return -1;
+        }
+        int k = req->has_file ? i - 1 : i;
+        if (k < 0)
+            file = p;
+        else if (k < req->argc)
+            argv[k] = (char *)p;
+        else
+            envp[k - req->argc] = (char *)p;
+        p = nul + 1;
+    }
+    argv[req->argc] = NULL;
+    envp[req->envc] = NULL;
+    // The new process is the shell's child, not ours, so the shell reaps
+    // it and gets its rusage exactly as if it had forked it.
+    pid_t pid = (pid_t)syscall(SYS_clone, CLONE_PARENT | SIGCHLD, NULL, NULL, NULL, NULL);
+    if (pid == 0)
+        spawn_child(req, fds, argv, envp, file);
+    int saved = errno;
+    free(argv);
+    errno = saved;
+    return pid;
+}
+
+static void serve(int fd) {
+    for (size_t i = 0; i < sizeof(ignored) / sizeof(ignored[0]); i++)
+        signal(ignored[i], SIG_IGN);
+    for (;;) {
+        union
+        {
+            char buf[CMSG_SPACE(sizeof(int) * (SPAWNSRV_MAX_FDS + 1))];
+            struct cmsghdr align;
+        } ctl;
+        struct iovec iov = {msg, sizeof(msg)};
+        struct msghdr mh = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctl.buf,
+                            .msg_controllen = sizeof(ctl.buf)};
+        ssize_t n = recvmsg(fd, &mh, MSG_CMSG_CLOEXEC);
+        if (n < 0 && errno == EINTR)
+            continue;
+        // The shell closed its end, or went away.
+        if (n <= 0)
+            _exit(0);
+        int fds[SPAWNSRV_MAX_FDS + 1];
+        int nfds = 0;
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(&mh); c; c = CMSG_NXTHDR(&mh, c)) {
+            if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+                continue;
+            int k = (int)((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            memcpy(fds + nfds, CMSG_DATA(c), (size_t)k * sizeof(int));
+            nfds += k;
+        }
+        const struct spawn_req *req = (const struct spawn_req *)msg;
+        struct spawn_reply reply = {-1, EINVAL};
+        if ((size_t)n >= sizeof(*req) && !(mh.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) &&
+            req->nfds >= 0 && req->nfds < SPAWNSRV_MAX_FDS && nfds == req->nfds + 1 &&
+            req->argc > 0 && req->envc >= 0) {
+            reply.pid = serve_one(req, (size_t)n, fds);
+            reply.err = reply.pid < 0 ? errno : 0;
+        }
+        for (int i = 0; i < nfds; i++)
+            close(fds[i]);
+        while (send(fd, &reply, sizeof(reply), MSG_NOSIGNAL) < 0 && errno == EINTR)
+            ;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// spawnsrv_start
+//-----------------------------------------------------------------------------
+int spawnsrv_start(void) {
+    if (spawnsrv_running())
+        return 0;
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) != 0)
+        return -1;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(sv[0]);
+        serve(sv[1]);
+    }
+    close(sv[1]);
+    if (pid < 0) {
+        close(sv[0]);
+        return -1;
+    }
+    sock = sv[0];
+    server_pid = pid;
+    owner = getpid();
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+// spawnsrv_stop
+//-----------------------------------------------------------------------------
+void spawnsrv_stop(void) {
+    if (!spawnsrv_running())
+        return;
+    close(sock);
+    sock = -1;
+    while (waitpid(server_pid, NULL, 0) < 0 && errno == EINTR)
+        ;
+    server_pid = 0;
+}
+
+bool spawnsrv_running(void) {
+    return sock >= 0 && getpid() == owner;
+}
+
+uint64_t spawnsrv_count(void) {
+    return count;
+}
+
+//-----------------------------------------------------------------------------
+// spawnsrv_spawn
+//-----------------------------------------------------------------------------
+static char *put(char *p, const char *end, const char *s) {
+    size_t n = strlen(s) + 1;
+    if (!p || (size_t)(end - p) < n)
+        return NULL;
+    memcpy(p, s, n);
+    return p + n;
+}
+
+pid_t spawnsrv_spawn(const char *file, char *const *argv, char *const *envp, const int *fds,
+                     const int *targets, int nfds, int cwd, pid_t pgid, bool interactive) {
+    if (!spawnsrv_running() || nfds >= SPAWNSRV_MAX_FDS) {
+        errno = EINVAL;
+        return -1;
+    }
+    struct spawn_req *req = (struct spawn_req *)msg;
+    memset(req, 0, sizeof(*req));
+    req->pgid = pgid;
+    req->interactive = interactive;
+    req->nfds = nfds;
+    memcpy(req->targets, targets, (size_t)nfds * sizeof(int));
+    req->has_file = file != NULL;
+    char *p = msg + sizeof(*req);
+    const char *end = msg + sizeof(msg);
+    if (file)
+        p = put(p, end, file);
+    for (; argv[req->argc]; req->argc++)
+        p = put(p, end, argv[req->argc]);
+    for (; envp && envp[req->envc]; req->envc++)
+        p = put(p, end, envp[req->envc]);
+    if (!p) {
+        errno = E2BIG;
+        return -1;
+    }
+
+    union
+    {
+        char buf[CMSG_SPACE(sizeof(int) * (SPAWNSRV_MAX_FDS + 1))];
+        struct cmsghdr align;
+    } ctl;
+    struct iovec iov = {msg, (size_t)(p - msg)};
+    struct msghdr mh = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctl.buf,
+                        .msg_controllen = CMSG_SPACE(sizeof(int) * (size_t)(nfds + 1))};
+    struct cmsghdr *c = CMSG_FIRSTHDR(&mh);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int) * (size_t)(nfds + 1));
+    memcpy(CMSG_DATA(c), fds, (size_t)nfds * sizeof(int));
+    memcpy((int *)CMSG_DATA(c) + nfds, &cwd, sizeof(int));
+    ssize_t n;
+    while ((n = sendmsg(sock, &mh, MSG_NOSIGNAL)) < 0 && errno == EINTR)
+        ;
+    struct spawn_reply reply;
+    if (n >= 0) {
+        while ((n = recv(sock, &reply, sizeof(reply), 0)) < 0 && errno == EINTR)
+            ;
+    }
+    if (n != (ssize_t)sizeof(reply)) {
+        // A server that has gone is not asked again.
+        if (n >= 0 || errno == EPIPE || errno == ECONNRESET)
+            spawnsrv_stop();
+        errno = n < 0 ? errno : EPIPE;
+        return -1;
+    }
+    if (reply.pid < 0) {
+        errno = reply.err;
+        return -1;
+    }
+    count++;
+    return reply.pid;
+}
@@ -0,0 +1,82 @@
+#ifndef SPAWNSRV_H
+#define SPAWNSRV_H
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * Most fds one spawn hands to the new process, stdin, stdout and stderr
+   * included.
+   */
+#define SPAWNSRV_MAX_FDS 16
+
+  /**
+   * Largest request, argv and environment together. A bigger one is
+   * refused and the caller forks as usual.
+   */
+#define SPAWNSRV_MAX_MSG (128 * 1024)
+
+  /**
+   * @brief Fork the spawn server. It should be started as early as
+   * possible, while the shell is still small, since only its own pages are
+   * copied when it forks. The server makes each process with CLONE_PARENT
+   * so it is a child of the shell, which waits for it like any other.
+   *
+   * @return 0 on success or if it is already running, -1 with errno set
+   */
+  int spawnsrv_start(void);
+
+  /**
+   * @brief Stop the server and wait for it. Processes it started are not
+   * affected.
+   */
+  void spawnsrv_stop(void);
+
+  /**
+   * @brief Whether spawns should go through the server. A forked copy of
+   * the shell shares the socket with its parent and never uses it.
+   *
+   * @return True in the process that started a server still running
+   */
+  bool spawnsrv_running(void);
+
+  /**
+   * @brief Number of processes the server has started.
+   *
+   * @return The count
+   */
+  uint64_t spawnsrv_count(void);
+
+  /**
+   * @brief Have the server start argv. In the new process each fds[i] is
+   * moved to targets[i], every other fd is closed, the cwd is set to the
+   * directory cwd refers to and the environment is envp. It joins process
+   * group pgid, or starts its own if pgid is 0 and takes the terminal when
+   * interactive is set. The signals the shell ignores are reset.
+   *
+   * @param file The path to exec or NULL to search PATH for argv[0]
+   * @param argv The command
+   * @param envp The environment
+   * @param fds The fds to hand over, left open in the caller
+   * @param targets Where each fd goes in the new process
+   * @param nfds Number of fds, at most SPAWNSRV_MAX_FDS
+   * @param cwd An fd on the working directory
+   * @param pgid The process group to join or 0
+   * @param interactive Whether the shell controls a terminal
+   * @return The pid of the new process or -1 with errno set, in which case
+   * the caller should fork it itself
+   */
+  pid_t spawnsrv_spawn(const char *file, char *const *argv, char *const *envp, const int *fds,
+                       const int *targets, int nfds, int cwd, pid_t pgid, bool interactive);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,1102 @@
+#ifndef SYSNAMES_H
+#define SYSNAMES_H
+#include <sys/syscall.h>
+
+// Syscall names for sysprof, generated from the x86_64 <asm/unistd_64.h>.
+// Every entry is guarded so other architectures get the names they have
+// and anything missing is printed by number.
+
+#define SYSNAME(n) [__NR_##n] = #n,
+
+static const char *const sysnames[] = {
+#ifdef __NR_read
+    SYSNAME(read)
+#endif
+#ifdef __NR_write
+    SYSNAME(write)
+#endif
+#ifdef __NR_open
+    SYSNAME(open)
+#endif
+#ifdef __NR_close
+    SYSNAME(close)
+#endif
+#ifdef __NR_stat
+    SYSNAME(stat)
+#endif
+#ifdef __NR_fstat
+    SYSNAME(fstat)
+#endif
+#ifdef __NR_lstat
+    SYSNAME(lstat)
+#endif
+#ifdef __NR_poll
+    SYSNAME(poll)
+#endif
+#ifdef __NR_lseek
+    SYSNAME(lseek)
+#endif
+#ifdef __NR_mmap
+    SYSNAME(mmap)
+#endif
+#ifdef __NR_mprotect
+    SYSNAME(mprotect)
+#endif
+#ifdef __NR_munmap
+    SYSNAME(munmap)
+#endif
+#ifdef __NR_brk
+    SYSNAME(brk)
+#endif
+#ifdef __NR_rt_sigaction
+    SYSNAME(rt_sigaction)
+#endif
+#ifdef __NR_rt_sigprocmask
+    SYSNAME(rt_sigprocmask)
+#endif
+#ifdef __NR_rt_sigreturn
+    SYSNAME(rt_sigreturn)
+#endif
+#ifdef __NR_ioctl
+    SYSNAME(ioctl)
+#endif
+#ifdef __NR_pread64
+    SYSNAME(pread64)
+#endif
+#ifdef __NR_pwrite64
+    SYSNAME(pwrite64)
+#endif
+#ifdef __NR_readv
+    SYSNAME(readv)
+#endif
+#ifdef __NR_writev
+    SYSNAME(writev)
+#endif
+#ifdef __NR_access
+    SYSNAME(access)
+#endif
+#ifdef __NR_pipe
+    SYSNAME(pipe)
+#endif
+#ifdef __NR_select
+    SYSNAME(select)
+#endif
+#ifdef __NR_sched_yield
+    SYSNAME(sched_yield)
+#endif
+#ifdef __NR_mremap
+    SYSNAME(mremap)
+#endif
+#ifdef __NR_msync
+    SYSNAME(msync)
+#endif
+#ifdef __NR_mincore
+    SYSNAME(mincore)
+#endif
+#ifdef __NR_madvise
+    SYSNAME(madvise)
+#endif
+#ifdef __NR_shmget
+    SYSNAME(shmget)
+#endif
+#ifdef __NR_shmat
+    SYSNAME(shmat)
+#endif
+#ifdef __NR_shmctl
+    SYSNAME(shmctl)
+#endif
+#ifdef __NR_dup
+    SYSNAME(dup)
+#endif
+#ifdef __NR_dup2
+    SYSNAME(dup2)
+#endif
+#ifdef __NR_pause
+    SYSNAME(pause)
+#endif
+#ifdef __NR_nanosleep
+    SYSNAME(nanosleep)
+#endif
+#ifdef __NR_getitimer
+    SYSNAME(getitimer)
+#endif
+#ifdef __NR_alarm
+    SYSNAME(alarm)
+#endif
+#ifdef __NR_setitimer
+    SYSNAME(setitimer)
+#endif
+#ifdef __NR_getpid
+    SYSNAME(getpid)
+#endif
+#ifdef __NR_sendfile
+    SYSNAME(sendfile)
+#endif
+#ifdef __NR_socket
+    SYSNAME(socket)
+#endif
+#ifdef __NR_connect
+    SYSNAME(connect)
+#endif
+#ifdef __NR_accept
+    SYSNAME(accept)
+#endif
+#ifdef __NR_sendto
+    SYSNAME(sendto)
+#endif
+#ifdef __NR_recvfrom
+    SYSNAME(recvfrom)
+#endif
+#ifdef __NR_sendmsg
+    SYSNAME(sendmsg)
+#endif
+#ifdef __NR_recvmsg
+    SYSNAME(recvmsg)
+#endif
+#ifdef __NR_shutdown
+    SYSNAME(shutdown)
+#endif
+#ifdef __NR_bind
+    SYSNAME(bind)
+#endif
+#ifdef __NR_listen
+    SYSNAME(listen)
+#endif
+#ifdef __NR_getsockname
+    SYSNAME(getsockname)
+#endif
+#ifdef __NR_getpeername
+    SYSNAME(getpeername)
+#endif
+#ifdef __NR_socketpair
+    SYSNAME(socketpair)
+#endif
+#ifdef __NR_setsockopt
+    SYSNAME(setsockopt)
+#endif
+#ifdef __NR_getsockopt
+    SYSNAME(getsockopt)
+#endif
+#ifdef __NR_clone
+    SYSNAME(clone)
+#endif
+#ifdef __NR_fork
+    SYSNAME(fork)
+#endif
+#ifdef __NR_vfork
+    SYSNAME(vfork)
+#endif
+#ifdef __NR_execve
+    SYSNAME(execve)
+#endif
+#ifdef __NR_exit
+    SYSNAME(exit)
+#endif
+#ifdef __NR_wait4
+    SYSNAME(wait4)
+#endif
+#ifdef __NR_kill
+    SYSNAME(kill)
+#endif
+#ifdef __NR_uname
+    SYSNAME(uname)
+#endif
+#ifdef __NR_semget
+    SYSNAME(semget)
+#endif
+#ifdef __NR_semop
+    SYSNAME(semop)
+#endif
+#ifdef __NR_semctl
+    SYSNAME(semctl)
+#endif
+#ifdef __NR_shmdt
+    SYSNAME(shmdt)
+#endif
+#ifdef __NR_msgget
+    SYSNAME(msgget)
+#endif
+#ifdef __NR_msgsnd
+    SYSNAME(msgsnd)
+#endif
+#ifdef __NR_msgrcv
+    SYSNAME(msgrcv)
+#endif
+#ifdef __NR_msgctl
+    SYSNAME(msgctl)
+#endif
+#ifdef __NR_fcntl
+    SYSNAME(fcntl)
+#endif
+#ifdef __NR_flock
+    SYSNAME(flock)
+#endif
+#ifdef __NR_fsync
+    SYSNAME(fsync)
+#endif
+#ifdef __NR_fdatasync
+    SYSNAME(fdatasync)
+#endif
+#ifdef __NR_truncate
+    SYSNAME(truncate)
+#endif
+#ifdef __NR_ftruncate
+    SYSNAME(ftruncate)
+#endif
+#ifdef __NR_getdents
+    SYSNAME(getdents)
+#endif
+#ifdef __NR_getcwd
+    SYSNAME(getcwd)
+#endif
+#ifdef __NR_chdir
+    SYSNAME(chdir)
+#endif
+#ifdef __NR_fchdir
+    SYSNAME(fchdir)
+#endif
+#ifdef __NR_rename
+    SYSNAME(rename)
+#endif
+#ifdef __NR_mkdir
+    SYSNAME(mkdir)
+#endif
+#ifdef __NR_rmdir
+    SYSNAME(rmdir)
+#endif
+#ifdef __NR_creat
+    SYSNAME(creat)
+#endif
+#ifdef __NR_link
+    SYSNAME(link)
+#endif
+#ifdef __NR_unlink
+    SYSNAME(unlink)
+#endif
+#ifdef __NR_symlink
+    SYSNAME(symlink)
+#endif
+#ifdef __NR_readlink
+    SYSNAME(readlink)
+#endif
+#ifdef __NR_chmod
+    SYSNAME(chmod)
+#endif
+#ifdef __NR_fchmod
+    SYSNAME(fchmod)
+#endif
+#ifdef __NR_chown
+    SYSNAME(chown)
+#endif
+#ifdef __NR_fchown
+    SYSNAME(fchown)
+#endif
+#ifdef __NR_lchown
+    SYSNAME(lchown)
+#endif
+#ifdef __NR_umask
+    SYSNAME(umask)
+#endif
+#ifdef __NR_gettimeofday
+    SYSNAME(gettimeofday)
+#endif
+#ifdef __NR_getrlimit
+    SYSNAME(getrlimit)
+#endif
+#ifdef __NR_getrusage
+    SYSNAME(getrusage)
+#endif
+#ifdef __NR_sysinfo
+    SYSNAME(sysinfo)
+#endif
+#ifdef __NR_times
+    SYSNAME(times)
+#endif
+#ifdef __NR_ptrace
+    SYSNAME(ptrace)
+#endif
+#ifdef __NR_getuid
+    SYSNAME(getuid)
+#endif
+#ifdef __NR_syslog
+    SYSNAME(syslog)
+#endif
+#ifdef __NR_getgid
+    SYSNAME(getgid)
+#endif
+#ifdef __NR_setuid
+    SYSNAME(setuid)
+#endif
+#ifdef __NR_setgid
+    SYSNAME(setgid)
+#endif
+#ifdef __NR_geteuid
+    SYSNAME(geteuid)
+#endif
+#ifdef __NR_getegid
+    SYSNAME(getegid)
+#endif
+#ifdef __NR_setpgid
+    SYSNAME(setpgid)
+#endif
+#ifdef __NR_getppid
+    SYSNAME(getppid)
+#endif
+#ifdef __NR_getpgrp
+    SYSNAME(getpgrp)
+#endif
+#ifdef __NR_setsid
+    SYSNAME(setsid)
+#endif
+#ifdef __NR_setreuid
+    SYSNAME(setreuid)
+#endif
+#ifdef __NR_setregid
+    SYSNAME(setregid)
+#endif
+#ifdef __NR_getgroups
+    SYSNAME(getgroups)
+#endif
+#ifdef __NR_setgroups
+    SYSNAME(setgroups)
+#endif
+#ifdef __NR_setresuid
+    SYSNAME(setresuid)
+#endif
+#ifdef __NR_getresuid
+    SYSNAME(getresuid)
+#endif
+#ifdef __NR_setresgid
+    SYSNAME(setresgid)
+#endif
+#ifdef __NR_getresgid
+    SYSNAME(getresgid)
+#endif
+#ifdef __NR_getpgid
+    SYSNAME(getpgid)
+#endif
+#ifdef __NR_setfsuid
+    SYSNAME(setfsuid)
+#endif
+#ifdef __NR_setfsgid
+    SYSNAME(setfsgid)
+#endif
+#ifdef __NR_getsid
+    SYSNAME(getsid)
+#endif
+#ifdef __NR_capget
+    SYSNAME(capget)
+#endif
+#ifdef __NR_capset
+    SYSNAME(capset)
+#endif
+#ifdef __NR_rt_sigpending
+    SYSNAME(rt_sigpending)
+#endif
+#ifdef __NR_rt_sigtimedwait
+    SYSNAME(rt_sigtimedwait)
+#endif
+#ifdef __NR_rt_sigqueueinfo
+    SYSNAME(rt_sigqueueinfo)
+#endif
+#ifdef __NR_rt_sigsuspend
+    SYSNAME(rt_sigsuspend)
+#endif
+#ifdef __NR_sigaltstack
+    SYSNAME(sigaltstack)
+#endif
+#ifdef __NR_utime
+    SYSNAME(utime)
+#endif
+#ifdef __NR_mknod
+    SYSNAME(mknod)
+#endif
+#ifdef __NR_uselib
+    SYSNAME(uselib)
+#endif
+#ifdef __NR_personality
+    SYSNAME(personality)
+#endif
+#ifdef __NR_ustat
+    SYSNAME(ustat)
+#endif
+#ifdef __NR_statfs
+    SYSNAME(statfs)
+#endif
+#ifdef __NR_fstatfs
+    SYSNAME(fstatfs)
+#endif
+#ifdef __NR_sysfs
+    SYSNAME(sysfs)
+#endif
+#ifdef __NR_getpriority
+    SYSNAME(getpriority)
+#endif
+#ifdef __NR_setpriority
+    SYSNAME(setpriority)
+#endif
+#ifdef __NR_sched_setparam
+    SYSNAME(sched_setparam)
+#endif
+#ifdef __NR_sched_getparam
+    SYSNAME(sched_getparam)
+#endif
+#ifdef __NR_sched_setscheduler
+    SYSNAME(sched_setscheduler)
+#endif
+#ifdef __NR_sched_getscheduler
+    SYSNAME(sched_getscheduler)
+#endif
+#ifdef __NR_sched_get_priority_max
+    SYSNAME(sched_get_priority_max)
+#endif
+#ifdef __NR_sched_get_priority_min
+    SYSNAME(sched_get_priority_min)
+#endif
+#ifdef __NR_sched_rr_get_interval
+    SYSNAME(sched_rr_get_interval)
+#endif
+#ifdef __NR_mlock
+    SYSNAME(mlock)
+#endif
+#ifdef __NR_munlock
+    SYSNAME(munlock)
+#endif
+#ifdef __NR_mlockall
+    SYSNAME(mlockall)
+#endif
+#ifdef __NR_munlockall
+    SYSNAME(munlockall)
+#endif
+#ifdef __NR_vhangup
+    SYSNAME(vhangup)
+#endif
+#ifdef __NR_modify_ldt
+    SYSNAME(modify_ldt)
+#endif
+#ifdef __NR_pivot_root
+    SYSNAME(pivot_root)
+#endif
+#ifdef __NR__sysctl
+    SYSNAME(_sysctl)
+#endif
+#ifdef __NR_prctl
+    SYSNAME(prctl)
+#endif
+#ifdef __NR_arch_prctl
+    SYSNAME(arch_prctl)
+#endif
+#ifdef __NR_adjtimex
+    SYSNAME(adjtimex)
+#endif
+#ifdef __NR_setrlimit
+    SYSNAME(setrlimit)
+#endif
+#ifdef __NR_chroot
+    SYSNAME(chroot)
+#endif
+#ifdef __NR_sync
+    SYSNAME(sync)
+#endif
+#ifdef __NR_acct
+    SYSNAME(acct)
+#endif
+#ifdef __NR_settimeofday
+    SYSNAME(settimeofday)
+#endif
+#ifdef __NR_mount
+    SYSNAME(mount)
+#endif
+#ifdef __NR_umount2
+    SYSNAME(umount2)
+#endif
+#ifdef __NR_swapon
+    SYSNAME(swapon)
+#endif
+#ifdef __NR_swapoff
+    SYSNAME(swapoff)
+#endif
+#ifdef __NR_reboot
+    SYSNAME(reboot)
+#endif
+#ifdef __NR_sethostname
+    SYSNAME(sethostname)
+#endif
+#ifdef __NR_setdomainname
+    SYSNAME(setdomainname)
+#endif
+#ifdef __NR_iopl
+    SYSNAME(iopl)
+#endif
+#ifdef __NR_ioperm
+    SYSNAME(ioperm)
+#endif
+#ifdef __NR_create_module
+    SYSNAME(create_module)
+#endif
+#ifdef __NR_init_module
+    SYSNAME(init_module)
+#endif
+#ifdef __NR_delete_module
+    SYSNAME(delete_module)
+#endif
+#ifdef __NR_get_kernel_syms
+    SYSNAME(get_kernel_syms)
+#endif
+#ifdef __NR_query_module
+    SYSNAME(query_module)
+#endif
+#ifdef __NR_quotactl
+    SYSNAME(quotactl)
+#endif
+#ifdef __NR_nfsservctl
+    SYSNAME(nfsservctl)
+#endif
+#ifdef __NR_getpmsg
+    SYSNAME(getpmsg)
+#endif
+#ifdef __NR_putpmsg
+    SYSNAME(putpmsg)
+#endif
+#ifdef __NR_afs_syscall
+    SYSNAME(afs_syscall)
+#endif
+#ifdef __NR_tuxcall
+    SYSNAME(tuxcall)
+#endif
+#ifdef __NR_security
+    SYSNAME(security)
+#endif
+#ifdef __NR_gettid
+    SYSNAME(gettid)
+#endif
+#ifdef __NR_readahead
+    SYSNAME(readahead)
+#endif
+#ifdef __NR_setxattr
+    SYSNAME(setxattr)
+#endif
+#ifdef __NR_lsetxattr
+    SYSNAME(lsetxattr)
+#endif
+#ifdef __NR_fsetxattr
+    SYSNAME(fsetxattr)
+#endif
+#ifdef __NR_getxattr
+    SYSNAME(getxattr)
+#endif
+#ifdef __NR_lgetxattr
+    SYSNAME(lgetxattr)
+#endif
+#ifdef __NR_fgetxattr
+    SYSNAME(fgetxattr)
+#endif
+#ifdef __NR_listxattr
+    SYSNAME(listxattr)
+#endif
+#ifdef __NR_llistxattr
+    SYSNAME(llistxattr)
+#endif
+#ifdef __NR_flistxattr
+    SYSNAME(flistxattr)
+#endif
+#ifdef __NR_removexattr
+    SYSNAME(removexattr)
+#endif
+#ifdef __NR_lremovexattr
+    SYSNAME(lremovexattr)
+#endif
+#ifdef __NR_fremovexattr
+    SYSNAME(fremovexattr)
+#endif
+#ifdef __NR_tkill
+    SYSNAME(tkill)
+#endif
+#ifdef __NR_time
+    SYSNAME(time)
+#endif
+#ifdef __NR_futex
+    SYSNAME(futex)
+#endif
+#ifdef __NR_sched_setaffinity
+    SYSNAME(sched_setaffinity)
+#endif
+#ifdef __NR_sched_getaffinity
+    SYSNAME(sched_getaffinity)
+#endif
+#ifdef __NR_set_thread_area
+    SYSNAME(set_thread_area)
+#endif
+#ifdef __NR_io_setup
+    SYSNAME(io_setup)
+#endif
+#ifdef __NR_io_destroy
+    SYSNAME(io_destroy)
+#endif
+#ifdef __NR_io_getevents
+    SYSNAME(io_getevents)
+#endif
+#ifdef __NR_io_submit
+    SYSNAME(io_submit)
+#endif
+#ifdef __NR_io_cancel
+    SYSNAME(io_cancel)
+#endif
+#ifdef __NR_get_thread_area
+    SYSNAME(get_thread_area)
+#endif
+#ifdef __NR_lookup_dcookie
+    SYSNAME(lookup_dcookie)
+#endif
+#ifdef __NR_epoll_create
+    SYSNAME(epoll_create)
+#endif
+#ifdef __NR_epoll_ctl_old
+    SYSNAME(epoll_ctl_old)
+#endif
+#ifdef __NR_epoll_wait_old
+    SYSNAME(epoll_wait_old)
+#endif
+#ifdef __NR_remap_file_pages
+    SYSNAME(remap_file_pages)
+#endif
+#ifdef __NR_getdents64
+    SYSNAME(getdents64)
+#endif
+#ifdef __NR_set_tid_address
+    SYSNAME(set_tid_address)
+#endif
+#ifdef __NR_restart_syscall
+    SYSNAME(restart_syscall)
+#endif
+#ifdef __NR_semtimedop
+    SYSNAME(semtimedop)
+#endif
+#ifdef __NR_fadvise64
+    SYSNAME(fadvise64)
+#endif
+#ifdef __NR_timer_create
+    SYSNAME(timer_create)
+#endif
+#ifdef __NR_timer_settime
+    SYSNAME(timer_settime)
+#endif
+#ifdef __NR_timer_gettime
+    SYSNAME(timer_gettime)
+#endif
+#ifdef __NR_timer_getoverrun
+    SYSNAME(timer_getoverrun)
+#endif
+#ifdef __NR_timer_delete
+    SYSNAME(timer_delete)
+#endif
+#ifdef __NR_clock_settime
+    SYSNAME(clock_settime)
+#endif
+#ifdef __NR_clock_gettime
+    SYSNAME(clock_gettime)
+#endif
+#ifdef __NR_clock_getres
+    SYSNAME(clock_getres)
+#endif
+#ifdef __NR_clock_nanosleep
+    SYSNAME(clock_nanosleep)
+#endif
+#ifdef __NR_exit_group
+    SYSNAME(exit_group)
+#endif
+#ifdef __NR_epoll_wait
+    SYSNAME(epoll_wait)
+#endif
+#ifdef __NR_epoll_ctl
+    SYSNAME(epoll_ctl)
+#endif
+#ifdef __NR_tgkill
+    SYSNAME(tgkill)
+#endif
+#ifdef __NR_utimes
+    SYSNAME(utimes)
+#endif
+#ifdef __NR_vserver
+    SYSNAME(vserver)
+#endif
+#ifdef __NR_mbind
+    SYSNAME(mbind)
+#endif
+#ifdef __NR_set_mempolicy
+    SYSNAME(set_mempolicy)
+#endif
+#ifdef __NR_get_mempolicy
+    SYSNAME(get_mempolicy)
+#endif
+#ifdef __NR_mq_open
+    SYSNAME(mq_open)
+#endif
+#ifdef __NR_mq_unlink
+    SYSNAME(mq_unlink)
+#endif
+#ifdef __NR_mq_timedsend
+    SYSNAME(mq_timedsend)
+#endif
+#ifdef __NR_mq_timedreceive
+    SYSNAME(mq_timedreceive)
+#endif
+#ifdef __NR_mq_notify
+    SYSNAME(mq_notify)
+#endif
+#ifdef __NR_mq_getsetattr
+    SYSNAME(mq_getsetattr)
+#endif
+#ifdef __NR_kexec_load
+    SYSNAME(kexec_load)
+#endif
+#ifdef __NR_waitid
+    SYSNAME(waitid)
+#endif
+#ifdef __NR_add_key
+    SYSNAME(add_key)
+#endif
+#ifdef __NR_request_key
+    SYSNAME(request_key)
+#endif
+#ifdef __NR_keyctl
+    SYSNAME(keyctl)
+#endif
+#ifdef __NR_ioprio_set
+    SYSNAME(ioprio_set)
+#endif
+#ifdef __NR_ioprio_get
+    SYSNAME(ioprio_get)
+#endif
+#ifdef __NR_inotify_init
+    SYSNAME(inotify_init)
+#endif
+#ifdef __NR_inotify_add_watch
+    SYSNAME(inotify_add_watch)
+#endif
+#ifdef __NR_inotify_rm_watch
+    SYSNAME(inotify_rm_watch)
+#endif
+#ifdef __NR_migrate_pages
+    SYSNAME(migrate_pages)
+#endif
+#ifdef __NR_openat
+    SYSNAME(openat)
+#endif
+#ifdef __NR_mkdirat
+    SYSNAME(mkdirat)
+#endif
+#ifdef __NR_mknodat
+    SYSNAME(mknodat)
+#endif
+#ifdef __NR_fchownat
+    SYSNAME(fchownat)
+#endif
+#ifdef __NR_futimesat
+    SYSNAME(futimesat)
+#endif
+#ifdef __NR_newfstatat
+    SYSNAME(newfstatat)
+#endif
+#ifdef __NR_unlinkat
+    SYSNAME(unlinkat)
+#endif
+#ifdef __NR_renameat
+    SYSNAME(renameat)
+#endif
+#ifdef __NR_linkat
+    SYSNAME(linkat)
+#endif
+#ifdef __NR_symlinkat
+    SYSNAME(symlinkat)
+#endif
+#ifdef __NR_readlinkat
+    SYSNAME(readlinkat)
+#endif
+#ifdef __NR_fchmodat
+    SYSNAME(fchmodat)
+#endif
+#ifdef __NR_faccessat
+    SYSNAME(faccessat)
+#endif
+#ifdef __NR_pselect6
+    SYSNAME(pselect6)
+#endif
+#ifdef __NR_ppoll
+    SYSNAME(ppoll)
+#endif
+#ifdef __NR_unshare
+    SYSNAME(unshare)
+#endif
+#ifdef __NR_set_robust_list
+    SYSNAME(set_robust_list)
+#endif
+#ifdef __NR_get_robust_list
+    SYSNAME(get_robust_list)
+#endif
+#ifdef __NR_splice
+    SYSNAME(splice)
+#endif
+#ifdef __NR_tee
+    SYSNAME(tee)
+#endif
+#ifdef __NR_sync_file_range
+    SYSNAME(sync_file_range)
+#endif
+#ifdef __NR_vmsplice
+    SYSNAME(vmsplice)
+#endif
+#ifdef __NR_move_pages
+    SYSNAME(move_pages)
+#endif
+#ifdef __NR_utimensat
+    SYSNAME(utimensat)
+#endif
+#ifdef __NR_epoll_pwait
+    SYSNAME(epoll_pwait)
+#endif
+#ifdef __NR_signalfd
+    SYSNAME(signalfd)
+#endif
+#ifdef __NR_timerfd_create
+    SYSNAME(timerfd_create)
+#endif
+#ifdef __NR_eventfd
+    SYSNAME(eventfd)
+#endif
+#ifdef __NR_fallocate
+    SYSNAME(fallocate)
+#endif
+#ifdef __NR_timerfd_settime
+    SYSNAME(timerfd_settime)
+#endif
+#ifdef __NR_timerfd_gettime
+    SYSNAME(timerfd_gettime)
+#endif
+#ifdef __NR_accept4
+    SYSNAME(accept4)
+#endif
+#ifdef __NR_signalfd4
+    SYSNAME(signalfd4)
+#endif
+#ifdef __NR_eventfd2
+    SYSNAME(eventfd2)
+#endif
+#ifdef __NR_epoll_create1
+    SYSNAME(epoll_create1)
+#endif
+#ifdef __NR_dup3
+    SYSNAME(dup3)
+#endif
+#ifdef __NR_pipe2
+    SYSNAME(pipe2)
+#endif
+#ifdef __NR_inotify_init1
+    SYSNAME(inotify_init1)
+#endif
+#ifdef __NR_preadv
+    SYSNAME(preadv)
+#endif
+#ifdef __NR_pwritev
+    SYSNAME(pwritev)
+#endif
+#ifdef __NR_rt_tgsigqueueinfo
+    SYSNAME(rt_tgsigqueueinfo)
+#endif
+#ifdef __NR_perf_event_open
+    SYSNAME(perf_event_open)
+#endif
+#ifdef __NR_recvmmsg
+    SYSNAME(recvmmsg)
+#endif
+#ifdef __NR_fanotify_init
+    SYSNAME(fanotify_init)
+#endif
+#ifdef __NR_fanotify_mark
+    SYSNAME(fanotify_mark)
+#endif
+#ifdef __NR_prlimit64
+    SYSNAME(prlimit64)
+#endif
+#ifdef __NR_name_to_handle_at
+    SYSNAME(name_to_handle_at)
+#endif
+#ifdef __NR_open_by_handle_at
+    SYSNAME(open_by_handle_at)
+#endif
+#ifdef __NR_clock_adjtime
+    SYSNAME(clock_adjtime)
+#endif
+#ifdef __NR_syncfs
+    SYSNAME(syncfs)
+#endif
+#ifdef __NR_sendmmsg
+    SYSNAME(sendmmsg)
+#endif
+#ifdef __NR_setns
+    SYSNAME(setns)
+#endif
+#ifdef __NR_getcpu
+    SYSNAME(getcpu)
+#endif
+#ifdef __NR_process_vm_readv
+    SYSNAME(process_vm_readv)
+#endif
+#ifdef __NR_process_vm_writev
+    SYSNAME(process_vm_writev)
+#endif
+#ifdef __NR_kcmp
+    SYSNAME(kcmp)
+#endif
+#ifdef __NR_finit_module
+    SYSNAME(finit_module)
+#endif
+#ifdef __NR_sched_setattr
+    SYSNAME(sched_setattr)
+#endif
+#ifdef __NR_sched_getattr
+    SYSNAME(sched_getattr)
+#endif
+#ifdef __NR_renameat2
+    SYSNAME(renameat2)
+#endif
+#ifdef __NR_seccomp
+    SYSNAME(seccomp)
+#endif
+#ifdef __NR_getrandom
+    SYSNAME(getrandom)
+#endif
+#ifdef __NR_memfd_create
+    SYSNAME(memfd_create)
+#endif
+#ifdef __NR_kexec_file_load
+    SYSNAME(kexec_file_load)
+#endif
+#ifdef __NR_bpf
+    SYSNAME(bpf)
+#endif
+#ifdef __NR_execveat
+    SYSNAME(execveat)
+#endif
+#ifdef __NR_userfaultfd
+    SYSNAME(userfaultfd)
+#endif
+#ifdef __NR_membarrier
+    SYSNAME(membarrier)
+#endif
+#ifdef __NR_mlock2
+    SYSNAME(mlock2)
+#endif
+#ifdef __NR_copy_file_range
+    SYSNAME(copy_file_range)
+#endif
+#ifdef __NR_preadv2
+    SYSNAME(preadv2)
+#endif
+#ifdef __NR_pwritev2
+    SYSNAME(pwritev2)
+#endif
+#ifdef __NR_pkey_mprotect
+    SYSNAME(pkey_mprotect)
+#endif
+#ifdef __NR_pkey_alloc
+    SYSNAME(pkey_alloc)
+#endif
+#ifdef __NR_pkey_free
+    SYSNAME(pkey_free)
+#endif
+#ifdef __NR_statx
+    SYSNAME(statx)
+#endif
+#ifdef __NR_io_pgetevents
+    SYSNAME(io_pgetevents)
+#endif
+#ifdef __NR_rseq
+    SYSNAME(rseq)
+#endif
+#ifdef __NR_pidfd_send_signal
+    SYSNAME(pidfd_send_signal)
+#endif
+#ifdef __NR_io_uring_setup
+    SYSNAME(io_uring_setup)
+#endif
+#ifdef __NR_io_uring_enter
+    SYSNAME(io_uring_enter)
+#endif
+#ifdef __NR_io_uring_register
+    SYSNAME(io_uring_register)
+#endif
+#ifdef __NR_open_tree
+    SYSNAME(open_tree)
+#endif
+#ifdef __NR_move_mount
+    SYSNAME(move_mount)
+#endif
+#ifdef __NR_fsopen
+    SYSNAME(fsopen)
+#endif
+#ifdef __NR_fsconfig
+    SYSNAME(fsconfig)
+#endif
+#ifdef __NR_fsmount
+    SYSNAME(fsmount)
+#endif
+#ifdef __NR_fspick
+    SYSNAME(fspick)
+#endif
+#ifdef __NR_pidfd_open
+    SYSNAME(pidfd_open)
+#endif
+#ifdef __NR_clone3
+    SYSNAME(clone3)
+#endif
+#ifdef __NR_close_range
+    SYSNAME(close_range)
+#endif
+#ifdef __NR_openat2
+    SYSNAME(openat2)
+#endif
+#ifdef __NR_pidfd_getfd
+    SYSNAME(pidfd_getfd)
+#endif
+#ifdef __NR_faccessat2
+    SYSNAME(faccessat2)
+#endif
+#ifdef __NR_process_madvise
+    SYSNAME(process_madvise)
+#endif
+#ifdef __NR_epoll_pwait2
+    SYSNAME(epoll_pwait2)
+#endif
+#ifdef __NR_mount_setattr
+    SYSNAME(mount_setattr)
+#endif
+#ifdef __NR_quotactl_fd
+    SYSNAME(quotactl_fd)
+#endif
+#ifdef __NR_landlock_create_ruleset
+    SYSNAME(landlock_create_ruleset)
+#endif
+#ifdef __NR_landlock_add_rule
+    SYSNAME(landlock_add_rule)
+#endif
+#ifdef __NR_landlock_restrict_self
+    SYSNAME(landlock_restrict_self)
+#endif
+#ifdef __NR_memfd_secret
+    SYSNAME(memfd_secret)
+#endif
+#ifdef __NR_process_mrelease
+    SYSNAME(process_mrelease)
+#endif
+#ifdef __NR_futex_waitv
+    SYSNAME(futex_waitv)
+#endif
+#ifdef __NR_set_mempolicy_home_node
+    SYSNAME(set_mempolicy_home_node)
+#endif
+};
+
+#undef SYSNAME
+
+#endif
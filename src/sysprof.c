@@ -0,0 +1,324 @@
+#define _GNU_SOURCE
+#include "sysprof.h"
+#include "sysnames.h"
+#include "lab.h"
+#include "job.h"
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <sys/ptrace.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+
+#define NSYSNAMES (sizeof(sysnames) / sizeof(sysnames[0]))
+
+// Where one traced process or thread is between its stops.
+struct tracee
+{
+    pid_t pid;
+    bool fresh;
+    bool in_syscall;
+    int nr;
+    uint64_t t_entry;
+};
+
+struct tracees
+{
+    struct tracee *v;
+    size_t n;
+    size_t cap;
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+//-----------------------------------------------------------------------------
+// sysprof_nr
+//-----------------------------------------------------------------------------
+int sysprof_nr(const char *name) {
+    for (size_t i = 0; i < NSYSNAMES; i++) {
+        if (sysnames[i] && strcmp(sysnames[i], name) == 0)
+            return (int)i;
+    }
+    return -1;
+}
+
+// Tracees are only ever added for the profiled command and for what its
+// fork and clone events report, the shell's other children are not ours.
+static struct tracee *tracee_add(struct tracees *ts, pid_t pid) {
+    if (ts->n == ts->cap) {
+        size_t cap = ts->cap ? ts->cap * 2 : 8;
+        struct tracee *tmp = realloc(ts->v, cap * sizeof(*tmp));
+        if (!tmp)
+            return NULL;
+        ts->v = tmp;
+        ts->cap = cap;
+    }
+    // A child auto-attached by a fork or clone event starts out stopped
+    // with a SIGSTOP that is not meant for it.
+    struct tracee *t = &ts->v[ts->n++];
+    memset(t, 0, sizeof(*t));
+    t->pid = pid;
+    t->fresh = true;
+    return t;
+}
+
+static void tracee_remove(struct tracees *ts, struct tracee *t) {
+    *t = ts->v[--ts->n];
+}
+
+//-----------------------------------------------------------------------------
+// child
+//-----------------------------------------------------------------------------
+// A seccomp filter that makes the selected syscalls, or all of them, stop
+// in the tracer and lets everything else through untouched.
+static int install_filter(const struct sysprof *prof) {
+    struct sock_filter f[SYSPROF_MAX_FILTER + 3];
+    int n = 0;
+    if (prof->nfilter == 0) {
+        f[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_TRACE);
+    } else {
+        f[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+                                              offsetof(struct seccomp_data, nr));
+        for (int i = 0; i < prof->nfilter; i++) {
+            // Jump to the RET_TRACE at the end if it matches.
+            f[n] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (unsigned)prof->filter[i],
+                                                (unsigned char)(prof->nfilter - i), 0);
+            n++;
+        }
+        f[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+        f[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_TRACE);
+    }
+    struct sock_fprog prog = {(unsigned short)n, f};
+    // no_new_privs is what lets an unprivileged process install a filter.
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0)
+        return -1;
+    return prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog);
+}
+
+static void sysprof_child(struct shell *sh, char **argv, const struct sysprof *prof) {
+    if (sh->shell_is_interactive) {
+        pid_t child = getpid();
+        setpgid(child, child);
+        tcsetpgrp(sh->shell_terminal, child);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGQUIT, SIG_DFL);
+        signal(SIGTSTP, SIG_DFL);
+        signal(SIGTTIN, SIG_DFL);
+        signal(SIGTTOU, SIG_DFL);
+    }
+    if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) != 0) {
+        fprintf(stderr, "sysprof: ptrace: %s\n", strerror(errno));
+        _exit(126);
+    }
+    // Wait here until the parent has set the trace options.
+    raise(SIGSTOP);
+    if (prof->mode == SYSPROF_SECCOMP && install_filter(prof) != 0) {
+        fprintf(stderr, "sysprof: seccomp: %s\n", strerror(errno));
+        _exit(126);
+    }
+    execvp(argv[0], argv);
+    fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
+    _exit(127);
+}
+
+//-----------------------------------------------------------------------------
+// sysprof_run
+//-----------------------------------------------------------------------------
+static void syscall_entry(struct tracee *t, struct sysprof *prof, uint64_t nr) {
+    t->nr = nr < SYSPROF_MAX_NR ? (int)nr : SYSPROF_MAX_NR;
+    t->in_syscall = true;
+    // Counted on entry, exit_group and a successful execve never return.
+    prof->sc[t->nr].calls++;
+    t->t_entry = now_ns();
+}
+
+static void syscall_exit(struct tracee *t, struct sysprof *prof, bool is_error) {
+    if (!t->in_syscall)
+        return;
+    prof->sc[t->nr].ns += now_ns() - t->t_entry;
+    prof->sc[t->nr].errors += is_error;
+    t->in_syscall = false;
+}
+
+static void sysprof_stop(struct tracees *ts, struct tracee *t, struct sysprof *prof,
+                         enum __ptrace_request resume, int ws) {
+    pid_t w = t->pid;
+    int sig = WSTOPSIG(ws);
+    int event = ws >> 16;
+    struct __ptrace_syscall_info info;
+    if (sig == (SIGTRAP | 0x80)) {
+        ptrace(PTRACE_GET_SYSCALL_INFO, w, (void *)sizeof(info), &info);
+        if (info.op == PTRACE_SYSCALL_INFO_ENTRY)
+            syscall_entry(t, prof, info.entry.nr);
+        else if (info.op == PTRACE_SYSCALL_INFO_EXIT)
+            syscall_exit(t, prof, info.exit.is_error);
+        ptrace(resume, w, NULL, NULL);
+    } else if (event == PTRACE_EVENT_SECCOMP) {
+        ptrace(PTRACE_GET_SYSCALL_INFO, w, (void *)sizeof(info), &info);
+        syscall_entry(t, prof, info.seccomp.nr);
+        // One more stop to see this syscall return, then run free.
+        ptrace(PTRACE_SYSCALL, w, NULL, NULL);
+    } else if (event == PTRACE_EVENT_FORK || event == PTRACE_EVENT_VFORK ||
+               event == PTRACE_EVENT_CLONE) {
+        unsigned long child;
+        ptrace(PTRACE_GETEVENTMSG, w, NULL, &child);
+        ptrace(resume, w, NULL, NULL);
+        // t may move once the new tracee is added.
+        if (!tracee_add(ts, (pid_t)child))
+            ptrace(PTRACE_DETACH, (pid_t)child, NULL, NULL);
+    } else if (event) {
+        ptrace(resume, w, NULL, NULL);
+    } else if (sig == SIGSTOP && t->fresh) {
+        t->fresh = false;
+        ptrace(resume, w, NULL, NULL);
+    } else {
+        // A real signal, hand it on.
+        ptrace(resume, w, NULL, (void *)(long)sig);
+    }
+}
+
+int sysprof_run(struct shell *sh, char **argv, struct sysprof *prof) {
+    memset(prof->sc, 0, sizeof(prof->sc));
+    fflush(stdout);
+    uint64_t start = now_ns();
+    pid_t pid = fork();
+    if (pid == 0) {
+        sysprof_child(sh, argv, prof);
+    } else if (pid < 0) {
+        perror("sysprof: fork");
+        return -1;
+    }
+    if (sh->shell_is_interactive) {
+        setpgid(pid, pid);
+        tcsetpgrp(sh->shell_terminal, pid);
+    }
+
+    int status = 0;
+    struct job_stats st = {0};
+    st.jobs = 1;
+    struct tracees ts = {0};
+    if (waitpid(pid, &status, 0) == pid && WIFSTOPPED(status)) {
+        long opts = PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK |
+                    PTRACE_O_TRACECLONE | PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL;
+        if (prof->mode == SYSPROF_SECCOMP)
+            opts |= PTRACE_O_TRACESECCOMP;
+        ptrace(PTRACE_SETOPTIONS, pid, NULL, (void *)opts);
+        struct tracee *first = tracee_add(&ts, pid);
+        if (first)
+            first->fresh = false;
+        // In seccomp mode nothing stops unless the filter says so.
+        enum __ptrace_request resume = prof->mode == SYSPROF_SECCOMP ? PTRACE_CONT : PTRACE_SYSCALL;
+        ptrace(resume, pid, NULL, NULL);
+
+        // Waiting for any child would also reap the shell's coprocesses and
+        // other helpers, so every tracee is polled by its own pid and the
+        // tracer sleeps on SIGCHLD, blocked so none is lost between polls.
+        sigset_t chld, old_mask;
+        sigemptyset(&chld);
+        sigaddset(&chld, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &chld, &old_mask);
+        while (ts.n > 0) {
+            bool seen = false;
+            for (size_t i = 0; i < ts.n;) {
+                int ws;
+                struct rusage ru;
+                struct tracee *t = &ts.v[i];
+                pid_t w = wait4(t->pid, &ws, __WALL | WNOHANG, &ru);
+                if (w == 0 || (w < 0 && errno == EINTR)) {
+                    i++;
+                    continue;
+                }
+                seen = true;
+                // A thread that was replaced by an execve in another one is
+                // gone without a word.
+                if (w < 0 || WIFEXITED(ws) || WIFSIGNALED(ws)) {
+                    if (w > 0)
+                        job_stats_add(&st, &ru);
+                    if (w == pid)
+                        status = ws;
+                    tracee_remove(&ts, t);
+                    continue;
+                }
+                i++;
+                sysprof_stop(&ts, t, prof, resume, ws);
+            }
+            if (!seen)
+                sigwaitinfo(&chld, NULL);
+        }
+        sigprocmask(SIG_SETMASK, &old_mask, NULL);
+    }
+    free(ts.v);
+    if (sh->shell_is_interactive)
+        tcsetpgrp(sh->shell_terminal, sh->shell_pgid);
+    st.real_ns = now_ns() - start;
+    sh->last_job = st;
+    job_stats_merge(&sh->totals, &st);
+
+    if (WIFSIGNALED(status))
+        return 128 + WTERMSIG(status);
+    if (WIFEXITED(status))
+        return WEXITSTATUS(status);
+    return -1;
+}
+
+//-----------------------------------------------------------------------------
+// sysprof_print
+//-----------------------------------------------------------------------------
+static const struct sysprof *sort_prof;
+
+static int cmp_entry(const void *a, const void *b) {
+    const struct sysprof_entry *x = &sort_prof->sc[*(const int *)a];
+    const struct sysprof_entry *y = &sort_prof->sc[*(const int *)b];
+    if (x->ns != y->ns)
+        return x->ns < y->ns ? 1 : -1;
+    return x->calls < y->calls ? 1 : x->calls > y->calls ? -1 : 0;
+}
+
+void sysprof_print(FILE *fp, const struct sysprof *prof) {
+    int order[SYSPROF_MAX_NR + 1];
+    int n = 0;
+    struct sysprof_entry total = {0};
+    for (int i = 0; i <= SYSPROF_MAX_NR; i++) {
+        if (!prof->sc[i].calls)
+            continue;
+        order[n++] = i;
+        total.calls += prof->sc[i].calls;
+        total.errors += prof->sc[i].errors;
+        total.ns += prof->sc[i].ns;
+    }
+    sort_prof = prof;
+    qsort(order, n, sizeof(int), cmp_entry);
+
+    static const char rule[] = "------ ----------- ----------- --------- --------- ----------------\n";
+    fprintf(fp, "%6s %11s %11s %9s %9s %s\n", "% time", "seconds", "usecs/call", "calls",
+            "errors", "syscall");
+    fputs(rule, fp);
+    for (int i = 0; i < n; i++) {
+        const struct sysprof_entry *e = &prof->sc[order[i]];
+        char unknown[32];
+        const char *name = (size_t)order[i] < NSYSNAMES ? sysnames[order[i]] : NULL;
+        if (!name) {
+            if (order[i] == SYSPROF_MAX_NR)
+                snprintf(unknown, sizeof(unknown), "other");
+            else
+                snprintf(unknown, sizeof(unknown), "syscall_%d", order[i]);
+            name = unknown;
+        }
+        fprintf(fp, "%6.2f %11.6f %11llu %9llu %9llu %s\n",
+                total.ns ? 100.0 * (double)e->ns / (double)total.ns : 0.0, (double)e->ns / 1e9,
+                (unsigned long long)(e->ns / 1000 / e->calls), (unsigned long long)e->calls,
+                (unsigned long long)e->errors, name);
+    }
+    fputs(rule, fp);
+    fprintf(fp, "%6.2f %11.6f %11s %9llu %9llu %s\n", 100.0, (double)total.ns / 1e9, "",
+            (unsigned long long)total.calls, (unsigned long long)total.errors, "total");
+}
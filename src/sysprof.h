@@ -0,0 +1,86 @@
+#ifndef SYSPROF_H
+#define SYSPROF_H
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  struct shell;
+
+  /**
+   * Syscall numbers at or above this are counted as one "other" entry.
+   */
+#define SYSPROF_MAX_NR 1024
+
+  /**
+   * Most syscalls a seccomp filter can select.
+   */
+#define SYSPROF_MAX_FILTER 64
+
+  enum sysprof_mode
+  {
+    /** Stop at every syscall entry and exit with PTRACE_SYSCALL. */
+    SYSPROF_PTRACE,
+    /**
+     * A seccomp filter returns SECCOMP_RET_TRACE, either for every syscall
+     * or only for the ones in the filter list. Syscalls that are not
+     * selected never stop which is where the lower overhead comes from.
+     */
+    SYSPROF_SECCOMP,
+  };
+
+  struct sysprof_entry
+  {
+    uint64_t calls;
+    uint64_t errors;
+    uint64_t ns;
+  };
+
+  struct sysprof
+  {
+    enum sysprof_mode mode;
+    int filter[SYSPROF_MAX_FILTER];
+    int nfilter;
+    struct sysprof_entry sc[SYSPROF_MAX_NR + 1];
+  };
+
+  /**
+   * @brief Fork argv under ptrace, following every process and thread it
+   * creates, and collect per syscall counts, errors and time from entry to
+   * exit. Only the shell's own child is traced so no privileges are
+   * needed.
+   *
+   * @param sh The shell
+   * @param argv The command to run
+   * @param prof Mode and filter in, results out
+   * @return The exit status of the command, 128 + the signal number if it
+   * was killed, or -1 if it could not be traced
+   */
+  int sysprof_run(struct shell *sh, char **argv, struct sysprof *prof);
+
+  /**
+   * @brief Print a table sorted by time, or by calls if nothing was timed.
+   *
+   * @param fp Where to print
+   * @param prof The results of sysprof_run
+   */
+  void sysprof_print(FILE *fp, const struct sysprof *prof);
+
+  /**
+   * @brief Map a syscall name to its number.
+   *
+   * @param name The name, for example "openat"
+   * @return The number or -1 if it is unknown
+   */
+  int sysprof_nr(const char *name);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
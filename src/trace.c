@@ -0,0 +1,148 @@
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+struct trace_buffer *trace_buf;
+static char *trace_path;
+static pid_t trace_owner;
+
+static const char *kind_names[TRACE_KIND_MAX] = {
+    "command", "parse", "builtin", "spawn", "exec", "wait", "pipeline", "subshell",
+};
+
+//-----------------------------------------------------------------------------
+// trace_now
+//-----------------------------------------------------------------------------
+uint64_t trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+//-----------------------------------------------------------------------------
+// trace_kind_name
+//-----------------------------------------------------------------------------
+const char *trace_kind_name(enum trace_kind kind) {
+    return kind < TRACE_KIND_MAX ? kind_names[kind] : "unknown";
+}
+
+//-----------------------------------------------------------------------------
+// trace_open
+//-----------------------------------------------------------------------------
+int trace_open(const char *file) {
+    if (trace_buf)
+        trace_close();
+    char *path = strdup(file);
+    if (!path)
+        return -1;
+    void *p = mmap(NULL, sizeof(struct trace_buffer), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        free(path);
+        return -1;
+    }
+    trace_path = path;
+    trace_owner = getpid();
+    trace_buf = p;
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+// trace_span
+//-----------------------------------------------------------------------------
+void trace_span(enum trace_kind kind, uint64_t start_ns, uint64_t end_ns, int job,
+                const char *detail) {
+    struct trace_buffer *b = trace_buf;
+    if (!b)
+        return;
+    uint64_t i = __atomic_fetch_add(&b->next, 1, __ATOMIC_RELAXED);
+    if (i >= TRACE_MAX_EVENTS) {
+        __atomic_fetch_add(&b->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    struct trace_event *e = &b->events[i];
+    e->pid = getpid();
+    e->job = job;
+    e->kind = (uint16_t)kind;
+    e->start_ns = start_ns;
+    if (detail) {
+        strncpy(e->detail, detail, sizeof(e->detail) - 1);
+        e->detail[sizeof(e->detail) - 1] = '\0';
+    } else {
+        e->detail[0] = '\0';
+    }
+    // end_ns doubles as the "slot is complete" flag for the writer.
+    __atomic_store_n(&e->end_ns, end_ns ? end_ns : start_ns + 1, __ATOMIC_RELEASE);
+}
+
+//-----------------------------------------------------------------------------
+// trace_close
+//-----------------------------------------------------------------------------
+static void json_string(FILE *fp, const char *s) {
+    fputc('"', fp);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+            fprintf(fp, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(fp, "\\u%04x", c);
+        else
+            fputc(c, fp);
+    }
+    fputc('"', fp);
+}
+
+static int trace_write(struct trace_buffer *b, const char *file) {
+    FILE *fp = fopen(file, "w");
+    if (!fp)
+        return -1;
+    uint64_t n = __atomic_load_n(&b->next, __ATOMIC_ACQUIRE);
+    if (n > TRACE_MAX_EVENTS)
+        n = TRACE_MAX_EVENTS;
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped\":%llu},\"traceEvents\":[\n",
+            (unsigned long long)b->dropped);
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"shell\"}}",
+            (int)trace_owner);
+    for (uint64_t i = 0; i < n; i++) {
+        struct trace_event *e = &b->events[i];
+        uint64_t end = __atomic_load_n(&e->end_ns, __ATOMIC_ACQUIRE);
+        if (!end)
+            continue;
+        // Everything goes in the shell's process lane, each process that
+        // recorded spans gets its own thread lane so subshells and the
+        // children of parallel jobs stack separately.
+        fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"shell\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                    "\"pid\":%d,\"tid\":%d,\"args\":{\"job\":%d,\"detail\":",
+                trace_kind_name(e->kind), (double)e->start_ns / 1000.0,
+                (double)(end - e->start_ns) / 1000.0, (int)trace_owner, (int)e->pid, e->job);
+        json_string(fp, e->detail);
+        fputs("}}", fp);
+    }
+    fputs("\n]}\n", fp);
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+int trace_close(void) {
+    struct trace_buffer *b = trace_buf;
+    if (!b)
+        return 0;
+    trace_buf = NULL;
+    int rval = 0;
+    if (getpid() == trace_owner)
+        rval = trace_write(b, trace_path);
+    munmap(b, sizeof(*b));
+    free(trace_path);
+    trace_path = NULL;
+    return rval;
+}
+
+//-----------------------------------------------------------------------------
+// trace_file
+//-----------------------------------------------------------------------------
+const char *trace_file(void) {
+    return trace_buf ? trace_path : NULL;
+}
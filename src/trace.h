@@ -0,0 +1,128 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * Number of spans the in-memory buffer holds. Spans recorded once it is
+   * full are counted and dropped.
+   */
+#define TRACE_MAX_EVENTS (1u << 16)
+
+  /**
+   * What a span covers, the names shown in the viewer come from
+   * trace_kind_name.
+   */
+  enum trace_kind
+  {
+    TRACE_COMMAND,
+    TRACE_PARSE,
+    TRACE_BUILTIN,
+    TRACE_SPAWN,
+    TRACE_EXEC,
+    TRACE_WAIT,
+    TRACE_PIPELINE,
+    TRACE_SUBSHELL,
+    TRACE_KIND_MAX
+  };
+
+  struct trace_event
+  {
+    uint64_t start_ns;
+    uint64_t end_ns;
+    pid_t pid;
+    int job;
+    uint16_t kind;
+    char detail[38];
+  };
+
+  /**
+   * The buffer lives in a shared anonymous mapping so forked children such
+   * as subshells and pipeline stages record into the same timeline.
+   * Writers claim a slot with one atomic add, there are no locks.
+   */
+  struct trace_buffer
+  {
+    uint64_t next;
+    uint64_t dropped;
+    struct trace_event events[TRACE_MAX_EVENTS];
+  };
+
+  /**
+   * The active buffer or NULL, checked inline so a disabled trace costs a
+   * single branch.
+   */
+  extern struct trace_buffer *trace_buf;
+
+  /**
+   * @brief Start recording. Any trace that was already running is written
+   * out first.
+   *
+   * @param file Where the Chrome trace-event JSON is written by trace_close
+   * @return 0 on success, -1 with errno set if the buffer could not be mapped
+   */
+  int trace_open(const char *file);
+
+  /**
+   * @brief Write the recorded spans as Chrome trace-event JSON and stop
+   * recording. Only the process that called trace_open writes the file, a
+   * forked child that calls this just detaches.
+   *
+   * @return 0 on success, -1 if the file could not be written
+   */
+  int trace_close(void);
+
+  /**
+   * @brief The file the current trace will be written to.
+   *
+   * @return The path or NULL if tracing is off
+   */
+  const char *trace_file(void);
+
+  /**
+   * @brief Monotonic clock used for span timestamps.
+   *
+   * @return The time in nanoseconds
+   */
+  uint64_t trace_now(void);
+
+  /**
+   * @brief Record a finished span. Does nothing when tracing is off.
+   *
+   * @param kind What the span covers
+   * @param start_ns Start from trace_now
+   * @param end_ns End from trace_now
+   * @param job Job number the span belongs to, lets parallel jobs be told apart
+   * @param detail Usually the command name, truncated to fit, may be NULL
+   */
+  void trace_span(enum trace_kind kind, uint64_t start_ns, uint64_t end_ns, int job,
+                  const char *detail);
+
+  /**
+   * @brief Name of a span kind as it appears in the trace.
+   *
+   * @param kind The kind
+   * @return The name
+   */
+  const char *trace_kind_name(enum trace_kind kind);
+
+  /**
+   * @brief True if a trace is being recorded.
+   */
+  static inline bool trace_enabled(void)
+  {
+    return trace_buf != NULL;
+  }
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
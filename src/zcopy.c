@@ -0,0 +1,412 @@
+#define _GNU_SOURCE
+#include "zcopy.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+
+//-----------------------------------------------------------------------------
+// copy paths
+//-----------------------------------------------------------------------------
+static ssize_t write_all(int fd, const char *buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = write(fd, buf + done, len - done);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return (ssize_t)done;
+}
+
+static ssize_t copy_range(int in, int out, size_t len) {
+    return copy_file_range(in, NULL, out, NULL, len, 0);
+}
+
+static ssize_t send_file(int in, int out, size_t len) {
+    return sendfile(out, in, NULL, len);
+}
+
+static ssize_t splice_move(int in, int out, size_t len) {
+    return splice(in, NULL, out, NULL, len, SPLICE_F_MOVE);
+}
+
+static ssize_t read_write(int in, int out, size_t len) {
+    char buf[ZCOPY_CHUNK];
+    ssize_t n = read(in, buf, len < sizeof(buf) ? len : sizeof(buf));
+    if (n <= 0)
+        return n;
+    return write_all(out, buf, (size_t)n);
+}
+
+// The kernel says a pair of files is not something the call can do with
+// these errors, before or after moving anything. Both fds are left at the
+// right offset so the next path carries on from there.
+static bool path_refused(int err) {
+    return err == EINVAL || err == ENOSYS || err == EOPNOTSUPP || err == EXDEV ||
+           err == EBADF || err == ESPIPE;
+}
+
+typedef ssize_t (*copy_fn)(int in, int out, size_t len);
+
+ssize_t zcopy_fd(int in, int out, enum zcopy_path *path) {
+    struct stat si, so;
+    if (fstat(in, &si) != 0 || fstat(out, &so) != 0)
+        return -1;
+    int flags = fcntl(out, F_GETFL);
+    // copy_file_range refuses an O_APPEND destination outright.
+    const struct
+    {
+        enum zcopy_path path;
+        copy_fn fn;
+        bool ok;
+    } paths[] = {
+        {ZCOPY_COPY_FILE_RANGE, copy_range,
+         S_ISREG(si.st_mode) && S_ISREG(so.st_mode) && !(flags & O_APPEND)},
+        {ZCOPY_SENDFILE, send_file, S_ISREG(si.st_mode) || S_ISBLK(si.st_mode)},
+        {ZCOPY_SPLICE, splice_move, S_ISFIFO(si.st_mode) || S_ISFIFO(so.st_mode)},
+        {ZCOPY_READ_WRITE, read_write, true},
+    };
+    ssize_t done = 0;
+    for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+        if (!paths[i].ok)
+            continue;
+        ssize_t n;
+        while ((n = paths[i].fn(in, out, ZCOPY_CHUNK)) != 0) {
+            if (n > 0)
+                done += n;
+            else if (errno != EINTR)
+                break;
+        }
+        if (n == 0) {
+            if (path)
+                *path = paths[i].path;
+            return done;
+        }
+        if (paths[i].fn == read_write || !path_refused(errno))
+            return -1;
+    }
+    return -1;
+}
+
+//-----------------------------------------------------------------------------
+// zcopy_tee
+//-----------------------------------------------------------------------------
+// One splice out of a pipe, or a read and write of the same amount if the
+// destination cannot be spliced into.
+static ssize_t pipe_some(int in, int out, size_t len) {
+    ssize_t n;
+    while ((n = splice_move(in, out, len)) < 0 && errno == EINTR)
+        ;
+    if (n < 0 && errno == EINVAL)
+        while ((n = read_write(in, out, len)) < 0 && errno == EINTR)
+            ;
+    return n;
+}
+
+// Move exactly *len bytes out of a pipe that holds at least that many,
+// on failure *len is what is left.
+static int pipe_exact(int in, int out, size_t *len) {
+    while (*len > 0) {
+        ssize_t n = pipe_some(in, out, *len);
+        if (n <= 0)
+            return -1;
+        *len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Drop what an output that failed halfway did not take.
+static void discard(int in, size_t len) {
+    char buf[4096];
+    while (len > 0) {
+        ssize_t n = read(in, buf, len < sizeof(buf) ? len : sizeof(buf));
+        if (n <= 0 && errno != EINTR)
+            return;
+        if (n > 0)
+            len -= (size_t)n;
+    }
+}
+
+static void drop(int *outs, const char *const *names, int k, int *rval) {
+    fprintf(stderr, "tee: %s: %s\n", names[k], strerror(errno));
+    outs[k] = -1;
+    *rval = 1;
+}
+
+// in is a pipe. Every output but the last gets a tee(2) of what is in the
+// pipe through a private scratch pipe, the last one gets the data itself
+// spliced out of in. The scratch pipe is at least as big as in so one tee
+// always copies everything it found.
+static int tee_pipe(int in, int *outs, const char *const *names, int nouts, int scratch[2]) {
+    int cap = fcntl(in, F_GETPIPE_SZ);
+    if (cap <= 0 || fcntl(scratch[1], F_SETPIPE_SZ, cap) < cap)
+        return -2;
+    int rval = 0;
+    for (;;) {
+        int last = -1;
+        for (int k = 0; k < nouts; k++)
+            if (outs[k] >= 0)
+                last = k;
+        if (last < 0)
+            return rval;
+        size_t n = 0;
+        for (int k = 0; k < last; k++) {
+            if (outs[k] < 0)
+                continue;
+            ssize_t t;
+            while ((t = tee(in, scratch[1], n ? n : (size_t)cap, 0)) < 0 && errno == EINTR)
+                ;
+            if (t < 0)
+                return n ? -1 : -2;
+            if (t == 0)
+                return rval;
+            n = (size_t)t;
+            size_t left = n;
+            if (pipe_exact(scratch[0], outs[k], &left) != 0) {
+                if (errno == EPIPE)
+                    return -1;
+                drop(outs, names, k, &rval);
+                discard(scratch[0], left);
+            }
+        }
+        if (n == 0) {
+            ssize_t m = pipe_some(in, outs[last], (size_t)cap);
+            if (m == 0)
+                return rval;
+            if (m < 0) {
+                if (errno == EPIPE)
+                    return -1;
+                drop(outs, names, last, &rval);
+            }
+        } else if (pipe_exact(in, outs[last], &n) != 0) {
+            if (errno == EPIPE)
+                return -1;
+            // The rest of this round was already given to every other
+            // output.
+            drop(outs, names, last, &rval);
+            discard(in, n);
+        }
+    }
+}
+
+static int tee_buffered(int in, int *outs, const char *const *names, int nouts) {
+    char buf[ZCOPY_CHUNK];
+    int rval = 0;
+    for (;;) {
+        ssize_t n = read(in, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            fprintf(stderr, "tee: read error: %s\n", strerror(errno));
+            return 1;
+        }
+        if (n == 0)
+            return rval;
+        for (int k = 0; k < nouts; k++) {
+            if (outs[k] >= 0 && write_all(outs[k], buf, (size_t)n) < 0) {
+                if (errno == EPIPE)
+                    return -1;
+                drop(outs, names, k, &rval);
+            }
+        }
+    }
+}
+
+int zcopy_tee(int in, int *outs, const char *const *names, int nouts, enum zcopy_path *path) {
+    struct stat si;
+    int scratch[2];
+    if (fstat(in, &si) == 0 && S_ISFIFO(si.st_mode) && pipe2(scratch, O_CLOEXEC) == 0) {
+        int r = tee_pipe(in, outs, names, nouts, scratch);
+        close(scratch[0]);
+        close(scratch[1]);
+        if (r != -2) {
+            if (path)
+                *path = ZCOPY_TEE;
+            if (r == -1)
+                errno = EPIPE;
+            return r;
+        }
+    }
+    if (path)
+        *path = ZCOPY_READ_WRITE;
+    int r = tee_buffered(in, outs, names, nouts);
+    if (r == -1)
+        errno = EPIPE;
+    return r;
+}
+
+//-----------------------------------------------------------------------------
+// cat and tee
+//-----------------------------------------------------------------------------
+// An option word is anything but "-" starting with a dash before "--", the
+// way getopt permutes them. Returns false if argv has an option whose
+// letters are not all in allowed.
+static bool options_ok(char **argv, const char *allowed) {
+    for (int i = 1; argv[i] && strcmp(argv[i], "--") != 0; i++) {
+        if (argv[i][0] != '-' || !argv[i][1])
+            continue;
+        for (const char *c = argv[i] + 1; *c; c++)
+            if (!strchr(allowed, *c))
+                return false;
+    }
+    return true;
+}
+
+// Call fn with every operand of argv and return how many there were.
+static int operands(char **argv, void (*fn)(const char *op, void *arg), void *arg) {
+    int n = 0;
+    bool options = true;
+    for (int i = 1; argv[i]; i++) {
+        if (options && strcmp(argv[i], "--") == 0) {
+            options = false;
+            continue;
+        }
+        if (options && argv[i][0] == '-' && argv[i][1])
+            continue;
+        if (fn)
+            fn(argv[i], arg);
+        n++;
+    }
+    return n;
+}
+
+// A terminal, fifo, device or socket can block for as long as it likes,
+// and the interrupt that would stop it is ignored by the shell the copy
+// runs in. A file that cannot be looked at is left for zcopy_run to report.
+static bool may_block(mode_t mode) {
+    return S_ISFIFO(mode) || S_ISCHR(mode) || S_ISBLK(mode) || S_ISSOCK(mode);
+}
+
+struct operand_check
+{
+    bool reads_stdin;
+    bool blocks;
+};
+
+static void check_operand(const char *op, void *arg) {
+    struct operand_check *c = arg;
+    struct stat st;
+    if (strcmp(op, "-") == 0)
+        c->reads_stdin = true;
+    else if (stat(op, &st) == 0 && may_block(st.st_mode))
+        c->blocks = true;
+}
+
+static bool input_blocks(int in) {
+    struct stat st;
+    return in != ZCOPY_STAGE_PIPE && fstat(in, &st) == 0 && may_block(st.st_mode);
+}
+
+bool zcopy_handles(char **argv, int in) {
+    if (!argv || !argv[0])
+        return false;
+    struct operand_check c = {false, false};
+    if (strcmp(argv[0], "cat") == 0) {
+        if (!options_ok(argv, "u"))
+            return false;
+        if (operands(argv, check_operand, &c) == 0)
+            c.reads_stdin = true;
+        return !c.blocks && (!c.reads_stdin || !input_blocks(in));
+    }
+    if (strcmp(argv[0], "tee") == 0)
+        return options_ok(argv, "ai") && operands(argv, check_operand, &c) < ZCOPY_MAX_OUTS &&
+               !c.blocks && !input_blocks(in);
+    return false;
+}
+
+struct cat_state
+{
+    int in;
+    int out;
+    int rval;
+};
+
+static void cat_one(const char *op, void *arg) {
+    struct cat_state *c = arg;
+    if (c->rval > 1)
+        return;
+    bool is_stdin = strcmp(op, "-") == 0;
+    int fd = is_stdin ? c->in : open(op, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "cat: %s: %s\n", op, strerror(errno));
+        c->rval = 1;
+        return;
+    }
+    if (zcopy_fd(fd, c->out, NULL) < 0) {
+        if (errno == EPIPE) {
+            c->rval = 128 + SIGPIPE;
+        } else {
+            fprintf(stderr, "cat: %s: %s\n", op, strerror(errno));
+            c->rval = 1;
+        }
+    }
+    if (!is_stdin)
+        close(fd);
+}
+
+static int run_cat(char **argv, int in, int out) {
+    struct cat_state c = {in, out, 0};
+    if (operands(argv, cat_one, &c) == 0)
+        cat_one("-", &c);
+    return c.rval;
+}
+
+struct tee_state
+{
+    int flags;
+    int outs[ZCOPY_MAX_OUTS];
+    const char *names[ZCOPY_MAX_OUTS];
+    int nouts;
+    int rval;
+};
+
+static void tee_open(const char *op, void *arg) {
+    struct tee_state *t = arg;
+    int fd = open(op, t->flags, 0666);
+    if (fd < 0) {
+        fprintf(stderr, "tee: %s: %s\n", op, strerror(errno));
+        t->rval = 1;
+        return;
+    }
+    t->outs[t->nouts] = fd;
+    t->names[t->nouts++] = op;
+}
+
+static int run_tee(char **argv, int in, int out) {
+    struct tee_state t = {O_WRONLY | O_CREAT | O_CLOEXEC | O_TRUNC, {out}, {"standard output"}, 1, 0};
+    for (int i = 1; argv[i] && strcmp(argv[i], "--") != 0; i++)
+        if (argv[i][0] == '-' && strchr(argv[i], 'a'))
+            t.flags = O_WRONLY | O_CREAT | O_CLOEXEC | O_APPEND;
+    operands(argv, tee_open, &t);
+    int r = zcopy_tee(in, t.outs, t.names, t.nouts, NULL);
+    for (int k = 1; k < t.nouts; k++)
+        if (t.outs[k] >= 0)
+            close(t.outs[k]);
+    if (r < 0)
+        return 128 + SIGPIPE;
+    return r || t.rval;
+}
+
+int zcopy_run(char **argv, int in, int out) {
+    // A reader that goes away must end the copy, not the shell it runs in.
+    // EPIPE comes back from the write and the signal is taken off again.
+    sigset_t pipe_set, saved;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, &saved);
+    int status = strcmp(argv[0], "tee") == 0 ? run_tee(argv, in, out) : run_cat(argv, in, out);
+    struct timespec zero = {0, 0};
+    while (sigtimedwait(&pipe_set, NULL, &zero) == SIGPIPE)
+        ;
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    return status;
+}
@@ -0,0 +1,102 @@
+#ifndef ZCOPY_H
+#define ZCOPY_H
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * Most bytes asked of the kernel per copy call, and the size of the
+   * buffer used when there is no way around read and write.
+   */
+#define ZCOPY_CHUNK (128 * 1024)
+
+  /**
+   * Most files one tee writes, more than that is left to the real tee.
+   */
+#define ZCOPY_MAX_OUTS 64
+
+  /**
+   * How the bytes of the last copy were moved, the fastest path that
+   * worked for the pair of file types.
+   */
+  enum zcopy_path
+  {
+    ZCOPY_NONE,
+    ZCOPY_COPY_FILE_RANGE,
+    ZCOPY_SENDFILE,
+    ZCOPY_SPLICE,
+    ZCOPY_TEE,
+    ZCOPY_READ_WRITE,
+  };
+
+  /**
+   * @brief Copy everything from in to out, starting and leaving both at
+   * their file offsets. Two regular files use copy_file_range, a regular
+   * file into anything else uses sendfile, and a pipe on either side uses
+   * splice. Whatever the kernel refuses falls back to read and write.
+   *
+   * @param in The fd to read until end of file
+   * @param out The fd to write
+   * @param path If not NULL, set to the path that moved the bytes
+   * @return The number of bytes copied or -1 with errno set
+   */
+  ssize_t zcopy_fd(int in, int out, enum zcopy_path *path);
+
+  /**
+   * @brief Copy everything from in to every fd in outs. When in is a pipe
+   * the data is duplicated with tee(2) and moved with splice, otherwise it
+   * is read once and written to each. A write to a pipe nobody reads ends
+   * the copy, any other failing output is reported and dropped.
+   *
+   * @param in The fd to read until end of file
+   * @param outs The fds to write, an output that fails is set to -1
+   * @param names Names of the fds used in error messages
+   * @param nouts Number of fds in outs
+   * @param path If not NULL, set to the path that moved the bytes
+   * @return 0 if every output got everything, 1 otherwise or -1 with
+   * errno set to EPIPE if a pipe stopped being read
+   */
+  int zcopy_tee(int in, int *outs, const char *const *names, int nouts,
+                enum zcopy_path *path);
+
+  /**
+   * Passed to zcopy_handles for input that is a pipe from an earlier stage
+   * of the same job, which ends when that stage does.
+   */
+#define ZCOPY_STAGE_PIPE (-1)
+
+  /**
+   * @brief Check that the cat or tee in argv can be run by zcopy_run. Only
+   * the options that do not change the bytes are understood, anything else
+   * is left to the real command. So is reading or writing a terminal, fifo,
+   * device or socket, which can block where only the real command can be
+   * interrupted.
+   *
+   * @param argv The command
+   * @param in The fd the command would read, or ZCOPY_STAGE_PIPE
+   * @return True if zcopy_run handles argv
+   */
+  bool zcopy_handles(char **argv, int in);
+
+  /**
+   * @brief Run cat or tee with the given fds as stdin and stdout. Nothing
+   * is allocated on the heap and no stdio stream other than stderr is
+   * touched, so this is safe on a helper thread.
+   *
+   * @param argv A command zcopy_handles accepted
+   * @param in The fd to use as stdin
+   * @param out The fd to use as stdout
+   * @return The exit status
+   */
+  int zcopy_run(char **argv, int in, int out);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
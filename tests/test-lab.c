@@ -1,6 +1,57 @@
 #include <string.h>
 #include "harness/unity.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "../src/lab.h"
+#include "../src/pathcache.h"
+#include "../src/dircache.h"
+#include "../src/arena.h"
+#include "../src/intern.h"
+#include "../src/trace.h"
+#include "../src/parse.h"
+#include "../src/job.h"
+#include "../src/journal.h"
+#include "../src/metrics.h"
+#include "../src/sysprof.h"
+#include "../src/jobmeter.h"
+#include "../src/zcopy.h"
+#include "../src/optimize.h"
+#include "../src/ioeng.h"
+#include "../src/lineread.h"
+#include "../src/cmdsub.h"
+#include "../src/coproc.h"
+#include "../src/spawnsrv.h"
+#include "../src/forkmem.h"
+#include "../src/shserver.h"
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <errno.h>
+
+#ifdef __SANITIZE_ADDRESS__
+// From sanitizer/allocator_interface.h which is not always installed.
+int __sanitizer_install_malloc_and_free_hooks(
+    void (*malloc_hook)(const volatile void *, size_t),
+    void (*free_hook)(const volatile void *));
+#endif
+
+static volatile size_t heap_allocs;
+
+#ifdef __SANITIZE_ADDRESS__
+static void count_malloc(const volatile void *ptr, size_t size)
+{
+     UNUSED(ptr);
+     UNUSED(size);
+     heap_allocs++;
+}
+
+static void count_free(const volatile void *ptr)
+{
+     UNUSED(ptr);
+}
+#endif
 
 
 void setUp(void) {
@@ -35,6 +86,8 @@ void test_cmd_parse2(void)
      free(expected[0]);
      free(expected[1]);
      free(expected);
+     cmd_free(actual);
+     free(stng);
 }
 
 void test_cmd_parse(void)
@@ -159,8 +212,1464 @@ void test_ch_dir_root(void)
      cmd_free(cmd);
 }
 
+static char *make_tmpdir(void)
+{
+     char tmpl[] = "/tmp/test-lab-XXXXXX";
+     char *dir = mkdtemp(tmpl);
+     TEST_ASSERT_NOT_NULL(dir);
+     return strdup(dir);
+}
+
+static void touch_exec(const char *dir, const char *name, mode_t mode)
+{
+     char path[512];
+     snprintf(path, sizeof(path), "%s/%s", dir, name);
+     FILE *fp = fopen(path, "w");
+     TEST_ASSERT_NOT_NULL(fp);
+     fclose(fp);
+     chmod(path, mode);
+}
+
+static void rm_tree(const char *dir)
+{
+     char cmd[600];
+     snprintf(cmd, sizeof(cmd), "rm -rf '%s'", dir);
+     TEST_ASSERT_EQUAL_INT(0, system(cmd));
+}
+
+// A shell as sh_init leaves it for a script, never attached to a terminal,
+// with the PATH cache built up front.
+static void shell_setup(struct shell *sh)
+{
+     memset(sh, 0, sizeof(*sh));
+     sh->pid = getpid();
+     arena_init(&sh->arena, 0);
+     sh->pathcache = pathcache_create(getenv("PATH"), NULL);
+}
+
+static void shell_teardown(struct shell *sh)
+{
+     pathcache_destroy(sh->pathcache);
+     arena_destroy(&sh->arena);
+}
+
+static void count_names(const char *name, void *arg)
+{
+     UNUSED(name);
+     (*(int *)arg)++;
+}
+
+static void join_names(const char *name, void *arg)
+{
+     strcat((char *)arg, name);
+     strcat((char *)arg, " ");
+}
+
+void test_pathcache_complete(void)
+{
+     char *a = make_tmpdir();
+     char *b = make_tmpdir();
+     touch_exec(a, "gitk", 0755);
+     touch_exec(a, "git", 0755);
+     touch_exec(a, "gizmo.txt", 0644);
+     touch_exec(b, "git", 0755);
+     touch_exec(b, "gimp", 0755);
+     char path[256];
+     snprintf(path, sizeof(path), "%s:%s", a, b);
+
+     struct pathcache *pc = pathcache_create(path, NULL);
+     TEST_ASSERT_NOT_NULL(pc);
+     char names[128] = "";
+     TEST_ASSERT_EQUAL_INT(3, pathcache_complete(pc, "gi", join_names, names));
+     TEST_ASSERT_EQUAL_STRING("gimp git gitk ", names);
+     TEST_ASSERT_EQUAL_STRING(a, pathcache_lookup(pc, "git"));
+     TEST_ASSERT_EQUAL_STRING(b, pathcache_lookup(pc, "gimp"));
+     TEST_ASSERT_NULL(pathcache_lookup(pc, "gizmo.txt"));
+     TEST_ASSERT_NULL(pathcache_lookup(pc, "gi"));
+
+     // A new executable shows up through inotify without a rescan of a.
+     touch_exec(b, "gitlab", 0755);
+     TEST_ASSERT_EQUAL_INT(1, pathcache_refresh(pc));
+     TEST_ASSERT_EQUAL_STRING(b, pathcache_lookup(pc, "gitlab"));
+     TEST_ASSERT_EQUAL_INT(0, pathcache_refresh(pc));
+
+     pathcache_destroy(pc);
+     rm_tree(a);
+     rm_tree(b);
+     free(a);
+     free(b);
+}
+
+void test_pathcache_persist(void)
+{
+     char *a = make_tmpdir();
+     char *c = make_tmpdir();
+     touch_exec(a, "ls", 0755);
+     char file[256];
+     snprintf(file, sizeof(file), "%s/sub/pathcache", c);
+
+     struct pathcache *pc = pathcache_create(a, file);
+     TEST_ASSERT_NOT_NULL(pc);
+     pathcache_destroy(pc);
+     TEST_ASSERT_EQUAL_INT(0, access(file, R_OK));
+
+     // Plant a name in the cache that is not on disk, if the cache is used
+     // for the unchanged directory the name must be found.
+     FILE *fp = fopen(file, "r");
+     char buf[1024] = "";
+     size_t n = fread(buf, 1, sizeof(buf) - 1, fp);
+     buf[n] = '\0';
+     fclose(fp);
+     char *count = strstr(buf, " 1 /");
+     TEST_ASSERT_NOT_NULL(count);
+     count[1] = '2';
+     fp = fopen(file, "w");
+     fwrite(buf, 1, n, fp);
+     fwrite("cached-only", 1, sizeof("cached-only"), fp);
+     fclose(fp);
+
+     pc = pathcache_create(a, file);
+     int total = 0;
+     pathcache_complete(pc, "", count_names, &total);
+     TEST_ASSERT_EQUAL_INT(2, total);
+     TEST_ASSERT_EQUAL_STRING(a, pathcache_lookup(pc, "cached-only"));
+     pathcache_destroy(pc);
+
+     rm_tree(a);
+     rm_tree(c);
+     free(a);
+     free(c);
+}
+
+void test_dircache_prefix(void)
+{
+     char *a = make_tmpdir();
+     const char *files[] = {"app.log.2", "app.log.1", "db.log", "app.err", ".hidden"};
+     for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++)
+          touch_exec(a, files[i], 0644);
+
+     struct dircache *dc = dircache_create(0);
+     char names[256] = "";
+     TEST_ASSERT_EQUAL_INT(3, dircache_complete(dc, a, "app", join_names, names));
+     TEST_ASSERT_EQUAL_STRING("app.err app.log.1 app.log.2 ", names);
+     // Narrowing the previous prefix searches inside the previous range.
+     names[0] = '\0';
+     TEST_ASSERT_EQUAL_INT(2, dircache_complete(dc, a, "app.log", join_names, names));
+     TEST_ASSERT_EQUAL_STRING("app.log.1 app.log.2 ", names);
+     names[0] = '\0';
+     TEST_ASSERT_EQUAL_INT(1, dircache_complete(dc, a, "d", join_names, names));
+     TEST_ASSERT_EQUAL_STRING("db.log ", names);
+     int total = 0;
+     TEST_ASSERT_EQUAL_INT(4, dircache_complete(dc, a, "", count_names, &total));
+     TEST_ASSERT_EQUAL_INT(1, dircache_complete(dc, a, ".", count_names, &total));
+     TEST_ASSERT_EQUAL_INT(1, dc->nentries);
+
+     // A new file changes the directory mtime and drops the listing.
+     touch_exec(a, "app.log.3", 0644);
+     total = 0;
+     TEST_ASSERT_EQUAL_INT(3, dircache_complete(dc, a, "app.log", count_names, &total));
+     TEST_ASSERT_EQUAL_INT(-1, dircache_complete(dc, "/nonexistent-dir", "", count_names, &total));
+
+     dircache_destroy(dc);
+     rm_tree(a);
+     free(a);
+}
+
+void test_dircache_lru(void)
+{
+     char *a = make_tmpdir();
+     char *b = make_tmpdir();
+     touch_exec(a, "one", 0644);
+     touch_exec(b, "two", 0644);
+
+     // A budget of one byte keeps only the most recently used listing.
+     struct dircache *dc = dircache_create(1);
+     int total = 0;
+     dircache_complete(dc, a, "", count_names, &total);
+     dircache_complete(dc, b, "", count_names, &total);
+     TEST_ASSERT_EQUAL_INT(2, total);
+     TEST_ASSERT_EQUAL_INT(1, dc->nentries);
+     TEST_ASSERT_EQUAL_PTR(dc->head, dc->tail);
+     dircache_destroy(dc);
+
+     dc = dircache_create(0);
+     dircache_complete(dc, a, "", count_names, &total);
+     dircache_complete(dc, b, "", count_names, &total);
+     dircache_complete(dc, a, "", count_names, &total);
+     TEST_ASSERT_EQUAL_INT(2, dc->nentries);
+     struct stat st;
+     stat(a, &st);
+     TEST_ASSERT_EQUAL_INT(st.st_ino, dc->head->ino);
+     dircache_destroy(dc);
+
+     rm_tree(a);
+     rm_tree(b);
+     free(a);
+     free(b);
+}
+
+void test_arena_reuse(void)
+{
+     struct arena a;
+     arena_init(&a, 64);
+     char *p = arena_alloc(&a, 10);
+     char *q = arena_alloc(&a, 10);
+     TEST_ASSERT_NOT_NULL(p);
+     TEST_ASSERT_TRUE(q >= p + 10);
+     TEST_ASSERT_EQUAL_INT(0, (uintptr_t)q % _Alignof(max_align_t));
+     // Bigger than a chunk gets a chunk of its own.
+     char *big = arena_alloc(&a, 1000);
+     memset(big, 'x', 1000);
+     TEST_ASSERT_EQUAL_STRING("abc", arena_strndup(&a, "abcdef", 3));
+     size_t allocs = a.heap_allocs;
+
+     for (int i = 0; i < 100; i++) {
+          arena_reset(&a);
+          TEST_ASSERT_EQUAL_PTR(p, arena_alloc(&a, 10));
+          arena_alloc(&a, 10);
+          arena_alloc(&a, 1000);
+          arena_strndup(&a, "abcdef", 3);
+     }
+     TEST_ASSERT_EQUAL_INT(allocs, a.heap_allocs);
+     arena_destroy(&a);
+}
+
+void test_cmd_parse_arena(void)
+{
+     struct arena a;
+     arena_init(&a, 0);
+     char **rval = cmd_parse_arena(&a, "  ls\t-a   -l ");
+     TEST_ASSERT_EQUAL_STRING("ls", rval[0]);
+     TEST_ASSERT_EQUAL_STRING("-a", rval[1]);
+     TEST_ASSERT_EQUAL_STRING("-l", rval[2]);
+     TEST_ASSERT_NULL(rval[3]);
+     rval = cmd_parse_arena(&a, "");
+     TEST_ASSERT_NULL(rval[0]);
+     arena_destroy(&a);
+}
+
+void test_execute_builtin_no_heap(void)
+{
+     struct shell sh;
+     shell_setup(&sh);
+     char *cwd = getcwd(NULL, 0);
+
+     // Warm up the arena, after that builtin-only lines never hit the heap.
+     for (int i = 0; i < 4; i++) {
+          sh_execute(&sh, "cd /tmp");
+          arena_reset(&sh.arena);
+     }
+     size_t arena_allocs = sh.arena.heap_allocs;
+#ifdef __SANITIZE_ADDRESS__
+     static bool hooked;
+     if (!hooked)
+          hooked = __sanitizer_install_malloc_and_free_hooks(count_malloc, count_free);
+     TEST_ASSERT_TRUE(hooked);
+#endif
+     heap_allocs = 0;
+     for (int i = 0; i < 1000; i++) {
+          sh_execute(&sh, i % 2 ? "cd /tmp" : "cd    /");
+          arena_reset(&sh.arena);
+     }
+     size_t seen = heap_allocs;
+     TEST_ASSERT_EQUAL_INT(0, seen);
+     TEST_ASSERT_EQUAL_INT(arena_allocs, sh.arena.heap_allocs);
+
+     TEST_ASSERT_EQUAL_INT(0, chdir(cwd));
+     free(cwd);
+     shell_teardown(&sh);
+}
+
+void test_execute_external_status(void)
+{
+     struct shell sh;
+     shell_setup(&sh);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, "true"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_INT(1, sh_execute(&sh, "false"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_INT(127, sh_execute(&sh, "/nonexistent/command"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_INT(127, sh_execute(&sh, "no-such-command-xyz"));
+     shell_teardown(&sh);
+}
+
+void test_intern_shares_storage(void)
+{
+     const char *a = intern("grep");
+     char buf[] = "grep -v";
+     const char *b = intern_n(buf, 4);
+     TEST_ASSERT_EQUAL_PTR(a, b);
+     TEST_ASSERT_EQUAL_STRING("grep", b);
+     TEST_ASSERT_EQUAL_PTR(a, intern_find("grep"));
+     TEST_ASSERT_NULL(intern_find("never-interned-word"));
+     TEST_ASSERT_EQUAL_UINT32(intern_hash_bytes("grep", 4), intern_hash(a));
+     TEST_ASSERT_TRUE(a != intern("gre"));
+
+     // Enough words to make the table grow keep their identity.
+     char word[16];
+     const char *first = intern("w0");
+     size_t before = intern_count();
+     for (int i = 0; i < 5000; i++) {
+          snprintf(word, sizeof(word), "w%d", i);
+          intern(word);
+     }
+     TEST_ASSERT_EQUAL_PTR(first, intern("w0"));
+     TEST_ASSERT_EQUAL_PTR(a, intern("grep"));
+     TEST_ASSERT_TRUE(intern_count() >= before + 4999);
+}
+
+void test_cmd_parse_arena_interns(void)
+{
+     struct arena a;
+     arena_init(&a, 0);
+     char **one = cmd_parse_arena(&a, "ls -l arena-only-word");
+     char **two = cmd_parse_arena(&a, "ls -l");
+     TEST_ASSERT_EQUAL_PTR(one[0], two[0]);
+     TEST_ASSERT_EQUAL_PTR(intern("ls"), two[0]);
+     // Arguments live in the arena, the table only grows with commands.
+     TEST_ASSERT_EQUAL_STRING("-l", two[1]);
+     TEST_ASSERT_TRUE(one[1] != two[1]);
+     TEST_ASSERT_NULL(intern_find("arena-only-word"));
+     struct pipeline *list = pipeline_parse(&a, "grep pipeline-only-word");
+     TEST_ASSERT_NOT_NULL(list);
+     TEST_ASSERT_EQUAL_PTR(intern("grep"), list->cmds[0].argv[0]);
+     TEST_ASSERT_NULL(intern_find("pipeline-only-word"));
+     arena_destroy(&a);
+}
+
+void test_pathcache_resolve(void)
+{
+     char *a = make_tmpdir();
+     touch_exec(a, "tool", 0755);
+     struct pathcache *pc = pathcache_create(a, NULL);
+     const char *file = pathcache_resolve(pc, intern("tool"));
+     char expected[512];
+     snprintf(expected, sizeof(expected), "%s/tool", a);
+     TEST_ASSERT_EQUAL_STRING(expected, file);
+     TEST_ASSERT_EQUAL_PTR(file, pathcache_resolve(pc, intern("tool")));
+     TEST_ASSERT_NULL(pathcache_resolve(pc, intern("other")));
+     // A miss is forgotten as soon as the directory changes.
+     touch_exec(a, "other", 0755);
+     pathcache_refresh(pc);
+     TEST_ASSERT_NOT_NULL(pathcache_resolve(pc, intern("other")));
+     pathcache_destroy(pc);
+     rm_tree(a);
+     free(a);
+}
+
+static char *slurp(const char *file)
+{
+     FILE *fp = fopen(file, "r");
+     TEST_ASSERT_NOT_NULL(fp);
+     static char buf[65536];
+     size_t n = fread(buf, 1, sizeof(buf) - 1, fp);
+     buf[n] = '\0';
+     fclose(fp);
+     return buf;
+}
+
+void test_trace_spans(void)
+{
+     char *dir = make_tmpdir();
+     char file[256], cmd[300];
+     snprintf(file, sizeof(file), "%s/trace.json", dir);
+     struct shell sh;
+     shell_setup(&sh);
+
+     TEST_ASSERT_FALSE(trace_enabled());
+     snprintf(cmd, sizeof(cmd), "set -o trace=%s", file);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, cmd));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_TRUE(trace_enabled());
+     TEST_ASSERT_EQUAL_STRING(file, trace_file());
+     sh_execute(&sh, "true");
+     arena_reset(&sh.arena);
+     sh_execute(&sh, "cd .");
+     arena_reset(&sh.arena);
+     // A forked subshell and the one run in the shell inside it are both
+     // spans of their own.
+     sh_execute(&sh, "(true && (cd .))");
+     arena_reset(&sh.arena);
+     sh_execute(&sh, "set +o trace");
+     arena_reset(&sh.arena);
+     TEST_ASSERT_FALSE(trace_enabled());
+
+     char *json = slurp(file);
+     TEST_ASSERT_NOT_NULL(strstr(json, "\"traceEvents\""));
+     const char *kinds[] = {"parse", "spawn", "exec", "wait", "command", "builtin"};
+     for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+          char name[64];
+          snprintf(name, sizeof(name), "{\"name\":\"%s\"", kinds[i]);
+          TEST_ASSERT_NOT_NULL_MESSAGE(strstr(json, name), kinds[i]);
+     }
+     // exec is recorded by the child on its own thread lane.
+     TEST_ASSERT_NOT_NULL(strstr(json, "\"detail\":\"true\""));
+     int subshells = 0;
+     for (const char *s = json; (s = strstr(s, "{\"name\":\"subshell\"")); s++)
+          subshells++;
+     TEST_ASSERT_EQUAL_INT(2, subshells);
+     TEST_ASSERT_EQUAL_INT(1, sh_execute(&sh, "set -o trace"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_INT(1, sh_execute(&sh, "set -o nosuchoption"));
+
+     shell_teardown(&sh);
+     rm_tree(dir);
+     free(dir);
+}
+
+void test_pipeline_parse(void)
+{
+     struct arena a;
+     arena_init(&a, 0);
+     struct pipeline *p = pipeline_parse(&a, "time ls -l|grep foo | wc -l");
+     TEST_ASSERT_NOT_NULL(p);
+     TEST_ASSERT_TRUE(p->timed);
+     TEST_ASSERT_EQUAL_INT(3, p->ncmds);
+     TEST_ASSERT_EQUAL_INT(2, p->cmds[0].argc);
+     TEST_ASSERT_EQUAL_STRING("ls", p->cmds[0].argv[0]);
+     TEST_ASSERT_EQUAL_STRING("-l", p->cmds[0].argv[1]);
+     TEST_ASSERT_NULL(p->cmds[0].argv[2]);
+     TEST_ASSERT_EQUAL_STRING("foo", p->cmds[1].argv[1]);
+     TEST_ASSERT_EQUAL_STRING("wc", p->cmds[2].argv[0]);
+     TEST_ASSERT_TRUE(p->cmds[2].argv[0] == intern("wc"));
+
+     p = pipeline_parse(&a, "   ");
+     TEST_ASSERT_NOT_NULL(p);
+     TEST_ASSERT_EQUAL_INT(0, p->ncmds);
+     TEST_ASSERT_NULL(pipeline_parse(&a, "| ls"));
+     TEST_ASSERT_NULL(pipeline_parse(&a, "ls |"));
+     TEST_ASSERT_NULL(pipeline_parse(&a, "ls | | wc"));
+
+     // Lists and redirections.
+     p = pipeline_parse(&a, "sort<in>out -r && time wc>>log||tr a b <<<abc");
+     TEST_ASSERT_NOT_NULL(p);
+     TEST_ASSERT_EQUAL_INT(LIST_FIRST, p->op);
+     TEST_ASSERT_EQUAL_INT(-1, p->folded);
+     TEST_ASSERT_EQUAL_INT(2, p->cmds[0].argc);
+     TEST_ASSERT_EQUAL_STRING("-r", p->cmds[0].argv[1]);
+     TEST_ASSERT_EQUAL_INT(2, p->cmds[0].nredirs);
+     TEST_ASSERT_EQUAL_INT(REDIR_IN, p->cmds[0].redirs[0].type);
+     TEST_ASSERT_EQUAL_STRING("in", p->cmds[0].redirs[0].word);
+     TEST_ASSERT_EQUAL_INT(REDIR_OUT, p->cmds[0].redirs[1].type);
+     p = p->next;
+     TEST_ASSERT_EQUAL_INT(LIST_AND, p->op);
+     TEST_ASSERT_TRUE(p->timed);
+     TEST_ASSERT_EQUAL_INT(REDIR_APPEND, p->cmds[0].redirs[0].type);
+     p = p->next;
+     TEST_ASSERT_EQUAL_INT(LIST_OR, p->op);
+     TEST_ASSERT_EQUAL_INT(3, p->cmds[0].argc);
+     TEST_ASSERT_EQUAL_INT(REDIR_HERE, p->cmds[0].redirs[0].type);
+     TEST_ASSERT_EQUAL_STRING("abc", p->cmds[0].redirs[0].word);
+     TEST_ASSERT_NULL(p->next);
+     TEST_ASSERT_NULL(pipeline_parse(&a, "ls &&"));
+     TEST_ASSERT_NULL(pipeline_parse(&a, "ls >"));
+     TEST_ASSERT_NULL(pipeline_parse(&a, "< in"));
+     TEST_ASSERT_NULL(pipeline_parse(&a, "ls & wc"));
+
+     // A leading pipesize=N sizes that pipeline's pipes only.
+     p = pipeline_parse(&a, "time pipesize=1m cat big | wc -c && ls | wc");
+     TEST_ASSERT_NOT_NULL(p);
+     TEST_ASSERT_TRUE(p->timed);
+     TEST_ASSERT_EQUAL_INT(1 << 20, p->pipesize);
+     TEST_ASSERT_EQUAL_STRING("cat", p->cmds[0].argv[0]);
+     TEST_ASSERT_EQUAL_INT(0, p->next->pipesize);
+     TEST_ASSERT_NULL(pipeline_parse(&a, "pipesize=0 ls | wc"));
+     TEST_ASSERT_EQUAL_INT(4096, parse_size("4096", 4));
+     TEST_ASSERT_EQUAL_INT(256 * 1024, parse_size("256K", 4));
+     TEST_ASSERT_EQUAL_INT(-1, parse_size("1g", 2));
+     TEST_ASSERT_EQUAL_INT(-1, parse_size("4096m", 5));
+     TEST_ASSERT_TRUE(job_pipe_max() >= 4096);
+     arena_destroy(&a);
+}
+
+void test_job_rusage(void)
+{
+     struct shell sh;
+     shell_setup(&sh);
+
+     // The status of a pipeline is the status of its last stage.
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, "false | true"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_INT(1, sh_execute(&sh, "true | false"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_INT(2, sh.totals.jobs);
+
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, "seq 1 100000 | tail -n 0"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_TRUE(sh.last_job.maxrss_kb > 0);
+     TEST_ASSERT_TRUE(sh.last_job.minflt > 0);
+     TEST_ASSERT_TRUE(sh.last_job.real_ns > 0);
+     TEST_ASSERT_EQUAL_INT(3, sh.totals.jobs);
+     TEST_ASSERT_TRUE(sh.totals.minflt >= sh.last_job.minflt);
+
+     // A builtin that runs in the shell is not a job that was waited for.
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, "times"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_INT(3, sh.totals.jobs);
+     TEST_ASSERT_EQUAL_INT(2, sh_execute(&sh, "times -x"));
+
+     shell_teardown(&sh);
+}
+
+void test_journal_records(void)
+{
+     char *dir = make_tmpdir();
+     char file[256], cmd[300];
+     snprintf(file, sizeof(file), "%s/journal", dir);
+     struct shell sh;
+     shell_setup(&sh);
+
+     snprintf(cmd, sizeof(cmd), "set -o journal=%s", file);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, cmd));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_TRUE(journal_enabled());
+     TEST_ASSERT_EQUAL_INT(1, sh_execute(&sh, "false"));
+     arena_reset(&sh.arena);
+     // A fork still has the fd but not the buffers, it records nothing.
+     fflush(stdout);
+     pid_t pid = fork();
+     if (pid == 0) {
+          journal_record("true", 0, 1, 0, NULL, 1);
+          _exit(journal_enabled() ? 1 : 0);
+     }
+     int status;
+     TEST_ASSERT_EQUAL_INT(pid, waitpid(pid, &status, 0));
+     TEST_ASSERT_TRUE(WIFEXITED(status));
+     TEST_ASSERT_EQUAL_INT(0, WEXITSTATUS(status));
+     TEST_ASSERT_EQUAL_INT(1, sh_execute(&sh, "false"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, "set +o journal"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_FALSE(journal_enabled());
+
+     FILE *fp = fopen(file, "rb");
+     TEST_ASSERT_NOT_NULL(fp);
+     char magic[8];
+     TEST_ASSERT_EQUAL_INT(1, fread(magic, 8, 1, fp));
+     TEST_ASSERT_EQUAL_MEMORY(JOURNAL_MAGIC, magic, 8);
+     // The cwd and the line are each written once, before the first
+     // command that needs them.
+     int strs = 0, cmds = 0;
+     uint32_t type;
+     while (fread(&type, sizeof(type), 1, fp) == 1) {
+          if (type == JOURNAL_STR) {
+               struct journal_str r;
+               TEST_ASSERT_EQUAL_INT(1, fread((char *)&r + 4, sizeof(r) - 4, 1, fp));
+               TEST_ASSERT_EQUAL_INT(0, fseek(fp, (r.len + 7) & ~7u, SEEK_CUR));
+               strs++;
+          } else {
+               TEST_ASSERT_EQUAL_INT(JOURNAL_CMD, type);
+               struct journal_cmd r;
+               TEST_ASSERT_EQUAL_INT(1, fread((char *)&r + 4, sizeof(r) - 4, 1, fp));
+               TEST_ASSERT_EQUAL_INT(1, r.status);
+               TEST_ASSERT_EQUAL_UINT64(journal_hash("false", 5), r.argv_hash);
+               TEST_ASSERT_TRUE(r.duration_ns > 0);
+               TEST_ASSERT_TRUE(r.maxrss_kb > 0);
+               TEST_ASSERT_EQUAL_INT(1, r.ncmds);
+               cmds++;
+          }
+     }
+     fclose(fp);
+     TEST_ASSERT_EQUAL_INT(2, strs);
+     TEST_ASSERT_EQUAL_INT(2, cmds);
+
+     shell_teardown(&sh);
+     rm_tree(dir);
+     free(dir);
+}
+
+void test_metrics_textfile(void)
+{
+     char *dir = make_tmpdir();
+     char file[256], cmd[300];
+     snprintf(file, sizeof(file), "%s/shell.prom", dir);
+     struct shell sh;
+     shell_setup(&sh);
+
+     snprintf(cmd, sizeof(cmd), "set -o metrics=%s", file);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, cmd));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_TRUE(metrics_enabled());
+     // Written as soon as the exporter starts.
+     TEST_ASSERT_EQUAL_INT(0, access(file, R_OK));
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, "true | true"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_INT(127, sh_execute(&sh, "no-such-command-xyz"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, "cd ."));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, "set +o metrics"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_FALSE(metrics_enabled());
+
+     char *text = slurp(file);
+     TEST_ASSERT_NOT_NULL(text);
+     TEST_ASSERT_NOT_NULL(strstr(text, "\ntonyshell_commands_total 3\n"));
+     TEST_ASSERT_NOT_NULL(strstr(text, "\ntonyshell_builtins_total 1\n"));
+     TEST_ASSERT_NOT_NULL(strstr(text, "\ntonyshell_jobs_total 2\n"));
+     TEST_ASSERT_NOT_NULL(strstr(text, "\ntonyshell_processes_total 3\n"));
+     TEST_ASSERT_NOT_NULL(strstr(text, "\ntonyshell_spawn_failures_total 1\n"));
+     TEST_ASSERT_NOT_NULL(strstr(text, "le=\"+Inf\"} 3\n"));
+     TEST_ASSERT_NOT_NULL(strstr(text, "\ntonyshell_command_duration_seconds_count 3\n"));
+
+     // A socket is never created over a file that is already there.
+     snprintf(cmd, sizeof(cmd), "set -o metrics=unix:%s", file);
+     TEST_ASSERT_NOT_EQUAL(0, sh_execute(&sh, cmd));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_FALSE(metrics_enabled());
+     TEST_ASSERT_NOT_NULL(strstr(slurp(file), "tonyshell_commands_total"));
+
+     shell_teardown(&sh);
+     rm_tree(dir);
+     free(dir);
+}
+
+void test_sysprof_counts(void)
+{
+     struct shell sh;
+     shell_setup(&sh);
+     struct sysprof *prof = calloc(1, sizeof(*prof));
+     TEST_ASSERT_NOT_NULL(prof);
+     char *argv[] = {"true", NULL};
+
+     prof->mode = SYSPROF_PTRACE;
+     TEST_ASSERT_EQUAL_INT(0, sysprof_run(&sh, argv, prof));
+     TEST_ASSERT_TRUE(prof->sc[SYS_execve].calls >= 1);
+     TEST_ASSERT_EQUAL_UINT64(1, prof->sc[SYS_exit_group].calls);
+     TEST_ASSERT_EQUAL_UINT64(1, sh.totals.jobs);
+
+     // With a filter only the selected syscall stops, and it is still
+     // timed from entry to exit.
+     prof->mode = SYSPROF_SECCOMP;
+     prof->filter[0] = sysprof_nr("openat");
+     prof->nfilter = 1;
+     TEST_ASSERT_TRUE(prof->filter[0] >= 0);
+     TEST_ASSERT_EQUAL_INT(0, sysprof_run(&sh, argv, prof));
+     TEST_ASSERT_EQUAL_UINT64(0, prof->sc[SYS_execve].calls);
+     TEST_ASSERT_EQUAL_UINT64(0, prof->sc[SYS_exit_group].calls);
+     TEST_ASSERT_TRUE(prof->sc[SYS_openat].calls >= 1);
+     TEST_ASSERT_TRUE(prof->sc[SYS_openat].ns > 0);
+
+     char *missing[] = {"no-such-command-xyz", NULL};
+     TEST_ASSERT_EQUAL_INT(127, sysprof_run(&sh, missing, prof));
+
+     // Children the command forks are traced, one of the shell's own that
+     // exits meanwhile is left for the shell to reap.
+     fflush(stdout);
+     pid_t other = fork();
+     if (other == 0)
+          _exit(7);
+     char *forks[] = {"sh", "-c", "true | true; exit 4", NULL};
+     prof->mode = SYSPROF_PTRACE;
+     TEST_ASSERT_EQUAL_INT(4, sysprof_run(&sh, forks, prof));
+     TEST_ASSERT_TRUE(prof->sc[SYS_execve].calls >= 3);
+     int status;
+     TEST_ASSERT_EQUAL_INT(other, waitpid(other, &status, 0));
+     TEST_ASSERT_TRUE(WIFEXITED(status));
+     TEST_ASSERT_EQUAL_INT(7, WEXITSTATUS(status));
+     free(prof);
+     shell_teardown(&sh);
+}
+
+void test_jobmeter_samples(void)
+{
+     struct shell sh;
+     shell_setup(&sh);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, "set -o jobmeter=50"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_NOT_NULL(sh.jobmeter);
+     TEST_ASSERT_EQUAL_UINT(50, sh.jobmeter->interval_ms);
+
+     // Stages are still reaped with their rusage while the timer runs.
+     TEST_ASSERT_EQUAL_INT(1, sh_execute(&sh, "sleep 0.2 | false"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_UINT64(1, sh.totals.jobs);
+     TEST_ASSERT_TRUE(sh.jobmeter->last.nprocs >= 1);
+     TEST_ASSERT_TRUE(sh.jobmeter->last.rss_kb > 0);
+     TEST_ASSERT_NULL(sh.jobmeter->p);
+
+     TEST_ASSERT_EQUAL_INT(1, sh_execute(&sh, "set -o jobmeter=0"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, "set +o jobmeter"));
+     TEST_ASSERT_NULL(sh.jobmeter);
+     shell_teardown(&sh);
+}
+
+void test_pipemeter_relays(void)
+{
+     struct shell sh;
+     shell_setup(&sh);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, "set -o pipemeter"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_TRUE(sh.pipemeter);
+
+     // Every byte makes it through both relays.
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, "head -c 300000 /dev/zero | cat | cmp -s -n 300000 - /dev/zero"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_INT(1, sh_execute(&sh, "head -c 1000 /dev/zero | cmp -s -n 1001 - /dev/zero"));
+     arena_reset(&sh.arena);
+     // A reader that quits early leaves the relay writing into a closed
+     // pipe, that must end the job instead of the shell.
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, "yes | true"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_UINT64(3, sh.totals.jobs);
+
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, "set +o pipemeter"));
+     TEST_ASSERT_FALSE(sh.pipemeter);
+     shell_teardown(&sh);
+}
+
+void test_zcopy_cat_tee(void)
+{
+     char *dir = make_tmpdir();
+     char src[256], two[256], dst[256], log[256], cmd[1200];
+     snprintf(src, sizeof(src), "%s/src", dir);
+     snprintf(two, sizeof(two), "%s/two", dir);
+     snprintf(dst, sizeof(dst), "%s/dst", dir);
+     snprintf(log, sizeof(log), "%s/log", dir);
+     FILE *fp = fopen(src, "w");
+     TEST_ASSERT_NOT_NULL(fp);
+     for (int i = 0; i < 20000; i++)
+          fprintf(fp, "line %d\n", i);
+     fclose(fp);
+     fp = fopen(two, "w");
+     TEST_ASSERT_NOT_NULL(fp);
+     for (int i = 0; i < 40000; i++)
+          fprintf(fp, "line %d\n", i % 20000);
+     fclose(fp);
+
+     // File to file and file to pipe take the kernel paths.
+     enum zcopy_path path;
+     int in = open(src, O_RDONLY);
+     int out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+     TEST_ASSERT_EQUAL_INT(208890, zcopy_fd(in, out, &path));
+     TEST_ASSERT_EQUAL_INT(ZCOPY_COPY_FILE_RANGE, path);
+     close(out);
+     int fds[2];
+     TEST_ASSERT_EQUAL_INT(0, pipe(fds));
+     TEST_ASSERT_EQUAL_INT(208000, lseek(in, 208000, SEEK_SET));
+     TEST_ASSERT_EQUAL_INT(890, zcopy_fd(in, fds[1], &path));
+     TEST_ASSERT_EQUAL_INT(ZCOPY_SENDFILE, path);
+     close(fds[1]);
+
+     // A pipe fans out with tee(2) to a file and another pipe.
+     int fan[2];
+     TEST_ASSERT_EQUAL_INT(0, pipe(fan));
+     int outs[2] = {fan[1], open(log, O_WRONLY | O_CREAT | O_TRUNC, 0644)};
+     const char *names[2] = {"pipe", "log"};
+     TEST_ASSERT_EQUAL_INT(0, zcopy_tee(fds[0], outs, names, 2, &path));
+     TEST_ASSERT_EQUAL_INT(ZCOPY_TEE, path);
+     close(outs[0]);
+     close(outs[1]);
+     char buf[1024];
+     TEST_ASSERT_EQUAL_INT(890, read(fan[0], buf, sizeof(buf)));
+     TEST_ASSERT_EQUAL_STRING_LEN(buf, slurp(log), 890);
+     close(fan[0]);
+     close(fds[0]);
+     close(in);
+
+     // Only arguments that leave the bytes alone are taken over.
+     char *plain[] = {"cat", src, NULL};
+     char *numbered[] = {"cat", "-n", src, NULL};
+     char *append[] = {"tee", "-a", "--", "-n", NULL};
+     char *device[] = {"cat", "/dev/zero", NULL};
+     char *from_stdin[] = {"cat", NULL};
+     TEST_ASSERT_TRUE(zcopy_handles(plain, STDIN_FILENO));
+     TEST_ASSERT_FALSE(zcopy_handles(numbered, STDIN_FILENO));
+     // Nothing is read or written in the shell that may block where an
+     // interrupt cannot stop it, a pipe from an earlier stage always ends.
+     in = open(src, O_RDONLY);
+     TEST_ASSERT_TRUE(zcopy_handles(append, in));
+     TEST_ASSERT_TRUE(zcopy_handles(from_stdin, in));
+     TEST_ASSERT_TRUE(zcopy_handles(append, ZCOPY_STAGE_PIPE));
+     TEST_ASSERT_TRUE(zcopy_handles(from_stdin, ZCOPY_STAGE_PIPE));
+     TEST_ASSERT_EQUAL_INT(0, pipe(fan));
+     TEST_ASSERT_FALSE(zcopy_handles(append, fan[0]));
+     TEST_ASSERT_FALSE(zcopy_handles(from_stdin, fan[0]));
+     TEST_ASSERT_FALSE(zcopy_handles(device, in));
+     close(fan[0]);
+     close(fan[1]);
+     close(in);
+
+     struct shell sh;
+     shell_setup(&sh);
+     snprintf(cmd, sizeof(cmd), "cat %s %s | tee %s | cmp -s - %s", src, src, log, two);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, cmd));
+     arena_reset(&sh.arena);
+     struct stat st;
+     TEST_ASSERT_EQUAL_INT(0, stat(log, &st));
+     TEST_ASSERT_EQUAL_INT(2 * 208890, st.st_size);
+     // cat and tee reading an earlier stage run on threads, which leave no
+     // pid behind.
+     snprintf(cmd, sizeof(cmd), "head -n 20000 %s | cat | tee %s | cmp -s - %s", src, log, src);
+     struct pipeline *p = pipeline_parse(&sh.arena, cmd);
+     TEST_ASSERT_NOT_NULL(p);
+     TEST_ASSERT_EQUAL_INT(0, job_spawn(&sh, p));
+     TEST_ASSERT_TRUE(p->cmds[0].pid > 0);
+     TEST_ASSERT_EQUAL_INT(0, p->cmds[1].pid);
+     TEST_ASSERT_EQUAL_INT(0, p->cmds[2].pid);
+     TEST_ASSERT_TRUE(p->cmds[3].pid > 0);
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_INT(0, stat(log, &st));
+     TEST_ASSERT_EQUAL_INT(208890, st.st_size);
+     // The last stage's status comes from the thread.
+     snprintf(cmd, sizeof(cmd), "true | cat %s/missing", dir);
+     TEST_ASSERT_EQUAL_INT(1, sh_execute(&sh, cmd));
+     arena_reset(&sh.arena);
+     // A reader that stops early ends the copy, not the shell.
+     TEST_ASSERT_EQUAL_INT(1, sh_execute(&sh, "yes | cat | head -c 100000 | cmp -s - /dev/zero"));
+     arena_reset(&sh.arena);
+     // A redirected stdin is checked once it is in place, a fifo is left
+     // to the real cat.
+     char fifo[256];
+     snprintf(fifo, sizeof(fifo), "%s/fifo", dir);
+     TEST_ASSERT_EQUAL_INT(0, mkfifo(fifo, 0600));
+     fflush(stdout);
+     pid_t writer = fork();
+     if (writer == 0) {
+          int fd = open(fifo, O_WRONLY);
+          _exit(write(fd, "fifo\n", 5) == 5 ? 0 : 1);
+     }
+     snprintf(cmd, sizeof(cmd), "cat < %s > %s", fifo, dst);
+     uint64_t jobs = sh.totals.jobs;
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, cmd));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_UINT64(jobs + 1, sh.totals.jobs);
+     TEST_ASSERT_EQUAL_STRING("fifo\n", slurp(dst));
+     int status;
+     TEST_ASSERT_EQUAL_INT(writer, waitpid(writer, &status, 0));
+
+     shell_teardown(&sh);
+     rm_tree(dir);
+     free(dir);
+}
+
+static void count_done(void *arg, ssize_t res)
+{
+     ssize_t *total = arg;
+     *total += res;
+}
+
+void test_ioeng_batches(void)
+{
+     char *dir = make_tmpdir();
+     char file[256];
+     snprintf(file, sizeof(file), "%s/data", dir);
+     static char chunk[16][4096];
+     for (int i = 0; i < 16; i++)
+          memset(chunk[i], 'a' + i, sizeof(chunk[i]));
+
+     for (int uring = 1; uring >= 0; uring--) {
+          struct ioeng e;
+          TEST_ASSERT_EQUAL_INT(0, ioeng_init(&e, uring));
+          int fd = open(file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+          TEST_ASSERT_TRUE(fd >= 0);
+          // Sixteen writes leave in one io_uring_enter or one pwritev.
+          ssize_t total = 0;
+          for (int i = 0; i < 16; i++) {
+               struct ioeng_op op = {IOENG_WRITE, fd, chunk[i], sizeof(chunk[i]),
+                                     i * (int64_t)sizeof(chunk[i]), count_done, &total};
+               TEST_ASSERT_EQUAL_INT(0, ioeng_queue(&e, &op));
+          }
+          TEST_ASSERT_EQUAL_INT(16, ioeng_submit(&e));
+          TEST_ASSERT_EQUAL_UINT64(1, e.syscalls);
+          ioeng_drain(&e);
+          TEST_ASSERT_EQUAL_INT(16 * 4096, total);
+          TEST_ASSERT_EQUAL_UINT64(16, e.ops);
+          TEST_ASSERT_EQUAL_INT(0, e.inflight);
+
+          // The lines come back the same whichever backend read them, one
+          // of them straddles the two read buffers.
+          TEST_ASSERT_EQUAL_INT(0, ftruncate(fd, 0));
+          FILE *fp = fopen(file, "w");
+          fprintf(fp, "first\n\n");
+          for (int i = 0; i < LINEREAD_BLOCK; i++)
+               fputc('x', fp);
+          fprintf(fp, "\nlast");
+          fclose(fp);
+          int in = open(file, O_RDONLY);
+          struct lineread r;
+          TEST_ASSERT_EQUAL_INT(0, lineread_init(&r, &e, in));
+          size_t len;
+          TEST_ASSERT_EQUAL_STRING("first", lineread_next(&r, &len));
+          TEST_ASSERT_EQUAL_STRING("", lineread_next(&r, &len));
+          TEST_ASSERT_NOT_NULL(lineread_next(&r, &len));
+          TEST_ASSERT_EQUAL_INT(LINEREAD_BLOCK, len);
+          TEST_ASSERT_EQUAL_STRING("last", lineread_next(&r, &len));
+          TEST_ASSERT_NULL(lineread_next(&r, &len));
+          lineread_destroy(&r);
+          close(in);
+
+          // A pipe is only read when asked, the rest is left to whoever
+          // the line hands it to.
+          int fds[2];
+          TEST_ASSERT_EQUAL_INT(0, pipe(fds));
+          TEST_ASSERT_EQUAL_INT(4, write(fds[1], "one\n", 4));
+          TEST_ASSERT_EQUAL_INT(0, lineread_init(&r, &e, fds[0]));
+          TEST_ASSERT_EQUAL_STRING("one", lineread_next(&r, NULL));
+          TEST_ASSERT_EQUAL_INT(0, e.inflight);
+          lineread_destroy(&r);
+          TEST_ASSERT_EQUAL_INT(0, e.inflight);
+          close(fds[0]);
+          close(fds[1]);
+
+          close(fd);
+          ioeng_destroy(&e);
+     }
+     rm_tree(dir);
+     free(dir);
+}
+
+void test_script_input(void)
+{
+     char *dir = make_tmpdir();
+     char out[256];
+     snprintf(out, sizeof(out), "%s/out", dir);
+     int fds[2];
+     TEST_ASSERT_EQUAL_INT(0, pipe(fds));
+     fflush(stdout);
+     pid_t pid = fork();
+     if (pid == 0) {
+          // A script on a pipe, read the way main reads it. A hang is
+          // ended by the alarm.
+          alarm(10);
+          close(fds[1]);
+          dup2(fds[0], STDIN_FILENO);
+          close(fds[0]);
+          int fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+          dup2(fd, STDOUT_FILENO);
+          close(fd);
+          struct shell sh;
+          shell_setup(&sh);
+          if (!ioeng_default())
+               _exit(2);
+          char *line;
+          while ((line = sh_read_line(&sh))) {
+               sh_execute(&sh, line);
+               arena_reset(&sh.arena);
+          }
+          sh_destroy(&sh);
+          fflush(stdout);
+          _exit(0);
+     }
+     close(fds[0]);
+     // exit in a forked stage or subshell leaves the shell and its read of
+     // the script alone.
+     const char *exits = "sleep 0 | exit 3\n(exit 3)\necho still-here\n";
+     TEST_ASSERT_EQUAL_INT((ssize_t)strlen(exits), write(fds[1], exits, strlen(exits)));
+     // What comes after a line that reads stdin is that command's input.
+     TEST_ASSERT_EQUAL_INT(10, write(fds[1], "head -n 1\n", 10));
+     usleep(200000);
+     TEST_ASSERT_EQUAL_INT(3, write(fds[1], "hi\n", 3));
+     usleep(200000);
+     TEST_ASSERT_EQUAL_INT(10, write(fds[1], "echo done\n", 10));
+     close(fds[1]);
+     int status;
+     TEST_ASSERT_EQUAL_INT(pid, waitpid(pid, &status, 0));
+     TEST_ASSERT_TRUE(WIFEXITED(status));
+     TEST_ASSERT_EQUAL_INT(0, WEXITSTATUS(status));
+     TEST_ASSERT_EQUAL_STRING("still-here\nhi\ndone\n", slurp(out));
+     rm_tree(dir);
+     free(dir);
+}
+
+void test_process_substitution(void)
+{
+     char *dir = make_tmpdir();
+     char file[256], out[256], line[1024];
+     snprintf(file, sizeof(file), "%s/nums", dir);
+     snprintf(out, sizeof(out), "%s/out", dir);
+     FILE *fp = fopen(file, "w");
+     TEST_ASSERT_NOT_NULL(fp);
+     for (int i = 1; i <= 1000; i++)
+          fprintf(fp, "%d\n", i);
+     fclose(fp);
+
+     struct arena a;
+     arena_init(&a, 0);
+     struct pipeline *p = pipeline_parse(&a, "diff <(sort -n x | uniq) >(wc -c)");
+     TEST_ASSERT_NOT_NULL(p);
+     TEST_ASSERT_EQUAL_INT(3, p->cmds[0].argc);
+     TEST_ASSERT_EQUAL_INT(2, p->cmds[0].nsubs);
+     TEST_ASSERT_EQUAL_INT(1, p->cmds[0].subs[0].argi);
+     TEST_ASSERT_FALSE(p->cmds[0].subs[0].out);
+     TEST_ASSERT_EQUAL_INT(2, p->cmds[0].subs[0].body->ncmds);
+     TEST_ASSERT_TRUE(p->cmds[0].subs[1].out);
+     TEST_ASSERT_NULL(pipeline_parse(&a, "cat <(ls"));
+     TEST_ASSERT_NULL(pipeline_parse(&a, "cat <()"));
+     TEST_ASSERT_NULL(pipeline_parse(&a, "cat <(ls |)"));
+     arena_destroy(&a);
+
+     struct shell sh;
+     shell_setup(&sh);
+     snprintf(line, sizeof(line), "cmp -s <(seq 1 1000) %s", file);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, line));
+     arena_reset(&sh.arena);
+     // Both sides substituted, and the substitutions are part of the job.
+     TEST_ASSERT_EQUAL_INT(1, sh_execute(&sh, "cmp -s <(seq 1 3) <(seq 1 4)"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_UINT64(2, sh.totals.jobs);
+     // A writer whose reader has gone is not waited for forever.
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, "head -c 10 <(yes) | cmp -s - <(yes | head -c 10)"));
+     arena_reset(&sh.arena);
+     // The builtin cat is forked to hand it the pipe.
+     snprintf(line, sizeof(line), "cat <(cat %s) | cmp -s - %s", file, file);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, line));
+     arena_reset(&sh.arena);
+     snprintf(line, sizeof(line), "tee >(wc -l > %s) < %s | cmp -s - %s", out, file, file);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, line));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_STRING("1000\n", slurp(out));
+
+     shell_teardown(&sh);
+     rm_tree(dir);
+     free(dir);
+}
+
+void test_command_substitution(void)
+{
+     char *dir = make_tmpdir();
+     char out[256], line[1024];
+     snprintf(out, sizeof(out), "%s/out", dir);
+
+     struct arena a;
+     arena_init(&a, 0);
+     struct pipeline *p = pipeline_parse(&a, "echo a$(ls $(pwd))b > $(echo f)");
+     TEST_ASSERT_NOT_NULL(p);
+     TEST_ASSERT_EQUAL_INT(2, p->cmds[0].argc);
+     TEST_ASSERT_TRUE(p->cmds[0].expand);
+     TEST_ASSERT_EQUAL_INT(2, pipeline_parse(&a, "echo $(pwd)")->cmds[0].argc);
+     TEST_ASSERT_FALSE(pipeline_parse(&a, "echo pwd")->cmds[0].expand);
+     TEST_ASSERT_NULL(pipeline_parse(&a, "echo $(ls"));
+     arena_destroy(&a);
+
+     struct shell sh;
+     shell_setup(&sh);
+     char cwd[512];
+     TEST_ASSERT_NOT_NULL(getcwd(cwd, sizeof(cwd)));
+     // A pure builtin inside a builtin forks nothing at all.
+     snprintf(line, sizeof(line), "echo $(pwd) > %s", out);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, line));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_UINT64(0, sh.totals.jobs);
+     snprintf(line, sizeof(line), "%s\n", cwd);
+     TEST_ASSERT_EQUAL_STRING(line, slurp(out));
+     // Trailing newlines go, the rest is split into fields.
+     snprintf(line, sizeof(line), "echo x$(seq 1 3)y [$(seq 4 4)] > %s", out);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, line));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_STRING("x1 2 3y [4]\n", slurp(out));
+     // An empty substitution leaves no word behind.
+     snprintf(line, sizeof(line), "echo $(true) $(echo $(echo nested)) > %s", out);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, line));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_STRING("nested\n", slurp(out));
+     snprintf(line, sizeof(line), "$(echo echo) hi > $(echo %s)", out);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, line));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_STRING("hi\n", slurp(out));
+     // Past CMDSUB_SPILL the output goes through a memfd.
+     snprintf(line, sizeof(line), "echo $(seq 1 300000) > %s", out);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, line));
+     arena_reset(&sh.arena);
+     struct stat sb;
+     TEST_ASSERT_EQUAL_INT(0, stat(out, &sb));
+     TEST_ASSERT_EQUAL_INT64(1988895, sb.st_size);
+     TEST_ASSERT_NULL(sh.captures);
+
+     shell_teardown(&sh);
+     rm_tree(dir);
+     free(dir);
+}
+
+void test_subshell(void)
+{
+     char *dir = make_tmpdir();
+     char out[256], line[1024], cwd[512], expect[600];
+     snprintf(out, sizeof(out), "%s/out", dir);
+     TEST_ASSERT_NOT_NULL(getcwd(cwd, sizeof(cwd)));
+
+     struct arena a;
+     arena_init(&a, 0);
+     struct pipeline *p = pipeline_parse(&a, "(cd / && (pwd)) > x | wc");
+     TEST_ASSERT_NOT_NULL(p);
+     TEST_ASSERT_EQUAL_INT(2, p->ncmds);
+     TEST_ASSERT_EQUAL_INT(1, p->cmds[0].argc);
+     TEST_ASSERT_EQUAL_INT(1, p->cmds[0].nredirs);
+     TEST_ASSERT_NOT_NULL(p->cmds[0].group);
+     TEST_ASSERT_EQUAL_INT(LIST_AND, p->cmds[0].group->next->op);
+     TEST_ASSERT_NOT_NULL(p->cmds[0].group->next->cmds[0].group);
+     TEST_ASSERT_NULL(p->cmds[1].group);
+     TEST_ASSERT_NULL(pipeline_parse(&a, "()"));
+     TEST_ASSERT_NULL(pipeline_parse(&a, "(pwd"));
+     TEST_ASSERT_NULL(pipeline_parse(&a, "(pwd) x"));
+     TEST_ASSERT_NULL(pipeline_parse(&a, "echo (pwd)"));
+     arena_destroy(&a);
+
+     struct shell sh;
+     shell_setup(&sh);
+     // Builtins only: no fork, and the cwd and stdout are put back.
+     snprintf(line, sizeof(line), "(cd %s && pwd) > %s", dir, out);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, line));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_UINT64(0, sh.totals.jobs);
+     TEST_ASSERT_EQUAL_UINT64(1, sh.subshells_local);
+     TEST_ASSERT_EQUAL_UINT64(0, sh.opt.forks);
+     snprintf(expect, sizeof(expect), "%s\n", dir);
+     TEST_ASSERT_EQUAL_STRING(expect, slurp(out));
+     char now[512];
+     TEST_ASSERT_NOT_NULL(getcwd(now, sizeof(now)));
+     TEST_ASSERT_EQUAL_STRING(cwd, now);
+     // A failed cd inside still leaves the shell where it was.
+     snprintf(line, sizeof(line), "(cd %s/none || cd /) && pwd > %s", dir, out);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, line));
+     arena_reset(&sh.arena);
+     snprintf(expect, sizeof(expect), "%s\n", cwd);
+     TEST_ASSERT_EQUAL_STRING(expect, slurp(out));
+     // An external command or exit takes a real fork.
+     snprintf(line, sizeof(line), "(cd %s && ls) > %s", dir, out);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, line));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_UINT64(1, sh.totals.jobs);
+     TEST_ASSERT_EQUAL_STRING("out\n", slurp(out));
+     TEST_ASSERT_EQUAL_INT(3, sh_execute(&sh, "(exit 3)"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_UINT64(2, sh.totals.jobs);
+     TEST_ASSERT_NOT_NULL(getcwd(now, sizeof(now)));
+     TEST_ASSERT_EQUAL_STRING(cwd, now);
+
+     shell_teardown(&sh);
+     rm_tree(dir);
+     free(dir);
+}
+
+void test_coproc(void)
+{
+     char *dir = make_tmpdir();
+     char out[256], line[1024];
+     snprintf(out, sizeof(out), "%s/out", dir);
+
+     struct shell sh;
+     shell_setup(&sh);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, "coproc C cat"));
+     arena_reset(&sh.arena);
+     struct coproc *c = coproc_find("C");
+     TEST_ASSERT_NOT_NULL(c);
+     TEST_ASSERT_NOT_NULL(getenv("C_PID"));
+     TEST_ASSERT_EQUAL_INT(c->pid, atoi(getenv("C_PID")));
+     TEST_ASSERT_EQUAL_INT(c->in, atoi(getenv("C_IN")));
+     TEST_ASSERT_EQUAL_INT(c->out, atoi(getenv("C_OUT")));
+     TEST_ASSERT_EQUAL_INT(1, sh_execute(&sh, "coproc C cat"));
+     arena_reset(&sh.arena);
+
+     // Round trips through the one cat, no process per line.
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, "write C one && write C two && write C three"));
+     arena_reset(&sh.arena);
+     snprintf(line, sizeof(line), "echo $(read C) > %s", out);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, line));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_STRING("one\n", slurp(out));
+     uint64_t jobs = sh.totals.jobs;
+     // A forked reader takes its line and nothing more.
+     snprintf(line, sizeof(line), "read C | cat > %s", out);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, line));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_UINT64(jobs + 1, sh.totals.jobs);
+     TEST_ASSERT_EQUAL_STRING("two\n", slurp(out));
+     snprintf(line, sizeof(line), "read C > %s", out);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, line));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_STRING("three\n", slurp(out));
+
+     // Closing gives its status, then the names are free again.
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, "coproc C"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_NULL(coproc_find("C"));
+     TEST_ASSERT_NULL(getenv("C_PID"));
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, "coproc F false"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_INT(1, sh_execute(&sh, "coproc F"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_INT(1, sh_execute(&sh, "coproc F"));
+     arena_reset(&sh.arena);
+
+     shell_teardown(&sh);
+     rm_tree(dir);
+     free(dir);
+}
+
+void test_spawn_server(void)
+{
+     char *dir = make_tmpdir();
+     char out[256], line[1024];
+     snprintf(out, sizeof(out), "%s/out", dir);
+
+     struct shell sh;
+     shell_setup(&sh);
+     TEST_ASSERT_EQUAL_INT(0, spawnsrv_start());
+     TEST_ASSERT_TRUE(spawnsrv_running());
+     uint64_t before = spawnsrv_count();
+     // Output, exit status and rusage come back as if the shell forked.
+     snprintf(line, sizeof(line), "seq 1 3 > %s", out);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, line));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_STRING("1\n2\n3\n", slurp(out));
+     TEST_ASSERT_EQUAL_INT(1, sh_execute(&sh, "false"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_UINT64(2, sh.totals.jobs);
+     // Pipes, a here-string, substitutions and the cwd all reach it.
+     snprintf(line, sizeof(line), "(cd %s && wc -c <<< abcd | cat > out)", dir);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, line));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_STRING("5\n", slurp(out));
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, "cmp -s <(seq 1 50) <(seq 1 50)"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_INT(127, sh_execute(&sh, "no-such-command-here"));
+     arena_reset(&sh.arena);
+     // The subshell forked itself, everything else was the server's.
+     TEST_ASSERT_EQUAL_UINT64(before + 4, spawnsrv_count());
+     spawnsrv_stop();
+     TEST_ASSERT_FALSE(spawnsrv_running());
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, "true"));
+     arena_reset(&sh.arena);
+
+     shell_teardown(&sh);
+     rm_tree(dir);
+     free(dir);
+}
+
+void test_forkmem(void)
+{
+     size_t size = 1 << 20;
+     char *p = forkmem_alloc(size);
+     TEST_ASSERT_NOT_NULL(p);
+     memset(p, 'x', size);
+     // The kernel lists the mapping with the dc (do not copy) flag.
+     char want[64], line[256];
+     snprintf(want, sizeof(want), "%lx-", (unsigned long)(uintptr_t)p);
+     FILE *fp = fopen("/proc/self/smaps", "r");
+     TEST_ASSERT_NOT_NULL(fp);
+     bool found = false, dc = false;
+     while (fgets(line, sizeof(line), fp)) {
+          if (strncmp(line, want, strlen(want)) == 0)
+               found = true;
+          else if (found && strncmp(line, "VmFlags:", 8) == 0) {
+               dc = strstr(line, " dc") != NULL;
+               break;
+          }
+     }
+     fclose(fp);
+     TEST_ASSERT_TRUE(found);
+     TEST_ASSERT_TRUE(dc);
+
+     // A forked copy does not see the trie, names it already resolved
+     // still resolve and lookups simply miss.
+     struct pathcache *pc = pathcache_create(getenv("PATH"), NULL);
+     const char *sh = intern("sh");
+     const char *file = pathcache_resolve(pc, sh);
+     TEST_ASSERT_NOT_NULL(file);
+     TEST_ASSERT_NOT_NULL(pathcache_lookup(pc, "sh"));
+     fflush(stdout);
+     pid_t pid = fork();
+     if (pid == 0) {
+          bool ok = pathcache_lookup(pc, "sh") == NULL && pathcache_resolve(pc, sh) == file;
+          _exit(ok ? 0 : 1);
+     }
+     int status = -1;
+     TEST_ASSERT_EQUAL_INT(pid, waitpid(pid, &status, 0));
+     TEST_ASSERT_TRUE(WIFEXITED(status));
+     TEST_ASSERT_EQUAL_INT(0, WEXITSTATUS(status));
+     TEST_ASSERT_NOT_NULL(pathcache_lookup(pc, "sh"));
+     pathcache_destroy(pc);
+     forkmem_free(p, size);
+}
+
+void test_shell_server(void)
+{
+     char *dir = make_tmpdir();
+     char sock_path[256], out[256], line[1024];
+     snprintf(sock_path, sizeof(sock_path), "%s/sock", dir);
+     snprintf(out, sizeof(out), "%s/out", dir);
+
+     fflush(stdout);
+     pid_t server = fork();
+     if (server == 0) {
+          struct shell sh;
+          shell_setup(&sh);
+          _exit(shserver_run(&sh, sock_path) == 0 ? 0 : 1);
+     }
+     int a = -1;
+     for (int i = 0; i < 200 && a < 0; i++) {
+          a = shserver_connect(sock_path);
+          if (a < 0)
+               usleep(10000);
+     }
+     TEST_ASSERT_TRUE(a >= 0);
+     int b = shserver_connect(sock_path);
+     TEST_ASSERT_TRUE(b >= 0);
+
+     // The client's fds are the session's stdio, the status comes back.
+     int fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+     int fds[] = {STDIN_FILENO, fd, fd};
+     TEST_ASSERT_EQUAL_INT(0, shserver_send(a, "echo hello", fds, 3));
+     TEST_ASSERT_EQUAL_INT(1, shserver_send(a, "false", NULL, 0));
+     TEST_ASSERT_EQUAL_INT(0, shserver_send(a, "", NULL, 0));
+     // A cd in one session is not seen by the other one running next to it.
+     snprintf(line, sizeof(line), "cd %s", dir);
+     TEST_ASSERT_EQUAL_INT(0, shserver_send(a, line, NULL, 0));
+     TEST_ASSERT_EQUAL_INT(0, shserver_send(a, "pwd", NULL, 0));
+     TEST_ASSERT_EQUAL_INT(0, shserver_send(b, "pwd", fds, 3));
+     TEST_ASSERT_EQUAL_INT(0, shserver_send(b, "seq 1 3 | wc -l", NULL, 0));
+     // Only the fds that are sent are replaced.
+     int null = open("/dev/null", O_WRONLY);
+     TEST_ASSERT_EQUAL_INT(127, shserver_send(b, "no-such-command-here", (int[]){0, fd, null}, 3));
+     TEST_ASSERT_EQUAL_INT(0, shserver_send(b, "echo done", fds, 2));
+     close(null);
+     close(fd);
+     char *cwd = getcwd(NULL, 0);
+     snprintf(line, sizeof(line), "hello\n%s\n%s\n3\ndone\n", dir, cwd);
+     TEST_ASSERT_EQUAL_STRING(line, slurp(out));
+     free(cwd);
+     // exit still answers, then ends only its own session.
+     TEST_ASSERT_EQUAL_INT(3, shserver_send(a, "exit 3", NULL, 0));
+     TEST_ASSERT_EQUAL_INT(-1, shserver_send(a, "true", NULL, 0));
+     TEST_ASSERT_EQUAL_INT(EPIPE, errno);
+     TEST_ASSERT_EQUAL_INT(0, shserver_send(b, "true", NULL, 0));
+     close(a);
+     close(b);
+
+     int status = -1;
+     kill(server, SIGTERM);
+     TEST_ASSERT_EQUAL_INT(server, waitpid(server, &status, 0));
+     TEST_ASSERT_TRUE(WIFEXITED(status));
+     TEST_ASSERT_EQUAL_INT(0, WEXITSTATUS(status));
+     TEST_ASSERT_NOT_EQUAL(0, access(sock_path, F_OK));
+     rm_tree(dir);
+     free(dir);
+}
+
+void test_optimize_rewrites(void)
+{
+     char *dir = make_tmpdir();
+     char file[256], out[256], line[1024];
+     snprintf(file, sizeof(file), "%s/hello", dir);
+     snprintf(out, sizeof(out), "%s/out", dir);
+     FILE *fp = fopen(file, "w");
+     TEST_ASSERT_NOT_NULL(fp);
+     fputs("hello world\n", fp);
+     fclose(fp);
+
+     struct arena a;
+     arena_init(&a, 0);
+     struct opt_stats st = {0};
+     snprintf(line, sizeof(line), "cat %s | wc -l", file);
+     struct pipeline *p = pipeline_parse(&a, line);
+     pipeline_optimize(&a, p, &st);
+     TEST_ASSERT_EQUAL_INT(1, p->ncmds);
+     TEST_ASSERT_EQUAL_STRING("wc", p->cmds[0].argv[0]);
+     TEST_ASSERT_EQUAL_INT(REDIR_IN, p->cmds[0].redirs[0].type);
+     TEST_ASSERT_EQUAL_STRING(file, p->cmds[0].redirs[0].word);
+     // cat of one file would have run on a thread.
+     TEST_ASSERT_EQUAL_UINT64(1, st.stages);
+     TEST_ASSERT_EQUAL_UINT64(0, st.forks);
+
+     // cat would fail, the redirection would fail differently.
+     p = pipeline_parse(&a, "cat /no/such/file | wc -l");
+     pipeline_optimize(&a, p, &st);
+     TEST_ASSERT_EQUAL_INT(2, p->ncmds);
+     p = pipeline_parse(&a, "echo -n x | wc -c");
+     pipeline_optimize(&a, p, &st);
+     TEST_ASSERT_EQUAL_INT(2, p->ncmds);
+     // A builtin left alone would run in the shell instead of a child.
+     p = pipeline_parse(&a, "echo 7 | exit 3");
+     pipeline_optimize(&a, p, &st);
+     TEST_ASSERT_EQUAL_INT(2, p->ncmds);
+     p = pipeline_parse(&a, "echo 7 | $(echo exit) 3");
+     pipeline_optimize(&a, p, &st);
+     TEST_ASSERT_EQUAL_INT(2, p->ncmds);
+     p = pipeline_parse(&a, "echo 7 | read");
+     pipeline_optimize(&a, p, &st);
+     TEST_ASSERT_EQUAL_INT(2, p->ncmds);
+
+     p = pipeline_parse(&a, "echo a  b | tr a-z A-Z >x");
+     pipeline_optimize(&a, p, &st);
+     TEST_ASSERT_EQUAL_INT(1, p->ncmds);
+     TEST_ASSERT_EQUAL_INT(2, p->cmds[0].nredirs);
+     TEST_ASSERT_EQUAL_INT(REDIR_HERE, p->cmds[0].redirs[0].type);
+     TEST_ASSERT_EQUAL_STRING("a b", p->cmds[0].redirs[0].word);
+     TEST_ASSERT_EQUAL_INT(REDIR_OUT, p->cmds[0].redirs[1].type);
+     TEST_ASSERT_EQUAL_UINT64(1, st.forks);
+
+     p = pipeline_parse(&a, "true && false || time true");
+     pipeline_optimize(&a, p, &st);
+     TEST_ASSERT_EQUAL_INT(0, p->folded);
+     TEST_ASSERT_EQUAL_INT(1, p->next->folded);
+     TEST_ASSERT_EQUAL_INT(-1, p->next->next->folded);
+     arena_destroy(&a);
+
+     // The same lines behave the same with the optimizer on.
+     struct shell sh;
+     shell_setup(&sh);
+     sh.optimize = true;
+     snprintf(line, sizeof(line), "echo hello world | cmp -s - %s", file);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, line));
+     arena_reset(&sh.arena);
+     snprintf(line, sizeof(line), "cat %s | cmp -s - %s && cat %s /no/such/file | true", file,
+              file, file);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, line));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_UINT64(3, sh.totals.jobs);
+     TEST_ASSERT_EQUAL_INT(1, sh_execute(&sh, "false && no-such-command-xyz"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, "true || no-such-command-xyz"));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_UINT64(3, sh.totals.jobs);
+     TEST_ASSERT_EQUAL_UINT64(2, sh.opt.stages);
+     TEST_ASSERT_EQUAL_UINT64(3, sh.opt.forks);
+
+     // cd and exit after a pipe change only the child they run in.
+     char cwd[PATH_MAX], now[PATH_MAX];
+     TEST_ASSERT_NOT_NULL(getcwd(cwd, sizeof(cwd)));
+     snprintf(line, sizeof(line), "cat %s | cd /", file);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, line));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_NOT_NULL(getcwd(now, sizeof(now)));
+     TEST_ASSERT_EQUAL_STRING(cwd, now);
+     TEST_ASSERT_EQUAL_INT(3, sh_execute(&sh, "echo 7 | exit 3"));
+     arena_reset(&sh.arena);
+     snprintf(line, sizeof(line), "cat %s | $(echo cd) /", file);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, line));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_NOT_NULL(getcwd(now, sizeof(now)));
+     TEST_ASSERT_EQUAL_STRING(cwd, now);
+     snprintf(line, sizeof(line), "cat %s | $(echo exit) 3", file);
+     TEST_ASSERT_EQUAL_INT(3, sh_execute(&sh, line));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_UINT64(2, sh.opt.stages);
+
+     // Redirections on a builtin leave the shell's own fds as they were.
+     snprintf(line, sizeof(line), "times > %s", out);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, line));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_NOT_NULL(strchr(slurp(out), 's'));
+     snprintf(line, sizeof(line), "echo again >> %s", file);
+     TEST_ASSERT_EQUAL_INT(0, sh_execute(&sh, line));
+     arena_reset(&sh.arena);
+     TEST_ASSERT_EQUAL_STRING("hello world\nagain\n", slurp(file));
+     TEST_ASSERT_EQUAL_INT(1, sh_execute(&sh, "wc < /no/such/file"));
+     arena_reset(&sh.arena);
+
+     shell_teardown(&sh);
+     rm_tree(dir);
+     free(dir);
+}
+
 int main(void) {
   UNITY_BEGIN();
+  // First, a fork only gets the default I/O engine the script is read with
+  // while the test process has none of its own.
+  RUN_TEST(test_script_input);
   RUN_TEST(test_cmd_parse);
   RUN_TEST(test_cmd_parse2);
   RUN_TEST(test_trim_white_no_whitespace);
@@ -173,6 +1682,35 @@ int main(void) {
   RUN_TEST(test_get_prompt_custom);
   RUN_TEST(test_ch_dir_home);
   RUN_TEST(test_ch_dir_root);
+  RUN_TEST(test_pathcache_complete);
+  RUN_TEST(test_pathcache_persist);
+  RUN_TEST(test_dircache_prefix);
+  RUN_TEST(test_dircache_lru);
+  RUN_TEST(test_arena_reuse);
+  RUN_TEST(test_cmd_parse_arena);
+  RUN_TEST(test_execute_builtin_no_heap);
+  RUN_TEST(test_execute_external_status);
+  RUN_TEST(test_intern_shares_storage);
+  RUN_TEST(test_cmd_parse_arena_interns);
+  RUN_TEST(test_pathcache_resolve);
+  RUN_TEST(test_trace_spans);
+  RUN_TEST(test_pipeline_parse);
+  RUN_TEST(test_job_rusage);
+  RUN_TEST(test_journal_records);
+  RUN_TEST(test_metrics_textfile);
+  RUN_TEST(test_sysprof_counts);
+  RUN_TEST(test_jobmeter_samples);
+  RUN_TEST(test_pipemeter_relays);
+  RUN_TEST(test_zcopy_cat_tee);
+  RUN_TEST(test_optimize_rewrites);
+  RUN_TEST(test_ioeng_batches);
+  RUN_TEST(test_process_substitution);
+  RUN_TEST(test_command_substitution);
+  RUN_TEST(test_subshell);
+  RUN_TEST(test_coproc);
+  RUN_TEST(test_spawn_server);
+  RUN_TEST(test_forkmem);
+  RUN_TEST(test_shell_server);
 
   return UNITY_END();
 }
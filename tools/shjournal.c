@@ -0,0 +1,361 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "../src/journal.h"
+
+// Summarizes one or more command journals written by set -o journal, for
+// example every journal collected from a fleet of hosts. Commands are
+// grouped by their exact line.
+
+struct group
+{
+    uint64_t id;
+    size_t count;
+    size_t failed;
+    uint64_t total_ns;
+    uint64_t cpu_us;
+    uint32_t maxrss_kb;
+    uint64_t *durations;
+    size_t cap;
+};
+
+struct text
+{
+    uint64_t id;
+    char *s;
+};
+
+struct summary
+{
+    struct group *groups;
+    size_t ngroups;
+    size_t groups_cap;
+    struct text *texts;
+    size_t ntexts;
+    size_t texts_cap;
+    uint64_t *durations;
+    size_t ncmds;
+    size_t cmds_cap;
+    uint64_t first_ns;
+    uint64_t last_ns;
+};
+
+enum sort_key
+{
+    SORT_TOTAL,
+    SORT_MEAN,
+    SORT_MAX,
+    SORT_COUNT,
+};
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-n N] [-s total|mean|max|count] journal...\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+static void *xrealloc(void *p, size_t n) {
+    p = realloc(p, n);
+    if (!p) {
+        perror("realloc");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+static void push(uint64_t **a, size_t *n, size_t *cap, uint64_t v) {
+    if (*n == *cap) {
+        *cap = *cap ? *cap * 2 : 16;
+        *a = xrealloc(*a, *cap * sizeof(**a));
+    }
+    (*a)[(*n)++] = v;
+}
+
+//-----------------------------------------------------------------------------
+// hash tables
+//-----------------------------------------------------------------------------
+// Both tables are open addressing keyed by the 64 bit ids the shell wrote,
+// an id of zero never occurs so it marks an empty slot.
+static struct group *group_get(struct summary *s, uint64_t id) {
+    if (s->ngroups * 2 >= s->groups_cap) {
+        size_t cap = s->groups_cap ? s->groups_cap * 2 : 256;
+        struct group *g = calloc(cap, sizeof(*g));
+        if (!g) {
+            perror("calloc");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < s->groups_cap; i++) {
+            if (!s->groups[i].id)
+                continue;
+            size_t j = s->groups[i].id & (cap - 1);
+            while (g[j].id)
+                j = (j + 1) & (cap - 1);
+            g[j] = s->groups[i];
+        }
+        free(s->groups);
+        s->groups = g;
+        s->groups_cap = cap;
+    }
+    size_t j = id & (s->groups_cap - 1);
+    while (s->groups[j].id && s->groups[j].id != id)
+        j = (j + 1) & (s->groups_cap - 1);
+    if (!s->groups[j].id) {
+        s->groups[j].id = id;
+        s->ngroups++;
+    }
+    return &s->groups[j];
+}
+
+static struct text *text_slot(struct summary *s, uint64_t id) {
+    if (s->ntexts * 2 >= s->texts_cap) {
+        size_t cap = s->texts_cap ? s->texts_cap * 2 : 256;
+        struct text *t = calloc(cap, sizeof(*t));
+        if (!t) {
+            perror("calloc");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < s->texts_cap; i++) {
+            if (!s->texts[i].id)
+                continue;
+            size_t j = s->texts[i].id & (cap - 1);
+            while (t[j].id)
+                j = (j + 1) & (cap - 1);
+            t[j] = s->texts[i];
+        }
+        free(s->texts);
+        s->texts = t;
+        s->texts_cap = cap;
+    }
+    size_t j = id & (s->texts_cap - 1);
+    while (s->texts[j].id && s->texts[j].id != id)
+        j = (j + 1) & (s->texts_cap - 1);
+    return &s->texts[j];
+}
+
+static const char *text_find(struct summary *s, uint64_t id) {
+    if (!s->texts_cap)
+        return NULL;
+    size_t j = id & (s->texts_cap - 1);
+    while (s->texts[j].id) {
+        if (s->texts[j].id == id)
+            return s->texts[j].s;
+        j = (j + 1) & (s->texts_cap - 1);
+    }
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// load
+//-----------------------------------------------------------------------------
+static int load(struct summary *s, const char *file) {
+    FILE *fp = fopen(file, "rb");
+    if (!fp) {
+        perror(file);
+        return -1;
+    }
+    char magic[8];
+    if (fread(magic, 1, 8, fp) != 8 || memcmp(magic, JOURNAL_MAGIC, 8) != 0) {
+        fprintf(stderr, "%s: not a journal\n", file);
+        fclose(fp);
+        return -1;
+    }
+    uint32_t type;
+    while (fread(&type, sizeof(type), 1, fp) == 1) {
+        if (type == JOURNAL_CMD) {
+            struct journal_cmd r;
+            r.type = type;
+            if (fread((char *)&r + sizeof(type), sizeof(r) - sizeof(type), 1, fp) != 1)
+                break;
+            struct group *g = group_get(s, r.argv_hash);
+            g->count++;
+            g->failed += r.status != 0;
+            g->total_ns += r.duration_ns;
+            g->cpu_us += r.utime_us + r.stime_us;
+            if (r.maxrss_kb > g->maxrss_kb)
+                g->maxrss_kb = r.maxrss_kb;
+            size_t n = g->count - 1;
+            push(&g->durations, &n, &g->cap, r.duration_ns);
+            push(&s->durations, &s->ncmds, &s->cmds_cap, r.duration_ns);
+            if (!s->first_ns || r.time_ns < s->first_ns)
+                s->first_ns = r.time_ns;
+            if (r.time_ns > s->last_ns)
+                s->last_ns = r.time_ns;
+        } else if (type == JOURNAL_STR) {
+            struct journal_str r;
+            r.type = type;
+            if (fread((char *)&r + sizeof(type), sizeof(r) - sizeof(type), 1, fp) != 1)
+                break;
+            size_t padded = ((size_t)r.len + 7) & ~(size_t)7;
+            char *text = xrealloc(NULL, padded + 1);
+            if (padded && fread(text, padded, 1, fp) != 1) {
+                free(text);
+                break;
+            }
+            text[r.len] = '\0';
+            struct text *t = text_slot(s, r.id);
+            if (t->id) {
+                // Every shell writes its own copy of the same text.
+                free(text);
+            } else {
+                t->id = r.id;
+                t->s = text;
+                s->ntexts++;
+            }
+        } else {
+            fprintf(stderr, "%s: unknown record type %u, stopping\n", file, type);
+            break;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+// report
+//-----------------------------------------------------------------------------
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Nearest rank on a sorted array.
+static uint64_t percentile(const uint64_t *v, size_t n, double p) {
+    if (n == 0)
+        return 0;
+    size_t i = (size_t)(p / 100.0 * (double)n + 0.999999);
+    if (i == 0)
+        i = 1;
+    return v[i > n ? n - 1 : i - 1];
+}
+
+static const char *fmt_ns(char *buf, size_t len, uint64_t ns) {
+    if (ns < 1000)
+        snprintf(buf, len, "%luns", (unsigned long)ns);
+    else if (ns < 1000000)
+        snprintf(buf, len, "%.1fus", (double)ns / 1e3);
+    else if (ns < 1000000000)
+        snprintf(buf, len, "%.2fms", (double)ns / 1e6);
+    else
+        snprintf(buf, len, "%.2fs", (double)ns / 1e9);
+    return buf;
+}
+
+static enum sort_key sort_by;
+
+static uint64_t sort_value(const struct group *g) {
+    switch (sort_by) {
+    case SORT_MEAN:
+        return g->total_ns / g->count;
+    case SORT_MAX:
+        return g->durations[g->count - 1];
+    case SORT_COUNT:
+        return g->count;
+    default:
+        return g->total_ns;
+    }
+}
+
+static int cmp_group(const void *a, const void *b) {
+    uint64_t x = sort_value(*(struct group *const *)a);
+    uint64_t y = sort_value(*(struct group *const *)b);
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static void report(struct summary *s, size_t top) {
+    char a[32], b[32], c[32], d[32], e[32];
+    qsort(s->durations, s->ncmds, sizeof(uint64_t), cmp_u64);
+    char first[32] = "-", last[32] = "-";
+    if (s->ncmds) {
+        time_t t0 = (time_t)(s->first_ns / 1000000000u), t1 = (time_t)(s->last_ns / 1000000000u);
+        strftime(first, sizeof(first), "%Y-%m-%d %H:%M:%S", localtime(&t0));
+        strftime(last, sizeof(last), "%Y-%m-%d %H:%M:%S", localtime(&t1));
+    }
+    printf("commands %zu, distinct %zu, from %s to %s\n", s->ncmds, s->ngroups, first, last);
+    printf("duration p50 %s  p90 %s  p99 %s  max %s\n",
+           fmt_ns(a, sizeof(a), percentile(s->durations, s->ncmds, 50)),
+           fmt_ns(b, sizeof(b), percentile(s->durations, s->ncmds, 90)),
+           fmt_ns(c, sizeof(c), percentile(s->durations, s->ncmds, 99)),
+           fmt_ns(d, sizeof(d), s->ncmds ? s->durations[s->ncmds - 1] : 0));
+    if (!s->ngroups)
+        return;
+
+    struct group **order = xrealloc(NULL, s->ngroups * sizeof(*order));
+    size_t n = 0;
+    for (size_t i = 0; i < s->groups_cap; i++) {
+        struct group *g = &s->groups[i];
+        if (!g->id)
+            continue;
+        qsort(g->durations, g->count, sizeof(uint64_t), cmp_u64);
+        order[n++] = g;
+    }
+    qsort(order, n, sizeof(*order), cmp_group);
+    if (top > n)
+        top = n;
+    printf("\n%8s %10s %10s %10s %10s %10s %6s %10s  %s\n", "count", "total", "mean", "p50",
+           "p99", "max", "fail", "cpu", "command");
+    for (size_t i = 0; i < top; i++) {
+        struct group *g = order[i];
+        const char *cmd = text_find(s, g->id);
+        char unknown[32];
+        if (!cmd) {
+            snprintf(unknown, sizeof(unknown), "#%016llx", (unsigned long long)g->id);
+            cmd = unknown;
+        }
+        char cpu[32];
+        printf("%8zu %10s %10s %10s %10s %10s %6zu %10s  %s\n", g->count,
+               fmt_ns(a, sizeof(a), g->total_ns), fmt_ns(b, sizeof(b), g->total_ns / g->count),
+               fmt_ns(c, sizeof(c), percentile(g->durations, g->count, 50)),
+               fmt_ns(d, sizeof(d), percentile(g->durations, g->count, 99)),
+               fmt_ns(e, sizeof(e), g->durations[g->count - 1]), g->failed,
+               fmt_ns(cpu, sizeof(cpu), g->cpu_us * 1000u), cmd);
+    }
+    free(order);
+}
+
+int main(int argc, char **argv) {
+    size_t top = 10;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i += 2) {
+        if (i + 1 >= argc)
+            usage(argv[0]);
+        if (strcmp(argv[i], "-n") == 0) {
+            top = strtoul(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "-s") == 0) {
+            const char *k = argv[i + 1];
+            if (strcmp(k, "total") == 0)
+                sort_by = SORT_TOTAL;
+            else if (strcmp(k, "mean") == 0)
+                sort_by = SORT_MEAN;
+            else if (strcmp(k, "max") == 0)
+                sort_by = SORT_MAX;
+            else if (strcmp(k, "count") == 0)
+                sort_by = SORT_COUNT;
+            else
+                usage(argv[0]);
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (i >= argc)
+        usage(argv[0]);
+
+    struct summary s;
+    memset(&s, 0, sizeof(s));
+    int rval = 0;
+    for (; i < argc; i++) {
+        if (load(&s, argv[i]) != 0)
+            rval = 1;
+    }
+    report(&s, top);
+
+    for (size_t j = 0; j < s.groups_cap; j++)
+        free(s.groups[j].durations);
+    for (size_t j = 0; j < s.texts_cap; j++)
+        free(s.texts[j].s);
+    free(s.groups);
+    free(s.texts);
+    free(s.durations);
+    return rval;
+}